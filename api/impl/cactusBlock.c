@@ -28,10 +28,12 @@ Block *block_construct2(Name name, int64_t length,
 		End *leftEnd, End *rightEnd,
 		Flower *flower) {
 	Block *block;
-	block = st_malloc(sizeof(Block));
-	block->rBlock = st_malloc(sizeof(Block));
+	//The contents and both orientations are allocated together.
+	BlockContents *blockContents = flowerArena_allocate(flower_getArena(flower), sizeof(BlockContents) + 2 * sizeof(Block));
+	block = (Block *) (blockContents + 1);
+	block->rBlock = block + 1;
 	block->rBlock->rBlock = block;
-	block->blockContents = st_malloc(sizeof(BlockContents));
+	block->blockContents = blockContents;
 	block->rBlock->blockContents = block->blockContents;
 
 	block->orientation = 1;
@@ -54,8 +56,9 @@ Block *block_construct2(Name name, int64_t length,
 
 void block_destruct(Block *block) {
 	Segment *segment;
+	Flower *flower = block_getFlower(block);
 	//remove from flower.
-	flower_removeBlock(block_getFlower(block), block);
+	flower_removeBlock(flower, block);
 
 	//remove instances
 	while((segment = block_getFirst(block)) != NULL) {
@@ -64,9 +67,7 @@ void block_destruct(Block *block) {
 	//now the actual instances.
 	stSortedSet_destruct(block->blockContents->segments);
 
-	free(block->rBlock);
-	free(block->blockContents);
-	free(block);
+	flowerArena_free(flower_getArena(flower), block->blockContents, sizeof(BlockContents) + 2 * sizeof(Block));
 }
 
 bool block_getOrientation(Block *block) {
@@ -363,6 +364,7 @@ void block_removeInstance(Block *block, Segment *segment) {
 }
 
 void block_setFlower(Block *block, Flower *flower) {
+	flower_adoptArenas(flower, block_getFlower(block));
 	flower_removeBlock(block_getFlower(block), block);
 	block->blockContents->flower = flower;
 	flower_addBlock(flower, block);
@@ -24,9 +24,12 @@ Cap *cap_construct3(Name instance, Event *event, End *end) {
     assert(instance != NULL_NAME);
     Cap *cap;
 
-    cap = st_malloc(sizeof(Cap));
-    cap->capContents = st_malloc(sizeof(CapContents));
-    cap->rCap = st_malloc(sizeof(Cap));
+    //The contents and both orientations are allocated together.
+    CapContents *capContents = flowerArena_allocate(flower_getArena(end_getFlower(end)),
+            sizeof(CapContents) + 2 * sizeof(Cap));
+    cap = (Cap *) (capContents + 1);
+    cap->capContents = capContents;
+    cap->rCap = cap + 1;
     cap->rCap->rCap = cap;
     cap->rCap->capContents = cap->capContents;
 
@@ -101,9 +104,10 @@ Cap *cap_copyConstruct(End *end, Cap *cap) {
 }
 
 void cap_destruct(Cap *cap) {
+    Flower *flower = end_getFlower(cap_getEnd(cap));
     //Remove from end.
     end_removeInstance(cap_getEnd(cap), cap);
-    flower_removeCap(end_getFlower(cap_getEnd(cap)), cap);
+    flower_removeCap(flower, cap);
 
     // Remove parent->child link from parent (if any).
     Cap *capParent = cap->capContents->parent;
@@ -118,9 +122,7 @@ void cap_destruct(Cap *cap) {
     }
 
     destructList(cap->capContents->children);
-    free(cap->rCap);
-    free(cap->capContents);
-    free(cap);
+    flowerArena_free(flower_getArena(flower), cap->capContents, sizeof(CapContents) + 2 * sizeof(Cap));
 }
 
 Name cap_getName(Cap *cap) {
@@ -430,6 +432,34 @@ void cap_writeBinaryRepresentationP(Cap *cap2, int64_t elementType,
     binaryRepresentation_writeName(cap_getName(cap2), writeFn);
 }
 
+static void cap_writeCoordinates(Cap *cap, Name sequenceName, void(*writeFn)(const void * ptr, size_t size, size_t count)) {
+    /*
+     * In the compact format the sequence (or event) name is written first, as the coordinate is
+     * delta coded against the last coordinate on the same sequence.
+     */
+    if (binaryRepresentation_getFormatVersion() == BINARY_REPRESENTATION_FORMAT_COMPACT) {
+        binaryRepresentation_writeBool(cap_getStrand(cap), writeFn);
+        binaryRepresentation_writeName(sequenceName, writeFn);
+        binaryRepresentation_writeCoordinate(cap_getCoordinate(cap), sequenceName, writeFn);
+    } else {
+        binaryRepresentation_writeInteger(cap_getCoordinate(cap), writeFn);
+        binaryRepresentation_writeBool(cap_getStrand(cap), writeFn);
+        binaryRepresentation_writeName(sequenceName, writeFn);
+    }
+}
+
+static void cap_loadCoordinates(void **binaryString, int64_t *coordinate, int64_t *strand, Name *sequenceName) {
+    if (binaryRepresentation_getFormatVersion() == BINARY_REPRESENTATION_FORMAT_COMPACT) {
+        *strand = binaryRepresentation_getBool(binaryString);
+        *sequenceName = binaryRepresentation_getName(binaryString);
+        *coordinate = binaryRepresentation_getCoordinate(binaryString, *sequenceName);
+    } else {
+        *coordinate = binaryRepresentation_getInteger(binaryString);
+        *strand = binaryRepresentation_getBool(binaryString);
+        *sequenceName = binaryRepresentation_getName(binaryString);
+    }
+}
+
 void cap_writeBinaryRepresentation(Cap *cap, void(*writeFn)(const void * ptr, size_t size, size_t count)) {
     Cap *cap2;
     if (cap_getCoordinate(cap) == INT64_MAX) {
@@ -440,15 +470,11 @@ void cap_writeBinaryRepresentation(Cap *cap, void(*writeFn)(const void * ptr, si
     } else if (cap_getSequence(cap) != NULL) {
         binaryRepresentation_writeElementType(CODE_CAP_WITH_COORDINATES, writeFn);
         binaryRepresentation_writeName(cap_getName(cap), writeFn);
-        binaryRepresentation_writeInteger(cap_getCoordinate(cap), writeFn);
-        binaryRepresentation_writeBool(cap_getStrand(cap), writeFn);
-        binaryRepresentation_writeName(sequence_getName(cap_getSequence(cap)), writeFn);
+        cap_writeCoordinates(cap, sequence_getName(cap_getSequence(cap)), writeFn);
     } else {
         binaryRepresentation_writeElementType(CODE_CAP_WITH_COORDINATES_BUT_NO_SEQUENCE, writeFn);
         binaryRepresentation_writeName(cap_getName(cap), writeFn);
-        binaryRepresentation_writeInteger(cap_getCoordinate(cap), writeFn);
-        binaryRepresentation_writeBool(cap_getStrand(cap), writeFn);
-        binaryRepresentation_writeName(event_getName(cap_getEvent(cap)), writeFn);
+        cap_writeCoordinates(cap, event_getName(cap_getEvent(cap)), writeFn);
     }
     if ((cap2 = cap_getAdjacency(cap)) != NULL) {
         cap_writeBinaryRepresentationP(cap2, CODE_ADJACENCY, writeFn);
@@ -486,6 +512,7 @@ Cap *cap_loadFromBinaryRepresentation(void **binaryString, End *end) {
     Event *event;
     int64_t coordinate;
     int64_t strand;
+    Name sequenceName;
     Sequence *sequence;
 
     cap = NULL;
@@ -500,17 +527,15 @@ Cap *cap_loadFromBinaryRepresentation(void **binaryString, End *end) {
     } else if (binaryRepresentation_peekNextElementType(*binaryString) == CODE_CAP_WITH_COORDINATES) {
         binaryRepresentation_popNextElementType(binaryString);
         name = binaryRepresentation_getName(binaryString);
-        coordinate = binaryRepresentation_getInteger(binaryString);
-        strand = binaryRepresentation_getBool(binaryString);
-        sequence = flower_getSequence(end_getFlower(end), binaryRepresentation_getName(binaryString));
+        cap_loadCoordinates(binaryString, &coordinate, &strand, &sequenceName);
+        sequence = flower_getSequence(end_getFlower(end), sequenceName);
         cap = cap_construct4(name, end, coordinate, strand, sequence);
         cap_loadFromBinaryRepresentationP2(binaryString, cap);
     } else if (binaryRepresentation_peekNextElementType(*binaryString) == CODE_CAP_WITH_COORDINATES_BUT_NO_SEQUENCE) {
         binaryRepresentation_popNextElementType(binaryString);
         name = binaryRepresentation_getName(binaryString);
-        coordinate = binaryRepresentation_getInteger(binaryString);
-        strand = binaryRepresentation_getBool(binaryString);
-        event = eventTree_getEvent(flower_getEventTree(end_getFlower(end)), binaryRepresentation_getName(binaryString));
+        cap_loadCoordinates(binaryString, &coordinate, &strand, &sequenceName);
+        event = eventTree_getEvent(flower_getEventTree(end_getFlower(end)), sequenceName);
         cap = cap_construct3(name, event, end);
         cap_setCoordinates(cap, coordinate, strand, NULL);
         cap_loadFromBinaryRepresentationP2(binaryString, cap);
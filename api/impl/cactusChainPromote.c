@@ -18,6 +18,7 @@ static void promoteBlock(Block *block, Flower *flower, Flower *parentFlower) {
     /*
      * Redirects all the pointers in the block to the higher level.
      */
+    flower_adoptArenas(parentFlower, flower); //The block and its segments stay in the memory of the lower flower.
     Segment *segment;
     Block_InstanceIterator *it = block_getInstanceIterator(block);
     while ((segment = block_getNext(it)) != NULL) {
@@ -87,6 +88,7 @@ static void promoteBlockEnd(End *end, Flower *flower, Flower *parentFlower) {
     assert(end_getFlower(end) == flower);
     assert(flower != parentFlower);
     assert(flower_getEnd(parentFlower, end_getName(end)) == NULL);
+    flower_adoptArenas(parentFlower, flower); //The end and its caps stay in the memory of the lower flower.
     Cap *cap;
     End_InstanceIterator *it = end_getInstanceIterator(end);
     EventTree *eventTree = flower_getEventTree(parentFlower);
@@ -13,22 +13,156 @@
 #include <math.h>
 #include <time.h>
 #define CACTUS_DISK_NAME_INCREMENT 16384
+#define CACTUS_DISK_MAX_LEASE_SIZE 16777216
 #define CACTUS_DISK_BUCKET_NUMBER 65536
 #define CACTUS_DISK_PARAMETER_KEY -100000
+#define CACTUS_DISK_DICTIONARY_KEY -100001
+#define CACTUS_DISK_DICTIONARY_SIZE 112640
+#define CACTUS_DISK_DICTIONARY_SAMPLES 1000
 #define CACTUS_DISK_SEQUENCE_CHUNK_SIZE 500
+#define CACTUS_DISK_CACHE_SIZE_VARIABLE "CACTUS_DISK_CACHE_SIZE"
+#define CACTUS_DISK_STRING_CACHE_SIZE_VARIABLE "CACTUS_DISK_STRING_CACHE_SIZE"
+#define CACTUS_DISK_SNAPSHOT_VARIABLE "CACTUS_DISK_SNAPSHOT"
+#define CACTUS_DISK_SNAPSHOT_BATCH_SIZE 1000
+
+/*
+ * The database connection may be shared with a thread prefetching flowers for a flower stream,
+ * so all the uses of it are serialised with the database lock.
+ */
+
+static void lockDatabase(CactusDisk *cactusDisk) {
+    pthread_mutex_lock(&cactusDisk->databaseLock);
+}
+
+static void unlockDatabase(CactusDisk *cactusDisk) {
+    pthread_mutex_unlock(&cactusDisk->databaseLock);
+}
+
+/*
+ * The following functions read the stored (compressed) records from the database, or from the snapshot
+ * if the cactus disk was constructed from one, in which case the records are not copied but point into
+ * its mapping. They are called with the database locked, and do not use stTry, so the callers handle
+ * database errors.
+ */
+
+static void *getRawRecord(CactusDisk *cactusDisk, Name objectName, int64_t *recordSize) {
+    int64_t startTime = cactusDiskStats_getTime();
+    void *record;
+    if (cactusDisk->snapshot != NULL) {
+        record = (void *) cactusDiskSnapshot_getRecord(cactusDisk->snapshot, objectName, recordSize);
+    } else {
+        record = stKVDatabase_getRecord2(cactusDisk->database, objectName, recordSize);
+    }
+    cactusDiskStats_addCall(cactusDisk->stats, CACTUS_DISK_OP_GET, startTime, record != NULL,
+            record != NULL ? *recordSize : 0, 0);
+    return record;
+}
+
+static void freeRawRecord(CactusDisk *cactusDisk, void *record) {
+    if (cactusDisk->snapshot == NULL) {
+        free(record);
+    }
+}
+
+static bool containsRawRecord(CactusDisk *cactusDisk, Name objectName) {
+    int64_t startTime = cactusDiskStats_getTime();
+    bool b = cactusDisk->snapshot != NULL ? cactusDiskSnapshot_containsRecord(cactusDisk->snapshot, objectName) :
+            stKVDatabase_containsRecord(cactusDisk->database, objectName);
+    cactusDiskStats_addCall(cactusDisk->stats, CACTUS_DISK_OP_CONTAINS, startTime, 1, 0, 0);
+    return b;
+}
+
+static bool needsDictionary(CactusDisk *cactusDisk, const void *record, int64_t recordSize) {
+    return cactusDisk->taggedRecords && !recordCodec_hasDictionary(cactusDisk->codec)
+            && recordCodec_getRecordType(record, recordSize) == RECORD_CODEC_ZSTD_DICTIONARY;
+}
+
+static void loadDictionary2(CactusDisk *cactusDisk) {
+    /*
+     * Loads the dictionary of zstd dictionary records, if it is stored and not yet loaded. Another process
+     * may store it after this one starts, so the functions reading records also load it when they read a
+     * record needing it, so it is always loaded before the records are decompressed.
+     */
+    if (recordCodec_hasDictionary(cactusDisk->codec)) {
+        return;
+    }
+    int64_t dictionarySize;
+    void *dictionary = getRawRecord(cactusDisk, CACTUS_DISK_DICTIONARY_KEY, &dictionarySize);
+    if (dictionary != NULL) {
+        cactusDiskStats_addBytes(cactusDisk->stats, CACTUS_DISK_OP_GET, 0, dictionarySize);
+        recordCodec_setDictionary(cactusDisk->codec, dictionary, dictionarySize);
+        freeRawRecord(cactusDisk, dictionary);
+    }
+}
+
+typedef struct _rawRecords {
+    stList *results; //The database results holding the records, or NULL if they are in the snapshot.
+    void **records; //The records, NULL for those not found.
+    int64_t *recordSizes;
+} RawRecords;
+
+static RawRecords *rawRecords_get(CactusDisk *cactusDisk, stList *objectNames) {
+    int64_t startTime = cactusDiskStats_getTime();
+    int64_t length = stList_length(objectNames);
+    RawRecords *rawRecords = st_calloc(1, sizeof(RawRecords));
+    rawRecords->records = st_calloc(length + 1, sizeof(void *));
+    rawRecords->recordSizes = st_calloc(length + 1, sizeof(int64_t));
+    if (cactusDisk->snapshot != NULL) {
+        for (int64_t i = 0; i < length; i++) {
+            rawRecords->records[i] = (void *) cactusDiskSnapshot_getRecord(cactusDisk->snapshot,
+                    *((int64_t *) stList_get(objectNames, i)), &rawRecords->recordSizes[i]);
+        }
+    } else {
+        rawRecords->results = stKVDatabase_bulkGetRecords(cactusDisk->database, objectNames);
+        assert(stList_length(rawRecords->results) == length);
+        for (int64_t i = 0; i < length; i++) {
+            stKVDatabaseBulkResult *result = stList_get(rawRecords->results, i);
+            assert(result != NULL);
+            rawRecords->records[i] = stKVDatabaseBulkResult_getRecord(result, &rawRecords->recordSizes[i]);
+        }
+    }
+    cactusDiskStats_addCall(cactusDisk->stats, CACTUS_DISK_OP_BULK_GET, startTime, length, 0, 0);
+    for (int64_t i = 0; i < length; i++) {
+        if (rawRecords->records[i] != NULL && needsDictionary(cactusDisk, rawRecords->records[i], rawRecords->recordSizes[i])) {
+            loadDictionary2(cactusDisk);
+        }
+    }
+    return rawRecords;
+}
+
+static void rawRecords_destruct(RawRecords *rawRecords) {
+    if (rawRecords->results != NULL) {
+        stList_setDestructor(rawRecords->results, (void (*)(void *)) stKVDatabaseBulkResult_destruct);
+        stList_destruct(rawRecords->results);
+    }
+    free(rawRecords->records);
+    free(rawRecords->recordSizes);
+    free(rawRecords);
+}
+
+static void checkWritable(CactusDisk *cactusDisk) {
+    if (cactusDisk->snapshot != NULL) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "The cactus disk was read from the snapshot %s, so can not be written",
+                cactusDiskSnapshot_getFileName(cactusDisk->snapshot));
+    }
+}
 
 /*
  * Functions on meta sequences.
  */
 
 void cactusDisk_addMetaSequence(CactusDisk *cactusDisk, MetaSequence *metaSequence) {
+    cactusDisk_lock(cactusDisk);
     assert(stSortedSet_search(cactusDisk->metaSequences, metaSequence) == NULL);
     stSortedSet_insert(cactusDisk->metaSequences, metaSequence);
+    cactusDisk_unlock(cactusDisk);
 }
 
 void cactusDisk_removeMetaSequence(CactusDisk *cactusDisk, MetaSequence *metaSequence) {
+    cactusDisk_lock(cactusDisk);
     assert(stSortedSet_search(cactusDisk->metaSequences, metaSequence) != NULL);
     stSortedSet_remove(cactusDisk->metaSequences, metaSequence);
+    cactusDisk_unlock(cactusDisk);
 }
 
 /*
@@ -39,28 +173,47 @@ Name cactusDisk_addString(CactusDisk *cactusDisk, const char *string) {
     /*
      * Adds a string to the database.
      */
+    checkWritable(cactusDisk);
     int64_t stringSize = strlen(string);
     int64_t intervalSize = ceil((double) stringSize / CACTUS_DISK_SEQUENCE_CHUNK_SIZE);
     Name name = cactusDisk_getUniqueIDInterval(cactusDisk, intervalSize);
     stList *insertRequests = stList_construct3(0, (void (*)(void *)) stKVDatabaseBulkRequest_destruct);
+    int64_t insertBytes = 0;
     for (int64_t i = 0; i * CACTUS_DISK_SEQUENCE_CHUNK_SIZE < stringSize; i++) {
         int64_t j =
             (i + 1) * CACTUS_DISK_SEQUENCE_CHUNK_SIZE < stringSize ?
             CACTUS_DISK_SEQUENCE_CHUNK_SIZE : stringSize - i * CACTUS_DISK_SEQUENCE_CHUNK_SIZE;
-        char *subString = stString_getSubString(string, i * CACTUS_DISK_SEQUENCE_CHUNK_SIZE, j);
-        stList_append(insertRequests, stKVDatabaseBulkRequest_constructInsertRequest(name + i, subString, j + 1));
-        free(subString);
+        if (cactusDisk->sequenceFormat == CACTUS_DISK_SEQUENCE_FORMAT_PACKED) {
+            PackedSequence *packedSequence = packedSequence_construct(string + i * CACTUS_DISK_SEQUENCE_CHUNK_SIZE, j);
+            int64_t recordSize;
+            void *record = packedSequence_writeBinaryRepresentation(packedSequence, &recordSize);
+            stList_append(insertRequests, stKVDatabaseBulkRequest_constructInsertRequest(name + i, record, recordSize));
+            insertBytes += recordSize;
+            free(record);
+            packedSequence_destruct(packedSequence);
+        } else {
+            char *subString = stString_getSubString(string, i * CACTUS_DISK_SEQUENCE_CHUNK_SIZE, j);
+            stList_append(insertRequests, stKVDatabaseBulkRequest_constructInsertRequest(name + i, subString, j + 1));
+            insertBytes += j + 1;
+            free(subString);
+        }
     }
+    lockDatabase(cactusDisk);
     stTry
     {
+        int64_t startTime = cactusDiskStats_getTime();
         stKVDatabase_bulkSetRecords(cactusDisk->database, insertRequests);
+        cactusDiskStats_addCall(cactusDisk->stats, CACTUS_DISK_OP_BULK_SET, startTime, stList_length(insertRequests),
+                insertBytes, stringSize);
     }
     stCatch(except)
     {
+        unlockDatabase(cactusDisk);
         stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
                         "An unknown database error occurred when we tried to add a string to the cactus disk");
     }stTryEnd
          ;
+    unlockDatabase(cactusDisk);
     stList_destruct(insertRequests);
     return name;
 }
@@ -160,47 +313,70 @@ static void cacheSubstringsFromDB(CactusDisk *cactusDisk, stList *substrings) {
         stList_destruct(getRequests);
         return;
     }
-    stList *records = NULL;
+    RawRecords *records = NULL;
+    lockDatabase(cactusDisk);
     stTry
     {
-        records = stKVDatabase_bulkGetRecords(cactusDisk->database, getRequests);
+        records = rawRecords_get(cactusDisk, getRequests);
     }
     stCatch(except)
     {
+        unlockDatabase(cactusDisk);
         stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
                         "An unknown database error occurred when getting a sequence string");
     }stTryEnd
          ;
+    unlockDatabase(cactusDisk);
     assert(records != NULL);
-    assert(stList_length(records) == stList_length(getRequests));
+    int64_t recordNumber = stList_length(getRequests);
     stList_destruct(getRequests);
-    stListIterator *recordsIt = stList_getIterator(records);
+    cactusDisk_lock(cactusDisk); //The string cache is shared.
+    int64_t j = 0;
     for (int64_t i = 0; i < stList_length(substrings); i++) {
         Substring *substring = stList_get(substrings, i);
         int64_t intervalSize = (substring->length + substring->start - 1) / CACTUS_DISK_SEQUENCE_CHUNK_SIZE
             - substring->start / CACTUS_DISK_SEQUENCE_CHUNK_SIZE + 1;
-        stList *strings = stList_construct();
-        while (intervalSize-- > 0) {
-            int64_t recordSize;
-            stKVDatabaseBulkResult *result = stList_getNext(recordsIt);
-            assert(result != NULL);
-            char *string = stKVDatabaseBulkResult_getRecord(result, &recordSize);
-            assert(string != NULL);
-            assert(strlen(string) == recordSize - 1);
-            stList_append(strings, string);
-            assert(recordSize <= CACTUS_DISK_SEQUENCE_CHUNK_SIZE + 1);
-        }
-        assert(stList_length(strings) > 0);
-        char *joinedString = stString_join2("", strings);
-        stCache_setRecord(cactusDisk->stringCache, substring->name,
-                          (substring->start / CACTUS_DISK_SEQUENCE_CHUNK_SIZE) * CACTUS_DISK_SEQUENCE_CHUNK_SIZE,
-                          strlen(joinedString), joinedString);
-        free(joinedString);
-        stList_destruct(strings);
-    }
-    assert(stList_getNext(recordsIt) == NULL);
-    stList_destructIterator(recordsIt);
-    stList_destruct(records);
+        PackedSequence *packedSequence;
+        if (cactusDisk->sequenceFormat == CACTUS_DISK_SEQUENCE_FORMAT_PACKED) {
+            stList *packedSequences = stList_construct3(0, (void (*)(void *)) packedSequence_destruct);
+            while (intervalSize-- > 0) {
+                assert(j < recordNumber);
+                int64_t recordSize = records->recordSizes[j];
+                void *record = records->records[j++];
+                assert(record != NULL);
+                stList_append(packedSequences, packedSequence_loadFromBinaryRepresentation(record, recordSize));
+                cactusDiskStats_addBytes(cactusDisk->stats, CACTUS_DISK_OP_BULK_GET, recordSize,
+                        packedSequence_getLength(stList_peek(packedSequences)));
+                assert(packedSequence_getLength(stList_peek(packedSequences)) <= CACTUS_DISK_SEQUENCE_CHUNK_SIZE);
+            }
+            assert(stList_length(packedSequences) > 0);
+            packedSequence = packedSequence_concatenate(packedSequences);
+            stList_destruct(packedSequences);
+        } else { //Strings stored as plain text, which we pack for the cache.
+            stList *strings = stList_construct();
+            while (intervalSize-- > 0) {
+                assert(j < recordNumber);
+                int64_t recordSize = records->recordSizes[j];
+                char *string = records->records[j++];
+                assert(string != NULL);
+                cactusDiskStats_addBytes(cactusDisk->stats, CACTUS_DISK_OP_BULK_GET, recordSize, recordSize);
+                assert(strlen(string) == recordSize - 1);
+                stList_append(strings, string);
+                assert(recordSize <= CACTUS_DISK_SEQUENCE_CHUNK_SIZE + 1);
+            }
+            assert(stList_length(strings) > 0);
+            char *joinedString = stString_join2("", strings);
+            packedSequence = packedSequence_construct(joinedString, strlen(joinedString));
+            free(joinedString);
+            stList_destruct(strings);
+        }
+        packedSequenceCache_setRecord(cactusDisk->stringCache, substring->name,
+                                      (substring->start / CACTUS_DISK_SEQUENCE_CHUNK_SIZE) * CACTUS_DISK_SEQUENCE_CHUNK_SIZE,
+                                      packedSequence);
+    }
+    cactusDisk_unlock(cactusDisk);
+    assert(j == recordNumber);
+    rawRecords_destruct(records);
 }
 
 void cactusDisk_preCacheStrings2(CactusDisk *cactusDisk, stList *substrings) {
@@ -312,7 +488,8 @@ void cactusDisk_preCacheSegmentStrings(CactusDisk *cactusDisk, stList *flowers)
     stList_destruct(substrings);
 }
 
-char *cactusDisk_getStringFromCache(CactusDisk *cactusDisk, Name name, int64_t start, int64_t length, int64_t strand) {
+static char *getStringFromCache(CactusDisk *cactusDisk, Name name, int64_t start, int64_t length, int64_t strand,
+        bool countLookup) {
     /*
      * Gets a sequence from the cache.
      */
@@ -320,20 +497,27 @@ char *cactusDisk_getStringFromCache(CactusDisk *cactusDisk, Name name, int64_t s
         // No cache.
         return NULL;
     }
-    char *string = NULL;
-    if (stCache_containsRecord(cactusDisk->stringCache, name, start, sizeof(char) * length)) {
-        int64_t recordSize;
-        string = stCache_getRecord(cactusDisk->stringCache, name, start, sizeof(char) * length, &recordSize);
-        assert(string != NULL);
-        assert(recordSize == length);
-        string = st_realloc(string, sizeof(char) * (length + 1));
-        string[length] = '\0';
-        if (!strand) {
-            char *string2 = stString_reverseComplementString(string);
-            free(string);
-            string = string2;
-        }
+    int64_t offset;
+    PackedSequence *packedSequence = packedSequenceCache_getRecord(cactusDisk->stringCache, name, start, length, &offset,
+            countLookup);
+    if (packedSequence == NULL) {
+        return NULL;
     }
+    packedSequence = packedSequence_getSubSequence(packedSequence, offset, length);
+    if (!strand) {
+        PackedSequence *packedSequence2 = packedSequence_reverseComplement(packedSequence);
+        packedSequence_destruct(packedSequence);
+        packedSequence = packedSequence2;
+    }
+    char *string = packedSequence_getString(packedSequence);
+    packedSequence_destruct(packedSequence);
+    return string;
+}
+
+char *cactusDisk_getStringFromCache(CactusDisk *cactusDisk, Name name, int64_t start, int64_t length, int64_t strand) {
+    cactusDisk_lock(cactusDisk); //The cache changes as it is read.
+    char *string = getStringFromCache(cactusDisk, name, start, length, strand, 1);
+    cactusDisk_unlock(cactusDisk);
     return string;
 }
 
@@ -348,14 +532,25 @@ char *cactusDisk_getString(CactusDisk *cactusDisk, Name name, int64_t start, int
         return stString_copy("");
     }
     //First try getting it from the cache
-    char *string = cactusDisk_getStringFromCache(cactusDisk, name, start, length, strand);
+    cactusDisk_lock(cactusDisk); //The cache changes as it is read.
+    char *string = getStringFromCache(cactusDisk, name, start, length, strand, 1);
     if (string == NULL) { //If not in the cache, add it to the cache and then get it from the cache.
         stList *list = stList_construct3(0, (void (*)(void *)) substring_destruct);
         stList_append(list, substring_construct(name, start, length));
-        cacheSubstringsFromDB(cactusDisk, list);
+        stTry
+        {
+            cacheSubstringsFromDB(cactusDisk, list);
+        }
+        stCatch(except)
+        {
+            cactusDisk_unlock(cactusDisk);
+            stThrowNewCause(except, CACTUS_DISK_EXCEPTION_ID, "Could not get the string %" PRIi64, name);
+        }stTryEnd
+        ;
         stList_destruct(list);
-        string = cactusDisk_getStringFromCache(cactusDisk, name, start, length, strand);
+        string = getStringFromCache(cactusDisk, name, start, length, strand, 0); //Not counted, as the miss was.
     }
+    cactusDisk_unlock(cactusDisk);
     assert(string != NULL);
     return string;
 }
@@ -384,13 +579,40 @@ static void cactusDisk_writeBinaryRepresentation(CactusDisk *cactusDisk,
     if (cactusDisk->eventTree != NULL) {
         eventTree_writeBinaryRepresentation(cactusDisk->eventTree, writeFn);
     }
+    binaryRepresentation_writeElementType(CODE_SEQUENCE_FORMAT, writeFn);
+    binaryRepresentation_writeInteger(cactusDisk->sequenceFormat, writeFn);
+    if (cactusDisk->taggedRecords) {
+        binaryRepresentation_writeElementType(CODE_RECORD_CODEC, writeFn);
+        binaryRepresentation_writeInteger(recordCodec_getType(cactusDisk->codec), writeFn);
+        binaryRepresentation_writeInteger(recordCodec_getLevel(cactusDisk->codec), writeFn);
+    }
     binaryRepresentation_writeElementType(CODE_CACTUS_DISK, writeFn);
 }
 
-static void cactusDisk_loadFromBinaryRepresentation(void **binaryString, CactusDisk *cactusDisk, stKVDatabaseConf *conf) {
+static void cactusDisk_loadFromBinaryRepresentation(void **binaryString, CactusDisk *cactusDisk, stKVDatabaseConf *conf,
+        const char *compression) {
     assert(binaryRepresentation_peekNextElementType(*binaryString) == CODE_CACTUS_DISK);
     binaryRepresentation_popNextElementType(binaryString);
     cactusDisk->eventTree = eventTree_loadFromBinaryRepresentation(binaryString, cactusDisk);
+    //Databases written before the sequence format was recorded store plain strings.
+    cactusDisk->sequenceFormat = CACTUS_DISK_SEQUENCE_FORMAT_PLAIN;
+    if (binaryRepresentation_peekNextElementType(*binaryString) == CODE_SEQUENCE_FORMAT) {
+        binaryRepresentation_popNextElementType(binaryString);
+        cactusDisk->sequenceFormat = binaryRepresentation_getInteger(binaryString);
+    }
+    //Databases written before the record codecs were added hold untagged zlib records.
+    cactusDisk->taggedRecords = 0;
+    if (binaryRepresentation_peekNextElementType(*binaryString) == CODE_RECORD_CODEC) {
+        binaryRepresentation_popNextElementType(binaryString);
+        cactusDisk->taggedRecords = 1;
+        int64_t type = binaryRepresentation_getInteger(binaryString);
+        int64_t level = binaryRepresentation_getInteger(binaryString);
+        if (compression == NULL) {
+            cactusDisk->codec = recordCodec_construct(type, level);
+        }
+    } else if (compression != NULL) {
+        st_logInfo("The cactus disk predates record codecs, so records will be written with zlib not %s\n", compression);
+    }
     assert(binaryRepresentation_peekNextElementType(*binaryString) == CODE_CACTUS_DISK);
     binaryRepresentation_popNextElementType(binaryString);
 }
@@ -399,95 +621,143 @@ static void cactusDisk_loadFromBinaryRepresentation(void **binaryString, CactusD
  * The following two functions compress and decompress the data in the cactus disk..
  */
 
-static void *compress(void *data, int64_t *dataSize) {
+static void *compress(CactusDisk *cactusDisk, const void *data, int64_t *dataSize) {
     //Compression
+    int64_t startTime = cactusDiskStats_getTime();
     int64_t compressedSize;
-    void *data2 = stCompression_compress(data, *dataSize, &compressedSize, -1);
-    free(data);
+    void *data2;
+    if (cactusDisk->taggedRecords) {
+        data2 = recordCodec_compress(cactusDisk->codec, data, *dataSize, &compressedSize);
+    } else { //The parameters, and the records of databases created before the record codecs, are untagged zlib.
+        data2 = stCompression_compress((void *) data, *dataSize, &compressedSize, -1);
+    }
+    cactusDiskStats_addCall(cactusDisk->stats, CACTUS_DISK_OP_COMPRESS, startTime, 1, compressedSize, *dataSize);
     *dataSize = compressedSize;
     return data2;
 }
 
-static void *decompress(void *data, int64_t *dataSize) {
-    //Decompression
+static void loadDictionary(CactusDisk *cactusDisk) {
+    lockDatabase(cactusDisk);
+    stTry
+        {
+            loadDictionary2(cactusDisk);
+        }
+        stCatch(except)
+            {
+                unlockDatabase(cactusDisk);
+                stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
+                        "An unknown database error occurred when getting the record dictionary");
+            }stTryEnd
+    ;
+    unlockDatabase(cactusDisk);
+}
+
+static void *decompress(CactusDisk *cactusDisk, void *data, int64_t *dataSize) {
+    /*
+     * The dictionary, if needed, has been loaded with the record, as this may be called from a prefetching
+     * or write thread.
+     */
     int64_t uncompressedSize;
-    void *data2 = stCompression_decompress(data, *dataSize, &uncompressedSize);
+    void *data2;
+    if (cactusDisk->taggedRecords) {
+        int64_t startTime = cactusDiskStats_getTime();
+        data2 = recordCodec_decompress(cactusDisk->codec, data, *dataSize, &uncompressedSize);
+        cactusDiskStats_addCall(cactusDisk->stats, CACTUS_DISK_OP_DECOMPRESS, startTime, 1, *dataSize, uncompressedSize);
+    } else {
+        int64_t startTime = cactusDiskStats_getTime();
+        data2 = stCompression_decompress(data, *dataSize, &uncompressedSize);
+        cactusDiskStats_addCall(cactusDisk->stats, CACTUS_DISK_OP_DECOMPRESS, startTime, 1, *dataSize, uncompressedSize);
+    }
     *dataSize = uncompressedSize;
     return data2;
 }
 
 static stList *getRecords(CactusDisk *cactusDisk, stList *objectNames, char *type) {
+    /*
+     * Called with the cactus disk locked, as the record cache is shared.
+     */
     if (stList_length(objectNames) == 0) {
         return stList_construct3(0, NULL);
     }
-    stList *records = NULL;
+    RawRecords *rawRecords = NULL;
+    lockDatabase(cactusDisk);
     stTry
         {
-            records = stKVDatabase_bulkGetRecords(cactusDisk->database, objectNames);
+            rawRecords = rawRecords_get(cactusDisk, objectNames);
         }
         stCatch(except)
             {
+                unlockDatabase(cactusDisk);
                 stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
                         "An unknown database error occurred when getting a bulk set of %s", type);
             }stTryEnd
     ;
-    assert(records != NULL);
-    assert(stList_length(objectNames) == stList_length(records));
-    stList_setDestructor(records, free);
+    unlockDatabase(cactusDisk);
+    assert(rawRecords != NULL);
+    stList *records = stList_construct3(stList_length(objectNames), free);
     for (int64_t i = 0; i < stList_length(objectNames); i++) {
         Name objectName = *((int64_t *) stList_get(objectNames, i));
         int64_t recordSize;
-        void *record;
-        stKVDatabaseBulkResult *result = stList_get(records, i);
-        assert(result != NULL);
-        if (cactusDisk->cache == NULL
-            || !stCache_containsRecord(cactusDisk->cache, objectName, 0, INT64_MAX)) {
-            record = stKVDatabaseBulkResult_getRecord(result, &recordSize);
+        void *record = NULL;
+        if (cactusDisk->cache != NULL) {
+            record = recordCache_getRecord(cactusDisk->cache, objectName, &recordSize);
+        }
+        if (record == NULL) {
+            record = rawRecords->records[i];
+            recordSize = rawRecords->recordSizes[i];
             assert(recordSize >= 0);
             assert(record != NULL);
-            record = decompress(record, &recordSize);
+            int64_t compressedSize = recordSize;
+            record = decompress(cactusDisk, record, &recordSize);
+            cactusDiskStats_addBytes(cactusDisk->stats, CACTUS_DISK_OP_BULK_GET, compressedSize, recordSize);
             if (cactusDisk->cache != NULL) {
-                stCache_setRecord(cactusDisk->cache, objectName, 0, recordSize, record);
+                recordCache_setRecord(cactusDisk->cache, objectName, record, recordSize);
             }
-        } else {
-            record = stCache_getRecord(cactusDisk->cache, objectName, 0, INT64_MAX, &recordSize);
-            assert(recordSize >= 0);
-            assert(record != NULL);
         }
-        stKVDatabaseBulkResult_destruct(result);
         stList_set(records, i, record);
     }
+    rawRecords_destruct(rawRecords);
     return records;
 }
 
 static void *getRecord(CactusDisk *cactusDisk, Name objectName, char *type, int64_t *size) {
+    /*
+     * Called with the cactus disk locked, or before it is shared, as the record cache is shared.
+     */
     void *cA = NULL;
     int64_t recordSize = 0;
-    if (cactusDisk->cache != NULL
-        && stCache_containsRecord(cactusDisk->cache, objectName, 0, INT64_MAX)) { //If we already have the record, we won't update it.
-        cA = stCache_getRecord(cactusDisk->cache, objectName, 0, INT64_MAX, &recordSize);
-    } else {
+    if (cactusDisk->cache != NULL) { //If we already have the record, we won't update it.
+        cA = recordCache_getRecord(cactusDisk->cache, objectName, &recordSize);
+    }
+    if (cA == NULL) {
+        lockDatabase(cactusDisk);
         stTry
             {
-                cA = stKVDatabase_getRecord2(cactusDisk->database, objectName, &recordSize);
+                cA = getRawRecord(cactusDisk, objectName, &recordSize);
+                if (cA != NULL && needsDictionary(cactusDisk, cA, recordSize)) {
+                    loadDictionary2(cactusDisk);
+                }
             }
             stCatch(except)
                 {
+                    unlockDatabase(cactusDisk);
                     stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
                             "An unknown database error occurred when getting a %s", type);
                 }stTryEnd
         ;
+        unlockDatabase(cactusDisk);
         if (cA == NULL) {
             return NULL;
         }
         //Decompression
         assert(recordSize > 0);
-        void *cA2 = decompress(cA, &recordSize);
-        free(cA);
+        void *cA2 = decompress(cactusDisk, cA, &recordSize);
+        cactusDiskStats_addBytes(cactusDisk->stats, CACTUS_DISK_OP_GET, 0, recordSize);
+        freeRawRecord(cactusDisk, cA);
         cA = cA2;
         // Add the uncompressed record to the cache.
         if (cactusDisk->cache != NULL) {
-            stCache_setRecord(cactusDisk->cache, objectName, 0, recordSize, cA);
+            recordCache_setRecord(cactusDisk->cache, objectName, cA, recordSize);
         }
     }
     if (size != NULL) {
@@ -497,12 +767,92 @@ static void *getRecord(CactusDisk *cactusDisk, Name objectName, char *type, int6
 }
 
 static bool containsRecord(CactusDisk *cactusDisk, Name objectName) {
-    return (cactusDisk->cache != NULL
-            && stCache_containsRecord(cactusDisk->cache, objectName, 0, INT64_MAX))
-        || stKVDatabase_containsRecord(cactusDisk->database, objectName);
+    if (cactusDisk->cache != NULL && recordCache_containsRecord(cactusDisk->cache, objectName)) {
+        return 1;
+    }
+    lockDatabase(cactusDisk);
+    bool b = containsRawRecord(cactusDisk, objectName);
+    unlockDatabase(cactusDisk);
+    return b;
+}
+
+stList *cactusDisk_fetchRecords(CactusDisk *cactusDisk, stList *objectNames, int64_t **recordSizes,
+        stExcept **exception) {
+    /*
+     * This may be called from a prefetching thread, so a database error is returned rather than thrown. The
+     * exception stack is shared by the threads, so the try frame is only open with the database lock held,
+     * as are those around the other database calls.
+     */
+    *exception = NULL;
+    if (stList_length(objectNames) == 0) {
+        *recordSizes = st_malloc(sizeof(int64_t));
+        return stList_construct3(0, free);
+    }
+    RawRecords *rawRecords = NULL;
+    lockDatabase(cactusDisk);
+    stTry
+        {
+            rawRecords = rawRecords_get(cactusDisk, objectNames);
+        }
+        stCatch(except)
+            {
+                *exception = except;
+            }stTryEnd
+    ;
+    unlockDatabase(cactusDisk);
+    if (rawRecords == NULL) {
+        *recordSizes = NULL;
+        return NULL;
+    }
+    *recordSizes = st_malloc(sizeof(int64_t) * (stList_length(objectNames) + 1));
+    stList *records = stList_construct3(stList_length(objectNames), free);
+    for (int64_t i = 0; i < stList_length(objectNames); i++) {
+        int64_t recordSize = rawRecords->recordSizes[i];
+        void *record = rawRecords->records[i];
+        assert(record != NULL);
+        int64_t compressedSize = recordSize;
+        stList_set(records, i, decompress(cactusDisk, record, &recordSize));
+        cactusDiskStats_addBytes(cactusDisk->stats, CACTUS_DISK_OP_BULK_GET, compressedSize, recordSize);
+        (*recordSizes)[i] = recordSize;
+    }
+    rawRecords_destruct(rawRecords);
+    return records;
+}
+
+static int64_t getCacheSize(const char *variable, int64_t defaultSize) {
+    /*
+     * Gets the size in bytes of a cache from the environment, which may have a K, M or G suffix.
+     */
+    const char *value = getenv(variable);
+    if (value == NULL) {
+        return defaultSize;
+    }
+    int64_t size;
+    char suffix = '\0';
+    int64_t i = sscanf(value, "%" SCNi64 "%c", &size, &suffix);
+    if (i < 1 || size < 0) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Could not parse the cache size %s=%s", variable, value);
+    }
+    switch (suffix) {
+    case 'G':
+        size *= 1000;
+        // fall through
+    case 'M':
+        size *= 1000;
+        // fall through
+    case 'K':
+        size *= 1000;
+        // fall through
+    case '\0':
+        break;
+    default:
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Could not parse the cache size %s=%s", variable, value);
+    }
+    return size;
 }
 
-static CactusDisk *cactusDisk_constructPrivate(stKVDatabaseConf *conf, bool create, bool cache) {
+static CactusDisk *cactusDisk_constructPrivate(stKVDatabaseConf *conf, bool create, bool cache,
+        const char *compression, const char *snapshotFile) {
     CactusDisk *cactusDisk = st_calloc(1, sizeof(CactusDisk));
 
     //construct lists of in memory objects
@@ -515,13 +865,33 @@ static CactusDisk *cactusDisk_constructPrivate(stKVDatabaseConf *conf, bool crea
     cactusDisk->eventTree = NULL;
 
     //Now open the database
-    cactusDisk->database = stKVDatabase_construct(conf, create);
+    pthread_mutex_init(&cactusDisk->databaseLock, NULL);
+    pthread_mutexattr_t lockAttributes;
+    pthread_mutexattr_init(&lockAttributes);
+    pthread_mutexattr_settype(&lockAttributes, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&cactusDisk->lock, &lockAttributes);
+    pthread_mutexattr_destroy(&lockAttributes);
+    cactusDisk->writer = binaryRepresentationWriter_construct();
+    cactusDisk->writeThreads = 1;
+    cactusDisk->stats = cactusDiskStats_construct();
+    if (snapshotFile != NULL) { //The snapshot holds all the records read, so the database is not opened.
+        assert(!create);
+        cactusDisk->snapshot = cactusDiskSnapshot_construct(snapshotFile);
+    } else {
+        cactusDisk->database = stKVDatabase_construct(conf, create);
+    }
     if (cache) {
-        // 10MB for general DB responses
-        cactusDisk->cache = stCache_construct2(10000000);
+        // 10MB for general DB responses, unless set in the environment
+        cactusDisk->cache = recordCache_construct(getCacheSize(CACTUS_DISK_CACHE_SIZE_VARIABLE, 10000000));
+    }
+    // 100MB for strings, unless set in the environment
+    cactusDisk->stringCache = packedSequenceCache_construct(getCacheSize(CACTUS_DISK_STRING_CACHE_SIZE_VARIABLE, 100000000));
+    // New databases store packed strings, existing ones get the format from their parameters.
+    cactusDisk->sequenceFormat = CACTUS_DISK_SEQUENCE_FORMAT_PACKED;
+    // Records are written with the given codec, or else the one in the parameters, or else zlib.
+    if (compression != NULL) {
+        cactusDisk->codec = recordCodec_constructFromString(compression);
     }
-    // 100MB for strings
-    cactusDisk->stringCache = stCache_construct2(10000000);
 
     //initialise the unique ids.
     int64_t seed = (clock() << 24) | (time(NULL) << 16) | (getpid() & 65535); //Likely to be unique
@@ -529,6 +899,13 @@ static CactusDisk *cactusDisk_constructPrivate(stKVDatabaseConf *conf, bool crea
     st_randomSeed(seed);
     cactusDisk->uniqueNumber = 0;
     cactusDisk->maxUniqueNumber = 0;
+    cactusDisk->leaseStart = 0;
+    cactusDisk->leaseSize = CACTUS_DISK_NAME_INCREMENT;
+    cactusDisk->leaseBucket = 0;
+    cactusDisk->prefetchedUniqueNumber = 0;
+    cactusDisk->prefetchedMaxUniqueNumber = 0;
+    cactusDisk->leasePrefetching = 0;
+    cactusDisk->leaseException = NULL;
 
     //Now load any stuff..
     if (containsRecord(cactusDisk, CACTUS_DISK_PARAMETER_KEY)) {
@@ -537,23 +914,100 @@ static CactusDisk *cactusDisk_constructPrivate(stKVDatabaseConf *conf, bool crea
         }
         void *record = getRecord(cactusDisk, CACTUS_DISK_PARAMETER_KEY, "cactus_disk parameters", NULL);
         void *record2 = record;
-        cactusDisk_loadFromBinaryRepresentation(&record, cactusDisk, conf);
+        cactusDisk_loadFromBinaryRepresentation(&record, cactusDisk, conf, compression);
         free(record2);
     } else {
         assert(create);
+        cactusDisk->taggedRecords = 1;
+    }
+    if (cactusDisk->codec == NULL) {
+        cactusDisk->codec = recordCodec_construct(RECORD_CODEC_ZLIB, RECORD_CODEC_DEFAULT_LEVEL);
+    }
+    //Load any dictionary now, rather than on the prefetching and write threads.
+    if (cactusDisk->taggedRecords && recordCodec_getType(cactusDisk->codec) == RECORD_CODEC_ZSTD_DICTIONARY) {
+        loadDictionary(cactusDisk);
     }
 
     return cactusDisk;
 }
 
 CactusDisk *cactusDisk_construct(stKVDatabaseConf *conf, bool create, bool cache) {
-    return cactusDisk_constructPrivate(conf, create, cache);
+    char *snapshotFile = create ? NULL : getenv(CACTUS_DISK_SNAPSHOT_VARIABLE);
+    if (snapshotFile != NULL && snapshotFile[0] != '\0') {
+        st_logInfo("Reading the cactus disk from the snapshot %s\n", snapshotFile);
+        return cactusDisk_constructPrivate(conf, false, cache, NULL, snapshotFile);
+    }
+    return cactusDisk_constructPrivate(conf, create, cache, NULL, NULL);
+}
+
+CactusDisk *cactusDisk_construct2(stKVDatabaseConf *conf, bool create, bool cache, const char *compression) {
+    return cactusDisk_constructPrivate(conf, create, cache, compression, NULL);
+}
+
+CactusDisk *cactusDisk_constructFromSnapshot(const char *snapshotFile, bool cache) {
+    return cactusDisk_constructPrivate(NULL, false, cache, NULL, snapshotFile);
+}
+
+char *cactusDisk_getCompressionFromConfString(const char *confString) {
+    /*
+     * Looks for the attribute in the opening tag of the root element.
+     */
+    const char *start = strstr(confString, "<st_kv_database_conf");
+    if (start == NULL) {
+        return NULL;
+    }
+    const char *end = strchr(start, '>');
+    const char *attribute = strstr(start, " compression=");
+    if (attribute == NULL || (end != NULL && attribute > end)) {
+        return NULL;
+    }
+    attribute += strlen(" compression=");
+    char quote = *attribute++;
+    const char *attributeEnd = strchr(attribute, quote);
+    if ((quote != '"' && quote != '\'') || attributeEnd == NULL) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Could not parse the compression attribute of the database conf: %s",
+                confString);
+    }
+    return stString_getSubString(attribute, 0, attributeEnd - attribute);
+}
+
+static void logStats(CactusDisk *cactusDisk) {
+    /*
+     * Writes the timings of the database operations as a line of JSON, appended to the file named by
+     * CACTUS_DISK_STATS_FILE if it is set, else logged at the info level.
+     */
+    char *json = cactusDiskStats_getJson(cactusDisk->stats);
+    char *statsFile = getenv("CACTUS_DISK_STATS_FILE");
+    if (statsFile != NULL) {
+        FILE *fileHandle = fopen(statsFile, "a");
+        if (fileHandle == NULL) {
+            st_logCritical("Could not open the cactus disk stats file %s\n", statsFile);
+        } else {
+            fprintf(fileHandle, "%s\n", json);
+            fclose(fileHandle);
+        }
+    } else {
+        st_logInfo("%s\n", json);
+    }
+    free(json);
+}
+
+char *cactusDisk_getStatsJson(CactusDisk *cactusDisk) {
+    return cactusDiskStats_getJson(cactusDisk->stats);
 }
 
 void cactusDisk_destruct(CactusDisk *cactusDisk) {
     Flower *flower;
     MetaSequence *metaSequence;
 
+    if (cactusDisk->leasePrefetching) { //Wait for the lease being taken in the background.
+        pthread_join(cactusDisk->leaseThread, NULL);
+        if (cactusDisk->leaseException != NULL) { //The lease is not needed, so neither is the error.
+            st_logDebug("Got an exception when prefetching a lease: %s\n", stExcept_getMsg(cactusDisk->leaseException));
+            stExcept_free(cactusDisk->leaseException);
+        }
+    }
+
     while ((flower = stSortedSet_getFirst(cactusDisk->flowers)) != NULL) {
         flower_destruct(flower, FALSE);
     }
@@ -567,79 +1021,363 @@ void cactusDisk_destruct(CactusDisk *cactusDisk) {
     stSortedSet_destruct(cactusDisk->metaSequences);
 
     //close DB
-    stKVDatabase_destruct(cactusDisk->database);
+    if (cactusDisk->database != NULL) {
+        stKVDatabase_destruct(cactusDisk->database);
+    }
+    if (cactusDisk->snapshot != NULL) {
+        cactusDiskSnapshot_destruct(cactusDisk->snapshot);
+    }
 
     if (cactusDisk->cache != NULL) {
-        stCache_destruct(cactusDisk->cache);
+        cacheStats_log(recordCache_getStats(cactusDisk->cache), "cactus disk record cache");
+        recordCache_destruct(cactusDisk->cache);
     }
     if (cactusDisk->stringCache != NULL) {
-        stCache_destruct(cactusDisk->stringCache);
+        cacheStats_log(packedSequenceCache_getStats(cactusDisk->stringCache), "cactus disk string cache");
+        packedSequenceCache_destruct(cactusDisk->stringCache);
     }
 
     stList_destruct(cactusDisk->updateRequests);
 
+    logStats(cactusDisk);
+    cactusDiskStats_destruct(cactusDisk->stats);
+
+    pthread_mutex_destroy(&cactusDisk->databaseLock);
+    pthread_mutex_destroy(&cactusDisk->lock);
+    binaryRepresentationWriter_destruct(cactusDisk->writer);
+    recordCodec_destruct(cactusDisk->codec);
     free(cactusDisk);
 }
 
-void cactusDisk_addUpdateRequest(CactusDisk *cactusDisk, Flower *flower) {
+/*
+ * The following functions serialise, compress and diff the objects written by cactusDisk_write,
+ * which is done by a pool of threads if the cactus disk has more than one write thread.
+ */
+
+static void appendUpdateRequest(CactusDisk *cactusDisk, stKVDatabaseBulkRequest *request, int64_t recordSize,
+        int64_t uncompressedRecordSize) {
+    /*
+     * Adds a request to those written by the next cactusDisk_write, counting its bytes.
+     */
+    stList_append(cactusDisk->updateRequests, request);
+    cactusDisk->updateRequestBytes += recordSize;
+    cactusDisk->updateRequestUncompressedBytes += uncompressedRecordSize;
+}
+
+typedef struct _writeJob {
+    CactusDisk *cactusDisk;
+    void *object;
+    Name name;
+    void (*writeBinaryRepresentation)(void *, void (*writeFn)(const void * ptr, size_t size, size_t count));
+    Flower *flower; //If the object is a flower, it is not written if its record is unchanged.
+    bool hashed; //Non-zero if recordHash is the hash of the flower's record in the database.
+    uint64_t recordHash;
+    bool exists; //Non-zero if the record is already in the database.
+    void *oldRecord; //The record in the database, if needed for the diff.
+    bool oldRecordCompressed; //Non-zero if oldRecord is the raw record, still to be decompressed.
+    int64_t oldRecordSize;
+    void *record; //The compressed record to write, or NULL if it does not need writing.
     int64_t recordSize;
-    void *vA = binaryRepresentation_makeBinaryRepresentation(flower,
-            (void (*)(void *, void (*)(const void * ptr, size_t size, size_t count))) flower_writeBinaryRepresentation,
-            &recordSize);
-    //Compression
-    int64_t compressedSize;
-    void *compressed = stCompression_compress(vA, recordSize, &compressedSize, -1);
-    if (containsRecord(cactusDisk, flower_getName(flower))) {
-        // Check if this is a redundant update.
-        int64_t recordSize2;
-        void *vA2 = getRecord(cactusDisk, flower_getName(flower), "flower", &recordSize2);
-        if (!stCache_recordsIdentical(vA, recordSize, vA2, recordSize2)) { //Only rewrite if we actually did something
-            stList_append(cactusDisk->updateRequests,
-                    stKVDatabaseBulkRequest_constructUpdateRequest(flower_getName(flower), compressed, compressedSize));
-        }
-        free(vA2);
+    int64_t uncompressedRecordSize;
+} WriteJob;
+
+static WriteJob *writeJob_construct(CactusDisk *cactusDisk, void *object, Name name,
+        void (*writeBinaryRepresentation)(void *, void (*writeFn)(const void * ptr, size_t size, size_t count))) {
+    WriteJob *job = st_calloc(1, sizeof(WriteJob));
+    job->cactusDisk = cactusDisk;
+    job->object = object;
+    job->name = name;
+    job->writeBinaryRepresentation = writeBinaryRepresentation;
+    if (cactusDisk->cache != NULL && recordCache_containsRecord(cactusDisk->cache, name)) {
+        job->exists = 1;
+    }
+    return job;
+}
+
+static WriteJob *writeJob_constructForFlower(CactusDisk *cactusDisk, Flower *flower) {
+    /*
+     * A flower loaded from, or already written to, the database has the hash of its record, so is
+     * diffed without touching the database. Otherwise the old record is looked up here if it is
+     * in the cache, as the cache is not thread safe, or else by the job.
+     */
+    WriteJob *job = st_calloc(1, sizeof(WriteJob));
+    job->cactusDisk = cactusDisk;
+    job->object = flower;
+    job->name = flower_getName(flower);
+    job->writeBinaryRepresentation =
+            (void (*)(void *, void (*)(const void * ptr, size_t size, size_t count))) flower_writeBinaryRepresentation;
+    job->flower = flower;
+    if (flower_getRecordHash(flower, &job->recordHash)) {
+        job->hashed = 1;
+        job->exists = 1;
+    } else if (cactusDisk->cache != NULL
+            && (job->oldRecord = recordCache_getRecord(cactusDisk->cache, job->name, &job->oldRecordSize)) != NULL) {
+        job->exists = 1;
+    }
+    return job;
+}
+
+static void writeJob_destruct(WriteJob *job) {
+    if (job->oldRecordCompressed) {
+        freeRawRecord(job->cactusDisk, job->oldRecord);
+    } else {
+        free(job->oldRecord);
+    }
+    free(job->record);
+    free(job);
+}
+
+static void writeJobs_getOldRecords(CactusDisk *cactusDisk, stList *jobs) {
+    /*
+     * Looks up the records of the jobs not known to be in the database. This is done before the
+     * jobs are run, as the write threads can not catch database errors.
+     */
+    lockDatabase(cactusDisk);
+    stTry
+        {
+            for (int64_t i = 0; i < stList_length(jobs); i++) {
+                WriteJob *job = stList_get(jobs, i);
+                if (job->exists) {
+                    continue;
+                }
+                if (job->flower != NULL) {
+                    job->oldRecord = getRawRecord(cactusDisk, job->name, &job->oldRecordSize);
+                    job->exists = job->oldRecordCompressed = job->oldRecord != NULL;
+                    if (job->exists && needsDictionary(cactusDisk, job->oldRecord, job->oldRecordSize)) {
+                        loadDictionary2(cactusDisk);
+                    }
+                } else {
+                    job->exists = containsRawRecord(cactusDisk, job->name);
+                }
+            }
+        }
+        stCatch(except)
+            {
+                unlockDatabase(cactusDisk);
+                stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
+                        "An unknown database error occurred when getting the records to update");
+            }stTryEnd
+    ;
+    unlockDatabase(cactusDisk);
+}
+
+static void writeJob_run(WriteJob *job, BinaryRepresentationWriter *writer) {
+    /*
+     * May be called from a write thread, so does not touch the database.
+     */
+    CactusDisk *cactusDisk = job->cactusDisk;
+    if (job->oldRecordCompressed) {
+        void *oldRecord = decompress(cactusDisk, job->oldRecord, &job->oldRecordSize);
+        cactusDiskStats_addBytes(cactusDisk->stats, CACTUS_DISK_OP_GET, 0, job->oldRecordSize);
+        freeRawRecord(cactusDisk, job->oldRecord);
+        job->oldRecord = oldRecord;
+        job->oldRecordCompressed = 0;
+    }
+    int64_t recordSize;
+    const void *vA = binaryRepresentationWriter_makeBinaryRepresentation(writer, job->object,
+            job->writeBinaryRepresentation, &recordSize);
+    bool changed = 1;
+    if (job->flower != NULL) {
+        uint64_t recordHash = binaryRepresentation_hash(vA, recordSize);
+        if (job->hashed) {
+            changed = recordHash != job->recordHash;
+        } else if (job->oldRecord != NULL) {
+            changed = !stCache_recordsIdentical(vA, recordSize, job->oldRecord, job->oldRecordSize);
+        }
+        job->recordHash = recordHash;
+    }
+    //Only rewrite if we actually did something
+    if (changed) {
+        job->uncompressedRecordSize = recordSize;
+        job->recordSize = recordSize;
+        job->record = compress(cactusDisk, vA, &job->recordSize);
+    }
+    free(job->oldRecord);
+    job->oldRecord = NULL;
+}
+
+static void writeJob_addUpdateRequest(WriteJob *job) {
+    if (job->flower != NULL) {
+        //So the flower is not written again unless it changes.
+        flower_setRecordHash(job->flower, job->recordHash);
+    }
+    if (job->record == NULL) {
+        return;
+    }
+    appendUpdateRequest(job->cactusDisk,
+            job->exists ? stKVDatabaseBulkRequest_constructUpdateRequest(job->name, job->record, job->recordSize) :
+                    stKVDatabaseBulkRequest_constructInsertRequest(job->name, job->record, job->recordSize),
+            job->recordSize, job->uncompressedRecordSize);
+}
+
+typedef struct _writeJobQueue {
+    stList *jobs;
+    int64_t nextJob;
+    pthread_mutex_t lock;
+} WriteJobQueue;
+
+static void *writeJobQueue_run(WriteJobQueue *queue) {
+    BinaryRepresentationWriter *writer = binaryRepresentationWriter_construct();
+    while (1) {
+        pthread_mutex_lock(&queue->lock);
+        int64_t i = queue->nextJob++;
+        pthread_mutex_unlock(&queue->lock);
+        if (i >= stList_length(queue->jobs)) {
+            break;
+        }
+        writeJob_run(stList_get(queue->jobs, i), writer);
+    }
+    binaryRepresentationWriter_destruct(writer);
+    return NULL;
+}
+
+static void runWriteJobs(CactusDisk *cactusDisk, stList *jobs) {
+    /*
+     * Runs the jobs, then adds their update requests in the order of the list, so the requests
+     * are the same whatever the number of threads.
+     */
+    writeJobs_getOldRecords(cactusDisk, jobs);
+    int64_t threadNumber = cactusDisk->writeThreads < stList_length(jobs) ? cactusDisk->writeThreads : stList_length(jobs);
+    if (threadNumber <= 1) {
+        for (int64_t i = 0; i < stList_length(jobs); i++) {
+            writeJob_run(stList_get(jobs, i), cactusDisk->writer);
+        }
     } else {
-        stList_append(cactusDisk->updateRequests,
-                stKVDatabaseBulkRequest_constructInsertRequest(flower_getName(flower), compressed, compressedSize));
+        WriteJobQueue queue;
+        queue.jobs = jobs;
+        queue.nextJob = 0;
+        pthread_mutex_init(&queue.lock, NULL);
+        pthread_t *threads = st_malloc(sizeof(pthread_t) * threadNumber);
+        for (int64_t i = 0; i < threadNumber; i++) {
+            if (pthread_create(&threads[i], NULL, (void *(*)(void *)) writeJobQueue_run, &queue) != 0) {
+                st_errAbort("Could not create a thread to write the cactus disk");
+            }
+        }
+        for (int64_t i = 0; i < threadNumber; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        free(threads);
+        pthread_mutex_destroy(&queue.lock);
+    }
+    for (int64_t i = 0; i < stList_length(jobs); i++) {
+        writeJob_addUpdateRequest(stList_get(jobs, i));
     }
-    free(vA);
-    free(compressed);
+}
+
+void cactusDisk_addUpdateRequest(CactusDisk *cactusDisk, Flower *flower) {
+    cactusDisk_lock(cactusDisk); //The cache, the writer and the update requests are shared.
+    stList *jobs = stList_construct3(0, (void (*)(void *)) writeJob_destruct);
+    stList_append(jobs, writeJob_constructForFlower(cactusDisk, flower));
+    runWriteJobs(cactusDisk, jobs);
+    stList_destruct(jobs);
+    cactusDisk_unlock(cactusDisk);
+}
+
+void cactusDisk_setWriteThreads(CactusDisk *cactusDisk, int64_t writeThreads) {
+    if (writeThreads < 1) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "The number of write threads must be at least one, not %" PRIi64, writeThreads);
+    }
+    cactusDisk->writeThreads = writeThreads;
+}
+
+int64_t cactusDisk_getWriteThreads(CactusDisk *cactusDisk) {
+    return cactusDisk->writeThreads;
 }
 
 void cactusDisk_forceParameterUpdate(CactusDisk *cactusDisk, bool keyAlreadyExists) {
     int64_t recordSize;
-    void *cactusDiskParameters =
-        binaryRepresentation_makeBinaryRepresentation(cactusDisk,
-                                                      (void (*)(void *, void (*)(const void * ptr, size_t size, size_t count))) cactusDisk_writeBinaryRepresentation,
-                                                      &recordSize);
-    //Compression
-    cactusDiskParameters = compress(cactusDiskParameters, &recordSize);
+    const void *vA =
+        binaryRepresentationWriter_makeBinaryRepresentation(cactusDisk->writer, cactusDisk,
+                                                            (void (*)(void *, void (*)(const void * ptr, size_t size, size_t count))) cactusDisk_writeBinaryRepresentation,
+                                                            &recordSize);
+    //Compression, the parameters are always untagged zlib, as they say how the other records are compressed.
+    int64_t compressedSize;
+    int64_t startTime = cactusDiskStats_getTime();
+    void *cactusDiskParameters = stCompression_compress((void *) vA, recordSize, &compressedSize, -1);
+    cactusDiskStats_addCall(cactusDisk->stats, CACTUS_DISK_OP_COMPRESS, startTime, 1, compressedSize, recordSize);
     if (keyAlreadyExists) {
-        stList_append(cactusDisk->updateRequests,
+        appendUpdateRequest(cactusDisk,
                       stKVDatabaseBulkRequest_constructUpdateRequest(CACTUS_DISK_PARAMETER_KEY, cactusDiskParameters,
-                                                                     recordSize));
+                                                                     compressedSize), compressedSize, recordSize);
     } else {
-        stList_append(cactusDisk->updateRequests,
+        appendUpdateRequest(cactusDisk,
                       stKVDatabaseBulkRequest_constructInsertRequest(CACTUS_DISK_PARAMETER_KEY, cactusDiskParameters,
-                                                                     recordSize));
+                                                                     compressedSize), compressedSize, recordSize);
     }
     free(cactusDiskParameters);
 }
 
+static void trainDictionary(CactusDisk *cactusDisk) {
+    /*
+     * If the zstd dictionary codec is in use and no dictionary has been stored yet, trains one on
+     * a sample of the flowers in memory and stores it. If there are too few flowers the records
+     * are compressed without a dictionary for now.
+     */
+    if (!cactusDisk->taggedRecords || recordCodec_getType(cactusDisk->codec) != RECORD_CODEC_ZSTD_DICTIONARY
+            || recordCodec_hasDictionary(cactusDisk->codec)) {
+        return;
+    }
+    loadDictionary(cactusDisk); //Another process may have stored one.
+    if (recordCodec_hasDictionary(cactusDisk->codec)) {
+        return;
+    }
+    stList *samples = stList_construct3(0, free);
+    int64_t *sampleSizes = st_malloc(sizeof(int64_t) * CACTUS_DISK_DICTIONARY_SAMPLES);
+    stSortedSetIterator *it = stSortedSet_getIterator(cactusDisk->flowers);
+    Flower *flower;
+    while ((flower = stSortedSet_getNext(it)) != NULL && stList_length(samples) < CACTUS_DISK_DICTIONARY_SAMPLES) {
+        stList_append(samples, binaryRepresentation_makeBinaryRepresentation(flower,
+                (void (*)(void *, void (*)(const void * ptr, size_t size, size_t count))) flower_writeBinaryRepresentation,
+                &sampleSizes[stList_length(samples)]));
+    }
+    stSortedSet_destructIterator(it);
+    int64_t dictionarySize;
+    void *dictionary = recordCodec_trainDictionary(samples, sampleSizes, CACTUS_DISK_DICTIONARY_SIZE, &dictionarySize);
+    stList_destruct(samples);
+    free(sampleSizes);
+    if (dictionary == NULL) {
+        return;
+    }
+    checkWritable(cactusDisk);
+    lockDatabase(cactusDisk);
+    stTry
+        {
+            int64_t startTime = cactusDiskStats_getTime();
+            stKVDatabase_insertRecord(cactusDisk->database, CACTUS_DISK_DICTIONARY_KEY, dictionary, dictionarySize);
+            cactusDiskStats_addCall(cactusDisk->stats, CACTUS_DISK_OP_INSERT, startTime, 1, dictionarySize, dictionarySize);
+        }
+        stCatch(except)
+            {
+                //Another process stored a dictionary first, so we use that one.
+                st_logDebug("Got an exception when trying to insert the dictionary: %s\n", stExcept_getMsg(except));
+                stExcept_free(except);
+            }stTryEnd
+    ;
+    unlockDatabase(cactusDisk);
+    free(dictionary);
+    loadDictionary(cactusDisk);
+}
+
 void cactusDisk_write(CactusDisk *cactusDisk) {
     Flower *flower;
-    int64_t recordSize;
+
+    checkWritable(cactusDisk);
 
     stList *removeRequests = stList_construct3(0, (void (*)(void *)) stIntTuple_destruct);
 
     st_logDebug("Starting to write the cactus to disk\n");
 
+    trainDictionary(cactusDisk);
+
+    stList *jobs = stList_construct3(0, (void (*)(void *)) writeJob_destruct);
     stSortedSetIterator *it = stSortedSet_getIterator(cactusDisk->flowers);
     //Sort flowers to update.
     while ((flower = stSortedSet_getNext(it)) != NULL) {
-        cactusDisk_addUpdateRequest(cactusDisk, flower);
+        stList_append(jobs, writeJob_constructForFlower(cactusDisk, flower));
     }
     stSortedSet_destructIterator(it);
+    runWriteJobs(cactusDisk, jobs);
+    stList_destruct(jobs);
 
     st_logDebug("Got the flowers to update\n");
 
@@ -649,7 +1387,7 @@ void cactusDisk_write(CactusDisk *cactusDisk) {
     while ((nameString = stSortedSet_getNext(it)) != NULL) {
         Name name = cactusMisc_stringToName(nameString);
         if (containsRecord(cactusDisk, name)) {
-            stList_append(cactusDisk->updateRequests, stKVDatabaseBulkRequest_constructUpdateRequest(name, &name, 0)); //We set it to null in the first atomic operation.
+            appendUpdateRequest(cactusDisk, stKVDatabaseBulkRequest_constructUpdateRequest(name, &name, 0), 0, 0); //We set it to null in the first atomic operation.
             stList_append(removeRequests, stIntTuple_construct1(name));
         }
     }
@@ -658,25 +1396,16 @@ void cactusDisk_write(CactusDisk *cactusDisk) {
     st_logDebug("Avoided updating nets marked for deletion\n");
 
     // Insert and/or update meta-sequences.
+    jobs = stList_construct3(0, (void (*)(void *)) writeJob_destruct);
     it = stSortedSet_getIterator(cactusDisk->metaSequences);
     MetaSequence *metaSequence;
     while ((metaSequence = stSortedSet_getNext(it)) != NULL) {
-        void *vA =
-                binaryRepresentation_makeBinaryRepresentation(metaSequence,
-                        (void (*)(void *, void (*)(const void * ptr, size_t size, size_t count))) metaSequence_writeBinaryRepresentation,
-                        &recordSize);
-        //Compression
-        vA = compress(vA, &recordSize);
-        if (!containsRecord(cactusDisk, metaSequence_getName(metaSequence))) {
-            stList_append(cactusDisk->updateRequests,
-                    stKVDatabaseBulkRequest_constructInsertRequest(metaSequence_getName(metaSequence), vA, recordSize));
-        } else {
-            stList_append(cactusDisk->updateRequests,
-                    stKVDatabaseBulkRequest_constructUpdateRequest(metaSequence_getName(metaSequence), vA, recordSize));
-        }
-        free(vA);
+        stList_append(jobs, writeJob_construct(cactusDisk, metaSequence, metaSequence_getName(metaSequence),
+                (void (*)(void *, void (*)(const void * ptr, size_t size, size_t count))) metaSequence_writeBinaryRepresentation));
     }
     stSortedSet_destructIterator(it);
+    runWriteJobs(cactusDisk, jobs);
+    stList_destruct(jobs);
 
     st_logDebug("Got the sequences we are going to add to the database.\n");
 
@@ -688,51 +1417,68 @@ void cactusDisk_write(CactusDisk *cactusDisk) {
 
     if (stList_length(cactusDisk->updateRequests) > 0) {
         st_logDebug("Going to write %" PRIi64 " updates\n", stList_length(cactusDisk->updateRequests));
+        lockDatabase(cactusDisk);
         stTry
             {
                 st_logDebug("Writing %" PRIi64 " updates\n", stList_length(cactusDisk->updateRequests));
                 assert(stList_length(cactusDisk->updateRequests) > 0);
+                int64_t startTime = cactusDiskStats_getTime();
                 stKVDatabase_bulkSetRecords(cactusDisk->database, cactusDisk->updateRequests);
+                cactusDiskStats_addCall(cactusDisk->stats, CACTUS_DISK_OP_BULK_SET, startTime,
+                        stList_length(cactusDisk->updateRequests), cactusDisk->updateRequestBytes,
+                        cactusDisk->updateRequestUncompressedBytes);
             }
             stCatch(except)
                 {
+                    unlockDatabase(cactusDisk);
                     stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
                             "Failed when trying to set records in updating the cactus disk");
                 }stTryEnd
         ;
+        unlockDatabase(cactusDisk);
     }
 
     st_logDebug("Updated the database with inserts\n");
 
     if (stList_length(removeRequests) > 0) {
+        lockDatabase(cactusDisk);
         stTry
             {
+                int64_t startTime = cactusDiskStats_getTime();
                 stKVDatabase_bulkRemoveRecords(cactusDisk->database, removeRequests);
+                cactusDiskStats_addCall(cactusDisk->stats, CACTUS_DISK_OP_BULK_REMOVE, startTime,
+                        stList_length(removeRequests), 0, 0);
             }
             stCatch(except)
                 {
+                    unlockDatabase(cactusDisk);
                     stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
                             "Failed when trying to remove records in updating the cactus disk");
                 }stTryEnd
         ;
+        unlockDatabase(cactusDisk);
     }
 
     st_logDebug("Now removed flowers we don't need\n");
 
     stList_destruct(cactusDisk->updateRequests);
     cactusDisk->updateRequests = stList_construct3(0, (void (*)(void *)) stKVDatabaseBulkRequest_destruct);
+    cactusDisk->updateRequestBytes = 0;
+    cactusDisk->updateRequestUncompressedBytes = 0;
     stList_destruct(removeRequests);
 
     st_logDebug("Finished writing to the database\n");
 }
 
-stList *cactusDisk_getFlowers(CactusDisk *cactusDisk, stList *flowerNames) {
-    stList *records = getRecords(cactusDisk, flowerNames, "flowers");
+static stList *loadFlowers(CactusDisk *cactusDisk, stList *flowerNames, stList *records) {
+    /*
+     * Called with the cactus disk locked.
+     */
     assert(stList_length(flowerNames) == stList_length(records));
     stList *flowers = stList_construct();
     for (int64_t i = 0; i < stList_length(flowerNames); i++) {
         Name flowerName = *((int64_t *) stList_get(flowerNames, i));
-        static Flower flower;
+        Flower flower;
         flower.name = flowerName;
         Flower *flower2;
         if ((flower2 = stSortedSet_search(cactusDisk->flowers, &flower)) == NULL) {
@@ -744,72 +1490,253 @@ stList *cactusDisk_getFlowers(CactusDisk *cactusDisk, stList *flowerNames) {
         }
         stList_append(flowers, flower2);
     }
+    return flowers;
+}
+
+stList *cactusDisk_getFlowers(CactusDisk *cactusDisk, stList *flowerNames) {
+    cactusDisk_lock(cactusDisk);
+    stList *records = NULL;
+    stTry
+    {
+        records = getRecords(cactusDisk, flowerNames, "flowers");
+    }
+    stCatch(except)
+    {
+        cactusDisk_unlock(cactusDisk);
+        stThrowNewCause(except, CACTUS_DISK_EXCEPTION_ID, "Could not get a bulk set of flowers");
+    }stTryEnd
+    ;
+    stList *flowers = loadFlowers(cactusDisk, flowerNames, records);
+    cactusDisk_unlock(cactusDisk);
     stList_destruct(records);
     return flowers;
 }
 
+stList *cactusDisk_loadFlowers(CactusDisk *cactusDisk, stList *flowerNames, stList *records, int64_t *recordSizes) {
+    cactusDisk_lock(cactusDisk);
+    if (cactusDisk->cache != NULL) { //Cache the records, as if they had been fetched by getRecords
+        for (int64_t i = 0; i < stList_length(flowerNames); i++) {
+            Name flowerName = *((int64_t *) stList_get(flowerNames, i));
+            if (!recordCache_containsRecord(cactusDisk->cache, flowerName)) {
+                recordCache_setRecord(cactusDisk->cache, flowerName, stList_get(records, i), recordSizes[i]);
+            }
+        }
+    }
+    stList *flowers = loadFlowers(cactusDisk, flowerNames, records);
+    cactusDisk_unlock(cactusDisk);
+    return flowers;
+}
+
 Flower *cactusDisk_getFlower(CactusDisk *cactusDisk, Name flowerName) {
-    static Flower flower;
+    Flower flower;
+    cactusDisk_lock(cactusDisk);
     flower.name = flowerName;
     Flower *flower2;
-    if ((flower2 = stSortedSet_search(cactusDisk->flowers, &flower)) != NULL) {
-        return flower2;
-    }
-    void *cA = getRecord(cactusDisk, flowerName, "flower", NULL);
-
-    if (cA == NULL) {
-        return NULL;
+    if ((flower2 = stSortedSet_search(cactusDisk->flowers, &flower)) == NULL) {
+        void *cA = NULL;
+        stTry
+        {
+            cA = getRecord(cactusDisk, flowerName, "flower", NULL);
+        }
+        stCatch(except)
+        {
+            cactusDisk_unlock(cactusDisk);
+            stThrowNewCause(except, CACTUS_DISK_EXCEPTION_ID, "Could not get the flower %" PRIi64, flowerName);
+        }stTryEnd
+        ;
+        if (cA != NULL) {
+            void *cA2 = cA;
+            flower2 = flower_loadFromBinaryRepresentation(&cA2, cactusDisk);
+            free(cA);
+        }
     }
-    void *cA2 = cA;
-    flower2 = flower_loadFromBinaryRepresentation(&cA2, cactusDisk);
-    free(cA);
+    cactusDisk_unlock(cactusDisk);
     return flower2;
 }
 
 MetaSequence *cactusDisk_getMetaSequence(CactusDisk *cactusDisk, Name metaSequenceName) {
-    static MetaSequence metaSequence;
+    MetaSequence metaSequence;
+    cactusDisk_lock(cactusDisk);
     metaSequence.name = metaSequenceName;
     MetaSequence *metaSequence2;
-    if ((metaSequence2 = stSortedSet_search(cactusDisk->metaSequences, &metaSequence)) != NULL) {
-        return metaSequence2;
-    }
-    void *cA = getRecord(cactusDisk, metaSequenceName, "metaSequence", NULL);
-    if (cA == NULL) {
-        return NULL;
+    if ((metaSequence2 = stSortedSet_search(cactusDisk->metaSequences, &metaSequence)) == NULL) {
+        void *cA = NULL;
+        stTry
+        {
+            cA = getRecord(cactusDisk, metaSequenceName, "metaSequence", NULL);
+        }
+        stCatch(except)
+        {
+            cactusDisk_unlock(cactusDisk);
+            stThrowNewCause(except, CACTUS_DISK_EXCEPTION_ID, "Could not get the meta sequence %" PRIi64, metaSequenceName);
+        }stTryEnd
+        ;
+        if (cA != NULL) {
+            void *cA2 = cA;
+            metaSequence2 = metaSequence_loadFromBinaryRepresentation(&cA2, cactusDisk);
+            free(cA);
+        }
     }
-    void *cA2 = cA;
-    metaSequence2 = metaSequence_loadFromBinaryRepresentation(&cA2, cactusDisk);
-    free(cA);
+    cactusDisk_unlock(cactusDisk);
     return metaSequence2;
 }
 
+/*
+ * Functions to write snapshots.
+ */
+
+static void appendName(stList *names, Name name) {
+    int64_t *k = st_malloc(sizeof(int64_t));
+    k[0] = name;
+    stList_append(names, k);
+}
+
+static void writeSnapshotRecords(CactusDisk *cactusDisk, SnapshotWriter *writer, stList *objectNames, char *type) {
+    /*
+     * Copies the stored records to the snapshot, getting them in batches.
+     */
+    for (int64_t i = 0; i < stList_length(objectNames); i += CACTUS_DISK_SNAPSHOT_BATCH_SIZE) {
+        stList *batch = stList_construct();
+        for (int64_t j = i; j < stList_length(objectNames) && j < i + CACTUS_DISK_SNAPSHOT_BATCH_SIZE; j++) {
+            stList_append(batch, stList_get(objectNames, j));
+        }
+        RawRecords *rawRecords = NULL;
+        lockDatabase(cactusDisk);
+        stTry
+            {
+                rawRecords = rawRecords_get(cactusDisk, batch);
+            }
+            stCatch(except)
+                {
+                    unlockDatabase(cactusDisk);
+                    stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
+                            "An unknown database error occurred when getting %s to write to a snapshot", type);
+                }stTryEnd
+        ;
+        unlockDatabase(cactusDisk);
+        for (int64_t j = 0; j < stList_length(batch); j++) {
+            Name objectName = *((int64_t *) stList_get(batch, j));
+            if (rawRecords->records[j] == NULL) {
+                stThrowNew(CACTUS_DISK_EXCEPTION_ID, "The record of %s %" PRIi64 " is missing from the cactus disk",
+                        type, objectName);
+            }
+            snapshotWriter_addRecord(writer, objectName, rawRecords->records[j], rawRecords->recordSizes[j]);
+        }
+        rawRecords_destruct(rawRecords);
+        stList_destruct(batch);
+    }
+}
+
+void cactusDisk_writeSnapshot(CactusDisk *cactusDisk, Name rootFlowerName, const char *snapshotFile) {
+    /*
+     * Walks the flowers nested in the root flower, unloading those it loads, to get the names of
+     * the flowers, meta sequences and string chunks to write.
+     */
+    stList *flowerNames = stList_construct3(0, free);
+    stList *metaSequenceNames = stList_construct3(0, free);
+    stList *stringNames = stList_construct3(0, free);
+    stSortedSet *metaSequencesSeen = stSortedSet_construct3((int (*)(const void *, const void *)) stIntTuple_cmpFn,
+            (void (*)(void *)) stIntTuple_destruct);
+    stList *stack = stList_construct3(0, free);
+    appendName(stack, rootFlowerName);
+    while (stList_length(stack) > 0) {
+        int64_t *flowerName = stList_pop(stack);
+        stList_append(flowerNames, flowerName);
+        bool loaded = cactusDisk_flowerIsLoaded(cactusDisk, *flowerName);
+        Flower *flower = cactusDisk_getFlower(cactusDisk, *flowerName);
+        if (flower == NULL) {
+            stThrowNew(CACTUS_DISK_EXCEPTION_ID, "The flower %" PRIi64 " is missing from the cactus disk", *flowerName);
+        }
+        Flower_GroupIterator *groupIt = flower_getGroupIterator(flower);
+        Group *group;
+        while ((group = flower_getNextGroup(groupIt)) != NULL) {
+            if (!group_isLeaf(group)) {
+                appendName(stack, group_getName(group));
+            }
+        }
+        flower_destructGroupIterator(groupIt);
+        Flower_SequenceIterator *sequenceIt = flower_getSequenceIterator(flower);
+        Sequence *sequence;
+        while ((sequence = flower_getNextSequence(sequenceIt)) != NULL) {
+            MetaSequence *metaSequence = sequence_getMetaSequence(sequence);
+            stIntTuple *metaSequenceName = stIntTuple_construct1(metaSequence_getName(metaSequence));
+            if (stSortedSet_search(metaSequencesSeen, metaSequenceName) != NULL) {
+                stIntTuple_destruct(metaSequenceName);
+                continue;
+            }
+            stSortedSet_insert(metaSequencesSeen, metaSequenceName);
+            appendName(metaSequenceNames, metaSequence_getName(metaSequence));
+            int64_t chunkNumber = (metaSequence_getLength(metaSequence) + CACTUS_DISK_SEQUENCE_CHUNK_SIZE - 1)
+                    / CACTUS_DISK_SEQUENCE_CHUNK_SIZE;
+            for (int64_t i = 0; i < chunkNumber; i++) {
+                appendName(stringNames, metaSequence->stringName + i);
+            }
+        }
+        flower_destructSequenceIterator(sequenceIt);
+        if (!loaded) {
+            flower_unload(flower);
+        }
+    }
+    stList_destruct(stack);
+    stSortedSet_destruct(metaSequencesSeen);
+
+    stList *parameterNames = stList_construct3(0, free);
+    appendName(parameterNames, CACTUS_DISK_PARAMETER_KEY);
+    if (containsRecord(cactusDisk, CACTUS_DISK_DICTIONARY_KEY)) {
+        appendName(parameterNames, CACTUS_DISK_DICTIONARY_KEY);
+    }
+
+    SnapshotWriter *writer = snapshotWriter_construct(snapshotFile);
+    writeSnapshotRecords(cactusDisk, writer, parameterNames, "parameters");
+    writeSnapshotRecords(cactusDisk, writer, flowerNames, "flower");
+    writeSnapshotRecords(cactusDisk, writer, metaSequenceNames, "metaSequence");
+    writeSnapshotRecords(cactusDisk, writer, stringNames, "string");
+    snapshotWriter_destruct(writer);
+    st_logInfo("Wrote %" PRIi64 " flowers, %" PRIi64 " meta sequences and %" PRIi64 " string chunks to the snapshot %s\n",
+            stList_length(flowerNames), stList_length(metaSequenceNames), stList_length(stringNames), snapshotFile);
+
+    stList_destruct(parameterNames);
+    stList_destruct(flowerNames);
+    stList_destruct(metaSequenceNames);
+    stList_destruct(stringNames);
+}
+
 /*
  * Private functions.
  */
 
 bool cactusDisk_flowerIsLoaded(CactusDisk *cactusDisk, Name flowerName) {
-    static Flower flower;
+    Flower flower;
+    cactusDisk_lock(cactusDisk);
     flower.name = flowerName;
-    return stSortedSet_search(cactusDisk->flowers, &flower) != NULL;
+    bool isLoaded = stSortedSet_search(cactusDisk->flowers, &flower) != NULL;
+    cactusDisk_unlock(cactusDisk);
+    return isLoaded;
 }
 
 void cactusDisk_addFlower(CactusDisk *cactusDisk, Flower *flower) {
+    cactusDisk_lock(cactusDisk);
     assert(stSortedSet_search(cactusDisk->flowers, flower) == NULL);
     stSortedSet_insert(cactusDisk->flowers, flower);
+    cactusDisk_unlock(cactusDisk);
 }
 
 void cactusDisk_removeFlower(CactusDisk *cactusDisk, Flower *flower) {
+    cactusDisk_lock(cactusDisk);
     assert(cactusDisk_flowerIsLoaded(cactusDisk, flower_getName(flower)));
     stSortedSet_remove(cactusDisk->flowers, flower);
+    cactusDisk_unlock(cactusDisk);
 }
 
 void cactusDisk_deleteFlowerFromDisk(CactusDisk *cactusDisk, Flower *flower) {
     char *nameString = cactusMisc_nameToString(flower_getName(flower));
+    cactusDisk_lock(cactusDisk);
     if (stSortedSet_search(cactusDisk->flowerNamesMarkedForDeletion, nameString) == NULL) {
         stSortedSet_insert(cactusDisk->flowerNamesMarkedForDeletion, nameString);
     } else {
         free(nameString);
     }
+    cactusDisk_unlock(cactusDisk);
 }
 
 void cactusDisk_setEventTree(CactusDisk *cactusDisk, EventTree *eventTree) {
@@ -817,66 +1744,178 @@ void cactusDisk_setEventTree(CactusDisk *cactusDisk, EventTree *eventTree) {
 }
 
 /*
- * Function to get unique ID.
+ * Functions to get unique IDs.
+ *
+ * IDs are leased from buckets of the ID space kept in the database, each lease being an increment of a bucket's
+ * counter. The first lease picks a random bucket, so that jobs running at once rarely use the same one, and
+ * later leases increment the same bucket, taking one round trip. The lease size doubles each time a lease is
+ * used up, up to CACTUS_DISK_MAX_LEASE_SIZE, so jobs that make many objects make few round trips, and once a
+ * lease is three quarters used the next one is taken by a background thread.
+ */
+
+static void setLease(CactusDisk *cactusDisk, Name uniqueNumber, Name maxUniqueNumber) {
+    cactusDisk->uniqueNumber = uniqueNumber;
+    cactusDisk->maxUniqueNumber = maxUniqueNumber;
+    cactusDisk->leaseStart = uniqueNumber;
+}
+
+static int64_t getNextLeaseSize(CactusDisk *cactusDisk) {
+    return cactusDisk->leaseSize * 2 > CACTUS_DISK_MAX_LEASE_SIZE ? CACTUS_DISK_MAX_LEASE_SIZE : cactusDisk->leaseSize * 2;
+}
+
+static void getBucketRange(Name keyName, int64_t *minimumValue, int64_t *maximumValue) {
+    assert(keyName >= -CACTUS_DISK_BUCKET_NUMBER);
+    assert(keyName < 0);
+    int64_t bucketSize = INT64_MAX / CACTUS_DISK_BUCKET_NUMBER;
+    *minimumValue = bucketSize * (llabs(keyName) - 1) + 1; //plus one for the reserved '0' value.
+    *maximumValue = *minimumValue + (bucketSize - 1);
+    assert(*minimumValue >= 1);
+    assert(*maximumValue <= INT64_MAX);
+    assert(*minimumValue < *maximumValue);
+}
+
+/*
+ * Increments the counter of an existing bucket, returning the new maximum, which is fatal if it overruns the bucket.
  */
+static Name incrementBucket(CactusDisk *cactusDisk, Name keyName, int64_t intervalSize) {
+    int64_t minimumValue, maximumValue;
+    getBucketRange(keyName, &minimumValue, &maximumValue);
+    int64_t startTime = cactusDiskStats_getTime();
+    Name maxUniqueNumber = stKVDatabase_incrementInt64(cactusDisk->database, keyName, intervalSize);
+    cactusDiskStats_addCall(cactusDisk->stats, CACTUS_DISK_OP_INCREMENT, startTime, 1, 0, 0);
+    Name uniqueNumber = maxUniqueNumber - intervalSize;
+    if (uniqueNumber <= 0 || uniqueNumber < minimumValue || uniqueNumber > maximumValue) {
+        st_errAbort("Got a non positive unique number %lli %lli %lli %lli", uniqueNumber,
+                maxUniqueNumber, minimumValue, maximumValue);
+    }
+    if (maxUniqueNumber >= maximumValue) {
+        st_errAbort("We have exhausted a bucket, which seems really unlikely");
+    }
+    return maxUniqueNumber;
+}
+
+static void *prefetchLease(CactusDisk *cactusDisk) {
+    /*
+     * Run by the lease thread. A database error is kept in leaseException and rethrown by
+     * finishPrefetchingLease on the thread using the lease. The exception stack is shared by the threads,
+     * so the try frame is only open with the database lock held, as are those around the other database calls.
+     */
+    lockDatabase(cactusDisk);
+    stTry
+        {
+            cactusDisk->prefetchedMaxUniqueNumber = incrementBucket(cactusDisk, cactusDisk->leaseBucket,
+                    cactusDisk->leaseSize);
+            cactusDisk->prefetchedUniqueNumber = cactusDisk->prefetchedMaxUniqueNumber - cactusDisk->leaseSize;
+            cactusDiskStats_addLease(cactusDisk->stats, 1, 1, cactusDisk->leaseSize);
+        }
+        stCatch(except)
+            {
+                cactusDisk->leaseException = except;
+            }stTryEnd
+    ;
+    unlockDatabase(cactusDisk);
+    return NULL;
+}
+
+static void startPrefetchingLease(CactusDisk *cactusDisk) {
+    assert(!cactusDisk->leasePrefetching);
+    assert(cactusDisk->prefetchedUniqueNumber == cactusDisk->prefetchedMaxUniqueNumber);
+    //The prefetched lease is the size the next lease would be.
+    cactusDisk->leaseSize = getNextLeaseSize(cactusDisk);
+    if (pthread_create(&cactusDisk->leaseThread, NULL, (void *(*)(void *)) prefetchLease, cactusDisk) != 0) {
+        st_errAbort("Could not create the thread to prefetch unique IDs");
+    }
+    cactusDisk->leasePrefetching = 1;
+}
+
+static void finishPrefetchingLease(CactusDisk *cactusDisk) {
+    if (cactusDisk->leasePrefetching) {
+        pthread_join(cactusDisk->leaseThread, NULL);
+        cactusDisk->leasePrefetching = 0;
+        if (cactusDisk->leaseException != NULL) {
+            stExcept *except = cactusDisk->leaseException;
+            cactusDisk->leaseException = NULL;
+            stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
+                    "An unknown database error occurred when prefetching a lease of unique IDs");
+        }
+    }
+}
 
 void cactusDisk_getBlockOfUniqueIDs(CactusDisk *cactusDisk, int64_t intervalSize) {
-    intervalSize = intervalSize < CACTUS_DISK_NAME_INCREMENT ? CACTUS_DISK_NAME_INCREMENT : intervalSize;
+    checkWritable(cactusDisk);
+    bool wasPrefetching = cactusDisk->leasePrefetching;
+    finishPrefetchingLease(cactusDisk);
+    if (cactusDisk->prefetchedMaxUniqueNumber - cactusDisk->prefetchedUniqueNumber >= intervalSize) {
+        setLease(cactusDisk, cactusDisk->prefetchedUniqueNumber, cactusDisk->prefetchedMaxUniqueNumber);
+        cactusDisk->prefetchedUniqueNumber = cactusDisk->prefetchedMaxUniqueNumber = 0;
+        return;
+    }
+    //A prefetched lease too small for the interval is kept for a later call, and no lease is prefetched until it is used.
+    if (cactusDisk->leaseBucket != 0 && !wasPrefetching) { //Else the lease size has already grown.
+        cactusDisk->leaseSize = getNextLeaseSize(cactusDisk);
+    }
+    intervalSize = intervalSize < cactusDisk->leaseSize ? cactusDisk->leaseSize : intervalSize;
     bool done = 0;
     int64_t collisionCount = 0;
+    int64_t roundTrips = 0;
+    lockDatabase(cactusDisk);
     while (!done) {
         stTry
             {
-                Name keyName = st_randomInt(-CACTUS_DISK_BUCKET_NUMBER, 0);
-                assert(keyName >= -CACTUS_DISK_BUCKET_NUMBER);
-                assert(keyName < 0);
-                int64_t bucketSize = INT64_MAX / CACTUS_DISK_BUCKET_NUMBER;
-                int64_t minimumValue = bucketSize * (llabs(keyName) - 1) + 1; //plus one for the reserved '0' value.
-                int64_t maximumValue = minimumValue + (bucketSize - 1);
-                assert(minimumValue >= 1);
-                assert(maximumValue <= INT64_MAX);
-                assert(minimumValue < maximumValue);
-                if (stKVDatabase_containsRecord(cactusDisk->database, keyName)) {
-                    cactusDisk->maxUniqueNumber = stKVDatabase_incrementInt64(cactusDisk->database, keyName,
-                            intervalSize);
-                    cactusDisk->uniqueNumber = cactusDisk->maxUniqueNumber - intervalSize;
-                    if (cactusDisk->uniqueNumber <= 0 || cactusDisk->uniqueNumber < minimumValue
-                            || cactusDisk->uniqueNumber > maximumValue) {
-                        st_errAbort("Got a non positive unique number %lli %lli %lli %lli", cactusDisk->uniqueNumber,
-                                cactusDisk->maxUniqueNumber, minimumValue, maximumValue);
-                    }
-                    assert(cactusDisk->uniqueNumber >= minimumValue);
-                    assert(cactusDisk->uniqueNumber <= maximumValue);
-                    assert(cactusDisk->uniqueNumber > 0);
+                if (cactusDisk->leaseBucket != 0) { //Take the lease from the bucket the last came from.
+                    roundTrips++;
+                    Name maxUniqueNumber = incrementBucket(cactusDisk, cactusDisk->leaseBucket, intervalSize);
+                    setLease(cactusDisk, maxUniqueNumber - intervalSize, maxUniqueNumber);
+                    done = 1;
                 } else {
-                    stTry
-                        {
-                            stKVDatabase_insertInt64(cactusDisk->database, keyName, minimumValue);
-                        }
-                        stCatch(except)
+                    Name keyName = st_randomInt(-CACTUS_DISK_BUCKET_NUMBER, 0);
+                    int64_t minimumValue, maximumValue;
+                    getBucketRange(keyName, &minimumValue, &maximumValue);
+                    int64_t startTime = cactusDiskStats_getTime();
+                    roundTrips++;
+                    bool containsKey = stKVDatabase_containsRecord(cactusDisk->database, keyName);
+                    cactusDiskStats_addCall(cactusDisk->stats, CACTUS_DISK_OP_CONTAINS, startTime, 1, 0, 0);
+                    if (containsKey) {
+                        roundTrips++;
+                        Name maxUniqueNumber = incrementBucket(cactusDisk, keyName, intervalSize);
+                        cactusDisk->leaseBucket = keyName;
+                        setLease(cactusDisk, maxUniqueNumber - intervalSize, maxUniqueNumber);
+                        assert(cactusDisk->uniqueNumber >= minimumValue);
+                        assert(cactusDisk->uniqueNumber <= maximumValue);
+                        assert(cactusDisk->uniqueNumber > 0);
+                        done = 1;
+                    } else {
+                        stTry
                             {
-                                collisionCount++;
-                                if (collisionCount >= 10) {
-                                    stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
-                                            "Repeated unknown database errors occurred when we tried to get a unique ID, collision count %" PRIi64 "",
-                                            collisionCount);
-                                } else {
-                                    st_logDebug("Got an exception when trying to insert a uid record: %s",
-                                            stExcept_getMsg(except));
-                                }
-                            }stTryEnd
-                    ;
-                    continue;
-                }
-                if (cactusDisk->maxUniqueNumber >= maximumValue) {
-                    st_errAbort("We have exhausted a bucket, which seems really unlikely");
+                                startTime = cactusDiskStats_getTime();
+                                roundTrips++;
+                                stKVDatabase_insertInt64(cactusDisk->database, keyName, minimumValue);
+                                cactusDiskStats_addCall(cactusDisk->stats, CACTUS_DISK_OP_INSERT, startTime, 1,
+                                        sizeof(int64_t), sizeof(int64_t));
+                                cactusDisk->leaseBucket = keyName; //So the lease is taken from the new bucket.
+                            }
+                            stCatch(except)
+                                {
+                                    collisionCount++;
+                                    if (collisionCount >= 10) {
+                                        unlockDatabase(cactusDisk);
+                                        stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
+                                                "Repeated unknown database errors occurred when we tried to get a unique ID, collision count %" PRIi64 "",
+                                                collisionCount);
+                                    } else {
+                                        st_logDebug("Got an exception when trying to insert a uid record: %s",
+                                                stExcept_getMsg(except));
+                                    }
+                                }stTryEnd
+                        ;
+                    }
                 }
-                done = 1;
             }
             stCatch(except)
                 {
                     collisionCount++;
                     if (collisionCount >= 10) {
+                        unlockDatabase(cactusDisk);
                         stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
                                 "Repeated unknown database errors occurred when we tried to get a unique ID, collision count %" PRIi64 "",
                                 collisionCount);
@@ -886,15 +1925,35 @@ void cactusDisk_getBlockOfUniqueIDs(CactusDisk *cactusDisk, int64_t intervalSize
                 }stTryEnd
         ;
     }
+    cactusDiskStats_addLease(cactusDisk->stats, 0, roundTrips, intervalSize);
+    unlockDatabase(cactusDisk);
 }
 
 int64_t cactusDisk_getUniqueIDInterval(CactusDisk *cactusDisk, int64_t intervalSize) {
+    cactusDisk_lock(cactusDisk);
     assert(cactusDisk->uniqueNumber <= cactusDisk->maxUniqueNumber);
     if (cactusDisk->uniqueNumber + intervalSize > cactusDisk->maxUniqueNumber) {
-        cactusDisk_getBlockOfUniqueIDs(cactusDisk, intervalSize);
+        stTry
+        {
+            cactusDisk_getBlockOfUniqueIDs(cactusDisk, intervalSize);
+        }
+        stCatch(except)
+        {
+            cactusDisk_unlock(cactusDisk);
+            stThrowNewCause(except, CACTUS_DISK_EXCEPTION_ID, "Could not get a block of unique IDs");
+        }stTryEnd
+        ;
     }
     Name uniqueNumber = cactusDisk->uniqueNumber;
     cactusDisk->uniqueNumber += intervalSize;
+    //Once three quarters of the lease are used, take the next in the background.
+    if (cactusDisk->leaseBucket != 0 && !cactusDisk->leasePrefetching
+            && cactusDisk->prefetchedUniqueNumber == cactusDisk->prefetchedMaxUniqueNumber
+            && 4 * (cactusDisk->uniqueNumber - cactusDisk->leaseStart)
+                    >= 3 * (cactusDisk->maxUniqueNumber - cactusDisk->leaseStart)) {
+        startPrefetchingLease(cactusDisk);
+    }
+    cactusDisk_unlock(cactusDisk);
     return uniqueNumber;
 }
 
@@ -902,12 +1961,29 @@ int64_t cactusDisk_getUniqueID(CactusDisk *cactusDisk) {
     return cactusDisk_getUniqueIDInterval(cactusDisk, 1);
 }
 
+void cactusDisk_lock(CactusDisk *cactusDisk) {
+    pthread_mutex_lock(&cactusDisk->lock);
+}
+
+void cactusDisk_unlock(CactusDisk *cactusDisk) {
+    pthread_mutex_unlock(&cactusDisk->lock);
+}
+
+void cactusDisk_setCacheSizes(CactusDisk *cactusDisk, int64_t cacheSize, int64_t stringCacheSize) {
+    if (cactusDisk->cache != NULL) {
+        recordCache_setMaxSize(cactusDisk->cache, cacheSize);
+    }
+    if (cactusDisk->stringCache != NULL) {
+        packedSequenceCache_setMaxSize(cactusDisk->stringCache, stringCacheSize);
+    }
+}
+
 void cactusDisk_clearStringCache(CactusDisk *cactusDisk) {
-    stCache_clear(cactusDisk->stringCache);
+    packedSequenceCache_clear(cactusDisk->stringCache);
 }
 
 void cactusDisk_clearCache(CactusDisk *cactusDisk) {
-    stCache_clear(cactusDisk->cache);
+    recordCache_clear(cactusDisk->cache);
 }
 
 EventTree *cactusDisk_getEventTree(CactusDisk *cactusDisk) {
@@ -7,19 +7,39 @@
 #ifndef CACTUS_DISK_PRIVATE_H_
 #define CACTUS_DISK_PRIVATE_H_
 
+#include <pthread.h>
 #include "cactusGlobals.h"
 
 struct _cactusDisk {
-    stKVDatabase *database;
+    stKVDatabase *database; //NULL if the records are read from a snapshot.
+    CactusDiskSnapshot *snapshot; //The snapshot the records are read from, or NULL.
     stSortedSet *metaSequences;
     stSortedSet *flowers;
     stSortedSet *flowerNamesMarkedForDeletion;
     stList *updateRequests;
-    stCache *cache;
-    stCache *stringCache;
+    int64_t updateRequestBytes; //The total compressed size of the records in updateRequests.
+    int64_t updateRequestUncompressedBytes; //Their total size before compression.
+    RecordCache *cache;
+    PackedSequenceCache *stringCache;
     EventTree *eventTree;
+    int64_t sequenceFormat; //How the sequence strings are stored, see cactusPackedSequence.h
+    RecordCodec *codec; //Used to compress the records written.
+    bool taggedRecords; //Non-zero if the records start with the tag of their codec, see cactusRecordCodec.h
     Name uniqueNumber;
     Name maxUniqueNumber;
+    Name leaseStart; //The first ID of the current lease of IDs, which ends at maxUniqueNumber.
+    int64_t leaseSize; //The size of the next lease, which grows as leases are used up.
+    Name leaseBucket; //The key of the bucket the leases are taken from, or 0 until the first lease.
+    Name prefetchedUniqueNumber; //A lease taken ahead of need, empty if equal to prefetchedMaxUniqueNumber.
+    Name prefetchedMaxUniqueNumber;
+    bool leasePrefetching; //Non-zero if leaseThread has been started and not joined.
+    pthread_t leaseThread;
+    stExcept *leaseException; //The error the lease thread got, if any, rethrown when the lease is used.
+    BinaryRepresentationWriter *writer; //Buffer reused to serialise the objects written to the database.
+    int64_t writeThreads; //The number of threads cactusDisk_write serialises and compresses the records with.
+    CactusDiskStats *stats; //Timings of the database operations.
+    pthread_mutex_t databaseLock; //Serialises use of the database, which may be shared with a prefetching thread.
+    pthread_mutex_t lock; //Recursive, serialises the threads working on different flowers at once, see cactusDisk_lock.
 };
 
 ////////////////////////////////////////////////
@@ -50,6 +70,21 @@ void cactusDisk_removeFlower(CactusDisk *cactusDisk, Flower *flower);
  */
 void cactusDisk_deleteFlowerFromDisk(CactusDisk *cactusDisk, Flower *flower);
 
+/*
+ * Fetches and decompresses the records of the given objects, without using the cache. The length of
+ * each record is written to the array recordSizes, which must be freed. This is safe to call from a thread
+ * other than the one using the cactus disk. Database errors are not thrown, instead NULL is returned and
+ * the error is written to exception, for the caller to rethrow on the thread using the cactus disk.
+ */
+stList *cactusDisk_fetchRecords(CactusDisk *cactusDisk, stList *objectNames, int64_t **recordSizes,
+        stExcept **exception);
+
+/*
+ * Loads the flowers from records returned by cactusDisk_fetchRecords, adding the records to the cache.
+ * Flowers that are already loaded are returned as they are.
+ */
+stList *cactusDisk_loadFlowers(CactusDisk *cactusDisk, stList *flowerNames, stList *records, int64_t *recordSizes);
+
 /*
  * Functions on meta sequences.
  */
@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "cactusGlobalsPrivate.h"
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define MAGIC_SIZE 8
+#define HEADER_SIZE (MAGIC_SIZE + sizeof(int64_t))
+#define FOOTER_SIZE (2 * sizeof(int64_t) + MAGIC_SIZE)
+
+typedef struct _snapshotIndexEntry {
+    int64_t name;
+    int64_t offset;
+    int64_t size;
+} SnapshotIndexEntry;
+
+struct _cactusDiskSnapshot {
+    char *fileName;
+    const char *data; //The mapping of the whole file.
+    int64_t dataSize;
+    const SnapshotIndexEntry *index;
+    int64_t recordNumber;
+};
+
+CactusDiskSnapshot *cactusDiskSnapshot_construct(const char *fileName) {
+    int fileHandle = open(fileName, O_RDONLY);
+    if (fileHandle < 0) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Could not open the cactus disk snapshot %s", fileName);
+    }
+    struct stat fileStat;
+    if (fstat(fileHandle, &fileStat) != 0 || fileStat.st_size < (off_t) (HEADER_SIZE + FOOTER_SIZE)) {
+        close(fileHandle);
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "The file %s is too small to be a cactus disk snapshot", fileName);
+    }
+    const char *data = mmap(NULL, fileStat.st_size, PROT_READ, MAP_SHARED, fileHandle, 0);
+    close(fileHandle); //The mapping stays valid.
+    if (data == MAP_FAILED) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Could not map the cactus disk snapshot %s", fileName);
+    }
+    CactusDiskSnapshot *snapshot = st_malloc(sizeof(CactusDiskSnapshot));
+    snapshot->fileName = stString_copy(fileName);
+    snapshot->data = data;
+    snapshot->dataSize = fileStat.st_size;
+    const char *footer = data + snapshot->dataSize - FOOTER_SIZE;
+    int64_t version, indexOffset;
+    memcpy(&version, data + MAGIC_SIZE, sizeof(int64_t));
+    memcpy(&indexOffset, footer, sizeof(int64_t));
+    memcpy(&snapshot->recordNumber, footer + sizeof(int64_t), sizeof(int64_t));
+    if (memcmp(data, CACTUS_DISK_SNAPSHOT_MAGIC, MAGIC_SIZE) != 0
+            || memcmp(footer + 2 * sizeof(int64_t), CACTUS_DISK_SNAPSHOT_MAGIC, MAGIC_SIZE) != 0
+            || version != CACTUS_DISK_SNAPSHOT_VERSION || indexOffset < (int64_t) HEADER_SIZE
+            || indexOffset % sizeof(int64_t) != 0 || indexOffset > snapshot->dataSize - (int64_t) FOOTER_SIZE
+            || (snapshot->dataSize - (int64_t) FOOTER_SIZE - indexOffset) % sizeof(SnapshotIndexEntry) != 0
+            || snapshot->recordNumber
+                    != (snapshot->dataSize - (int64_t) FOOTER_SIZE - indexOffset) / (int64_t) sizeof(SnapshotIndexEntry)) {
+        cactusDiskSnapshot_destruct(snapshot);
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "The file %s is not a complete cactus disk snapshot", fileName);
+    }
+    snapshot->index = (const SnapshotIndexEntry *) (data + indexOffset);
+    //The records are returned without further checks, so each must lie between the header and the index.
+    for (int64_t i = 0; i < snapshot->recordNumber; i++) {
+        const SnapshotIndexEntry *entry = &snapshot->index[i];
+        if (entry->offset < (int64_t) HEADER_SIZE || entry->offset > indexOffset || entry->size < 0
+                || entry->size > indexOffset - entry->offset || (i > 0 && entry->name <= snapshot->index[i - 1].name)) {
+            cactusDiskSnapshot_destruct(snapshot);
+            stThrowNew(CACTUS_DISK_EXCEPTION_ID, "The index of the cactus disk snapshot %s is corrupt", fileName);
+        }
+    }
+    //The index is read at random.
+    posix_madvise((void *) snapshot->index, snapshot->recordNumber * sizeof(SnapshotIndexEntry), POSIX_MADV_WILLNEED);
+    return snapshot;
+}
+
+void cactusDiskSnapshot_destruct(CactusDiskSnapshot *snapshot) {
+    munmap((void *) snapshot->data, snapshot->dataSize);
+    free(snapshot->fileName);
+    free(snapshot);
+}
+
+const char *cactusDiskSnapshot_getFileName(CactusDiskSnapshot *snapshot) {
+    return snapshot->fileName;
+}
+
+int64_t cactusDiskSnapshot_getRecordNumber(CactusDiskSnapshot *snapshot) {
+    return snapshot->recordNumber;
+}
+
+static const SnapshotIndexEntry *getIndexEntry(CactusDiskSnapshot *snapshot, Name name) {
+    int64_t low = 0, high = snapshot->recordNumber - 1;
+    while (low <= high) {
+        int64_t middle = low + (high - low) / 2;
+        const SnapshotIndexEntry *entry = &snapshot->index[middle];
+        if (entry->name == name) {
+            return entry;
+        }
+        if (entry->name < name) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return NULL;
+}
+
+const void *cactusDiskSnapshot_getRecord(CactusDiskSnapshot *snapshot, Name name, int64_t *recordSize) {
+    const SnapshotIndexEntry *entry = getIndexEntry(snapshot, name);
+    if (entry == NULL) {
+        return NULL;
+    }
+    *recordSize = entry->size;
+    return snapshot->data + entry->offset;
+}
+
+bool cactusDiskSnapshot_containsRecord(CactusDiskSnapshot *snapshot, Name name) {
+    return getIndexEntry(snapshot, name) != NULL;
+}
+
+struct _snapshotWriter {
+    char *fileName;
+    FILE *fileHandle;
+    int64_t offset; //The offset at which the next record is written.
+    SnapshotIndexEntry *index;
+    int64_t recordNumber;
+    int64_t maxRecordNumber;
+    bool failed; //Non-zero if a write failed.
+};
+
+static void snapshotWriter_write(SnapshotWriter *writer, const void *data, int64_t size) {
+    if (size > 0 && fwrite(data, 1, size, writer->fileHandle) != (size_t) size) {
+        writer->failed = 1;
+    }
+    writer->offset += size;
+}
+
+SnapshotWriter *snapshotWriter_construct(const char *fileName) {
+    FILE *fileHandle = fopen(fileName, "wb");
+    if (fileHandle == NULL) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Could not create the cactus disk snapshot %s", fileName);
+    }
+    SnapshotWriter *writer = st_calloc(1, sizeof(SnapshotWriter));
+    writer->fileName = stString_copy(fileName);
+    writer->fileHandle = fileHandle;
+    writer->maxRecordNumber = 1024;
+    writer->index = st_malloc(writer->maxRecordNumber * sizeof(SnapshotIndexEntry));
+    int64_t version = CACTUS_DISK_SNAPSHOT_VERSION;
+    snapshotWriter_write(writer, CACTUS_DISK_SNAPSHOT_MAGIC, MAGIC_SIZE);
+    snapshotWriter_write(writer, &version, sizeof(int64_t));
+    return writer;
+}
+
+void snapshotWriter_addRecord(SnapshotWriter *writer, Name name, const void *record, int64_t recordSize) {
+    if (writer->recordNumber == writer->maxRecordNumber) {
+        writer->maxRecordNumber *= 2;
+        writer->index = st_realloc(writer->index, writer->maxRecordNumber * sizeof(SnapshotIndexEntry));
+    }
+    SnapshotIndexEntry *entry = &writer->index[writer->recordNumber++];
+    entry->name = name;
+    entry->offset = writer->offset;
+    entry->size = recordSize;
+    snapshotWriter_write(writer, record, recordSize);
+}
+
+static int snapshotIndexEntry_cmp(const void *entry1, const void *entry2) {
+    Name name1 = ((const SnapshotIndexEntry *) entry1)->name, name2 = ((const SnapshotIndexEntry *) entry2)->name;
+    return name1 < name2 ? -1 : (name1 > name2 ? 1 : 0);
+}
+
+void snapshotWriter_destruct(SnapshotWriter *writer) {
+    qsort(writer->index, writer->recordNumber, sizeof(SnapshotIndexEntry), snapshotIndexEntry_cmp);
+    int64_t duplicate = -1;
+    for (int64_t i = 1; i < writer->recordNumber && duplicate == -1; i++) {
+        if (writer->index[i - 1].name == writer->index[i].name) {
+            duplicate = i;
+        }
+    }
+    Name duplicateName = duplicate != -1 ? writer->index[duplicate].name : 0;
+    char padding[sizeof(int64_t)] = { 0 };
+    snapshotWriter_write(writer, padding, (sizeof(int64_t) - writer->offset % sizeof(int64_t)) % sizeof(int64_t));
+    int64_t indexOffset = writer->offset;
+    snapshotWriter_write(writer, writer->index, writer->recordNumber * sizeof(SnapshotIndexEntry));
+    snapshotWriter_write(writer, &indexOffset, sizeof(int64_t));
+    snapshotWriter_write(writer, &writer->recordNumber, sizeof(int64_t));
+    snapshotWriter_write(writer, CACTUS_DISK_SNAPSHOT_MAGIC, MAGIC_SIZE);
+    bool failed = fclose(writer->fileHandle) != 0 || writer->failed;
+    stExcept *except = NULL;
+    if (duplicate != -1) {
+        except = stExcept_new(CACTUS_DISK_EXCEPTION_ID, "The record %" PRIi64 " was added twice to the cactus disk snapshot %s",
+                duplicateName, writer->fileName);
+    } else if (failed) {
+        except = stExcept_new(CACTUS_DISK_EXCEPTION_ID, "Could not write the cactus disk snapshot %s", writer->fileName);
+    }
+    free(writer->fileName);
+    free(writer->index);
+    free(writer);
+    if (except != NULL) {
+        stThrow(except);
+    }
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_DISK_SNAPSHOT_H_
+#define CACTUS_DISK_SNAPSHOT_H_
+
+#include "cactusGlobals.h"
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Functions for immutable snapshots of the records of a cactus disk.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+/*
+ * A snapshot file holds records keyed by name, exactly as they are stored in the database. It is laid out as
+ * a header, the records, an index of the records sorted by name, and a footer locating the index:
+ *
+ * header: "CACTSNAP", version (int64)
+ * records: the bytes of each record, one after another
+ * index: for each record, its name, offset in the file and size (int64s), sorted by name
+ * footer: the offset of the index, the number of records (int64s), "CACTSNAP"
+ *
+ * The integers are in the byte order of the machine that wrote the snapshot, and the index is 8 byte aligned.
+ */
+#define CACTUS_DISK_SNAPSHOT_MAGIC "CACTSNAP"
+#define CACTUS_DISK_SNAPSHOT_VERSION 1
+
+typedef struct _cactusDiskSnapshot CactusDiskSnapshot;
+
+/*
+ * Maps the snapshot file into memory read only, throwing a CACTUS_DISK_EXCEPTION_ID if it can not be opened
+ * or is not a snapshot. The mapping is shared, so processes reading the same snapshot share its pages.
+ */
+CactusDiskSnapshot *cactusDiskSnapshot_construct(const char *fileName);
+
+void cactusDiskSnapshot_destruct(CactusDiskSnapshot *snapshot);
+
+const char *cactusDiskSnapshot_getFileName(CactusDiskSnapshot *snapshot);
+
+int64_t cactusDiskSnapshot_getRecordNumber(CactusDiskSnapshot *snapshot);
+
+/*
+ * Returns the record, setting recordSize to its size, or NULL if it is not in the snapshot. The record points
+ * into the mapping, so is not copied, must not be freed or changed, and is valid until the snapshot is destructed.
+ * Safe to call from several threads at once.
+ */
+const void *cactusDiskSnapshot_getRecord(CactusDiskSnapshot *snapshot, Name name, int64_t *recordSize);
+
+bool cactusDiskSnapshot_containsRecord(CactusDiskSnapshot *snapshot, Name name);
+
+typedef struct _snapshotWriter SnapshotWriter;
+
+/*
+ * Creates a snapshot file to add records to, throwing a CACTUS_DISK_EXCEPTION_ID if it can not be created.
+ * The records are written as they are added, and only their index is kept in memory.
+ */
+SnapshotWriter *snapshotWriter_construct(const char *fileName);
+
+/*
+ * Adds a record to the snapshot. Each name must be added at most once.
+ */
+void snapshotWriter_addRecord(SnapshotWriter *writer, Name name, const void *record, int64_t recordSize);
+
+/*
+ * Writes the index and footer of the snapshot and closes it, throwing a CACTUS_DISK_EXCEPTION_ID if a name
+ * was added twice or the file could not be written.
+ */
+void snapshotWriter_destruct(SnapshotWriter *writer);
+
+#endif
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "cactusGlobalsPrivate.h"
+#include <time.h>
+
+static const char *opNames[CACTUS_DISK_OP_NUMBER] = { "bulkGet", "bulkSet", "bulkRemove", "get", "contains",
+        "insert", "increment", "compress", "decompress" };
+
+typedef struct _opStats {
+    int64_t calls;
+    int64_t records;
+    int64_t compressedBytes;
+    int64_t uncompressedBytes;
+    int64_t totalTime; //In nanoseconds.
+    int64_t maxTime;
+    int64_t histogram[CACTUS_DISK_STATS_HISTOGRAM_SIZE];
+} OpStats;
+
+typedef struct _leaseStats {
+    int64_t leases;
+    int64_t roundTrips;
+    int64_t ids;
+} LeaseStats;
+
+struct _cactusDiskStats {
+    OpStats ops[CACTUS_DISK_OP_NUMBER];
+    LeaseStats leases[2]; //Indexed by whether the leases were prefetched.
+    pthread_mutex_t lock; //The operations may be timed by the write and prefetching threads.
+};
+
+CactusDiskStats *cactusDiskStats_construct(void) {
+    CactusDiskStats *stats = st_calloc(1, sizeof(CactusDiskStats));
+    pthread_mutex_init(&stats->lock, NULL);
+    return stats;
+}
+
+void cactusDiskStats_destruct(CactusDiskStats *stats) {
+    pthread_mutex_destroy(&stats->lock);
+    free(stats);
+}
+
+int64_t cactusDiskStats_getTime(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return ((int64_t) time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+static int64_t getHistogramBucket(int64_t time) {
+    int64_t bucket = 0;
+    for (int64_t microseconds = time / 1000; microseconds > 0 && bucket < CACTUS_DISK_STATS_HISTOGRAM_SIZE - 1;
+            microseconds >>= 1) {
+        bucket++;
+    }
+    return bucket;
+}
+
+void cactusDiskStats_addCall(CactusDiskStats *stats, int64_t op, int64_t startTime, int64_t records,
+        int64_t compressedBytes, int64_t uncompressedBytes) {
+    assert(op >= 0 && op < CACTUS_DISK_OP_NUMBER);
+    int64_t time = cactusDiskStats_getTime() - startTime;
+    pthread_mutex_lock(&stats->lock);
+    OpStats *opStats = &stats->ops[op];
+    opStats->calls++;
+    opStats->records += records;
+    opStats->compressedBytes += compressedBytes;
+    opStats->uncompressedBytes += uncompressedBytes;
+    opStats->totalTime += time;
+    if (time > opStats->maxTime) {
+        opStats->maxTime = time;
+    }
+    opStats->histogram[getHistogramBucket(time)]++;
+    pthread_mutex_unlock(&stats->lock);
+}
+
+void cactusDiskStats_addBytes(CactusDiskStats *stats, int64_t op, int64_t compressedBytes, int64_t uncompressedBytes) {
+    assert(op >= 0 && op < CACTUS_DISK_OP_NUMBER);
+    pthread_mutex_lock(&stats->lock);
+    stats->ops[op].compressedBytes += compressedBytes;
+    stats->ops[op].uncompressedBytes += uncompressedBytes;
+    pthread_mutex_unlock(&stats->lock);
+}
+
+int64_t cactusDiskStats_getCalls(CactusDiskStats *stats, int64_t op) {
+    return stats->ops[op].calls;
+}
+
+int64_t cactusDiskStats_getRecords(CactusDiskStats *stats, int64_t op) {
+    return stats->ops[op].records;
+}
+
+int64_t cactusDiskStats_getCompressedBytes(CactusDiskStats *stats, int64_t op) {
+    return stats->ops[op].compressedBytes;
+}
+
+int64_t cactusDiskStats_getUncompressedBytes(CactusDiskStats *stats, int64_t op) {
+    return stats->ops[op].uncompressedBytes;
+}
+
+void cactusDiskStats_addLease(CactusDiskStats *stats, bool prefetched, int64_t roundTrips, int64_t size) {
+    pthread_mutex_lock(&stats->lock);
+    LeaseStats *leaseStats = &stats->leases[prefetched ? 1 : 0];
+    leaseStats->leases++;
+    leaseStats->roundTrips += roundTrips;
+    leaseStats->ids += size;
+    pthread_mutex_unlock(&stats->lock);
+}
+
+int64_t cactusDiskStats_getLeases(CactusDiskStats *stats, bool prefetched) {
+    return stats->leases[prefetched ? 1 : 0].leases;
+}
+
+int64_t cactusDiskStats_getLeaseRoundTrips(CactusDiskStats *stats, bool prefetched) {
+    return stats->leases[prefetched ? 1 : 0].roundTrips;
+}
+
+int64_t cactusDiskStats_getLeasedIDs(CactusDiskStats *stats, bool prefetched) {
+    return stats->leases[prefetched ? 1 : 0].ids;
+}
+
+char *cactusDiskStats_getJson(CactusDiskStats *stats) {
+    pthread_mutex_lock(&stats->lock);
+    stList *opStrings = stList_construct3(0, free);
+    for (int64_t op = 0; op < CACTUS_DISK_OP_NUMBER; op++) {
+        OpStats *opStats = &stats->ops[op];
+        //The histogram is written up to its last non-empty bucket.
+        int64_t histogramSize = CACTUS_DISK_STATS_HISTOGRAM_SIZE;
+        while (histogramSize > 0 && opStats->histogram[histogramSize - 1] == 0) {
+            histogramSize--;
+        }
+        stList *buckets = stList_construct3(0, free);
+        for (int64_t i = 0; i < histogramSize; i++) {
+            stList_append(buckets, stString_print("%" PRIi64, opStats->histogram[i]));
+        }
+        char *histogram = stString_join2(",", buckets);
+        stList_append(opStrings, stString_print("\"%s\":{\"calls\":%" PRIi64 ",\"records\":%" PRIi64
+                ",\"compressedBytes\":%" PRIi64 ",\"uncompressedBytes\":%" PRIi64 ",\"totalMicroseconds\":%" PRIi64
+                ",\"maxMicroseconds\":%" PRIi64 ",\"latencyHistogram\":[%s]}", opNames[op], opStats->calls,
+                opStats->records, opStats->compressedBytes, opStats->uncompressedBytes, opStats->totalTime / 1000,
+                opStats->maxTime / 1000, histogram));
+        free(histogram);
+        stList_destruct(buckets);
+    }
+    for (int64_t i = 0; i < 2; i++) {
+        LeaseStats *leaseStats = &stats->leases[i];
+        stList_append(opStrings, stString_print("\"%sLeases\":{\"leases\":%" PRIi64 ",\"roundTrips\":%" PRIi64
+                ",\"ids\":%" PRIi64 "}", i ? "prefetched" : "synchronous", leaseStats->leases,
+                leaseStats->roundTrips, leaseStats->ids));
+    }
+    pthread_mutex_unlock(&stats->lock);
+    char *ops = stString_join2(",", opStrings);
+    char *json = stString_print("{\"cactusDiskStats\":{%s}}", ops);
+    free(ops);
+    stList_destruct(opStrings);
+    return json;
+}
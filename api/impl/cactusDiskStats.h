@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_DISK_STATS_H_
+#define CACTUS_DISK_STATS_H_
+
+#include "cactusGlobals.h"
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Functions for timing the database operations of the cactus disk.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+/*
+ * The operations timed.
+ */
+#define CACTUS_DISK_OP_BULK_GET 0
+#define CACTUS_DISK_OP_BULK_SET 1
+#define CACTUS_DISK_OP_BULK_REMOVE 2
+#define CACTUS_DISK_OP_GET 3
+#define CACTUS_DISK_OP_CONTAINS 4
+#define CACTUS_DISK_OP_INSERT 5
+#define CACTUS_DISK_OP_INCREMENT 6
+#define CACTUS_DISK_OP_COMPRESS 7
+#define CACTUS_DISK_OP_DECOMPRESS 8
+#define CACTUS_DISK_OP_NUMBER 9
+
+/*
+ * The number of buckets in the latency histograms. Bucket 0 counts the calls taking less than a
+ * microsecond, and bucket i > 0 those taking 2^(i-1) to 2^i microseconds, the last bucket
+ * counting all the longer calls.
+ */
+#define CACTUS_DISK_STATS_HISTOGRAM_SIZE 32
+
+typedef struct _cactusDiskStats CactusDiskStats;
+
+CactusDiskStats *cactusDiskStats_construct(void);
+
+void cactusDiskStats_destruct(CactusDiskStats *stats);
+
+/*
+ * Returns the time from a monotonic clock in nanoseconds, used to time the operations.
+ */
+int64_t cactusDiskStats_getTime(void);
+
+/*
+ * Adds a call of the operation that started at startTime (from cactusDiskStats_getTime) and has
+ * just finished, on the given number of records and bytes. Safe to call from several threads at once.
+ */
+void cactusDiskStats_addCall(CactusDiskStats *stats, int64_t op, int64_t startTime, int64_t records,
+        int64_t compressedBytes, int64_t uncompressedBytes);
+
+/*
+ * Adds bytes to the counts of the operation, for calls whose bytes are only known after they are counted.
+ */
+void cactusDiskStats_addBytes(CactusDiskStats *stats, int64_t op, int64_t compressedBytes, int64_t uncompressedBytes);
+
+int64_t cactusDiskStats_getCalls(CactusDiskStats *stats, int64_t op);
+
+int64_t cactusDiskStats_getRecords(CactusDiskStats *stats, int64_t op);
+
+int64_t cactusDiskStats_getCompressedBytes(CactusDiskStats *stats, int64_t op);
+
+int64_t cactusDiskStats_getUncompressedBytes(CactusDiskStats *stats, int64_t op);
+
+/*
+ * Adds a lease of unique IDs of the given size, taken with the given number of database round trips,
+ * either by the thread that needed it or prefetched in the background.
+ */
+void cactusDiskStats_addLease(CactusDiskStats *stats, bool prefetched, int64_t roundTrips, int64_t size);
+
+int64_t cactusDiskStats_getLeases(CactusDiskStats *stats, bool prefetched);
+
+int64_t cactusDiskStats_getLeaseRoundTrips(CactusDiskStats *stats, bool prefetched);
+
+int64_t cactusDiskStats_getLeasedIDs(CactusDiskStats *stats, bool prefetched);
+
+/*
+ * Returns the counts of all the operations and leases as a single line of JSON, which must be freed.
+ */
+char *cactusDiskStats_getJson(CactusDiskStats *stats);
+
+#endif
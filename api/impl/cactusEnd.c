@@ -31,10 +31,12 @@ End *end_construct2(bool side, bool isAttached, Flower *flower) {
 End *end_construct3(Name name, int64_t isStub, int64_t isAttached,
         int64_t side, Flower *flower) {
     End *end;
-    end = st_malloc(sizeof(End));
-    end->rEnd = st_malloc(sizeof(End));
+    //The contents and both orientations are allocated together.
+    EndContents *endContents = flowerArena_allocate(flower_getArena(flower), sizeof(EndContents) + 2 * sizeof(End));
+    end = (End *) (endContents + 1);
+    end->rEnd = end + 1;
     end->rEnd->rEnd = end;
-    end->endContents = st_malloc(sizeof(EndContents));
+    end->endContents = endContents;
     end->rEnd->endContents = end->endContents;
 
     end->orientation = 1;
@@ -98,8 +100,9 @@ End *end_copyConstruct(End *end, Flower *newFlower) {
 
 void end_destruct(End *end) {
     Cap *cap;
+    Flower *flower = end_getFlower(end);
     //remove from flower.
-    flower_removeEnd(end_getFlower(end), end);
+    flower_removeEnd(flower, end);
 
     //remove from group.
     end_setGroup(end, NULL);
@@ -111,9 +114,7 @@ void end_destruct(End *end) {
     //now the actual instances.
     stSortedSet_destruct(end->endContents->caps);
 
-    free(end->endContents);
-    free(end->rEnd);
-    free(end);
+    flowerArena_free(flower_getArena(flower), end->endContents, sizeof(EndContents) + 2 * sizeof(End));
 }
 
 void end_setBlock(End *end, Block *block) {
@@ -372,6 +373,7 @@ void end_removeInstance(End *end, Cap *cap) {
 }
 
 void end_setFlower(End *end, Flower *flower) {
+    flower_adoptArenas(flower, end_getFlower(end));
     flower_removeEnd(end_getFlower(end), end);
     end->endContents->flower = flower;
     flower_addEnd(flower, end);
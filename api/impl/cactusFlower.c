@@ -63,6 +63,14 @@ static Flower *flower_construct3(Name name, CactusDisk *cactusDisk) {
     flower->chains = stSortedSet_construct3(flower_constructChainsP, NULL);
     flower->faces = stSortedSet_construct3(flower_constructFacesP, NULL);
 
+    flower->sequencesByName = nameIndex_construct();
+    flower->capsByName = nameIndex_construct();
+    flower->endsByName = nameIndex_construct();
+    flower->segmentsByName = nameIndex_construct();
+    flower->blocksByName = nameIndex_construct();
+    flower->groupsByName = nameIndex_construct();
+    flower->chainsByName = nameIndex_construct();
+
     flower->parentFlowerName = NULL_NAME;
     flower->cactusDisk = cactusDisk;
     flower->faceIndex = 0;
@@ -72,6 +80,12 @@ static Flower *flower_construct3(Name name, CactusDisk *cactusDisk) {
     flower->builtFaces = 0;
     flower->builtTrees = 0;
 
+    flower->hasRecordHash = 0;
+    flower->recordHash = 0;
+
+    flower->arena = flowerArena_construct();
+    flower->adoptedArenas = stList_construct3(0, (void (*)(void *)) flowerArena_release);
+
     cactusDisk_addFlower(flower->cactusDisk, flower);
 
     return flower;
@@ -115,28 +129,39 @@ void flower_destruct(Flower *flower, int64_t recursive) {
         sequence_destruct(sequence);
     }
     stSortedSet_destruct(flower->sequences);
+    nameIndex_destruct(flower->sequencesByName);
 
     while ((chain = flower_getFirstChain(flower)) != NULL) {
         chain_destruct(chain);
     }
     stSortedSet_destruct(flower->chains);
+    nameIndex_destruct(flower->chainsByName);
 
     while ((end = flower_getFirstEnd(flower)) != NULL) {
         end_destruct(end);
     }
     stSortedSet_destruct(flower->caps);
     stSortedSet_destruct(flower->ends);
+    nameIndex_destruct(flower->capsByName);
+    nameIndex_destruct(flower->endsByName);
 
     while ((block = flower_getFirstBlock(flower)) != NULL) {
         block_destruct(block);
     }
     stSortedSet_destruct(flower->segments);
     stSortedSet_destruct(flower->blocks);
+    nameIndex_destruct(flower->segmentsByName);
+    nameIndex_destruct(flower->blocksByName);
 
     while ((group = flower_getFirstGroup(flower)) != NULL) {
         group_destruct(group);
     }
     stSortedSet_destruct(flower->groups);
+    nameIndex_destruct(flower->groupsByName);
+
+    //Frees the memory of the objects in one go.
+    flowerArena_release(flower->arena);
+    stList_destruct(flower->adoptedArenas);
 
     free(flower);
 }
@@ -158,11 +183,7 @@ Sequence *flower_getFirstSequence(Flower *flower) {
 }
 
 Sequence *flower_getSequence(Flower *flower, Name name) {
-    Sequence sequence;
-    MetaSequence metaSequence;
-    sequence.metaSequence = &metaSequence;
-    metaSequence.name = name;
-    return stSortedSet_search(flower->sequences, &sequence);
+    return nameIndex_search(flower->sequencesByName, name);
 }
 
 int64_t flower_getSequenceNumber(Flower *flower) {
@@ -194,11 +215,7 @@ Cap *flower_getFirstCap(Flower *flower) {
 }
 
 Cap *flower_getCap(Flower *flower, Name name) {
-    Cap cap;
-    CapContents capContents;
-    cap.capContents = &capContents;
-    cap.capContents->instance = name;
-    return stSortedSet_search(flower->caps, &cap);
+    return nameIndex_search(flower->capsByName, name);
 }
 
 int64_t flower_getCapNumber(Flower *flower) {
@@ -230,12 +247,7 @@ End *flower_getFirstEnd(Flower *flower) {
 }
 
 End *flower_getEnd(Flower *flower, Name name) {
-    End end;
-    EndContents endContents;
-    end.endContents = &endContents;
-    endContents.name = name;
-    end.orientation = 1;
-    return stSortedSet_search(flower->ends, &end);
+    return nameIndex_search(flower->endsByName, name);
 }
 
 int64_t flower_getEndNumber(Flower *flower) {
@@ -292,9 +304,7 @@ Segment *flower_getFirstSegment(Flower *flower) {
 }
 
 Segment *flower_getSegment(Flower *flower, Name name) {
-    Segment segment;
-    segment.name = name;
-    return stSortedSet_search(flower->segments, &segment);
+    return nameIndex_search(flower->segmentsByName, name);
 }
 
 int64_t flower_getSegmentNumber(Flower *flower) {
@@ -326,11 +336,7 @@ Block *flower_getFirstBlock(Flower *flower) {
 }
 
 Block *flower_getBlock(Flower *flower, Name name) {
-    Block block;
-    BlockContents blockContents;
-    block.blockContents = &blockContents;
-    blockContents.name = name;
-    return stSortedSet_search(flower->blocks, &block);
+    return nameIndex_search(flower->blocksByName, name);
 }
 
 int64_t flower_getBlockNumber(Flower *flower) {
@@ -362,9 +368,7 @@ Group *flower_getFirstGroup(Flower *flower) {
 }
 
 Group *flower_getGroup(Flower *flower, Name flowerName) {
-    Group group;
-    group.name = flowerName;
-    return stSortedSet_search(flower->groups, &group);
+    return nameIndex_search(flower->groupsByName, flowerName);
 }
 
 int64_t flower_getGroupNumber(Flower *flower) {
@@ -409,9 +413,7 @@ Chain *flower_getFirstChain(Flower *flower) {
 }
 
 Chain *flower_getChain(Flower *flower, Name name) {
-    Chain chain;
-    chain.name = name;
-    return stSortedSet_search(flower->chains, &chain);
+    return nameIndex_search(flower->chainsByName, name);
 }
 
 int64_t flower_getChainNumber(Flower *flower) {
@@ -796,82 +798,115 @@ void flower_unloadParent(Flower *flower) {
  * Private functions
  */
 
+FlowerArena *flower_getArena(Flower *flower) {
+    return flower->arena;
+}
+
+static void flower_adoptArena(Flower *flower, FlowerArena *arena) {
+    if (arena == flower->arena || stList_contains(flower->adoptedArenas, arena)) {
+        return;
+    }
+    flowerArena_retain(arena);
+    stList_append(flower->adoptedArenas, arena);
+}
+
+void flower_adoptArenas(Flower *flower, Flower *otherFlower) {
+    flower_adoptArena(flower, otherFlower->arena);
+    for (int64_t i = 0; i < stList_length(otherFlower->adoptedArenas); i++) {
+        flower_adoptArena(flower, stList_get(otherFlower->adoptedArenas, i));
+    }
+}
+
 void flower_addSequence(Flower *flower, Sequence *sequence) {
-    assert(stSortedSet_search(flower->sequences, sequence) == NULL);
+    assert(nameIndex_search(flower->sequencesByName, sequence_getName(sequence)) == NULL);
     stSortedSet_insert(flower->sequences, sequence);
+    nameIndex_insert(flower->sequencesByName, sequence_getName(sequence), sequence);
 }
 
 void flower_removeSequence(Flower *flower, Sequence *sequence) {
-    assert(stSortedSet_search(flower->sequences, sequence) != NULL);
+    assert(nameIndex_search(flower->sequencesByName, sequence_getName(sequence)) == sequence);
     stSortedSet_remove(flower->sequences, sequence);
+    nameIndex_remove(flower->sequencesByName, sequence_getName(sequence));
 }
 
 void flower_addCap(Flower *flower, Cap *cap) {
     cap = cap_getPositiveOrientation(cap);
-    assert(stSortedSet_search(flower->caps, cap) == NULL);
+    assert(nameIndex_search(flower->capsByName, cap_getName(cap)) == NULL);
     stSortedSet_insert(flower->caps, cap);
+    nameIndex_insert(flower->capsByName, cap_getName(cap), cap);
 }
 
 void flower_removeCap(Flower *flower, Cap *cap) {
     cap = cap_getPositiveOrientation(cap);
-    assert(stSortedSet_search(flower->caps, cap) != NULL);
+    assert(nameIndex_search(flower->capsByName, cap_getName(cap)) == cap);
     stSortedSet_remove(flower->caps, cap);
+    nameIndex_remove(flower->capsByName, cap_getName(cap));
 }
 
 void flower_addEnd(Flower *flower, End *end) {
     end = end_getPositiveOrientation(end);
-    assert(stSortedSet_search(flower->ends, end) == NULL);
+    assert(nameIndex_search(flower->endsByName, end_getName(end)) == NULL);
     stSortedSet_insert(flower->ends, end);
+    nameIndex_insert(flower->endsByName, end_getName(end), end);
 }
 
 void flower_removeEnd(Flower *flower, End *end) {
     end = end_getPositiveOrientation(end);
-    assert(stSortedSet_search(flower->ends, end) != NULL);
+    assert(nameIndex_search(flower->endsByName, end_getName(end)) == end);
     stSortedSet_remove(flower->ends, end);
+    nameIndex_remove(flower->endsByName, end_getName(end));
 }
 
 void flower_addSegment(Flower *flower, Segment *segment) {
     segment = segment_getPositiveOrientation(segment);
-    assert(stSortedSet_search(flower->segments, segment) == NULL);
+    assert(nameIndex_search(flower->segmentsByName, segment_getName(segment)) == NULL);
     stSortedSet_insert(flower->segments, segment);
+    nameIndex_insert(flower->segmentsByName, segment_getName(segment), segment);
 }
 
 void flower_removeSegment(Flower *flower, Segment *segment) {
     segment = segment_getPositiveOrientation(segment);
-    assert(stSortedSet_search(flower->segments, segment) != NULL);
+    assert(nameIndex_search(flower->segmentsByName, segment_getName(segment)) == segment);
     stSortedSet_remove(flower->segments, segment);
+    nameIndex_remove(flower->segmentsByName, segment_getName(segment));
 }
 
 void flower_addBlock(Flower *flower, Block *block) {
     block = block_getPositiveOrientation(block);
-    assert(stSortedSet_search(flower->blocks, block) == NULL);
+    assert(nameIndex_search(flower->blocksByName, block_getName(block)) == NULL);
     stSortedSet_insert(flower->blocks, block);
+    nameIndex_insert(flower->blocksByName, block_getName(block), block);
 }
 
 void flower_removeBlock(Flower *flower, Block *block) {
     block = block_getPositiveOrientation(block);
-    assert(stSortedSet_search(flower->blocks, block) != NULL);
+    assert(nameIndex_search(flower->blocksByName, block_getName(block)) == block);
     stSortedSet_remove(flower->blocks, block);
+    nameIndex_remove(flower->blocksByName, block_getName(block));
 }
 
 void flower_addChain(Flower *flower, Chain *chain) {
-    assert(stSortedSet_search(flower->chains, chain) == NULL);
+    assert(nameIndex_search(flower->chainsByName, chain_getName(chain)) == NULL);
     stSortedSet_insert(flower->chains, chain);
+    nameIndex_insert(flower->chainsByName, chain_getName(chain), chain);
 }
 
 void flower_removeChain(Flower *flower, Chain *chain) {
-    assert(stSortedSet_search(flower->chains, chain) != NULL);
+    assert(nameIndex_search(flower->chainsByName, chain_getName(chain)) == chain);
     stSortedSet_remove(flower->chains, chain);
+    nameIndex_remove(flower->chainsByName, chain_getName(chain));
 }
 
 void flower_addGroup(Flower *flower, Group *group) {
-    assert(stSortedSet_search(flower->groups, group) == NULL);
+    assert(nameIndex_search(flower->groupsByName, group_getName(group)) == NULL);
     stSortedSet_insert(flower->groups, group);
+    nameIndex_insert(flower->groupsByName, group_getName(group), group);
 }
 
 void flower_removeGroup(Flower *flower, Group *group) {
-    assert(stSortedSet_search(flower->groups, group) != NULL);
+    assert(nameIndex_search(flower->groupsByName, group_getName(group)) == group);
     stSortedSet_remove(flower->groups, group);
+    nameIndex_remove(flower->groupsByName, group_getName(group));
 }
 
 void flower_setParentGroup(Flower *flower, Group *group) {
@@ -905,8 +940,13 @@ void flower_writeBinaryRepresentation(Flower *flower, void(*writeFn)(const void
     Group *group;
     Chain *chain;
 
-    binaryRepresentation_writeElementType(CODE_FLOWER, writeFn);
+    //The flower's name is written in the fixed format, the rest of the record in the compact format.
+    BinaryRepresentationFormat *previousFormat = binaryRepresentation_setFormat(NULL);
+    binaryRepresentation_writeElementType(CODE_COMPACT_FLOWER, writeFn);
     binaryRepresentation_writeName(flower_getName(flower), writeFn);
+    BinaryRepresentationFormat *format = binaryRepresentationFormat_construct(BINARY_REPRESENTATION_FORMAT_COMPACT,
+            flower_getName(flower));
+    binaryRepresentation_setFormat(format);
     binaryRepresentation_writeBool(flower_builtBlocks(flower), writeFn);
     binaryRepresentation_writeBool(flower_builtTrees(flower), writeFn);
     binaryRepresentation_writeBool(flower_builtFaces(flower), writeFn);
@@ -942,15 +982,26 @@ void flower_writeBinaryRepresentation(Flower *flower, void(*writeFn)(const void
     }
     flower_destructChainIterator(chainIterator);
 
-    binaryRepresentation_writeElementType(CODE_FLOWER, writeFn); //this avoids interpretting things wrong.
+    binaryRepresentation_writeElementType(CODE_COMPACT_FLOWER, writeFn); //this avoids interpretting things wrong.
+    binaryRepresentation_setFormat(previousFormat);
+    binaryRepresentationFormat_destruct(format);
 }
 
 Flower *flower_loadFromBinaryRepresentation(void **binaryString, CactusDisk *cactusDisk) {
     Flower *flower = NULL;
     bool buildFaces;
-    if (binaryRepresentation_peekNextElementType(*binaryString) == CODE_FLOWER) {
+    void *record = *binaryString;
+    char elementType = binaryRepresentation_peekNextElementType(*binaryString);
+    if (elementType == CODE_FLOWER || elementType == CODE_COMPACT_FLOWER) {
+        //Flowers written before the compact format was added are entirely in the fixed format.
+        BinaryRepresentationFormat *previousFormat = binaryRepresentation_setFormat(NULL);
+        BinaryRepresentationFormat *format = NULL;
         binaryRepresentation_popNextElementType(binaryString);
         flower = flower_construct3(binaryRepresentation_getName(binaryString), cactusDisk);
+        if (elementType == CODE_COMPACT_FLOWER) {
+            format = binaryRepresentationFormat_construct(BINARY_REPRESENTATION_FORMAT_COMPACT, flower_getName(flower));
+            binaryRepresentation_setFormat(format);
+        }
         flower_setBuiltBlocks(flower, binaryRepresentation_getBool(binaryString));
         flower_setBuiltTrees(flower, binaryRepresentation_getBool(binaryString));
         buildFaces = binaryRepresentation_getBool(binaryString);
@@ -966,7 +1017,23 @@ Flower *flower_loadFromBinaryRepresentation(void **binaryString, CactusDisk *cac
         while (chain_loadFromBinaryRepresentation(binaryString, flower) != NULL)
             ;
         flower_setBuildFaces(flower, buildFaces);
-        assert(binaryRepresentation_popNextElementType(binaryString) == CODE_FLOWER);
+        assert(binaryRepresentation_popNextElementType(binaryString) == elementType);
+        binaryRepresentation_setFormat(previousFormat);
+        if (format != NULL) {
+            binaryRepresentationFormat_destruct(format);
+        }
+        //The hash of the record, so the flower is only written back if it changes.
+        flower_setRecordHash(flower, binaryRepresentation_hash(record, (char *) *binaryString - (char *) record));
     }
     return flower;
 }
+
+bool flower_getRecordHash(Flower *flower, uint64_t *recordHash) {
+    *recordHash = flower->recordHash;
+    return flower->hasRecordHash;
+}
+
+void flower_setRecordHash(Flower *flower, uint64_t recordHash) {
+    flower->recordHash = recordHash;
+    flower->hasRecordHash = 1;
+}
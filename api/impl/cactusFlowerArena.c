@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+
+#define FLOWER_ARENA_CHUNK_SIZE 65536
+#define FLOWER_ARENA_ALIGNMENT 16
+#define FLOWER_ARENA_SIZE_CLASSES 8
+
+typedef struct _flowerArenaChunk FlowerArenaChunk;
+
+struct _flowerArenaChunk {
+    FlowerArenaChunk *next;
+    int64_t size;
+};
+
+/*
+ * The header of a chunk is padded so the memory after it is aligned.
+ */
+#define FLOWER_ARENA_CHUNK_HEADER_SIZE \
+    ((sizeof(FlowerArenaChunk) + FLOWER_ARENA_ALIGNMENT - 1) / FLOWER_ARENA_ALIGNMENT * FLOWER_ARENA_ALIGNMENT)
+
+typedef struct _freeObject FreeObject;
+
+struct _freeObject {
+    FreeObject *next;
+};
+
+struct _flowerArena {
+    int64_t referenceCount;
+    FlowerArenaChunk *chunks;
+    char *next; //The next free byte of the first chunk.
+    char *end; //The end of the first chunk.
+    int64_t size;
+    //The objects freed, listed by their size. There are only a few sizes of cactus objects.
+    size_t freeSizes[FLOWER_ARENA_SIZE_CLASSES];
+    FreeObject *freeObjects[FLOWER_ARENA_SIZE_CLASSES];
+    int64_t sizeClassNumber;
+};
+
+FlowerArena *flowerArena_construct(void) {
+    FlowerArena *arena = st_calloc(1, sizeof(FlowerArena));
+    arena->referenceCount = 1;
+    return arena;
+}
+
+void flowerArena_retain(FlowerArena *arena) {
+    //Atomic, as flowers processed by different threads may share an arena.
+    __atomic_add_fetch(&arena->referenceCount, 1, __ATOMIC_RELAXED);
+}
+
+void flowerArena_release(FlowerArena *arena) {
+    if (__atomic_sub_fetch(&arena->referenceCount, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
+    }
+    FlowerArenaChunk *chunk = arena->chunks;
+    while (chunk != NULL) {
+        FlowerArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
+
+static size_t roundSize(size_t size) {
+    return (size + FLOWER_ARENA_ALIGNMENT - 1) / FLOWER_ARENA_ALIGNMENT * FLOWER_ARENA_ALIGNMENT;
+}
+
+static int64_t getSizeClass(FlowerArena *arena, size_t size) {
+    for (int64_t i = 0; i < arena->sizeClassNumber; i++) {
+        if (arena->freeSizes[i] == size) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void *flowerArena_allocate(FlowerArena *arena, size_t size) {
+    size = roundSize(size);
+    int64_t sizeClass = getSizeClass(arena, size);
+    if (sizeClass != -1 && arena->freeObjects[sizeClass] != NULL) {
+        FreeObject *object = arena->freeObjects[sizeClass];
+        arena->freeObjects[sizeClass] = object->next;
+        return object;
+    }
+    if (arena->next == NULL || (size_t) (arena->end - arena->next) < size) {
+        //Objects too big to share a chunk get a chunk of their own, behind the current one.
+        int64_t chunkSize = size > FLOWER_ARENA_CHUNK_SIZE / 4 ? size : FLOWER_ARENA_CHUNK_SIZE;
+        FlowerArenaChunk *chunk = st_malloc(FLOWER_ARENA_CHUNK_HEADER_SIZE + chunkSize);
+        chunk->size = chunkSize;
+        arena->size += chunkSize;
+        char *memory = (char *) chunk + FLOWER_ARENA_CHUNK_HEADER_SIZE;
+        if (chunkSize == FLOWER_ARENA_CHUNK_SIZE) {
+            chunk->next = arena->chunks;
+            arena->chunks = chunk;
+            arena->next = memory + size;
+            arena->end = memory + chunkSize;
+        } else if (arena->chunks != NULL) {
+            chunk->next = arena->chunks->next;
+            arena->chunks->next = chunk;
+        } else {
+            chunk->next = NULL;
+            arena->chunks = chunk;
+        }
+        return memory;
+    }
+    void *memory = arena->next;
+    arena->next += size;
+    return memory;
+}
+
+void flowerArena_free(FlowerArena *arena, void *memory, size_t size) {
+    size = roundSize(size);
+    int64_t sizeClass = getSizeClass(arena, size);
+    if (sizeClass == -1) {
+        if (arena->sizeClassNumber == FLOWER_ARENA_SIZE_CLASSES) {
+            return; //Not reused, but still freed with the arena.
+        }
+        sizeClass = arena->sizeClassNumber++;
+        arena->freeSizes[sizeClass] = size;
+        arena->freeObjects[sizeClass] = NULL;
+    }
+    FreeObject *object = memory;
+    object->next = arena->freeObjects[sizeClass];
+    arena->freeObjects[sizeClass] = object;
+}
+
+int64_t flowerArena_getSize(FlowerArena *arena) {
+    return arena->size;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_FLOWER_ARENA_H_
+#define CACTUS_FLOWER_ARENA_H_
+
+#include "cactusGlobals.h"
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Functions for the arenas the objects of a flower are allocated from.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+/*
+ * Each flower allocates its caps, ends, segments and blocks from an arena, by bumping a pointer into
+ * large chunks, and the chunks are all freed at once when the arena is released. Objects freed before
+ * then are kept on a list for their size and reused by the arena's later allocations.
+ *
+ * An object that moves to another flower stays in the memory of its original arena, so the flower it
+ * moves to must retain that arena (see flower_adoptArenas), and the arena is reference counted.
+ */
+typedef struct _flowerArena FlowerArena;
+
+/*
+ * Constructs an arena with a reference count of one.
+ */
+FlowerArena *flowerArena_construct(void);
+
+/*
+ * Increments the reference count of the arena.
+ */
+void flowerArena_retain(FlowerArena *arena);
+
+/*
+ * Decrements the reference count of the arena, freeing all the memory allocated from it when it reaches zero.
+ */
+void flowerArena_release(FlowerArena *arena);
+
+/*
+ * Returns uninitialised memory of the given size, aligned for any of the cactus objects.
+ */
+void *flowerArena_allocate(FlowerArena *arena, size_t size);
+
+/*
+ * Frees memory of the given size, allocated from this arena or one retained by the flower that owns it,
+ * for reuse by the arena.
+ */
+void flowerArena_free(FlowerArena *arena, void *memory, size_t size);
+
+/*
+ * Returns the total size of the chunks of the arena.
+ */
+int64_t flowerArena_getSize(FlowerArena *arena);
+
+#endif
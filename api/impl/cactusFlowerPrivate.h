@@ -19,6 +19,14 @@ struct _flower {
     stSortedSet *groups;
     stSortedSet *chains;
     stSortedSet *faces;
+    //Hash indexes of the elements by name, for fast lookups. The sorted sets above give the ordered iteration.
+    NameIndex *sequencesByName;
+    NameIndex *capsByName;
+    NameIndex *endsByName;
+    NameIndex *blocksByName;
+    NameIndex *segmentsByName;
+    NameIndex *groupsByName;
+    NameIndex *chainsByName;
     Name parentFlowerName;
     CactusDisk *cactusDisk;
     int64_t faceIndex;
@@ -26,6 +34,10 @@ struct _flower {
     bool builtBlocks;
     bool builtTrees;
     bool builtFaces;
+    bool hasRecordHash; //Non-zero if recordHash is the hash of the flower's record in the cactus disk.
+    uint64_t recordHash;
+    FlowerArena *arena; //The caps, ends, segments and blocks of the flower are allocated from this.
+    stList *adoptedArenas; //The arenas of other flowers that objects of this flower may have been allocated from.
 };
 
 ////////////////////////////////////////////////
@@ -55,6 +67,18 @@ void flower_setEventTree(Flower *flower, EventTree *eventTree);
  */
 void flower_removeEventTree(Flower *flower, EventTree *eventTree);
 
+/*
+ * Returns the arena the objects of the flower are allocated from.
+ */
+FlowerArena *flower_getArena(Flower *flower);
+
+/*
+ * Makes the flower retain the arena of the other flower, and any arenas it has adopted, so that
+ * objects can be moved from the other flower to this one and outlive the other flower. Must be
+ * called before moving caps, ends, segments or blocks between flowers.
+ */
+void flower_adoptArenas(Flower *flower, Flower *otherFlower);
+
 /*
  * Adds the sequence to the flower.
  */
@@ -162,4 +186,15 @@ void flower_writeBinaryRepresentation(Flower *flower, void(*writeFn)(const void
  */
 Flower *flower_loadFromBinaryRepresentation(void **binaryString, CactusDisk *cactusDisk);
 
+/*
+ * Gets the hash of the flower's record in the cactus disk, set when the flower is loaded or
+ * written, returning zero if the flower has no such record.
+ */
+bool flower_getRecordHash(Flower *flower, uint64_t *recordHash);
+
+/*
+ * Sets the hash of the flower's record in the cactus disk.
+ */
+void flower_setRecordHash(Flower *flower, uint64_t recordHash);
+
 #endif
@@ -1,3 +1,4 @@
+#include <pthread.h>
 #include "sonLib.h"
 #include "cactusGlobalsPrivate.h"
 
@@ -174,22 +175,182 @@ stList *flowerWriter_parseFlowersFromStdin(CactusDisk *cactusDisk) {
     return flowers;
 }
 
-static FlowerStream *flowerStream_construct(stList *flowerNames, CactusDisk *cactusDisk) {
+/*
+ * A batch of flower records fetched and decompressed by the prefetching thread of a flower stream.
+ */
+typedef struct _flowerBatch {
+    stList *flowerNames;
+    stList *records; //NULL if they could not be fetched.
+    int64_t *recordSizes;
+    int64_t size;
+    stExcept *except; //The error fetching the records, rethrown when the batch is taken.
+} FlowerBatch;
+
+struct _flowerStreamPrefetcher {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond; //Signalled whenever a batch is added to or taken from the queue, or the stream is stopped.
+    stList *batches; //Fetched batches, in stream order.
+    int64_t batchesSize; //The total size of the records in batches.
+    int64_t depth;
+    int64_t maxSize;
+    bool stop;
+};
+
+static stList *getNamesBatch(FlowerStream *flowerStream, int64_t batchStart) {
+    /*
+     * Get the next batch of names.
+     */
+    int64_t batchEnd = batchStart + FLOWER_STREAM_BATCH_SIZE;
+    if (batchEnd > stList_length(flowerStream->flowerNames)) {
+        batchEnd = stList_length(flowerStream->flowerNames);
+    }
+    stList *namesBatch = stList_construct2(batchEnd - batchStart);
+    for (int64_t i = batchStart; i < batchEnd; i++) {
+        stList_set(namesBatch, i - batchStart, stList_get(flowerStream->flowerNames, i));
+    }
+    // We want to be able to treat the batch like a stack and get
+    // the same order, so we reverse it.
+    stList_reverse(namesBatch);
+    return namesBatch;
+}
+
+static FlowerBatch *flowerBatch_construct(FlowerStream *flowerStream, int64_t batchStart) {
+    FlowerBatch *flowerBatch = st_malloc(sizeof(FlowerBatch));
+    flowerBatch->flowerNames = getNamesBatch(flowerStream, batchStart);
+    flowerBatch->records = cactusDisk_fetchRecords(flowerStream->cactusDisk, flowerBatch->flowerNames,
+            &flowerBatch->recordSizes, &flowerBatch->except);
+    flowerBatch->size = 0;
+    for (int64_t i = 0; flowerBatch->records != NULL && i < stList_length(flowerBatch->records); i++) {
+        flowerBatch->size += flowerBatch->recordSizes[i];
+    }
+    return flowerBatch;
+}
+
+static void flowerBatch_destruct(FlowerBatch *flowerBatch) {
+    stList_destruct(flowerBatch->flowerNames);
+    if (flowerBatch->records != NULL) {
+        stList_destruct(flowerBatch->records);
+    }
+    if (flowerBatch->except != NULL) {
+        stExcept_free(flowerBatch->except);
+    }
+    free(flowerBatch->recordSizes);
+    free(flowerBatch);
+}
+
+static void *flowerStream_prefetch(FlowerStream *flowerStream) {
+    /*
+     * Run by the prefetching thread, fetches the batches of the stream in order, keeping at most
+     * depth batches, and at most maxSize bytes beyond the first batch, ahead of the caller.
+     */
+    FlowerStreamPrefetcher *prefetcher = flowerStream->prefetcher;
+    for (int64_t batchStart = 0; batchStart < stList_length(flowerStream->flowerNames);
+            batchStart += FLOWER_STREAM_BATCH_SIZE) {
+        pthread_mutex_lock(&prefetcher->lock);
+        while (!prefetcher->stop && (stList_length(prefetcher->batches) >= prefetcher->depth
+                || (stList_length(prefetcher->batches) > 0 && prefetcher->batchesSize >= prefetcher->maxSize))) {
+            pthread_cond_wait(&prefetcher->cond, &prefetcher->lock);
+        }
+        bool stop = prefetcher->stop;
+        pthread_mutex_unlock(&prefetcher->lock);
+        if (stop) {
+            break;
+        }
+        FlowerBatch *flowerBatch = flowerBatch_construct(flowerStream, batchStart);
+        pthread_mutex_lock(&prefetcher->lock);
+        stList_append(prefetcher->batches, flowerBatch);
+        prefetcher->batchesSize += flowerBatch->size;
+        pthread_cond_broadcast(&prefetcher->cond);
+        pthread_mutex_unlock(&prefetcher->lock);
+    }
+    return NULL;
+}
+
+static FlowerStreamPrefetcher *flowerStreamPrefetcher_construct(FlowerStream *flowerStream, int64_t depth,
+        int64_t maxSize) {
+    FlowerStreamPrefetcher *prefetcher = st_malloc(sizeof(FlowerStreamPrefetcher));
+    pthread_mutex_init(&prefetcher->lock, NULL);
+    pthread_cond_init(&prefetcher->cond, NULL);
+    prefetcher->batches = stList_construct3(0, (void (*)(void *)) flowerBatch_destruct);
+    prefetcher->batchesSize = 0;
+    prefetcher->depth = depth;
+    prefetcher->maxSize = maxSize;
+    prefetcher->stop = 0;
+    flowerStream->prefetcher = prefetcher;
+    if (pthread_create(&prefetcher->thread, NULL, (void *(*)(void *)) flowerStream_prefetch, flowerStream) != 0) {
+        st_errAbort("Could not create the thread to prefetch flowers");
+    }
+    return prefetcher;
+}
+
+static void flowerStreamPrefetcher_destruct(FlowerStreamPrefetcher *prefetcher) {
+    pthread_mutex_lock(&prefetcher->lock);
+    prefetcher->stop = 1;
+    pthread_cond_broadcast(&prefetcher->cond);
+    pthread_mutex_unlock(&prefetcher->lock);
+    pthread_join(prefetcher->thread, NULL);
+    stList_destruct(prefetcher->batches);
+    pthread_cond_destroy(&prefetcher->cond);
+    pthread_mutex_destroy(&prefetcher->lock);
+    free(prefetcher);
+}
+
+static stList *flowerStreamPrefetcher_getNextBatch(FlowerStream *flowerStream) {
+    /*
+     * Waits for the prefetching thread to have the next batch, then loads its flowers.
+     */
+    FlowerStreamPrefetcher *prefetcher = flowerStream->prefetcher;
+    pthread_mutex_lock(&prefetcher->lock);
+    while (stList_length(prefetcher->batches) == 0) {
+        pthread_cond_wait(&prefetcher->cond, &prefetcher->lock);
+    }
+    FlowerBatch *flowerBatch = stList_removeFirst(prefetcher->batches);
+    prefetcher->batchesSize -= flowerBatch->size;
+    pthread_cond_broadcast(&prefetcher->cond);
+    pthread_mutex_unlock(&prefetcher->lock);
+    if (flowerBatch->except != NULL) { //The error is rethrown on this thread, which is using the cactus disk.
+        stExcept *except = flowerBatch->except;
+        flowerBatch->except = NULL;
+        flowerBatch_destruct(flowerBatch);
+        stThrowNewCause(except, CACTUS_DISK_EXCEPTION_ID, "Could not prefetch a batch of flowers");
+    }
+    // The flowers must be loaded on this thread, as loading changes the cactus disk.
+    stList *flowers = cactusDisk_loadFlowers(flowerStream->cactusDisk, flowerBatch->flowerNames, flowerBatch->records,
+            flowerBatch->recordSizes);
+    flowerBatch_destruct(flowerBatch);
+    return flowers;
+}
+
+static FlowerStream *flowerStream_construct(stList *flowerNames, CactusDisk *cactusDisk, int64_t prefetchDepth,
+        int64_t maxPrefetchSize) {
     FlowerStream *ret = malloc(sizeof(FlowerStream));
     ret->flowerNames = flowerNames;
     ret->flowerBatch = stList_construct();
     ret->curFlower = NULL;
     ret->nextIdx = 0;
     ret->cactusDisk = cactusDisk;
+    ret->prefetcher = NULL;
+    if (prefetchDepth > 0) {
+        flowerStreamPrefetcher_construct(ret, prefetchDepth, maxPrefetchSize);
+    }
     return ret;
 }
 
 FlowerStream *flowerWriter_getFlowerStream(CactusDisk *cactusDisk, FILE *file) {
+    return flowerWriter_getFlowerStream2(cactusDisk, file, 0, INT64_MAX);
+}
+
+FlowerStream *flowerWriter_getFlowerStream2(CactusDisk *cactusDisk, FILE *file, int64_t prefetchDepth,
+        int64_t maxPrefetchSize) {
     stList *flowerNamesList = flowerWriter_parseNames(file);
-    return flowerStream_construct(flowerNamesList, cactusDisk);
+    return flowerStream_construct(flowerNamesList, cactusDisk, prefetchDepth, maxPrefetchSize);
 }
 
 void flowerStream_destruct(FlowerStream *flowerStream) {
+    if (flowerStream->prefetcher != NULL) {
+        flowerStreamPrefetcher_destruct(flowerStream->prefetcher);
+    }
     if (flowerStream->curFlower != NULL) {
         flower_destruct(flowerStream->curFlower, false);
     }
@@ -209,22 +370,14 @@ Flower *flowerStream_getNext(FlowerStream *flowerStream) {
     }
     if (stList_length(flowerStream->flowerBatch) == 0) {
         // Time to load the next batch of flowers from the DB.
-        // Get the next batch of names.
-        int64_t batchStart = flowerStream->nextIdx;
-        int64_t batchEnd = flowerStream->nextIdx + FLOWER_STREAM_BATCH_SIZE;
-        if (batchEnd > stList_length(flowerStream->flowerNames)) {
-            batchEnd = stList_length(flowerStream->flowerNames);
-        }
-        stList *namesBatch = stList_construct2(batchEnd - batchStart);
-        for (int64_t i = batchStart; i < batchEnd; i++) {
-            stList_set(namesBatch, i - batchStart, stList_get(flowerStream->flowerNames, i));
-        }
-        // We want to be able to treat the batch like a stack and get
-        // the same order, so we reverse it.
-        stList_reverse(namesBatch);
         stList_destruct(flowerStream->flowerBatch);
-        flowerStream->flowerBatch = cactusDisk_getFlowers(flowerStream->cactusDisk, namesBatch);
-        stList_destruct(namesBatch);
+        if (flowerStream->prefetcher != NULL) {
+            flowerStream->flowerBatch = flowerStreamPrefetcher_getNextBatch(flowerStream);
+        } else {
+            stList *namesBatch = getNamesBatch(flowerStream, flowerStream->nextIdx);
+            flowerStream->flowerBatch = cactusDisk_getFlowers(flowerStream->cactusDisk, namesBatch);
+            stList_destruct(namesBatch);
+        }
     }
     flowerStream->curFlower = stList_pop(flowerStream->flowerBatch);
     flowerStream->nextIdx++;
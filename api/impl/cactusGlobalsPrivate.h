@@ -48,8 +48,16 @@
 #include "cactusMetaSequencePrivate.h"
 #include "cactusFlower.h"
 #include "cactusDisk.h"
+#include "cactusSerialisation.h"
+#include "cactusRecordCache.h"
+#include "cactusPackedSequence.h"
+#include "cactusRecordCodec.h"
+#include "cactusDiskStats.h"
+#include "cactusDiskSnapshot.h"
 #include "cactusDiskPrivate.h"
 #include "cactusMisc.h"
+#include "cactusFlowerArena.h"
+#include "cactusNameIndex.h"
 #include "cactusFlowerPrivate.h"
 #include "cactusFace.h"
 #include "cactusFacePrivate.h"
@@ -57,7 +65,6 @@
 #include "cactusFaceEndPrivate.h"
 #include "cactusSequence.h"
 #include "cactusSequencePrivate.h"
-#include "cactusSerialisation.h"
 #include "cactusTestCommon.h"
 #include "cactusFlowerWriter.h"
 
@@ -166,8 +166,8 @@ End *group_getFirstEnd(Group *group) {
 }
 
 End *group_getEnd(Group *group, Name name) {
-    static End end;
-    static EndContents endContents;
+    End end; //Not static, as threads may search the groups of different flowers at once.
+    EndContents endContents;
     end.endContents = &endContents;
     endContents.name = name;
     return stSortedSet_search(group->ends, &end);
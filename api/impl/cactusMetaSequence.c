@@ -99,6 +99,8 @@ void metaSequence_setHeader(MetaSequence *metaSequence,
 
 void metaSequence_writeBinaryRepresentation(MetaSequence *metaSequence,
 		void (*writeFn)(const void * ptr, size_t size, size_t count)) {
+	//Meta sequences are always in the fixed format, and may be loaded while a flower is being loaded.
+	BinaryRepresentationFormat *previousFormat = binaryRepresentation_setFormat(NULL);
 	binaryRepresentation_writeElementType(CODE_META_SEQUENCE, writeFn);
 	binaryRepresentation_writeName(metaSequence_getName(metaSequence), writeFn);
 	binaryRepresentation_writeInteger(metaSequence_getStart(metaSequence), writeFn);
@@ -107,6 +109,7 @@ void metaSequence_writeBinaryRepresentation(MetaSequence *metaSequence,
 	binaryRepresentation_writeName(metaSequence->stringName, writeFn);
 	binaryRepresentation_writeString(metaSequence_getHeader(metaSequence), writeFn);
 	binaryRepresentation_writeBool(metaSequence_isTrivialSequence(metaSequence), writeFn);
+	binaryRepresentation_setFormat(previousFormat);
 }
 
 MetaSequence *metaSequence_loadFromBinaryRepresentation(void **binaryString,
@@ -120,6 +123,7 @@ MetaSequence *metaSequence_loadFromBinaryRepresentation(void **binaryString,
 	char *header;
 
 	metaSequence = NULL;
+	BinaryRepresentationFormat *previousFormat = binaryRepresentation_setFormat(NULL);
 	if(binaryRepresentation_peekNextElementType(*binaryString) == CODE_META_SEQUENCE) {
 		binaryRepresentation_popNextElementType(binaryString);
 		name = binaryRepresentation_getName(binaryString);
@@ -133,6 +137,7 @@ MetaSequence *metaSequence_loadFromBinaryRepresentation(void **binaryString,
 				stringName, header, eventName, isTrivialSequence, cactusDisk);
 		free(header);
 	}
+	binaryRepresentation_setFormat(previousFormat);
 	return metaSequence;
 }
 
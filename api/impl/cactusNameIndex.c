@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+
+#define NAME_INDEX_INITIAL_SIZE_LOG2 3
+
+typedef struct _nameIndexEntry {
+    Name name;
+    void *object; //NULL if the entry is empty.
+} NameIndexEntry;
+
+struct _nameIndex {
+    NameIndexEntry *entries;
+    int64_t sizeLog2; //The table has 2^sizeLog2 entries, or none if entries is NULL.
+    int64_t size; //The number of objects in the table.
+};
+
+NameIndex *nameIndex_construct(void) {
+    return st_calloc(1, sizeof(NameIndex));
+}
+
+void nameIndex_destruct(NameIndex *nameIndex) {
+    free(nameIndex->entries);
+    free(nameIndex);
+}
+
+/*
+ * Fibonacci hashing, which spreads the consecutive names given out by the cactus disk over the table.
+ */
+static inline uint64_t getSlot(NameIndex *nameIndex, Name name) {
+    return (((uint64_t) name) * 0x9E3779B97F4A7C15ULL) >> (64 - nameIndex->sizeLog2);
+}
+
+static inline uint64_t getMask(NameIndex *nameIndex) {
+    return (((uint64_t) 1) << nameIndex->sizeLog2) - 1;
+}
+
+static void insert(NameIndex *nameIndex, Name name, void *object) {
+    uint64_t mask = getMask(nameIndex);
+    uint64_t slot = getSlot(nameIndex, name);
+    while (nameIndex->entries[slot].object != NULL) {
+        assert(nameIndex->entries[slot].name != name);
+        slot = (slot + 1) & mask;
+    }
+    nameIndex->entries[slot].name = name;
+    nameIndex->entries[slot].object = object;
+}
+
+static void resize(NameIndex *nameIndex, int64_t sizeLog2) {
+    NameIndexEntry *entries = nameIndex->entries;
+    int64_t oldSize = entries == NULL ? 0 : ((int64_t) 1) << nameIndex->sizeLog2;
+    nameIndex->entries = st_calloc(((int64_t) 1) << sizeLog2, sizeof(NameIndexEntry));
+    nameIndex->sizeLog2 = sizeLog2;
+    for (int64_t i = 0; i < oldSize; i++) {
+        if (entries[i].object != NULL) {
+            insert(nameIndex, entries[i].name, entries[i].object);
+        }
+    }
+    free(entries);
+}
+
+void nameIndex_insert(NameIndex *nameIndex, Name name, void *object) {
+    assert(object != NULL);
+    if (nameIndex->entries == NULL) {
+        resize(nameIndex, NAME_INDEX_INITIAL_SIZE_LOG2);
+    } else if (2 * (nameIndex->size + 1) > (((int64_t) 1) << nameIndex->sizeLog2)) {
+        //Kept at most half full, so the probes stay short.
+        resize(nameIndex, nameIndex->sizeLog2 + 1);
+    }
+    insert(nameIndex, name, object);
+    nameIndex->size++;
+}
+
+static int64_t find(NameIndex *nameIndex, Name name) {
+    if (nameIndex->entries == NULL) {
+        return -1;
+    }
+    uint64_t mask = getMask(nameIndex);
+    uint64_t slot = getSlot(nameIndex, name);
+    while (nameIndex->entries[slot].object != NULL) {
+        if (nameIndex->entries[slot].name == name) {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+void nameIndex_remove(NameIndex *nameIndex, Name name) {
+    int64_t i = find(nameIndex, name);
+    if (i == -1) { //Not in the index, as stSortedSet_remove.
+        return;
+    }
+    uint64_t mask = getMask(nameIndex);
+    uint64_t hole = i, slot = i;
+    /*
+     * Moves back each following entry of the run that could occupy the hole, that is each entry
+     * whose home slot is not cyclically between the hole and the entry.
+     */
+    while (1) {
+        slot = (slot + 1) & mask;
+        NameIndexEntry *entry = &nameIndex->entries[slot];
+        if (entry->object == NULL) {
+            break;
+        }
+        uint64_t home = getSlot(nameIndex, entry->name);
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            nameIndex->entries[hole] = *entry;
+            hole = slot;
+        }
+    }
+    nameIndex->entries[hole].object = NULL;
+    nameIndex->size--;
+}
+
+void *nameIndex_search(NameIndex *nameIndex, Name name) {
+    int64_t i = find(nameIndex, name);
+    return i == -1 ? NULL : nameIndex->entries[i].object;
+}
+
+int64_t nameIndex_size(NameIndex *nameIndex) {
+    return nameIndex->size;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_NAME_INDEX_H_
+#define CACTUS_NAME_INDEX_H_
+
+#include "cactusGlobals.h"
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Functions for the hash indexes of the elements of a flower by name.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+/*
+ * An open addressing hash table mapping names to objects, used by the flower to look up its elements
+ * in constant time. The flower keeps its sorted sets for ordered iteration. The table uses linear
+ * probing and deletes by shifting entries back, so lookups never cross deleted entries. The table
+ * is not allocated until the first insert, as most flowers are small.
+ */
+typedef struct _nameIndex NameIndex;
+
+NameIndex *nameIndex_construct(void);
+
+void nameIndex_destruct(NameIndex *nameIndex);
+
+/*
+ * Adds the object under the name, which must not already be in the index. The object must not be NULL.
+ */
+void nameIndex_insert(NameIndex *nameIndex, Name name, void *object);
+
+/*
+ * Removes the name, doing nothing if it is not in the index.
+ */
+void nameIndex_remove(NameIndex *nameIndex, Name name);
+
+/*
+ * Returns the object with the name, or NULL if there is none.
+ */
+void *nameIndex_search(NameIndex *nameIndex, Name name);
+
+int64_t nameIndex_size(NameIndex *nameIndex);
+
+#endif
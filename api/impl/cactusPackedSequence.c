@@ -0,0 +1,527 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Packed sequence functions.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+static const char packedSequence_codeToBase[4] = { 'A', 'C', 'G', 'T' };
+
+static inline int64_t getCode(const uint8_t *bases, int64_t i) {
+    return (bases[i >> 2] >> ((i & 3) << 1)) & 3;
+}
+
+static inline void setCode(uint8_t *bases, int64_t i, int64_t code) {
+    int64_t shift = (i & 3) << 1;
+    bases[i >> 2] = (uint8_t) ((bases[i >> 2] & ~(3 << shift)) | (code << shift));
+}
+
+static void appendRun(int64_t **runs, int64_t *runNumber, int64_t *maxRunNumber, int64_t start, int64_t length) {
+    /*
+     * Adds a run to the end of a list of runs, merging it with the last run if they abut.
+     */
+    if (*runNumber > 0 && (*runs)[2 * (*runNumber - 1)] + (*runs)[2 * (*runNumber - 1) + 1] == start) {
+        (*runs)[2 * (*runNumber - 1) + 1] += length;
+        return;
+    }
+    if (*runNumber == *maxRunNumber) {
+        *maxRunNumber = *maxRunNumber * 2 + 1;
+        *runs = st_realloc(*runs, sizeof(int64_t) * 2 * *maxRunNumber);
+    }
+    (*runs)[2 * *runNumber] = start;
+    (*runs)[2 * *runNumber + 1] = length;
+    (*runNumber)++;
+}
+
+static void appendException(PackedSequence *packedSequence, int64_t *maxExceptionNumber, int64_t position, char c) {
+    if (packedSequence->exceptionNumber == *maxExceptionNumber) {
+        *maxExceptionNumber = *maxExceptionNumber * 2 + 1;
+        packedSequence->exceptionPositions = st_realloc(packedSequence->exceptionPositions,
+                sizeof(int64_t) * *maxExceptionNumber);
+        packedSequence->exceptionChars = st_realloc(packedSequence->exceptionChars, sizeof(char) * *maxExceptionNumber);
+    }
+    packedSequence->exceptionPositions[packedSequence->exceptionNumber] = position;
+    packedSequence->exceptionChars[packedSequence->exceptionNumber++] = c;
+}
+
+static PackedSequence *packedSequence_constructEmpty(int64_t length) {
+    PackedSequence *packedSequence = st_calloc(1, sizeof(PackedSequence));
+    packedSequence->length = length;
+    packedSequence->bases = st_calloc((length + 3) / 4 + 1, sizeof(uint8_t));
+    return packedSequence;
+}
+
+PackedSequence *packedSequence_construct(const char *string, int64_t length) {
+    PackedSequence *packedSequence = packedSequence_constructEmpty(length);
+    int64_t maxNRunNumber = 0, maxMaskRunNumber = 0, maxExceptionNumber = 0;
+    for (int64_t i = 0; i < length; i++) {
+        char c = string[i];
+        switch (c) {
+            case 'a':
+            case 'c':
+            case 'g':
+            case 't':
+            case 'n':
+                appendRun(&packedSequence->maskRuns, &packedSequence->maskRunNumber, &maxMaskRunNumber, i, 1);
+                c = c - 'a' + 'A';
+                break;
+            default:
+                break;
+        }
+        switch (c) {
+            case 'A':
+                break;
+            case 'C':
+                setCode(packedSequence->bases, i, 1);
+                break;
+            case 'G':
+                setCode(packedSequence->bases, i, 2);
+                break;
+            case 'T':
+                setCode(packedSequence->bases, i, 3);
+                break;
+            case 'N':
+                appendRun(&packedSequence->nRuns, &packedSequence->nRunNumber, &maxNRunNumber, i, 1);
+                break;
+            default:
+                appendException(packedSequence, &maxExceptionNumber, i, c);
+        }
+    }
+    return packedSequence;
+}
+
+void packedSequence_destruct(PackedSequence *packedSequence) {
+    free(packedSequence->bases);
+    free(packedSequence->nRuns);
+    free(packedSequence->maskRuns);
+    free(packedSequence->exceptionPositions);
+    free(packedSequence->exceptionChars);
+    free(packedSequence);
+}
+
+int64_t packedSequence_getLength(PackedSequence *packedSequence) {
+    return packedSequence->length;
+}
+
+int64_t packedSequence_getMemorySize(PackedSequence *packedSequence) {
+    return sizeof(PackedSequence) + (packedSequence->length + 3) / 4
+            + sizeof(int64_t) * 2 * (packedSequence->nRunNumber + packedSequence->maskRunNumber)
+            + (sizeof(int64_t) + sizeof(char)) * packedSequence->exceptionNumber;
+}
+
+char *packedSequence_getString(PackedSequence *packedSequence) {
+    char *string = st_malloc(sizeof(char) * (packedSequence->length + 1));
+    for (int64_t i = 0; i < packedSequence->length; i++) {
+        string[i] = packedSequence_codeToBase[getCode(packedSequence->bases, i)];
+    }
+    for (int64_t i = 0; i < packedSequence->nRunNumber; i++) {
+        memset(string + packedSequence->nRuns[2 * i], 'N', packedSequence->nRuns[2 * i + 1]);
+    }
+    for (int64_t i = 0; i < packedSequence->maskRunNumber; i++) {
+        char *cA = string + packedSequence->maskRuns[2 * i];
+        for (int64_t j = 0; j < packedSequence->maskRuns[2 * i + 1]; j++) {
+            cA[j] = cA[j] - 'A' + 'a';
+        }
+    }
+    for (int64_t i = 0; i < packedSequence->exceptionNumber; i++) {
+        string[packedSequence->exceptionPositions[i]] = packedSequence->exceptionChars[i];
+    }
+    string[packedSequence->length] = '\0';
+    return string;
+}
+
+static int64_t getFirstRunEndingAfter(int64_t *runs, int64_t runNumber, int64_t position) {
+    /*
+     * Binary searches for the first run ending after the given position. The runs are disjoint and
+     * sorted, so their ends are sorted too.
+     */
+    int64_t i = 0, j = runNumber;
+    while (i < j) {
+        int64_t k = (i + j) / 2;
+        if (runs[2 * k] + runs[2 * k + 1] <= position) {
+            i = k + 1;
+        } else {
+            j = k;
+        }
+    }
+    return i;
+}
+
+static void copyRuns(int64_t *runs, int64_t runNumber, int64_t **runs2, int64_t *runNumber2, int64_t *maxRunNumber2,
+        int64_t start, int64_t length, int64_t shift) {
+    /*
+     * Appends the parts of the given runs within the interval start to start + length to runs2,
+     * moved by shift.
+     */
+    for (int64_t i = getFirstRunEndingAfter(runs, runNumber, start); i < runNumber && runs[2 * i] < start + length;
+            i++) {
+        int64_t runStart = runs[2 * i] > start ? runs[2 * i] : start;
+        int64_t runEnd = runs[2 * i] + runs[2 * i + 1] < start + length ? runs[2 * i] + runs[2 * i + 1] : start + length;
+        appendRun(runs2, runNumber2, maxRunNumber2, runStart - start + shift, runEnd - runStart);
+    }
+}
+
+static void copyBases(PackedSequence *packedSequence, int64_t start, int64_t length, PackedSequence *packedSequence2,
+        int64_t start2) {
+    if ((start & 3) == 0 && (start2 & 3) == 0) { //Byte aligned, so copy the whole bytes
+        memcpy(packedSequence2->bases + start2 / 4, packedSequence->bases + start / 4, length / 4);
+        for (int64_t i = length - (length & 3); i < length; i++) {
+            setCode(packedSequence2->bases, start2 + i, getCode(packedSequence->bases, start + i));
+        }
+        return;
+    }
+    for (int64_t i = 0; i < length; i++) {
+        setCode(packedSequence2->bases, start2 + i, getCode(packedSequence->bases, start + i));
+    }
+}
+
+static void copyExceptions(PackedSequence *packedSequence, int64_t start, int64_t length,
+        PackedSequence *packedSequence2, int64_t *maxExceptionNumber, int64_t shift) {
+    int64_t i = 0, j = packedSequence->exceptionNumber;
+    while (i < j) { //Binary search for the first exception at or after start
+        int64_t k = (i + j) / 2;
+        if (packedSequence->exceptionPositions[k] < start) {
+            i = k + 1;
+        } else {
+            j = k;
+        }
+    }
+    for (; i < packedSequence->exceptionNumber && packedSequence->exceptionPositions[i] < start + length; i++) {
+        appendException(packedSequence2, maxExceptionNumber, packedSequence->exceptionPositions[i] - start + shift,
+                packedSequence->exceptionChars[i]);
+    }
+}
+
+PackedSequence *packedSequence_getSubSequence(PackedSequence *packedSequence, int64_t start, int64_t length) {
+    assert(start >= 0);
+    assert(length >= 0);
+    assert(start + length <= packedSequence->length);
+    PackedSequence *packedSequence2 = packedSequence_constructEmpty(length);
+    copyBases(packedSequence, start, length, packedSequence2, 0);
+    int64_t maxNRunNumber = 0, maxMaskRunNumber = 0, maxExceptionNumber = 0;
+    copyRuns(packedSequence->nRuns, packedSequence->nRunNumber, &packedSequence2->nRuns, &packedSequence2->nRunNumber,
+            &maxNRunNumber, start, length, 0);
+    copyRuns(packedSequence->maskRuns, packedSequence->maskRunNumber, &packedSequence2->maskRuns,
+            &packedSequence2->maskRunNumber, &maxMaskRunNumber, start, length, 0);
+    copyExceptions(packedSequence, start, length, packedSequence2, &maxExceptionNumber, 0);
+    return packedSequence2;
+}
+
+static int64_t *reverseRuns(int64_t *runs, int64_t runNumber, int64_t length) {
+    if (runNumber == 0) {
+        return NULL;
+    }
+    int64_t *runs2 = st_malloc(sizeof(int64_t) * 2 * runNumber);
+    for (int64_t i = 0; i < runNumber; i++) {
+        int64_t j = runNumber - 1 - i;
+        runs2[2 * i] = length - runs[2 * j] - runs[2 * j + 1];
+        runs2[2 * i + 1] = runs[2 * j + 1];
+    }
+    return runs2;
+}
+
+PackedSequence *packedSequence_reverseComplement(PackedSequence *packedSequence) {
+    int64_t length = packedSequence->length;
+    PackedSequence *packedSequence2 = packedSequence_constructEmpty(length);
+    for (int64_t i = 0; i < length; i++) { //With the 0 to 3 coding the complement of a base is 3 - code
+        setCode(packedSequence2->bases, length - 1 - i, 3 - getCode(packedSequence->bases, i));
+    }
+    packedSequence2->nRunNumber = packedSequence->nRunNumber;
+    packedSequence2->nRuns = reverseRuns(packedSequence->nRuns, packedSequence->nRunNumber, length);
+    packedSequence2->maskRunNumber = packedSequence->maskRunNumber;
+    packedSequence2->maskRuns = reverseRuns(packedSequence->maskRuns, packedSequence->maskRunNumber, length);
+    packedSequence2->exceptionNumber = packedSequence->exceptionNumber;
+    if (packedSequence->exceptionNumber > 0) {
+        packedSequence2->exceptionPositions = st_malloc(sizeof(int64_t) * packedSequence->exceptionNumber);
+        packedSequence2->exceptionChars = st_malloc(sizeof(char) * packedSequence->exceptionNumber);
+        for (int64_t i = 0; i < packedSequence->exceptionNumber; i++) {
+            int64_t j = packedSequence->exceptionNumber - 1 - i;
+            packedSequence2->exceptionPositions[i] = length - 1 - packedSequence->exceptionPositions[j];
+            packedSequence2->exceptionChars[i] = stString_reverseComplementChar(packedSequence->exceptionChars[j]);
+        }
+    }
+    return packedSequence2;
+}
+
+PackedSequence *packedSequence_concatenate(stList *packedSequences) {
+    int64_t length = 0;
+    for (int64_t i = 0; i < stList_length(packedSequences); i++) {
+        length += packedSequence_getLength(stList_get(packedSequences, i));
+    }
+    PackedSequence *packedSequence2 = packedSequence_constructEmpty(length);
+    int64_t maxNRunNumber = 0, maxMaskRunNumber = 0, maxExceptionNumber = 0;
+    int64_t start2 = 0;
+    for (int64_t i = 0; i < stList_length(packedSequences); i++) {
+        PackedSequence *packedSequence = stList_get(packedSequences, i);
+        copyBases(packedSequence, 0, packedSequence->length, packedSequence2, start2);
+        copyRuns(packedSequence->nRuns, packedSequence->nRunNumber, &packedSequence2->nRuns,
+                &packedSequence2->nRunNumber, &maxNRunNumber, 0, packedSequence->length, start2);
+        copyRuns(packedSequence->maskRuns, packedSequence->maskRunNumber, &packedSequence2->maskRuns,
+                &packedSequence2->maskRunNumber, &maxMaskRunNumber, 0, packedSequence->length, start2);
+        copyExceptions(packedSequence, 0, packedSequence->length, packedSequence2, &maxExceptionNumber, start2);
+        start2 += packedSequence->length;
+    }
+    return packedSequence2;
+}
+
+/*
+ * Serialisation functions. All the integers of a record are 32 bit, as records hold at most a chunk of a string.
+ */
+
+static void writeUInt32(char **cA, int64_t i) {
+    assert(i >= 0 && i <= UINT32_MAX);
+    uint32_t j = (uint32_t) i;
+    memcpy(*cA, &j, sizeof(uint32_t));
+    *cA += sizeof(uint32_t);
+}
+
+static int64_t readUInt32(const char **cA) {
+    uint32_t j;
+    memcpy(&j, *cA, sizeof(uint32_t));
+    *cA += sizeof(uint32_t);
+    return j;
+}
+
+void *packedSequence_writeBinaryRepresentation(PackedSequence *packedSequence, int64_t *recordSize) {
+    int64_t basesSize = (packedSequence->length + 3) / 4;
+    *recordSize = sizeof(uint32_t) * (4 + 2 * (packedSequence->nRunNumber + packedSequence->maskRunNumber)
+            + packedSequence->exceptionNumber) + sizeof(char) * packedSequence->exceptionNumber + basesSize;
+    char *record = st_malloc(*recordSize);
+    char *cA = record;
+    writeUInt32(&cA, packedSequence->length);
+    writeUInt32(&cA, packedSequence->nRunNumber);
+    writeUInt32(&cA, packedSequence->maskRunNumber);
+    writeUInt32(&cA, packedSequence->exceptionNumber);
+    memcpy(cA, packedSequence->bases, basesSize);
+    cA += basesSize;
+    for (int64_t i = 0; i < 2 * packedSequence->nRunNumber; i++) {
+        writeUInt32(&cA, packedSequence->nRuns[i]);
+    }
+    for (int64_t i = 0; i < 2 * packedSequence->maskRunNumber; i++) {
+        writeUInt32(&cA, packedSequence->maskRuns[i]);
+    }
+    for (int64_t i = 0; i < packedSequence->exceptionNumber; i++) {
+        writeUInt32(&cA, packedSequence->exceptionPositions[i]);
+    }
+    for (int64_t i = 0; i < packedSequence->exceptionNumber; i++) {
+        *cA++ = packedSequence->exceptionChars[i];
+    }
+    assert(cA - record == *recordSize);
+    return record;
+}
+
+static int64_t *readRuns(const char **cA, int64_t runNumber) {
+    if (runNumber == 0) {
+        return NULL;
+    }
+    int64_t *runs = st_malloc(sizeof(int64_t) * 2 * runNumber);
+    for (int64_t i = 0; i < 2 * runNumber; i++) {
+        runs[i] = readUInt32(cA);
+    }
+    return runs;
+}
+
+PackedSequence *packedSequence_loadFromBinaryRepresentation(const void *record, int64_t recordSize) {
+    const char *cA = record;
+    assert(recordSize >= 4 * sizeof(uint32_t));
+    PackedSequence *packedSequence = packedSequence_constructEmpty(readUInt32(&cA));
+    packedSequence->nRunNumber = readUInt32(&cA);
+    packedSequence->maskRunNumber = readUInt32(&cA);
+    packedSequence->exceptionNumber = readUInt32(&cA);
+    int64_t basesSize = (packedSequence->length + 3) / 4;
+    memcpy(packedSequence->bases, cA, basesSize);
+    cA += basesSize;
+    packedSequence->nRuns = readRuns(&cA, packedSequence->nRunNumber);
+    packedSequence->maskRuns = readRuns(&cA, packedSequence->maskRunNumber);
+    if (packedSequence->exceptionNumber > 0) {
+        packedSequence->exceptionPositions = st_malloc(sizeof(int64_t) * packedSequence->exceptionNumber);
+        for (int64_t i = 0; i < packedSequence->exceptionNumber; i++) {
+            packedSequence->exceptionPositions[i] = readUInt32(&cA);
+        }
+        packedSequence->exceptionChars = st_malloc(sizeof(char) * packedSequence->exceptionNumber);
+        memcpy(packedSequence->exceptionChars, cA, packedSequence->exceptionNumber);
+        cA += packedSequence->exceptionNumber;
+    }
+    (void) recordSize;
+    assert(cA - (const char *) record == recordSize);
+    return packedSequence;
+}
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Packed sequence cache functions.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+struct _packedSequenceCache {
+    stSortedSet *records; //Cached substrings, sorted by name and then start. No record contains another.
+    struct _packedSequenceCacheRecord *head; //The most recently used record.
+    struct _packedSequenceCacheRecord *tail; //The least recently used record.
+    int64_t size;
+    int64_t maxSize;
+    CacheStats stats;
+};
+
+typedef struct _packedSequenceCacheRecord {
+    Name name;
+    int64_t start;
+    PackedSequence *packedSequence;
+    struct _packedSequenceCacheRecord *previous; //The next more recently used record.
+    struct _packedSequenceCacheRecord *next; //The next less recently used record.
+} PackedSequenceCacheRecord;
+
+static int packedSequenceCacheRecord_cmp(const PackedSequenceCacheRecord *record1,
+        const PackedSequenceCacheRecord *record2) {
+    int i = cactusMisc_nameCompare(record1->name, record2->name);
+    if (i != 0) {
+        return i;
+    }
+    return record1->start < record2->start ? -1 : (record1->start > record2->start ? 1 : 0);
+}
+
+static void packedSequenceCacheRecord_destruct(PackedSequenceCacheRecord *record) {
+    packedSequence_destruct(record->packedSequence);
+    free(record);
+}
+
+static int64_t packedSequenceCacheRecord_getEnd(PackedSequenceCacheRecord *record) {
+    return record->start + record->packedSequence->length;
+}
+
+PackedSequenceCache *packedSequenceCache_construct(int64_t maxSize) {
+    PackedSequenceCache *cache = st_calloc(1, sizeof(PackedSequenceCache));
+    cache->records = stSortedSet_construct3((int (*)(const void *, const void *)) packedSequenceCacheRecord_cmp,
+            (void (*)(void *)) packedSequenceCacheRecord_destruct);
+    cache->maxSize = maxSize;
+    return cache;
+}
+
+void packedSequenceCache_destruct(PackedSequenceCache *cache) {
+    stSortedSet_destruct(cache->records);
+    free(cache);
+}
+
+void packedSequenceCache_clear(PackedSequenceCache *cache) {
+    stSortedSet_destruct(cache->records);
+    cache->records = stSortedSet_construct3((int (*)(const void *, const void *)) packedSequenceCacheRecord_cmp,
+            (void (*)(void *)) packedSequenceCacheRecord_destruct);
+    cache->head = NULL;
+    cache->tail = NULL;
+    cache->size = 0;
+}
+
+static void unlinkRecord(PackedSequenceCache *cache, PackedSequenceCacheRecord *record) {
+    if (record->previous != NULL) {
+        record->previous->next = record->next;
+    } else {
+        cache->head = record->next;
+    }
+    if (record->next != NULL) {
+        record->next->previous = record->previous;
+    } else {
+        cache->tail = record->previous;
+    }
+}
+
+static void linkRecordAtHead(PackedSequenceCache *cache, PackedSequenceCacheRecord *record) {
+    record->previous = NULL;
+    record->next = cache->head;
+    if (cache->head != NULL) {
+        cache->head->previous = record;
+    } else {
+        cache->tail = record;
+    }
+    cache->head = record;
+}
+
+static void removeRecord(PackedSequenceCache *cache, PackedSequenceCacheRecord *record) {
+    unlinkRecord(cache, record);
+    stSortedSet_remove(cache->records, record);
+    cache->size -= packedSequence_getMemorySize(record->packedSequence);
+    packedSequenceCacheRecord_destruct(record);
+}
+
+static void evictRecords(PackedSequenceCache *cache, int64_t maxSize) {
+    while (cache->size > maxSize && cache->tail != NULL) {
+        removeRecord(cache, cache->tail);
+        cache->stats.evictions++;
+    }
+}
+
+void packedSequenceCache_setMaxSize(PackedSequenceCache *cache, int64_t maxSize) {
+    cache->maxSize = maxSize;
+    evictRecords(cache, maxSize);
+}
+
+int64_t packedSequenceCache_getMaxSize(PackedSequenceCache *cache) {
+    return cache->maxSize;
+}
+
+CacheStats *packedSequenceCache_getStats(PackedSequenceCache *cache) {
+    return &cache->stats;
+}
+
+void packedSequenceCache_setRecord(PackedSequenceCache *cache, Name name, int64_t start,
+        PackedSequence *packedSequence) {
+    PackedSequenceCacheRecord *record = st_malloc(sizeof(PackedSequenceCacheRecord));
+    record->name = name;
+    record->start = start;
+    record->packedSequence = packedSequence;
+    cache->stats.bytesFetched += packedSequence_getMemorySize(packedSequence);
+    //If an existing record already contains the substring we have nothing to do.
+    PackedSequenceCacheRecord *record2 = stSortedSet_searchLessThanOrEqual(cache->records, record);
+    if (record2 != NULL && record2->name == name
+            && packedSequenceCacheRecord_getEnd(record2) >= packedSequenceCacheRecord_getEnd(record)) {
+        unlinkRecord(cache, record2);
+        linkRecordAtHead(cache, record2);
+        packedSequenceCacheRecord_destruct(record);
+        return;
+    }
+    if (record2 != NULL && record2->name == name && record2->start == start) {
+        removeRecord(cache, record2);
+    }
+    //Evict the least recently used records to make room. The new record is always added, even if
+    //it is bigger than the cache, as the caller expects to find it.
+    evictRecords(cache, cache->maxSize - packedSequence_getMemorySize(packedSequence));
+    stSortedSet_insert(cache->records, record);
+    linkRecordAtHead(cache, record);
+    cache->size += packedSequence_getMemorySize(packedSequence);
+    //Now remove the records the new record contains, so that the set stays sorted by end as well as start.
+    while ((record2 = stSortedSet_searchGreaterThan(cache->records, record)) != NULL && record2->name == name
+            && packedSequenceCacheRecord_getEnd(record2) <= packedSequenceCacheRecord_getEnd(record)) {
+        removeRecord(cache, record2);
+    }
+}
+
+PackedSequence *packedSequenceCache_getRecord(PackedSequenceCache *cache, Name name, int64_t start,
+        int64_t length, int64_t *offset, bool countLookup) {
+    PackedSequenceCacheRecord record;
+    record.name = name;
+    record.start = start;
+    //As no record contains another, the last record starting at or before start reaches furthest.
+    PackedSequenceCacheRecord *record2 = stSortedSet_searchLessThanOrEqual(cache->records, &record);
+    if (record2 == NULL || record2->name != name || packedSequenceCacheRecord_getEnd(record2) < start + length) {
+        if (countLookup) {
+            cache->stats.misses++;
+        }
+        return NULL;
+    }
+    if (countLookup) {
+        cache->stats.hits++;
+    }
+    unlinkRecord(cache, record2);
+    linkRecordAtHead(cache, record2);
+    *offset = start - record2->start;
+    return record2->packedSequence;
+}
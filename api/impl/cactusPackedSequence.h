@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_PACKED_SEQUENCE_H_
+#define CACTUS_PACKED_SEQUENCE_H_
+
+#include "cactusGlobals.h"
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Functions for storing sequence strings packed at 2 bits per base.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+/*
+ * Codes recorded in the cactus disk parameters to say how the sequence strings are stored.
+ * Databases written before the code was recorded are plain.
+ */
+#define CACTUS_DISK_SEQUENCE_FORMAT_PLAIN 0
+#define CACTUS_DISK_SEQUENCE_FORMAT_PACKED 1
+
+typedef struct _packedSequence PackedSequence;
+typedef struct _packedSequenceCache PackedSequenceCache;
+
+struct _packedSequence {
+    int64_t length;
+    uint8_t *bases; //A, C, G and T coded as 0 to 3, four bases to a byte, first base in the low bits.
+    int64_t nRunNumber;
+    int64_t *nRuns; //Start and length pairs of the runs of N (or n).
+    int64_t maskRunNumber;
+    int64_t *maskRuns; //Start and length pairs of the runs of lower case (soft masked) bases.
+    int64_t exceptionNumber;
+    int64_t *exceptionPositions; //Positions of any other characters (IUPAC codes etc.), kept verbatim.
+    char *exceptionChars;
+};
+
+/*
+ * Packs the first length characters of the given string.
+ */
+PackedSequence *packedSequence_construct(const char *string, int64_t length);
+
+void packedSequence_destruct(PackedSequence *packedSequence);
+
+/*
+ * Returns the number of bases in the sequence.
+ */
+int64_t packedSequence_getLength(PackedSequence *packedSequence);
+
+/*
+ * Returns the approximate number of bytes of memory used by the sequence.
+ */
+int64_t packedSequence_getMemorySize(PackedSequence *packedSequence);
+
+/*
+ * Unpacks the sequence into a newly allocated string, with the original case restored.
+ */
+char *packedSequence_getString(PackedSequence *packedSequence);
+
+/*
+ * Gets a packed copy of the given interval of the sequence.
+ */
+PackedSequence *packedSequence_getSubSequence(PackedSequence *packedSequence, int64_t start, int64_t length);
+
+/*
+ * Gets the reverse complement of the sequence, computed without unpacking it.
+ */
+PackedSequence *packedSequence_reverseComplement(PackedSequence *packedSequence);
+
+/*
+ * Concatenates the list of packed sequences into one new packed sequence.
+ */
+PackedSequence *packedSequence_concatenate(stList *packedSequences);
+
+/*
+ * Serialises the sequence to a newly allocated record of size recordSize, as stored in the
+ * cactus disk. The sequence must be shorter than 2^32 bases.
+ */
+void *packedSequence_writeBinaryRepresentation(PackedSequence *packedSequence, int64_t *recordSize);
+
+/*
+ * Parses a sequence from a record created by packedSequence_writeBinaryRepresentation.
+ */
+PackedSequence *packedSequence_loadFromBinaryRepresentation(const void *record, int64_t recordSize);
+
+/*
+ * Constructs a cache of packed substrings, which evicts the least recently used substrings
+ * to keep its size at most maxSize bytes.
+ */
+PackedSequenceCache *packedSequenceCache_construct(int64_t maxSize);
+
+void packedSequenceCache_destruct(PackedSequenceCache *cache);
+
+/*
+ * Removes all the sequences from the cache.
+ */
+void packedSequenceCache_clear(PackedSequenceCache *cache);
+
+/*
+ * Sets the maximum size of the cache, evicting sequences if it is now too big.
+ */
+void packedSequenceCache_setMaxSize(PackedSequenceCache *cache, int64_t maxSize);
+
+int64_t packedSequenceCache_getMaxSize(PackedSequenceCache *cache);
+
+CacheStats *packedSequenceCache_getStats(PackedSequenceCache *cache);
+
+/*
+ * Adds the substring of the string with the given name starting at start to the cache. The
+ * cache takes ownership of the packed sequence. The substring is added even if it is bigger
+ * than the cache.
+ */
+void packedSequenceCache_setRecord(PackedSequenceCache *cache, Name name, int64_t start,
+        PackedSequence *packedSequence);
+
+/*
+ * Returns a cached sequence containing the given interval of the named string, setting offset
+ * to the start of the interval within it, or NULL if the interval is not cached. The returned
+ * sequence is owned by the cache. If countLookup is non-zero the lookup is counted in the
+ * cache's hits or misses.
+ */
+PackedSequence *packedSequenceCache_getRecord(PackedSequenceCache *cache, Name name, int64_t start,
+        int64_t length, int64_t *offset, bool countLookup);
+
+#endif
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+
+void cacheStats_log(CacheStats *stats, const char *cacheName) {
+    int64_t lookups = stats->hits + stats->misses;
+    st_logInfo("The %s had %" PRIi64 " hits and %" PRIi64 " misses (%.2f%% hits), %" PRIi64
+            " evictions and %" PRIi64 " bytes fetched\n", cacheName, stats->hits, stats->misses,
+            lookups > 0 ? 100.0 * stats->hits / lookups : 0.0, stats->evictions, stats->bytesFetched);
+}
+
+typedef struct _recordCacheEntry RecordCacheEntry;
+
+struct _recordCacheEntry {
+    Name name;
+    void *record;
+    int64_t recordSize;
+    RecordCacheEntry *previous; //The next more recently used entry.
+    RecordCacheEntry *next; //The next less recently used entry.
+};
+
+struct _recordCache {
+    stHash *entries; //The entries, keyed by themselves and hashed by name.
+    RecordCacheEntry *head; //The most recently used entry.
+    RecordCacheEntry *tail; //The least recently used entry.
+    int64_t size;
+    int64_t maxSize;
+    CacheStats stats;
+};
+
+static uint64_t recordCacheEntry_hashKey(const RecordCacheEntry *entry) {
+    return (uint64_t) entry->name * 0x9e3779b97f4a7c15ULL;
+}
+
+static int recordCacheEntry_equals(const RecordCacheEntry *entry1, const RecordCacheEntry *entry2) {
+    return entry1->name == entry2->name;
+}
+
+static int64_t recordCacheEntry_getSize(RecordCacheEntry *entry) {
+    return entry->recordSize + sizeof(RecordCacheEntry);
+}
+
+static void recordCacheEntry_destruct(RecordCacheEntry *entry) {
+    free(entry->record);
+    free(entry);
+}
+
+RecordCache *recordCache_construct(int64_t maxSize) {
+    RecordCache *cache = st_calloc(1, sizeof(RecordCache));
+    cache->entries = stHash_construct3((uint64_t (*)(const void *)) recordCacheEntry_hashKey,
+            (int (*)(const void *, const void *)) recordCacheEntry_equals, NULL, NULL);
+    cache->maxSize = maxSize;
+    return cache;
+}
+
+void recordCache_destruct(RecordCache *cache) {
+    recordCache_clear(cache);
+    stHash_destruct(cache->entries);
+    free(cache);
+}
+
+void recordCache_clear(RecordCache *cache) {
+    RecordCacheEntry *entry = cache->head;
+    while (entry != NULL) {
+        RecordCacheEntry *next = entry->next;
+        stHash_remove(cache->entries, entry);
+        recordCacheEntry_destruct(entry);
+        entry = next;
+    }
+    assert(stHash_size(cache->entries) == 0);
+    cache->head = NULL;
+    cache->tail = NULL;
+    cache->size = 0;
+}
+
+static void unlinkEntry(RecordCache *cache, RecordCacheEntry *entry) {
+    if (entry->previous != NULL) {
+        entry->previous->next = entry->next;
+    } else {
+        cache->head = entry->next;
+    }
+    if (entry->next != NULL) {
+        entry->next->previous = entry->previous;
+    } else {
+        cache->tail = entry->previous;
+    }
+    entry->previous = NULL;
+    entry->next = NULL;
+}
+
+static void linkEntryAtHead(RecordCache *cache, RecordCacheEntry *entry) {
+    entry->previous = NULL;
+    entry->next = cache->head;
+    if (cache->head != NULL) {
+        cache->head->previous = entry;
+    } else {
+        cache->tail = entry;
+    }
+    cache->head = entry;
+}
+
+static void removeEntry(RecordCache *cache, RecordCacheEntry *entry) {
+    unlinkEntry(cache, entry);
+    stHash_remove(cache->entries, entry);
+    cache->size -= recordCacheEntry_getSize(entry);
+    recordCacheEntry_destruct(entry);
+}
+
+static void evictEntries(RecordCache *cache, int64_t maxSize) {
+    while (cache->size > maxSize) {
+        assert(cache->tail != NULL);
+        removeEntry(cache, cache->tail);
+        cache->stats.evictions++;
+    }
+}
+
+void recordCache_setMaxSize(RecordCache *cache, int64_t maxSize) {
+    cache->maxSize = maxSize;
+    evictEntries(cache, maxSize);
+}
+
+int64_t recordCache_getMaxSize(RecordCache *cache) {
+    return cache->maxSize;
+}
+
+int64_t recordCache_getSize(RecordCache *cache) {
+    return cache->size;
+}
+
+static RecordCacheEntry *getEntry(RecordCache *cache, Name name) {
+    RecordCacheEntry entry;
+    entry.name = name;
+    return stHash_search(cache->entries, &entry);
+}
+
+bool recordCache_containsRecord(RecordCache *cache, Name name) {
+    return getEntry(cache, name) != NULL;
+}
+
+void *recordCache_getRecord(RecordCache *cache, Name name, int64_t *recordSize) {
+    RecordCacheEntry *entry = getEntry(cache, name);
+    if (entry == NULL) {
+        cache->stats.misses++;
+        return NULL;
+    }
+    cache->stats.hits++;
+    unlinkEntry(cache, entry);
+    linkEntryAtHead(cache, entry);
+    *recordSize = entry->recordSize;
+    void *record = st_malloc(entry->recordSize + 1);
+    memcpy(record, entry->record, entry->recordSize);
+    return record;
+}
+
+void recordCache_setRecord(RecordCache *cache, Name name, const void *record, int64_t recordSize) {
+    RecordCacheEntry *entry = getEntry(cache, name);
+    if (entry != NULL) {
+        removeEntry(cache, entry);
+    }
+    cache->stats.bytesFetched += recordSize;
+    if (recordSize + (int64_t) sizeof(RecordCacheEntry) > cache->maxSize) {
+        return;
+    }
+    entry = st_malloc(sizeof(RecordCacheEntry));
+    entry->name = name;
+    entry->record = st_malloc(recordSize + 1);
+    memcpy(entry->record, record, recordSize);
+    entry->recordSize = recordSize;
+    evictEntries(cache, cache->maxSize - recordCacheEntry_getSize(entry));
+    linkEntryAtHead(cache, entry);
+    stHash_insert(cache->entries, entry, entry);
+    cache->size += recordCacheEntry_getSize(entry);
+}
+
+CacheStats *recordCache_getStats(RecordCache *cache) {
+    return &cache->stats;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_RECORD_CACHE_H_
+#define CACTUS_RECORD_CACHE_H_
+
+#include "cactusGlobals.h"
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Functions for caching the records of the cactus disk.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+/*
+ * Counts of the use of a cache, kept by the record and string caches of the cactus disk.
+ */
+typedef struct _cacheStats {
+    int64_t hits; //Lookups found in the cache.
+    int64_t misses; //Lookups not found in the cache.
+    int64_t evictions; //Entries removed to keep the cache within its size.
+    int64_t bytesFetched; //Bytes added to the cache, having been fetched from the database.
+} CacheStats;
+
+/*
+ * Logs the counts at the info level, with the name of the cache.
+ */
+void cacheStats_log(CacheStats *stats, const char *cacheName);
+
+typedef struct _recordCache RecordCache;
+
+/*
+ * Constructs a cache of records keyed by name, which evicts the least recently used records
+ * to keep the total size of the records at most maxSize bytes.
+ */
+RecordCache *recordCache_construct(int64_t maxSize);
+
+void recordCache_destruct(RecordCache *cache);
+
+/*
+ * Removes all the records from the cache.
+ */
+void recordCache_clear(RecordCache *cache);
+
+/*
+ * Sets the maximum size of the cache, evicting records if it is now too big.
+ */
+void recordCache_setMaxSize(RecordCache *cache, int64_t maxSize);
+
+int64_t recordCache_getMaxSize(RecordCache *cache);
+
+/*
+ * Returns the total size of the records in the cache.
+ */
+int64_t recordCache_getSize(RecordCache *cache);
+
+/*
+ * Returns non-zero if the record is in the cache. Unlike recordCache_getRecord this is not
+ * counted as a lookup, and does not make the record more recently used.
+ */
+bool recordCache_containsRecord(RecordCache *cache, Name name);
+
+/*
+ * Returns a copy of the record, setting recordSize to its size, or NULL if it is not in the cache.
+ */
+void *recordCache_getRecord(RecordCache *cache, Name name, int64_t *recordSize);
+
+/*
+ * Adds a copy of the record to the cache, replacing any record with the same name. A record
+ * bigger than the cache is not added.
+ */
+void recordCache_setRecord(RecordCache *cache, Name name, const void *record, int64_t recordSize);
+
+CacheStats *recordCache_getStats(RecordCache *cache);
+
+#endif
@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+#include <pthread.h>
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+/*
+ * The minimum number of samples zstd needs to train a dictionary.
+ */
+#define RECORD_CODEC_MIN_DICTIONARY_SAMPLES 10
+
+/*
+ * The level passed to zlib, whose default level is -1, and to zstd.
+ */
+#define RECORD_CODEC_ZLIB_LEVEL(level) ((level) == RECORD_CODEC_DEFAULT_LEVEL ? -1 : (level))
+#define RECORD_CODEC_ZSTD_LEVEL(level) ((level) == RECORD_CODEC_DEFAULT_LEVEL ? ZSTD_CLEVEL_DEFAULT : (int) (level))
+
+struct _recordCodec {
+    int64_t type;
+    int64_t level;
+    void *dictionary; //Set last by recordCodec_setDictionary, so the zstd dictionaries are made once it is seen.
+    int64_t dictionarySize;
+#ifdef HAVE_ZSTD
+    ZSTD_CDict *compressionDictionary;
+    ZSTD_DDict *decompressionDictionary;
+#endif
+};
+
+#ifdef HAVE_ZSTD
+/*
+ * The zstd contexts of a thread, which are kept for the life of the thread as making them for each record is slow.
+ */
+typedef struct _zstdContexts {
+    ZSTD_CCtx *compressionContext;
+    ZSTD_DCtx *decompressionContext;
+} ZstdContexts;
+
+static pthread_key_t zstdContextsKey;
+static pthread_once_t zstdContextsKeyOnce = PTHREAD_ONCE_INIT;
+
+static void destructZstdContexts(void *contexts) {
+    ZSTD_freeCCtx(((ZstdContexts *) contexts)->compressionContext);
+    ZSTD_freeDCtx(((ZstdContexts *) contexts)->decompressionContext);
+    free(contexts);
+}
+
+static void constructZstdContextsKey(void) {
+    if (pthread_key_create(&zstdContextsKey, destructZstdContexts) != 0) {
+        st_errAbort("Could not create the key for the zstd contexts");
+    }
+}
+
+static ZstdContexts *getZstdContexts(void) {
+    pthread_once(&zstdContextsKeyOnce, constructZstdContextsKey);
+    ZstdContexts *contexts = pthread_getspecific(zstdContextsKey);
+    if (contexts == NULL) {
+        contexts = st_malloc(sizeof(ZstdContexts));
+        contexts->compressionContext = ZSTD_createCCtx();
+        contexts->decompressionContext = ZSTD_createDCtx();
+        if (contexts->compressionContext == NULL || contexts->decompressionContext == NULL) {
+            st_errAbort("Could not create the zstd contexts");
+        }
+        pthread_setspecific(zstdContextsKey, contexts);
+    }
+    return contexts;
+}
+#endif
+
+bool recordCodec_isAvailable(int64_t type) {
+    switch (type) {
+    case RECORD_CODEC_NONE:
+    case RECORD_CODEC_ZLIB:
+        return 1;
+#ifdef HAVE_LZ4
+    case RECORD_CODEC_LZ4:
+        return 1;
+#endif
+#ifdef HAVE_ZSTD
+    case RECORD_CODEC_ZSTD:
+    case RECORD_CODEC_ZSTD_DICTIONARY:
+        return 1;
+#endif
+    default:
+        return 0;
+    }
+}
+
+RecordCodec *recordCodec_construct(int64_t type, int64_t level) {
+    if (!recordCodec_isAvailable(type)) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "The record codec %" PRIi64 " is not available in this build", type);
+    }
+    RecordCodec *codec = st_calloc(1, sizeof(RecordCodec));
+    codec->type = type;
+    codec->level = level;
+    return codec;
+}
+
+RecordCodec *recordCodec_constructFromString(const char *string) {
+    static const char *names[] = { "none", "zlib", "lz4", "zstd", "zstd_dictionary" };
+    int64_t nameLength = strcspn(string, ":");
+    for (int64_t type = 0; type < 5; type++) {
+        if (strlen(names[type]) == nameLength && strncmp(string, names[type], nameLength) == 0) {
+            int64_t level = RECORD_CODEC_DEFAULT_LEVEL;
+            if (string[nameLength] == ':') {
+                int64_t j = sscanf(string + nameLength + 1, "%" SCNi64, &level);
+                if (j != 1) {
+                    stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Could not parse the level of the record codec: %s", string);
+                }
+            }
+            return recordCodec_construct(type, level);
+        }
+    }
+    stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Unknown record codec: %s", string);
+    return NULL;
+}
+
+void recordCodec_destruct(RecordCodec *codec) {
+#ifdef HAVE_ZSTD
+    if (codec->compressionDictionary != NULL) {
+        ZSTD_freeCDict(codec->compressionDictionary);
+        ZSTD_freeDDict(codec->decompressionDictionary);
+    }
+#endif
+    free(codec->dictionary);
+    free(codec);
+}
+
+int64_t recordCodec_getType(RecordCodec *codec) {
+    return codec->type;
+}
+
+int64_t recordCodec_getLevel(RecordCodec *codec) {
+    return codec->level;
+}
+
+bool recordCodec_hasDictionary(RecordCodec *codec) {
+    return __atomic_load_n(&codec->dictionary, __ATOMIC_ACQUIRE) != NULL;
+}
+
+void recordCodec_setDictionary(RecordCodec *codec, const void *dictionary, int64_t dictionarySize) {
+    assert(codec->dictionary == NULL);
+    void *dictionaryCopy = st_malloc(dictionarySize);
+    memcpy(dictionaryCopy, dictionary, dictionarySize);
+    codec->dictionarySize = dictionarySize;
+#ifdef HAVE_ZSTD
+    codec->compressionDictionary = ZSTD_createCDict(dictionaryCopy, dictionarySize,
+            RECORD_CODEC_ZSTD_LEVEL(codec->level));
+    codec->decompressionDictionary = ZSTD_createDDict(dictionaryCopy, dictionarySize);
+#endif
+    //Threads compressing at the same time see no dictionary until the zstd dictionaries are made.
+    __atomic_store_n(&codec->dictionary, dictionaryCopy, __ATOMIC_RELEASE);
+}
+
+void *recordCodec_trainDictionary(stList *samples, int64_t *sampleSizes, int64_t maxDictionarySize,
+        int64_t *dictionarySize) {
+#ifdef HAVE_ZSTD
+    if (stList_length(samples) < RECORD_CODEC_MIN_DICTIONARY_SAMPLES) {
+        return NULL;
+    }
+    //Concatenate the samples, as zstd wants them
+    int64_t totalSize = 0;
+    size_t *sizes = st_malloc(sizeof(size_t) * stList_length(samples));
+    for (int64_t i = 0; i < stList_length(samples); i++) {
+        sizes[i] = sampleSizes[i];
+        totalSize += sampleSizes[i];
+    }
+    char *concatenatedSamples = st_malloc(totalSize + 1);
+    char *c = concatenatedSamples;
+    for (int64_t i = 0; i < stList_length(samples); i++) {
+        memcpy(c, stList_get(samples, i), sampleSizes[i]);
+        c += sampleSizes[i];
+    }
+    void *dictionary = st_malloc(maxDictionarySize);
+    size_t i = ZDICT_trainFromBuffer(dictionary, maxDictionarySize, concatenatedSamples, sizes,
+            stList_length(samples));
+    free(concatenatedSamples);
+    free(sizes);
+    if (ZDICT_isError(i)) {
+        st_logInfo("Could not train a record compression dictionary: %s\n", ZDICT_getErrorName(i));
+        free(dictionary);
+        return NULL;
+    }
+    *dictionarySize = i;
+    return dictionary;
+#else
+    (void) samples;
+    (void) sampleSizes;
+    (void) maxDictionarySize;
+    (void) dictionarySize;
+    return NULL;
+#endif
+}
+
+void *recordCodec_compress(RecordCodec *codec, const void *data, int64_t dataSize, int64_t *recordSize) {
+    int64_t type = codec->type;
+    if (type == RECORD_CODEC_ZSTD_DICTIONARY && !recordCodec_hasDictionary(codec)) {
+        type = RECORD_CODEC_ZSTD;
+    }
+#ifdef HAVE_LZ4
+    if (type == RECORD_CODEC_LZ4 && dataSize > LZ4_MAX_INPUT_SIZE) {
+        //The LZ4 block API takes int sizes, so records too large for it are tagged as zlib.
+        type = RECORD_CODEC_ZLIB;
+    }
+#endif
+    char *record = NULL;
+    switch (type) {
+    case RECORD_CODEC_NONE: {
+        record = st_malloc(dataSize + 1);
+        memcpy(record + 1, data, dataSize);
+        *recordSize = dataSize + 1;
+        break;
+    }
+    case RECORD_CODEC_ZLIB: {
+        int64_t compressedSize;
+        char *compressed = stCompression_compress((void *) data, dataSize, &compressedSize,
+                codec->type == RECORD_CODEC_ZLIB ? RECORD_CODEC_ZLIB_LEVEL(codec->level) : -1);
+        record = st_malloc(compressedSize + 1);
+        memcpy(record + 1, compressed, compressedSize);
+        free(compressed);
+        *recordSize = compressedSize + 1;
+        break;
+    }
+#ifdef HAVE_LZ4
+    case RECORD_CODEC_LZ4: {
+        //LZ4 blocks don't record their uncompressed size, so it follows the tag.
+        int bound = LZ4_compressBound((int) dataSize);
+        record = st_malloc(1 + sizeof(int64_t) + bound);
+        memcpy(record + 1, &dataSize, sizeof(int64_t));
+        int64_t compressedSize = LZ4_compress_default(data, record + 1 + sizeof(int64_t), (int) dataSize, bound);
+        if (compressedSize <= 0 && dataSize > 0) {
+            st_errAbort("LZ4 failed to compress a record of %" PRIi64 " bytes", dataSize);
+        }
+        *recordSize = 1 + sizeof(int64_t) + compressedSize;
+        break;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case RECORD_CODEC_ZSTD:
+    case RECORD_CODEC_ZSTD_DICTIONARY: {
+        int64_t bound = ZSTD_compressBound(dataSize);
+        record = st_malloc(1 + bound);
+        size_t compressedSize;
+        ZSTD_CCtx *context = getZstdContexts()->compressionContext;
+        if (type == RECORD_CODEC_ZSTD) {
+            compressedSize = ZSTD_compressCCtx(context, record + 1, bound, data, dataSize,
+                    RECORD_CODEC_ZSTD_LEVEL(codec->level));
+        } else {
+            compressedSize = ZSTD_compress_usingCDict(context, record + 1, bound, data, dataSize,
+                    codec->compressionDictionary);
+        }
+        if (ZSTD_isError(compressedSize)) {
+            st_errAbort("zstd failed to compress a record: %s", ZSTD_getErrorName(compressedSize));
+        }
+        *recordSize = 1 + compressedSize;
+        break;
+    }
+#endif
+    default:
+        st_errAbort("The record codec %" PRIi64 " is not available in this build", type);
+    }
+    record[0] = (char) type;
+    return record;
+}
+
+int64_t recordCodec_getRecordType(const void *record, int64_t recordSize) {
+    assert(recordSize > 0);
+    (void) recordSize;
+    return *((const char *) record);
+}
+
+void *recordCodec_decompress(RecordCodec *codec, const void *record, int64_t recordSize, int64_t *dataSize) {
+    int64_t type = recordCodec_getRecordType(record, recordSize);
+    const char *compressed = (const char *) record + 1;
+    int64_t compressedSize = recordSize - 1;
+    char *data = NULL;
+    switch (type) {
+    case RECORD_CODEC_NONE: {
+        data = st_malloc(compressedSize + 1);
+        memcpy(data, compressed, compressedSize);
+        *dataSize = compressedSize;
+        break;
+    }
+    case RECORD_CODEC_ZLIB: {
+        data = stCompression_decompress((char *) compressed, compressedSize, dataSize);
+        break;
+    }
+#ifdef HAVE_LZ4
+    case RECORD_CODEC_LZ4: {
+        memcpy(dataSize, compressed, sizeof(int64_t));
+        if (*dataSize < 0 || *dataSize > LZ4_MAX_INPUT_SIZE || compressedSize - (int64_t) sizeof(int64_t) > INT_MAX) {
+            st_errAbort("An LZ4 record has an invalid size");
+        }
+        data = st_malloc(*dataSize + 1);
+        if (LZ4_decompress_safe(compressed + sizeof(int64_t), data, (int) (compressedSize - sizeof(int64_t)),
+                (int) *dataSize) != *dataSize) {
+            st_errAbort("LZ4 failed to decompress a record");
+        }
+        break;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case RECORD_CODEC_ZSTD:
+    case RECORD_CODEC_ZSTD_DICTIONARY: {
+        unsigned long long i = ZSTD_getFrameContentSize(compressed, compressedSize);
+        if (i == ZSTD_CONTENTSIZE_ERROR || i == ZSTD_CONTENTSIZE_UNKNOWN) {
+            st_errAbort("Could not get the size of a zstd compressed record");
+        }
+        data = st_malloc(i + 1);
+        size_t j;
+        ZSTD_DCtx *context = getZstdContexts()->decompressionContext;
+        if (type == RECORD_CODEC_ZSTD) {
+            j = ZSTD_decompressDCtx(context, data, i, compressed, compressedSize);
+        } else {
+            if (!recordCodec_hasDictionary(codec)) {
+                st_errAbort("Tried to decompress a record without its dictionary");
+            }
+            j = ZSTD_decompress_usingDDict(context, data, i, compressed, compressedSize,
+                    codec->decompressionDictionary);
+        }
+        if (ZSTD_isError(j) || j != i) {
+            st_errAbort("zstd failed to decompress a record");
+        }
+        *dataSize = i;
+        break;
+    }
+#endif
+    default:
+        st_errAbort("The record codec %" PRIi64 " is not available in this build", type);
+    }
+    return data;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_RECORD_CODEC_H_
+#define CACTUS_RECORD_CODEC_H_
+
+#include "cactusGlobals.h"
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Functions for compressing the records of the cactus disk.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+/*
+ * Codecs, each record starts with a byte giving the codec used to compress it.
+ * LZ4 and zstd are only available if cactus is built with HAVE_LZ4 and HAVE_ZSTD.
+ */
+#define RECORD_CODEC_NONE 0
+#define RECORD_CODEC_ZLIB 1
+#define RECORD_CODEC_LZ4 2
+#define RECORD_CODEC_ZSTD 3
+#define RECORD_CODEC_ZSTD_DICTIONARY 4
+
+/*
+ * The level selecting the library's default level. Not -1, as -1 is a valid zstd level.
+ */
+#define RECORD_CODEC_DEFAULT_LEVEL INT64_MIN
+
+typedef struct _recordCodec RecordCodec;
+
+/*
+ * Constructs a codec of the given type. The level is passed to zlib and zstd,
+ * RECORD_CODEC_DEFAULT_LEVEL selects the library's default level. Throws an exception if the
+ * codec is not available in this build.
+ */
+RecordCodec *recordCodec_construct(int64_t type, int64_t level);
+
+/*
+ * Parses a codec from a string of the form "none", "zlib", "zlib:N", "lz4", "zstd", "zstd:N",
+ * "zstd_dictionary" or "zstd_dictionary:N", where N is the level, the default level if it is not
+ * given. Throws an exception if the
+ * string is malformed or the codec is not available.
+ */
+RecordCodec *recordCodec_constructFromString(const char *string);
+
+void recordCodec_destruct(RecordCodec *codec);
+
+int64_t recordCodec_getType(RecordCodec *codec);
+
+int64_t recordCodec_getLevel(RecordCodec *codec);
+
+/*
+ * Returns non-zero if the codec type is available in this build.
+ */
+bool recordCodec_isAvailable(int64_t type);
+
+/*
+ * Returns non-zero if the codec has a dictionary.
+ */
+bool recordCodec_hasDictionary(RecordCodec *codec);
+
+/*
+ * Sets the dictionary used to compress and decompress RECORD_CODEC_ZSTD_DICTIONARY records.
+ * The dictionary is copied, and can only be set once. Other threads may compress and decompress
+ * with the codec meanwhile, those compressing use the dictionary once it is set.
+ */
+void recordCodec_setDictionary(RecordCodec *codec, const void *dictionary, int64_t dictionarySize);
+
+/*
+ * Trains a dictionary of at most maxDictionarySize bytes from the list of sample records,
+ * whose sizes are in sampleSizes. Returns NULL if there are too few samples to train a
+ * dictionary, or zstd is not available.
+ */
+void *recordCodec_trainDictionary(stList *samples, int64_t *sampleSizes, int64_t maxDictionarySize,
+        int64_t *dictionarySize);
+
+/*
+ * Compresses the data, returning a new record starting with the codec's tag byte. A
+ * RECORD_CODEC_ZSTD_DICTIONARY codec without a dictionary compresses as RECORD_CODEC_ZSTD.
+ * Safe to call from several threads at once.
+ */
+void *recordCodec_compress(RecordCodec *codec, const void *data, int64_t dataSize, int64_t *recordSize);
+
+/*
+ * Returns the tag byte of a record written by recordCodec_compress.
+ */
+int64_t recordCodec_getRecordType(const void *record, int64_t recordSize);
+
+/*
+ * Decompresses a record written by recordCodec_compress with any codec, using the given
+ * codec's dictionary if needed. Safe to call from several threads at once.
+ */
+void *recordCodec_decompress(RecordCodec *codec, const void *record, int64_t recordSize, int64_t *dataSize);
+
+#endif
@@ -40,8 +40,9 @@ Segment *segment_construct2(Block *block, int64_t startCoordinate, bool strand,
 
 Segment *segment_construct3(Name name, Block *block, Cap *_5Cap, Cap *_3Cap) {
     Segment *segment;
-    segment = st_malloc(sizeof(Segment));
-    segment->rInstance = st_malloc(sizeof(Segment));
+    //Both orientations are allocated together.
+    segment = flowerArena_allocate(flower_getArena(block_getFlower(block)), 2 * sizeof(Segment));
+    segment->rInstance = segment + 1;
     segment->rInstance->rInstance = segment;
     segment->name = name;
     segment->rInstance->name = name;
@@ -59,8 +60,8 @@ Segment *segment_construct3(Name name, Block *block, Cap *_5Cap, Cap *_3Cap) {
 void segment_destruct(Segment *segment) {
     block_removeInstance(segment_getBlock(segment), segment);
     flower_removeSegment(block_getFlower(segment_getBlock(segment)), segment);
-    free(segment->rInstance);
-    free(segment);
+    flowerArena_free(flower_getArena(block_getFlower(segment_getBlock(segment))),
+            segment < segment->rInstance ? segment : segment->rInstance, 2 * sizeof(Segment));
 }
 
 Block *segment_getBlock(Segment *segment) {
@@ -14,6 +14,87 @@
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
 
+struct _binaryRepresentationFormat {
+	int64_t version;
+	Name baseName;
+	/*
+	 * Last coordinate written or read for each sequence (or event) name, in an open addressed table
+	 * of parallel arrays, so that looking up the coordinate of a cap allocates nothing.
+	 */
+	Name *sequenceNames;
+	int64_t *lastCoordinates;
+	bool *used;
+	int64_t size;
+	int64_t maxSize; //A power of two.
+	int64_t lastSlot; //The slot of the last lookup, as consecutive caps are often on the same sequence.
+};
+
+/*
+ * The format used by the calling thread, NULL for the fixed width format.
+ */
+static __thread BinaryRepresentationFormat *binaryRepresentation_currentFormat = NULL;
+
+BinaryRepresentationFormat *binaryRepresentationFormat_construct(int64_t version, Name baseName) {
+	BinaryRepresentationFormat *format = st_malloc(sizeof(BinaryRepresentationFormat));
+	format->version = version;
+	format->baseName = baseName;
+	format->size = 0;
+	format->maxSize = 16;
+	format->sequenceNames = st_malloc(format->maxSize * sizeof(Name));
+	format->lastCoordinates = st_malloc(format->maxSize * sizeof(int64_t));
+	format->used = st_calloc(format->maxSize, sizeof(bool));
+	format->lastSlot = -1;
+	return format;
+}
+
+void binaryRepresentationFormat_destruct(BinaryRepresentationFormat *format) {
+	free(format->sequenceNames);
+	free(format->lastCoordinates);
+	free(format->used);
+	free(format);
+}
+
+BinaryRepresentationFormat *binaryRepresentation_setFormat(BinaryRepresentationFormat *format) {
+	BinaryRepresentationFormat *previousFormat = binaryRepresentation_currentFormat;
+	binaryRepresentation_currentFormat = format;
+	return previousFormat;
+}
+
+int64_t binaryRepresentation_getFormatVersion(void) {
+	return binaryRepresentation_currentFormat == NULL ? BINARY_REPRESENTATION_FORMAT_FIXED : binaryRepresentation_currentFormat->version;
+}
+
+static bool binaryRepresentation_isCompact(void) {
+	return binaryRepresentation_currentFormat != NULL && binaryRepresentation_currentFormat->version == BINARY_REPRESENTATION_FORMAT_COMPACT;
+}
+
+static void binaryRepresentation_writeVarint(int64_t i, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
+	/*
+	 * Writes the zig-zag encoding of i, seven bits to a byte, least significant first.
+	 */
+	uint64_t j = (((uint64_t) i) << 1) ^ (uint64_t) (i >> 63);
+	uint8_t bytes[10];
+	int64_t length = 0;
+	while (j >= 0x80) {
+		bytes[length++] = (uint8_t) (j | 0x80);
+		j >>= 7;
+	}
+	bytes[length++] = (uint8_t) j;
+	writeFn(bytes, sizeof(uint8_t), length);
+}
+
+static int64_t binaryRepresentation_getVarint(void **binaryString) {
+	uint8_t *bytes = *binaryString;
+	uint64_t j = 0;
+	int64_t shift = 0;
+	do {
+		j |= ((uint64_t) (*bytes & 0x7F)) << shift;
+		shift += 7;
+	} while (*bytes++ & 0x80);
+	*binaryString = bytes;
+	return (int64_t) ((j >> 1) ^ (~(j & 1) + 1));
+}
+
 void binaryRepresentation_writeElementType(char elementCode, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
 	writeFn(&elementCode, sizeof(char), 1);
 }
@@ -25,11 +106,76 @@ void binaryRepresentation_writeString(const char *name, void (*writeFn)(const vo
 }
 
 void binaryRepresentation_writeInteger(int64_t i, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
-	writeFn(&i, sizeof(int64_t), 1);
+	if (binaryRepresentation_isCompact()) {
+		binaryRepresentation_writeVarint(i, writeFn);
+	} else {
+		writeFn(&i, sizeof(int64_t), 1);
+	}
 }
 
 void binaryRepresentation_writeName(Name name, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
-	binaryRepresentation_writeInteger(name, writeFn);
+	if (binaryRepresentation_isCompact()) { //Unsigned arithmetic, as NULL_NAME is INT64_MAX
+		binaryRepresentation_writeVarint((int64_t) ((uint64_t) name - (uint64_t) binaryRepresentation_currentFormat->baseName), writeFn);
+	} else {
+		binaryRepresentation_writeInteger(name, writeFn);
+	}
+}
+
+static int64_t binaryRepresentationFormat_getSlot(BinaryRepresentationFormat *format, Name sequenceName) {
+	uint64_t i = (uint64_t) sequenceName * 0x9E3779B97F4A7C15ULL; //Fibonacci hashing, names are often consecutive.
+	i = (i >> 32) & (format->maxSize - 1);
+	while (format->used[i] && format->sequenceNames[i] != sequenceName) {
+		i = (i + 1) & (format->maxSize - 1);
+	}
+	return i;
+}
+
+static int64_t *binaryRepresentation_getLastCoordinate(Name sequenceName) {
+	BinaryRepresentationFormat *format = binaryRepresentation_currentFormat;
+	if (format->lastSlot != -1 && format->sequenceNames[format->lastSlot] == sequenceName) {
+		return &format->lastCoordinates[format->lastSlot];
+	}
+	int64_t i = binaryRepresentationFormat_getSlot(format, sequenceName);
+	if (!format->used[i]) {
+		if (2 * (format->size + 1) > format->maxSize) { //Keep the table at most half full.
+			Name *sequenceNames = format->sequenceNames;
+			int64_t *lastCoordinates = format->lastCoordinates;
+			bool *used = format->used;
+			int64_t maxSize = format->maxSize;
+			format->maxSize *= 2;
+			format->sequenceNames = st_malloc(format->maxSize * sizeof(Name));
+			format->lastCoordinates = st_malloc(format->maxSize * sizeof(int64_t));
+			format->used = st_calloc(format->maxSize, sizeof(bool));
+			for (int64_t j = 0; j < maxSize; j++) {
+				if (used[j]) {
+					int64_t k = binaryRepresentationFormat_getSlot(format, sequenceNames[j]);
+					format->sequenceNames[k] = sequenceNames[j];
+					format->lastCoordinates[k] = lastCoordinates[j];
+					format->used[k] = 1;
+				}
+			}
+			free(sequenceNames);
+			free(lastCoordinates);
+			free(used);
+			i = binaryRepresentationFormat_getSlot(format, sequenceName);
+		}
+		format->sequenceNames[i] = sequenceName;
+		format->lastCoordinates[i] = 0;
+		format->used[i] = 1;
+		format->size++;
+	}
+	format->lastSlot = i;
+	return &format->lastCoordinates[i];
+}
+
+void binaryRepresentation_writeCoordinate(int64_t coordinate, Name sequenceName, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
+	if (binaryRepresentation_isCompact()) {
+		int64_t *lastCoordinate = binaryRepresentation_getLastCoordinate(sequenceName);
+		binaryRepresentation_writeVarint((int64_t) ((uint64_t) coordinate - (uint64_t) *lastCoordinate), writeFn);
+		*lastCoordinate = coordinate;
+	} else {
+		binaryRepresentation_writeInteger(coordinate, writeFn);
+	}
 }
 
 void binaryRepresentation_writeFloat(float f, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
@@ -72,6 +218,9 @@ const char *binaryRepresentation_getStringStatic(void **binaryString) {
 }
 
 int64_t binaryRepresentation_getInteger(void **binaryString) {
+	if (binaryRepresentation_isCompact()) {
+		return binaryRepresentation_getVarint(binaryString);
+	}
 	int64_t *i;
 	i = *binaryString;
 	*binaryString = i + 1;
@@ -79,6 +228,18 @@ int64_t binaryRepresentation_getInteger(void **binaryString) {
 }
 
 Name binaryRepresentation_getName(void **binaryString) {
+	if (binaryRepresentation_isCompact()) {
+		return (Name) ((uint64_t) binaryRepresentation_currentFormat->baseName + (uint64_t) binaryRepresentation_getVarint(binaryString));
+	}
+	return binaryRepresentation_getInteger(binaryString);
+}
+
+int64_t binaryRepresentation_getCoordinate(void **binaryString, Name sequenceName) {
+	if (binaryRepresentation_isCompact()) {
+		int64_t *lastCoordinate = binaryRepresentation_getLastCoordinate(sequenceName);
+		*lastCoordinate = (int64_t) ((uint64_t) *lastCoordinate + (uint64_t) binaryRepresentation_getVarint(binaryString));
+		return *lastCoordinate;
+	}
 	return binaryRepresentation_getInteger(binaryString);
 }
 
@@ -96,36 +257,103 @@ bool binaryRepresentation_getBool(void **binaryString) {
 	return *i;
 }
 
-int64_t binaryRepresentation_makeBinaryRepresentationP_i = 0;
-void binaryRepresentation_makeBinaryRepresentationP(const void * ptr, size_t size, size_t count) {
-	/*
-	 * Records the cummulative size of the substrings written out in creating the flower.
-	 */
-	assert(ptr != NULL);
-	binaryRepresentation_makeBinaryRepresentationP_i += size * count;
+struct _binaryRepresentationWriter {
+	char *buffer;
+	int64_t length;
+	int64_t capacity;
+};
+
+/*
+ * The objects' write functions take a write function without an argument, so the write
+ * function finds the writer in use on the calling thread here.
+ */
+static __thread BinaryRepresentationWriter *binaryRepresentation_currentWriter = NULL;
+
+BinaryRepresentationWriter *binaryRepresentationWriter_construct(void) {
+	BinaryRepresentationWriter *writer = st_malloc(sizeof(BinaryRepresentationWriter));
+	writer->capacity = 1024;
+	writer->buffer = st_malloc(writer->capacity);
+	writer->length = 0;
+	return writer;
 }
 
-char *binaryRepresentation_makeBinaryRepresentationP2_vA = NULL;
-void binaryRepresentation_makeBinaryRepresentationP2(const void * ptr, size_t size, size_t count) {
-	/*
-	 * Cummulates all the binary data into one array
-	 */
-	memcpy(binaryRepresentation_makeBinaryRepresentationP2_vA, ptr, size*count);
-	binaryRepresentation_makeBinaryRepresentationP2_vA += size * count;
+void binaryRepresentationWriter_destruct(BinaryRepresentationWriter *writer) {
+	free(writer->buffer);
+	free(writer);
+}
+
+void binaryRepresentationWriter_write(BinaryRepresentationWriter *writer, const void *ptr, size_t size, size_t count) {
+	int64_t length = size * count;
+	if (writer->length + length > writer->capacity) {
+		while (writer->length + length > writer->capacity) {
+			writer->capacity *= 2;
+		}
+		writer->buffer = realloc(writer->buffer, writer->capacity);
+		if (writer->buffer == NULL) {
+			st_errAbort("Could not realloc memory\n");
+		}
+	}
+	memcpy(writer->buffer + writer->length, ptr, length);
+	writer->length += length;
+}
+
+static void binaryRepresentation_writeToCurrentWriter(const void * ptr, size_t size, size_t count) {
+	assert(binaryRepresentation_currentWriter != NULL);
+	binaryRepresentationWriter_write(binaryRepresentation_currentWriter, ptr, size, count);
+}
+
+const void *binaryRepresentationWriter_makeBinaryRepresentation(BinaryRepresentationWriter *writer, void *object, void (*writeBinaryRepresentation)(void *, void (*writeFn)(const void * ptr, size_t size, size_t count)), int64_t *recordSize) {
+	BinaryRepresentationWriter *previousWriter = binaryRepresentation_currentWriter;
+	binaryRepresentation_currentWriter = writer;
+	writer->length = 0;
+	writeBinaryRepresentation(object, binaryRepresentation_writeToCurrentWriter);
+	binaryRepresentation_currentWriter = previousWriter;
+	*recordSize = writer->length;
+	return writer->buffer;
 }
 
 void *binaryRepresentation_makeBinaryRepresentation(void *object, void (*writeBinaryRepresentation)(void *, void (*writeFn)(const void * ptr, size_t size, size_t count)), int64_t *recordSize) {
-	void *vA;
-	binaryRepresentation_makeBinaryRepresentationP_i = 0;
-	writeBinaryRepresentation(object, binaryRepresentation_makeBinaryRepresentationP);
-	assert(binaryRepresentation_makeBinaryRepresentationP_i < INT64_MAX);
-	vA = st_malloc(binaryRepresentation_makeBinaryRepresentationP_i);
-	binaryRepresentation_makeBinaryRepresentationP2_vA = vA;
-	writeBinaryRepresentation(object, binaryRepresentation_makeBinaryRepresentationP2);
-	*recordSize = binaryRepresentation_makeBinaryRepresentationP_i;
+	BinaryRepresentationWriter *writer = binaryRepresentationWriter_construct();
+	binaryRepresentationWriter_makeBinaryRepresentation(writer, object, writeBinaryRepresentation, recordSize);
+	void *vA = writer->buffer;
+	free(writer);
 	return vA;
 }
 
+uint64_t binaryRepresentation_hash(const void *record, int64_t recordSize) {
+	/*
+	 * MurmurHash64A, which hashes eight bytes at a time.
+	 */
+	const uint64_t m = 0xc6a4a7935bd1e995ULL;
+	const int64_t r = 47;
+	uint64_t h = 0x9747b28c ^ (recordSize * m);
+	const uint8_t *bytes = record;
+	const uint8_t *end = bytes + (recordSize & ~((int64_t) 7));
+	for (; bytes != end; bytes += 8) {
+		uint64_t k;
+		memcpy(&k, bytes, sizeof(uint64_t));
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+		h ^= k;
+		h *= m;
+	}
+	switch (recordSize & 7) {
+	case 7: h ^= (uint64_t) bytes[6] << 48; // fall through
+	case 6: h ^= (uint64_t) bytes[5] << 40; // fall through
+	case 5: h ^= (uint64_t) bytes[4] << 32; // fall through
+	case 4: h ^= (uint64_t) bytes[3] << 24; // fall through
+	case 3: h ^= (uint64_t) bytes[2] << 16; // fall through
+	case 2: h ^= (uint64_t) bytes[1] << 8; // fall through
+	case 1: h ^= (uint64_t) bytes[0];
+		h *= m;
+	}
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+	return h;
+}
+
 void *binaryRepresentation_resizeObjectAsPowerOf2(void *vA, int64_t *recordSize) {
     if(*recordSize == 0) {
         *recordSize = 1;
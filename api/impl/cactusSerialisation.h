@@ -46,6 +46,41 @@
 #define CODE_PSEUDO_CHROMOSOME 23
 #define CODE_PSEUDO_ADJACENCY 24
 #define CODE_CACTUS_DISK 25
+#define CODE_SEQUENCE_FORMAT 26
+#define CODE_COMPACT_FLOWER 27
+#define CODE_RECORD_CODEC 28
+
+/*
+ * The formats of the integers in a binary representation. In the fixed format every integer
+ * and name is written as eight bytes. In the compact format integers are written as zig-zag
+ * varints, names are delta coded against a base name and coordinates against the last
+ * coordinate written on the same sequence. Flowers are written in the compact format, under
+ * CODE_COMPACT_FLOWER, everything else, including flowers written before it was added, in
+ * the fixed format.
+ */
+#define BINARY_REPRESENTATION_FORMAT_FIXED 1
+#define BINARY_REPRESENTATION_FORMAT_COMPACT 2
+
+typedef struct _binaryRepresentationFormat BinaryRepresentationFormat;
+
+/*
+ * Constructs the state of a format for writing or reading one record, with names delta coded
+ * against baseName.
+ */
+BinaryRepresentationFormat *binaryRepresentationFormat_construct(int64_t version, Name baseName);
+
+void binaryRepresentationFormat_destruct(BinaryRepresentationFormat *format);
+
+/*
+ * Sets the format used by the calling thread to write and read integers, names and coordinates,
+ * NULL selecting the fixed format, returning the previous format so that it can be restored.
+ */
+BinaryRepresentationFormat *binaryRepresentation_setFormat(BinaryRepresentationFormat *format);
+
+/*
+ * Gets the version of the format used by the calling thread.
+ */
+int64_t binaryRepresentation_getFormatVersion(void);
 
 /*
  * Writes a code for the element type.
@@ -67,6 +102,11 @@ void binaryRepresentation_writeInteger(int64_t i, void (*writeFn)(const void * p
  */
 void binaryRepresentation_writeName(Name name, void (*writeFn)(const void * ptr, size_t size, size_t count));
 
+/*
+ * Writes a coordinate on the sequence (or event) with the given name to the binary stream.
+ */
+void binaryRepresentation_writeCoordinate(int64_t coordinate, Name sequenceName, void (*writeFn)(const void * ptr, size_t size, size_t count));
+
 /*
  * Writes a float to the binary stream.
  */
@@ -108,6 +148,11 @@ int64_t binaryRepresentation_getInteger(void **binaryString);
  */
 Name binaryRepresentation_getName(void **binaryString);
 
+/*
+ * Parses a coordinate on the sequence (or event) with the given name from a binary string.
+ */
+int64_t binaryRepresentation_getCoordinate(void **binaryString, Name sequenceName);
+
 /*
  * Parses a float from the binary string.
  */
@@ -124,6 +169,35 @@ bool binaryRepresentation_getBool(void **binaryString);
  */
 void *binaryRepresentation_makeBinaryRepresentation(void *object, void (*writeBinaryRepresentation)(void *, void (*writeFn)(const void * ptr, size_t size, size_t count)), int64_t *recordSize);
 
+/*
+ * A reusable buffer into which objects are serialised in a single pass. A writer can
+ * only be used by one thread at a time, but different threads can use different writers
+ * at the same time.
+ */
+typedef struct _binaryRepresentationWriter BinaryRepresentationWriter;
+
+BinaryRepresentationWriter *binaryRepresentationWriter_construct(void);
+
+void binaryRepresentationWriter_destruct(BinaryRepresentationWriter *writer);
+
+/*
+ * Appends count elements of the given size to the writer's buffer, growing it as needed.
+ */
+void binaryRepresentationWriter_write(BinaryRepresentationWriter *writer, const void *ptr, size_t size, size_t count);
+
+/*
+ * As binaryRepresentation_makeBinaryRepresentation, but the representation is written into
+ * the writer's buffer, which is returned. The buffer is owned by the writer and overwritten by
+ * its next use.
+ */
+const void *binaryRepresentationWriter_makeBinaryRepresentation(BinaryRepresentationWriter *writer, void *object, void (*writeBinaryRepresentation)(void *, void (*writeFn)(const void * ptr, size_t size, size_t count)), int64_t *recordSize);
+
+/*
+ * Returns a 64 bit hash of a record, used to tell if a record has changed without comparing it
+ * to the original.
+ */
+uint64_t binaryRepresentation_hash(const void *record, int64_t recordSize);
+
 /*
  * Resizes a record as a power of 2.
  */
@@ -26,10 +26,46 @@ extern const char *CACTUS_DISK_EXCEPTION_ID;
  * the 'create' is non-zero and the cactus disk already exists. If
  * "cache" is true, all DB responses will be cached. If "cache" is
  * false, no responses will be cached, saving memory but possibly
- * decreasing throughput.
+ * decreasing throughput. The caches of records and sequence strings evict the least
+ * recently used entries to stay within 10MB and 100MB, unless the sizes in bytes are set by
+ * the CACTUS_DISK_CACHE_SIZE and CACTUS_DISK_STRING_CACHE_SIZE environment variables, which
+ * may have a K, M or G suffix. If 'create' is zero and the CACTUS_DISK_SNAPSHOT environment
+ * variable names a snapshot file, the cactus disk is read from that as by
+ * cactusDisk_constructFromSnapshot, and the database is not opened.
  */
 CactusDisk *cactusDisk_construct(stKVDatabaseConf *conf, bool create, bool cache);
 
+/*
+ * As cactusDisk_construct, but the records written are compressed with the given codec
+ * ("none", "zlib", "zlib:N", "lz4", "zstd", "zstd:N", "zstd_dictionary" or "zstd_dictionary:N",
+ * where N is the compression level) rather than the codec the cactus disk was created with.
+ * Records written with any codec can be read. If compression is NULL this is the same as
+ * cactusDisk_construct.
+ */
+CactusDisk *cactusDisk_construct2(stKVDatabaseConf *conf, bool create, bool cache, const char *compression);
+
+/*
+ * Gets the codec given by the "compression" attribute of the root element of a database conf
+ * string, as used by cactusDisk_construct2, or NULL if there is none. The result must be freed.
+ */
+char *cactusDisk_getCompressionFromConfString(const char *confString);
+
+/*
+ * Constructs a read only cactus disk from a snapshot file written by cactusDisk_writeSnapshot.
+ * The snapshot is mapped into memory, so the processes reading one snapshot share its pages
+ * and no database requests are made. Writing to the cactus disk, or getting unique IDs or
+ * adding strings, throws an exception.
+ */
+CactusDisk *cactusDisk_constructFromSnapshot(const char *snapshotFile, bool cache);
+
+/*
+ * Writes the records of the flowers nested in the root flower (including the root flower),
+ * of their sequences and of the cactus disk parameters to an immutable snapshot file, as
+ * they are stored in the database. The flowers in memory are not written, so the cactus
+ * disk should be written first if any have changed.
+ */
+void cactusDisk_writeSnapshot(CactusDisk *cactusDisk, Name rootFlowerName, const char *snapshotFile);
+
 /*
  * Destructs the cactus disk and all open flowers and sequences, and
  * then disconnects from the cactus DB.
@@ -37,7 +73,8 @@ CactusDisk *cactusDisk_construct(stKVDatabaseConf *conf, bool create, bool cache
 void cactusDisk_destruct(CactusDisk *cactusDisk);
 
 /*
- * Retrieves the next unique ID.
+ * Retrieves the next unique ID. IDs are leased from the database in blocks that grow as they are used,
+ * the next block being leased by a background thread before the current one runs out.
  */
 int64_t cactusDisk_getUniqueID(CactusDisk *cactusDisk);
 
@@ -46,12 +83,30 @@ int64_t cactusDisk_getUniqueID(CactusDisk *cactusDisk);
  */
 int64_t cactusDisk_getUniqueIDInterval(CactusDisk *cactusDisk, int64_t intervalSize);
 
+/*
+ * The functions that read or change the state shared by the flowers of the cactus disk, such as its loaded
+ * flowers, caches, update requests and unique IDs, take this lock themselves. So threads may work on different
+ * flowers at once, each changing only its own flowers, without holding it. It is held to make several such calls
+ * atomic. The lock is recursive.
+ */
+void cactusDisk_lock(CactusDisk *cactusDisk);
+
+void cactusDisk_unlock(CactusDisk *cactusDisk);
+
 /*
  * Writes the updated state of the parts of the cactus disk in memory to disk.
  *
  */
 void cactusDisk_write(CactusDisk *cactusDisk);
 
+/*
+ * Sets the number of threads cactusDisk_write uses to serialise and compress the records, which must be
+ * at least one (the default). The records written are the same whatever the number of threads.
+ */
+void cactusDisk_setWriteThreads(CactusDisk *cactusDisk, int64_t writeThreads);
+
+int64_t cactusDisk_getWriteThreads(CactusDisk *cactusDisk);
+
 /*
  * This is used to serialise a flower before a call to a cactusDisk_write, it is exposed for use in the cactus_caf code.
  */
@@ -86,6 +141,19 @@ void cactusDisk_preCacheStrings(CactusDisk *cactusDisk, stList *flowers);
  */
 void cactusDisk_preCacheSegmentStrings(CactusDisk *cactusDisk, stList *flowers);
 
+/*
+ * Sets the maximum sizes in bytes of the record and string caches, evicting entries if they are now too big.
+ */
+void cactusDisk_setCacheSizes(CactusDisk *cactusDisk, int64_t cacheSize, int64_t stringCacheSize);
+
+/*
+ * Returns the call counts, bytes and latencies of the database operations done so far, and the numbers
+ * of leases of unique IDs taken with their round trips to the database, as a single
+ * line of JSON which must be freed. The same line is logged (or appended to the file named by the
+ * environment variable CACTUS_DISK_STATS_FILE) when the cactus disk is destructed.
+ */
+char *cactusDisk_getStatsJson(CactusDisk *cactusDisk);
+
 /*
  * Clears all cached sequences (but not cached DB responses).
  */
@@ -30,12 +30,15 @@ stList *flowerWriter_parseNames(FILE *fileHandle);
  */
 stList *flowerWriter_parseFlowersFromStdin(CactusDisk *cactusDisk);
 
+typedef struct _flowerStreamPrefetcher FlowerStreamPrefetcher;
+
 typedef struct {
     stList *flowerNames;
     stList *flowerBatch;
     CactusDisk *cactusDisk;
     Flower *curFlower;
     size_t nextIdx;
+    FlowerStreamPrefetcher *prefetcher; // NULL unless the batches are prefetched.
 } FlowerStream;
 
 /*
@@ -49,6 +52,24 @@ typedef struct {
  */
 FlowerStream *flowerWriter_getFlowerStream(CactusDisk *cactusDisk, FILE *file);
 
+/*
+ * As flowerWriter_getFlowerStream, but if prefetchDepth is greater than zero a
+ * background thread fetches and decompresses up to prefetchDepth batches of
+ * flowers ahead of the caller, holding at most maxPrefetchSize bytes of
+ * records beyond the next batch. The flowers themselves are still loaded
+ * on the calling thread. While the stream exists the cactus disk must only
+ * be used from the calling thread, and the records of flowers later in the
+ * stream must not be rewritten, as they may already have been fetched.
+ */
+FlowerStream *flowerWriter_getFlowerStream2(CactusDisk *cactusDisk, FILE *file,
+        int64_t prefetchDepth, int64_t maxPrefetchSize);
+
+/*
+ * Prefetch settings used by the reference and HAL phases.
+ */
+#define FLOWER_STREAM_DEFAULT_PREFETCH_DEPTH 2
+#define FLOWER_STREAM_DEFAULT_MAX_PREFETCH_SIZE 500000000
+
 /*
  * Free a flowerStream.
  */
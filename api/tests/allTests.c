@@ -24,6 +24,12 @@ CuSuite *cactusFaceEndTestSuite();
 CuSuite *cactusSequenceTestSuite();
 CuSuite *cactusSerialisationTestSuite();
 CuSuite *cactusFlowerWriterTestSuite();
+CuSuite *cactusPackedSequenceTestSuite();
+CuSuite *cactusRecordCodecTestSuite();
+CuSuite *cactusRecordCacheTestSuite();
+CuSuite *cactusDiskSnapshotTestSuite();
+CuSuite *cactusFlowerArenaTestSuite();
+CuSuite *cactusNameIndexTestSuite();
 
 
 int cactusAPIRunAllTests(void) {
@@ -47,6 +53,12 @@ int cactusAPIRunAllTests(void) {
 	CuSuiteAddSuite(suite, cactusSequenceTestSuite());
 	CuSuiteAddSuite(suite, cactusSerialisationTestSuite());
 	CuSuiteAddSuite(suite, cactusFlowerWriterTestSuite());
+	CuSuiteAddSuite(suite, cactusPackedSequenceTestSuite());
+	CuSuiteAddSuite(suite, cactusRecordCodecTestSuite());
+	CuSuiteAddSuite(suite, cactusRecordCacheTestSuite());
+	CuSuiteAddSuite(suite, cactusDiskSnapshotTestSuite());
+	CuSuiteAddSuite(suite, cactusFlowerArenaTestSuite());
+	CuSuiteAddSuite(suite, cactusNameIndexTestSuite());
 	CuSuiteRun(suite);
 	CuSuiteSummary(suite, output);
 	CuSuiteDetails(suite, output);
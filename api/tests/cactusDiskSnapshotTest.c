@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+
+static const char *snapshotFile = "./cactusDiskSnapshotTest.snapshot";
+
+static void testCactusDiskSnapshot_writeAndRead(CuTest* testCase) {
+    /*
+     * Writes random records, including empty ones, and checks they are all read back, and only they.
+     */
+    for (int64_t test = 0; test < 10; test++) {
+        stHash *records = stHash_construct3((uint64_t (*)(const void *)) stIntTuple_hashKey,
+                (int (*)(const void *, const void *)) stIntTuple_equalsFn, (void (*)(void *)) stIntTuple_destruct, free);
+        SnapshotWriter *writer = snapshotWriter_construct(snapshotFile);
+        int64_t recordNumber = st_randomInt(0, 1000);
+        for (int64_t i = 0; i < recordNumber; i++) {
+            stIntTuple *name = stIntTuple_construct1(st_randomInt(-1000000, 1000000));
+            if (stHash_search(records, name) != NULL) {
+                stIntTuple_destruct(name);
+                continue;
+            }
+            int64_t recordSize = st_randomInt(0, 100);
+            char *record = stRandom_getRandomDNAString(recordSize, true, true, true);
+            stHash_insert(records, name, record);
+            snapshotWriter_addRecord(writer, stIntTuple_get(name, 0), record, recordSize);
+        }
+        snapshotWriter_destruct(writer);
+
+        CactusDiskSnapshot *snapshot = cactusDiskSnapshot_construct(snapshotFile);
+        CuAssertIntEquals(testCase, stHash_size(records), cactusDiskSnapshot_getRecordNumber(snapshot));
+        stHashIterator *it = stHash_getIterator(records);
+        stIntTuple *name;
+        while ((name = stHash_getNext(it)) != NULL) {
+            char *record = stHash_search(records, name);
+            int64_t recordSize;
+            const char *record2 = cactusDiskSnapshot_getRecord(snapshot, stIntTuple_get(name, 0), &recordSize);
+            CuAssertTrue(testCase, record2 != NULL);
+            CuAssertIntEquals(testCase, strlen(record), recordSize);
+            CuAssertTrue(testCase, memcmp(record, record2, recordSize) == 0);
+            CuAssertTrue(testCase, cactusDiskSnapshot_containsRecord(snapshot, stIntTuple_get(name, 0)));
+        }
+        stHash_destructIterator(it);
+        for (int64_t i = 0; i < 100; i++) {
+            stIntTuple *name = stIntTuple_construct1(st_randomInt(-1000000, 1000000));
+            int64_t recordSize;
+            CuAssertTrue(testCase, (stHash_search(records, name) != NULL)
+                    == (cactusDiskSnapshot_getRecord(snapshot, stIntTuple_get(name, 0), &recordSize) != NULL));
+            stIntTuple_destruct(name);
+        }
+        cactusDiskSnapshot_destruct(snapshot);
+        stHash_destruct(records);
+    }
+    remove(snapshotFile);
+}
+
+static void testCactusDiskSnapshot_notASnapshot(CuTest* testCase) {
+    FILE *fileHandle = fopen(snapshotFile, "w");
+    fprintf(fileHandle, "This is not a snapshot, though it is long enough to be one\n");
+    fclose(fileHandle);
+    stTry {
+        cactusDiskSnapshot_construct(snapshotFile);
+        CuAssertTrue(testCase, 0);
+    } stCatch(except) {
+        st_logInfo("This is the message: %s\n", stExcept_getMsg(except));
+        stExcept_free(except);
+    } stTryEnd
+    remove(snapshotFile);
+}
+
+static void testCactusDiskSnapshot_corruptIndex(CuTest* testCase) {
+    /*
+     * Checks a snapshot whose index has a record running past the records is not read.
+     */
+    SnapshotWriter *writer = snapshotWriter_construct(snapshotFile);
+    snapshotWriter_addRecord(writer, 1, "ACGT", 4);
+    snapshotWriter_destruct(writer);
+    FILE *fileHandle = fopen(snapshotFile, "r+b");
+    fseek(fileHandle, -4 * (long) sizeof(int64_t), SEEK_END); //The size of the record, just before the footer.
+    int64_t recordSize = INT64_MAX - 1;
+    fwrite(&recordSize, sizeof(int64_t), 1, fileHandle);
+    fclose(fileHandle);
+    stTry {
+        cactusDiskSnapshot_construct(snapshotFile);
+        CuAssertTrue(testCase, 0);
+    } stCatch(except) {
+        st_logInfo("This is the message: %s\n", stExcept_getMsg(except));
+        stExcept_free(except);
+    } stTryEnd
+    remove(snapshotFile);
+}
+
+static void testCactusDisk_snapshot(CuTest* testCase) {
+    /*
+     * Writes a snapshot of a nested flower with a sequence, deletes the database, then checks the
+     * flowers and sequence are read from the snapshot and that it can not be written to.
+     */
+    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+    EventTree *eventTree = eventTree_construct2(cactusDisk);
+    Flower *flower = flower_construct(cactusDisk);
+    Flower *nestedFlower = flower_construct(cactusDisk);
+    group_construct(flower, nestedFlower);
+    end_construct(0, flower);
+    char *string = stRandom_getRandomDNAString(1234, true, true, true);
+    MetaSequence *metaSequence = metaSequence_construct(1, 1234, string, ">one",
+            event_getName(eventTree_getRootEvent(eventTree)), cactusDisk);
+    sequence_construct(metaSequence, nestedFlower);
+    Name flowerName = flower_getName(flower);
+    Name nestedFlowerName = flower_getName(nestedFlower);
+    cactusDisk_write(cactusDisk);
+    cactusDisk_writeSnapshot(cactusDisk, flowerName, snapshotFile);
+    testCommon_deleteTemporaryCactusDisk(cactusDisk);
+
+    stKVDatabaseConf *conf = testCommon_getTemporaryKVDatabaseConf();
+    setenv("CACTUS_DISK_SNAPSHOT", snapshotFile, 1);
+    cactusDisk = cactusDisk_construct(conf, false, true);
+    unsetenv("CACTUS_DISK_SNAPSHOT");
+    stKVDatabaseConf_destruct(conf);
+    flower = cactusDisk_getFlower(cactusDisk, flowerName);
+    CuAssertTrue(testCase, flower != NULL);
+    CuAssertIntEquals(testCase, 1, flower_getEndNumber(flower));
+    CuAssertIntEquals(testCase, 1, flower_getGroupNumber(flower));
+    nestedFlower = group_getNestedFlower(flower_getFirstGroup(flower));
+    CuAssertTrue(testCase, nestedFlower != NULL);
+    CuAssertTrue(testCase, flower_getName(nestedFlower) == nestedFlowerName);
+    CuAssertIntEquals(testCase, 1, flower_getSequenceNumber(nestedFlower));
+    char *string2 = sequence_getString(flower_getFirstSequence(nestedFlower), 1, 1234, 1);
+    CuAssertStrEquals(testCase, string, string2);
+    free(string2);
+    stTry {
+        cactusDisk_write(cactusDisk);
+        CuAssertTrue(testCase, 0);
+    } stCatch(except) {
+        st_logInfo("This is the message: %s\n", stExcept_getMsg(except));
+        stExcept_free(except);
+    } stTryEnd
+    cactusDisk_destruct(cactusDisk);
+
+    cactusDisk = cactusDisk_constructFromSnapshot(snapshotFile, false);
+    CuAssertTrue(testCase, cactusDisk_getFlower(cactusDisk, nestedFlowerName) != NULL);
+    cactusDisk_destruct(cactusDisk);
+    free(string);
+    remove(snapshotFile);
+}
+
+CuSuite* cactusDiskSnapshotTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testCactusDiskSnapshot_writeAndRead);
+    SUITE_ADD_TEST(suite, testCactusDiskSnapshot_notASnapshot);
+    SUITE_ADD_TEST(suite, testCactusDiskSnapshot_corruptIndex);
+    SUITE_ADD_TEST(suite, testCactusDisk_snapshot);
+    return suite;
+}
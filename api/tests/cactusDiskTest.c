@@ -81,6 +81,110 @@ void testCactusDisk_getMetaSequence(CuTest* testCase) {
     cactusDiskTestTeardown();
 }
 
+void testCactusDisk_writeThreads(CuTest* testCase) {
+    /*
+     * Writes flowers with several threads, checking the records are those written by one thread.
+     */
+    cactusDiskTestSetup();
+    cactusDisk_setWriteThreads(cactusDisk, 4);
+    CuAssertIntEquals(testCase, 4, cactusDisk_getWriteThreads(cactusDisk));
+    stList *flowers = stList_construct();
+    stList *flowerNames = stList_construct3(0, free);
+    for (int64_t i = 0; i < 200; i++) {
+        Flower *flower = flower_construct(cactusDisk);
+        for (int64_t j = st_randomInt(0, 10); j > 0; j--) {
+            end_construct(0, flower);
+        }
+        stList_append(flowers, flower);
+        int64_t *name = st_malloc(sizeof(int64_t));
+        *name = flower_getName(flower);
+        stList_append(flowerNames, name);
+    }
+    for (int64_t k = 0; k < 2; k++) {
+        cactusDisk_write(cactusDisk);
+        int64_t *recordSizes;
+        stExcept *except;
+        stList *records = cactusDisk_fetchRecords(cactusDisk, flowerNames, &recordSizes, &except);
+        CuAssertPtrEquals(testCase, NULL, except);
+        for (int64_t i = 0; i < stList_length(flowers); i++) {
+            int64_t recordSize;
+            void *record = binaryRepresentation_makeBinaryRepresentation(stList_get(flowers, i),
+                    (void (*)(void *, void (*)(const void * ptr, size_t size, size_t count))) flower_writeBinaryRepresentation,
+                    &recordSize);
+            CuAssertIntEquals(testCase, recordSize, recordSizes[i]);
+            CuAssertTrue(testCase, memcmp(record, stList_get(records, i), recordSize) == 0);
+            free(record);
+        }
+        stList_destruct(records);
+        free(recordSizes);
+        //Change some of the flowers, so the second write has a mix of updated and unchanged records.
+        for (int64_t i = 0; i < stList_length(flowers); i += 3) {
+            end_construct(0, stList_get(flowers, i));
+        }
+    }
+    stList_destruct(flowers);
+    stList_destruct(flowerNames);
+    cactusDiskTestTeardown();
+}
+
+void testCactusDisk_recordHash(CuTest* testCase) {
+    /*
+     * Checks loaded flowers have the hash of their record, and that changes to them are still written.
+     */
+    cactusDiskTestSetup();
+    Flower *flower = flower_construct(cactusDisk);
+    uint64_t recordHash;
+    CuAssertTrue(testCase, !flower_getRecordHash(flower, &recordHash));
+    end_construct(0, flower);
+    Name name = flower_getName(flower);
+    cactusDisk_write(cactusDisk);
+    CuAssertTrue(testCase, flower_getRecordHash(flower, &recordHash));
+    cactusDisk_destruct(cactusDisk);
+    for (int64_t i = 1; i <= 3; i++) {
+        cactusDisk = cactusDisk_construct(conf, false, true);
+        flower = cactusDisk_getFlower(cactusDisk, name);
+        CuAssertIntEquals(testCase, i, flower_getEndNumber(flower));
+        int64_t recordSize;
+        void *record = binaryRepresentation_makeBinaryRepresentation(flower,
+                (void (*)(void *, void (*)(const void * ptr, size_t size, size_t count))) flower_writeBinaryRepresentation,
+                &recordSize);
+        CuAssertTrue(testCase, flower_getRecordHash(flower, &recordHash));
+        CuAssertTrue(testCase, recordHash == binaryRepresentation_hash(record, recordSize));
+        free(record);
+        cactusDisk_write(cactusDisk); //Unchanged, so not rewritten.
+        end_construct(0, flower);
+        cactusDisk_write(cactusDisk);
+        cactusDisk_destruct(cactusDisk);
+    }
+    cactusDisk = cactusDisk_construct(conf, false, true);
+    CuAssertIntEquals(testCase, 4, flower_getEndNumber(cactusDisk_getFlower(cactusDisk, name)));
+    cactusDiskTestTeardown();
+}
+
+void testCactusDisk_stats(CuTest* testCase) {
+    /*
+     * Checks the database operations are counted, and reported as a single line of JSON.
+     */
+    cactusDiskTestSetup();
+    for (int64_t i = 0; i < 10; i++) {
+        end_construct(0, flower_construct(cactusDisk));
+    }
+    cactusDisk_write(cactusDisk);
+    CactusDiskStats *stats = cactusDisk->stats;
+    CuAssertTrue(testCase, cactusDiskStats_getCalls(stats, CACTUS_DISK_OP_BULK_SET) > 0);
+    CuAssertTrue(testCase, cactusDiskStats_getRecords(stats, CACTUS_DISK_OP_BULK_SET) >= 10);
+    CuAssertTrue(testCase, cactusDiskStats_getCompressedBytes(stats, CACTUS_DISK_OP_BULK_SET) > 0);
+    CuAssertTrue(testCase, cactusDiskStats_getUncompressedBytes(stats, CACTUS_DISK_OP_BULK_SET) > 0);
+    CuAssertTrue(testCase, cactusDiskStats_getCalls(stats, CACTUS_DISK_OP_COMPRESS) >= 10);
+    CuAssertIntEquals(testCase, 0, cactusDiskStats_getCalls(stats, CACTUS_DISK_OP_BULK_REMOVE));
+    char *json = cactusDisk_getStatsJson(cactusDisk);
+    CuAssertTrue(testCase, strncmp(json, "{\"cactusDiskStats\":{\"bulkGet\":{", 31) == 0);
+    CuAssertTrue(testCase, strstr(json, "\"decompress\":{") != NULL);
+    CuAssertTrue(testCase, strchr(json, '\n') == NULL);
+    free(json);
+    cactusDiskTestTeardown();
+}
+
 void testCactusDisk_getUniqueID(CuTest* testCase) {
     cactusDiskTestSetup();
     for (int64_t i = 0; i < 1000000; i++) { //Gets a billion ids, checks we are good.
@@ -134,14 +238,43 @@ void testCactusDisk_getUniqueID_UniqueIntervals(CuTest* testCase) {
     cactusDiskTestTeardown();
 }
 
+void testCactusDisk_getUniqueID_leases(CuTest* testCase) {
+    /*
+     * Checks that after the first lease the leases of IDs are taken in the background and grow, so
+     * a million IDs take a handful of leases, and that the IDs are unique.
+     */
+    cactusDiskTestSetup();
+    CactusDiskStats *stats = cactusDisk->stats;
+    int64_t synchronousLeases = cactusDiskStats_getLeases(stats, 0);
+    Name previousName = 0;
+    for (int64_t i = 0; i < 1000000; i++) {
+        Name uniqueName = cactusDisk_getUniqueID(cactusDisk);
+        CuAssertTrue(testCase, uniqueName > previousName); //The leases come from one bucket, so increase.
+        previousName = uniqueName;
+    }
+    CuAssertTrue(testCase, cactusDiskStats_getLeases(stats, 0) <= synchronousLeases + 1);
+    CuAssertTrue(testCase, cactusDiskStats_getLeases(stats, 1) >= 3);
+    CuAssertTrue(testCase, cactusDiskStats_getLeases(stats, 1) <= 10);
+    CuAssertTrue(testCase, cactusDiskStats_getLeasedIDs(stats, 0) + cactusDiskStats_getLeasedIDs(stats, 1) >= 1000000);
+    CuAssertIntEquals(testCase, cactusDiskStats_getLeases(stats, 1), cactusDiskStats_getLeaseRoundTrips(stats, 1));
+    char *json = cactusDisk_getStatsJson(cactusDisk);
+    CuAssertTrue(testCase, strstr(json, "\"prefetchedLeases\":{\"leases\":") != NULL);
+    free(json);
+    cactusDiskTestTeardown();
+}
+
 CuSuite* cactusDiskTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testCactusDisk_write);
     SUITE_ADD_TEST(suite, testCactusDisk_getFlower);
     SUITE_ADD_TEST(suite, testCactusDisk_getMetaSequence);
+    SUITE_ADD_TEST(suite, testCactusDisk_writeThreads);
+    SUITE_ADD_TEST(suite, testCactusDisk_recordHash);
+    SUITE_ADD_TEST(suite, testCactusDisk_stats);
     SUITE_ADD_TEST(suite, testCactusDisk_getUniqueID);
     SUITE_ADD_TEST(suite, testCactusDisk_getUniqueID_Unique);
     SUITE_ADD_TEST(suite, testCactusDisk_getUniqueID_UniqueIntervals);
+    SUITE_ADD_TEST(suite, testCactusDisk_getUniqueID_leases);
     SUITE_ADD_TEST(suite, testCactusDisk_constructAndDestruct);
     return suite;
 }
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+
+static void testFlowerArena_allocateAndFree(CuTest* testCase) {
+    FlowerArena *arena = flowerArena_construct();
+    CuAssertIntEquals(testCase, 0, flowerArena_getSize(arena));
+    //Objects are aligned and do not overlap.
+    stList *objects = stList_construct();
+    for (int64_t i = 0; i < 10000; i++) {
+        char *object = flowerArena_allocate(arena, 40);
+        CuAssertTrue(testCase, ((uintptr_t) object) % 16 == 0);
+        memset(object, (char) i, 40);
+        stList_append(objects, object);
+    }
+    for (int64_t i = 0; i < stList_length(objects); i++) {
+        char *object = stList_get(objects, i);
+        for (int64_t j = 0; j < 40; j++) {
+            CuAssertIntEquals(testCase, (char) i, object[j]);
+        }
+    }
+    int64_t size = flowerArena_getSize(arena);
+    CuAssertTrue(testCase, size >= 10000 * 48);
+    //Freed objects are reused before the arena grows.
+    for (int64_t i = 0; i < stList_length(objects); i++) {
+        flowerArena_free(arena, stList_get(objects, i), 40);
+    }
+    for (int64_t i = 0; i < stList_length(objects); i++) {
+        flowerArena_allocate(arena, 40);
+    }
+    CuAssertIntEquals(testCase, size, flowerArena_getSize(arena));
+    //A big object gets a chunk of its own.
+    char *bigObject = flowerArena_allocate(arena, 1000000);
+    memset(bigObject, 1, 1000000);
+    CuAssertIntEquals(testCase, size + 1000000, flowerArena_getSize(arena));
+    stList_destruct(objects);
+    flowerArena_retain(arena);
+    flowerArena_release(arena);
+    flowerArena_release(arena);
+}
+
+static void testFlowerArena_flower(CuTest* testCase) {
+    /*
+     * Builds a flower with blocks, segments, ends and caps, destructs some of them and checks the rest
+     * are intact.
+     */
+    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+    EventTree *eventTree = eventTree_construct2(cactusDisk);
+    Event *event = eventTree_getRootEvent(eventTree);
+    Flower *flower = flower_construct(cactusDisk);
+    stList *blocks = stList_construct();
+    for (int64_t i = 0; i < 100; i++) {
+        Block *block = block_construct(i + 1, flower);
+        segment_construct(block, event);
+        segment_construct(block, event);
+        stList_append(blocks, block);
+    }
+    for (int64_t i = 0; i < 100; i += 2) {
+        block_destruct(stList_get(blocks, i));
+    }
+    for (int64_t i = 0; i < 100; i++) { //Reuses the memory of the destructed blocks.
+        end_construct(0, flower);
+    }
+    CuAssertIntEquals(testCase, 50, flower_getBlockNumber(flower));
+    CuAssertIntEquals(testCase, 300, flower_getEndNumber(flower)); //Destructing a block leaves its ends.
+    for (int64_t i = 1; i < 100; i += 2) {
+        Block *block = stList_get(blocks, i);
+        CuAssertTrue(testCase, flower_getBlock(flower, block_getName(block)) == block);
+        CuAssertIntEquals(testCase, i + 1, block_getLength(block));
+        CuAssertIntEquals(testCase, 2, block_getInstanceNumber(block));
+        CuAssertTrue(testCase, block_getReverse(block_getReverse(block)) == block);
+        Segment *segment = block_getFirst(block);
+        CuAssertTrue(testCase, segment_getReverse(segment_getReverse(segment)) == segment);
+        CuAssertTrue(testCase, segment_getBlock(segment_getReverse(segment)) == block_getReverse(block));
+        Cap *cap = segment_get5Cap(segment);
+        CuAssertTrue(testCase, cap_getReverse(cap_getReverse(cap)) == cap);
+        CuAssertTrue(testCase, cap_getEnd(cap) == block_get5End(block));
+        CuAssertTrue(testCase, end_getReverse(end_getReverse(block_get5End(block))) == block_get5End(block));
+    }
+    stList_destruct(blocks);
+    testCommon_deleteTemporaryCactusDisk(cactusDisk);
+}
+
+static void testFlowerArena_moveBetweenFlowers(CuTest* testCase) {
+    /*
+     * Moves an end and a block to another flower, then destructs the flower they were allocated in.
+     */
+    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+    eventTree_construct2(cactusDisk);
+    Flower *flower = flower_construct(cactusDisk);
+    Flower *otherFlower = flower_construct(cactusDisk);
+    End *end = end_construct(0, flower);
+    Block *block = block_construct(10, flower);
+    end_setFlower(end, otherFlower);
+    end_setFlower(block_get5End(block), otherFlower);
+    end_setFlower(block_get3End(block), otherFlower);
+    block_setFlower(block, otherFlower);
+    flower_destruct(flower, 0);
+    CuAssertTrue(testCase, flower_getEnd(otherFlower, end_getName(end)) == end);
+    CuAssertTrue(testCase, flower_getBlock(otherFlower, block_getName(block)) == block);
+    CuAssertIntEquals(testCase, 10, block_getLength(block));
+    CuAssertTrue(testCase, block_getFlower(block) == otherFlower);
+    CuAssertTrue(testCase, end_getFlower(end) == otherFlower);
+    //The moved objects are freed into the memory of the other flower.
+    block_destruct(block);
+    end_destruct(end);
+    testCommon_deleteTemporaryCactusDisk(cactusDisk);
+}
+
+CuSuite* cactusFlowerArenaTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testFlowerArena_allocateAndFree);
+    SUITE_ADD_TEST(suite, testFlowerArena_flower);
+    SUITE_ADD_TEST(suite, testFlowerArena_moveBetweenFlowers);
+    return suite;
+}
@@ -435,6 +435,89 @@ void testFlower_isTerminal(CuTest *testCase) {
     cactusFlowerTestTeardown();
 }
 
+void testFlower_serialisation(CuTest *testCase) {
+    /*
+     * Checks a flower round trips through the compact format.
+     */
+    cactusFlowerTestSetup();
+    sequenceSetup();
+    endsSetup();
+    int64_t capNumber = 100;
+    Name capNames[100];
+    int64_t coordinates[100];
+    bool strands[100];
+    for (int64_t i = 0; i < capNumber; i++) {
+        strands[i] = st_random() > 0.5;
+        if (i % 10 == 0) {
+            Cap *cap = cap_construct(i % 2 ? end : end2, eventTree_getRootEvent(eventTree));
+            coordinates[i] = INT64_MAX;
+            strands[i] = cap_getStrand(cap);
+            capNames[i] = cap_getName(cap);
+        } else {
+            coordinates[i] = st_randomInt(0, 10);
+            capNames[i] = cap_getName(cap_construct2(i % 2 ? end : end2, coordinates[i], strands[i],
+                    i % 3 ? sequence : sequence2));
+        }
+    }
+    Name flowerName = flower_getName(flower);
+    int64_t recordSize;
+    void *vA = binaryRepresentation_makeBinaryRepresentation(flower,
+            (void(*)(void *, void(*)(const void *, size_t, size_t))) flower_writeBinaryRepresentation, &recordSize);
+    CuAssertIntEquals(testCase, CODE_COMPACT_FLOWER, binaryRepresentation_peekNextElementType(vA));
+    flower_destruct(flower, 0);
+    void *vA2 = vA;
+    flower = flower_loadFromBinaryRepresentation(&vA2, cactusDisk);
+    CuAssertIntEquals(testCase, recordSize, (char *) vA2 - (char *) vA);
+    free(vA);
+    CuAssertIntEquals(testCase, flowerName, flower_getName(flower));
+    CuAssertIntEquals(testCase, 2, flower_getSequenceNumber(flower));
+    CuAssertIntEquals(testCase, capNumber, flower_getCapNumber(flower));
+    for (int64_t i = 0; i < capNumber; i++) {
+        Cap *cap = flower_getCap(flower, capNames[i]);
+        CuAssertTrue(testCase, cap != NULL);
+        CuAssertIntEquals(testCase, coordinates[i], cap_getCoordinate(cap));
+        CuAssertIntEquals(testCase, strands[i], cap_getStrand(cap));
+        if (coordinates[i] != INT64_MAX) {
+            CuAssertIntEquals(testCase, i % 3 ? sequence_getName(sequence) : sequence_getName(sequence2),
+                    sequence_getName(cap_getSequence(cap)));
+        }
+    }
+    cactusFlowerTestTeardown();
+}
+
+void testFlower_loadFixedFormat(CuTest *testCase) {
+    /*
+     * Checks a flower record written before the compact format was added still loads.
+     */
+    cactusFlowerTestSetup();
+    Name name = cactusDisk_getUniqueID(cactusDisk);
+    Name parentName = NULL_NAME;
+    char record[2 + 2 * sizeof(Name) + 3 * sizeof(bool)];
+    char *c = record;
+    *c++ = CODE_FLOWER;
+    memcpy(c, &name, sizeof(Name));
+    c += sizeof(Name);
+    bool builtBlocks = 1, builtTrees = 0, builtFaces = 0;
+    memcpy(c, &builtBlocks, sizeof(bool));
+    c += sizeof(bool);
+    memcpy(c, &builtTrees, sizeof(bool));
+    c += sizeof(bool);
+    memcpy(c, &builtFaces, sizeof(bool));
+    c += sizeof(bool);
+    memcpy(c, &parentName, sizeof(Name));
+    c += sizeof(Name);
+    *c++ = CODE_FLOWER;
+    void *vA = record;
+    Flower *flower2 = flower_loadFromBinaryRepresentation(&vA, cactusDisk);
+    CuAssertTrue(testCase, flower2 != NULL);
+    CuAssertIntEquals(testCase, (char *) vA - record, c - record);
+    CuAssertIntEquals(testCase, name, flower_getName(flower2));
+    CuAssertTrue(testCase, flower_builtBlocks(flower2));
+    CuAssertTrue(testCase, !flower_builtTrees(flower2));
+    CuAssertTrue(testCase, flower_getParentGroup(flower2) == NULL);
+    cactusFlowerTestTeardown();
+}
+
 void testFlower_removeIfRedundant(CuTest *testCase) {
     /*
      * Do a simple test to see if function can remove a redundant flower.
@@ -545,6 +628,8 @@ CuSuite* cactusFlowerTestSuite(void) {
     SUITE_ADD_TEST(suite, testFlower_isLeaf);
     SUITE_ADD_TEST(suite, testFlower_isTerminal);
     SUITE_ADD_TEST(suite, testFlower_removeIfRedundant);
+    SUITE_ADD_TEST(suite, testFlower_serialisation);
+    SUITE_ADD_TEST(suite, testFlower_loadFixedFormat);
     SUITE_ADD_TEST(suite, testFlower_constructAndDestruct);
     return suite;
 }
@@ -53,6 +53,86 @@ static void testFlowerStream(CuTest *testCase) {
     testCommon_deleteTemporaryCactusDisk(cactusDisk);
 }
 
+static void testFlowerStream_prefetch(CuTest *testCase) {
+    /*
+     * Checks a prefetching stream returns the same flowers, in order, across many batches.
+     */
+    for (int64_t test = 0; test < 3; test++) {
+        CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+        char *tempPath = getTempFile();
+        FILE *f = fopen(tempPath, "w");
+        int64_t flowerNumber = st_randomInt(0, 300);
+        Name *flowerNames = st_malloc(sizeof(Name) * flowerNumber);
+        stList *flowers = stList_construct();
+        fprintf(f, "%" PRIi64, flowerNumber);
+        for (int64_t i = 0; i < flowerNumber; i++) {
+            Flower *flower = flower_construct(cactusDisk);
+            flowerNames[i] = flower_getName(flower);
+            fprintf(f, " %" PRIi64, i == 0 ? flowerNames[0] : flowerNames[i] - flowerNames[i - 1]);
+            stList_append(flowers, flower);
+        }
+        fclose(f);
+        cactusDisk_write(cactusDisk);
+        for (int64_t i = 0; i < flowerNumber; i++) {
+            flower_destruct(stList_get(flowers, i), false);
+        }
+        stList_destruct(flowers);
+
+        // Use a tiny memory cap on the last test, so only one batch is held at a time.
+        f = fopen(tempPath, "r");
+        FlowerStream *flowerStream = flowerWriter_getFlowerStream2(cactusDisk, f, test + 1,
+                test == 2 ? 1 : INT64_MAX);
+        CuAssertIntEquals(testCase, flowerNumber, flowerStream_size(flowerStream));
+        int64_t i = 0;
+        Flower *flower;
+        while ((flower = flowerStream_getNext(flowerStream)) != NULL) {
+            CuAssertTrue(testCase, i < flowerNumber);
+            CuAssertIntEquals(testCase, flowerNames[i], flower_getName(flower));
+            i++;
+        }
+        CuAssertIntEquals(testCase, flowerNumber, i);
+        CuAssertIntEquals(testCase, 0, stSortedSet_size(cactusDisk->flowers));
+        flowerStream_destruct(flowerStream);
+        fclose(f);
+        removeTempFile(tempPath);
+        free(flowerNames);
+        testCommon_deleteTemporaryCactusDisk(cactusDisk);
+    }
+}
+
+static void testFlowerStream_prefetchDestructEarly(CuTest *testCase) {
+    /*
+     * Checks a prefetching stream can be destroyed before it is exhausted.
+     */
+    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+    char *tempPath = getTempFile();
+    FILE *f = fopen(tempPath, "w");
+    int64_t flowerNumber = 200;
+    stList *flowers = stList_construct();
+    Name previousName = 0;
+    fprintf(f, "%" PRIi64, flowerNumber);
+    for (int64_t i = 0; i < flowerNumber; i++) {
+        Flower *flower = flower_construct(cactusDisk);
+        fprintf(f, " %" PRIi64, flower_getName(flower) - previousName);
+        previousName = flower_getName(flower);
+        stList_append(flowers, flower);
+    }
+    fclose(f);
+    cactusDisk_write(cactusDisk);
+    for (int64_t i = 0; i < flowerNumber; i++) {
+        flower_destruct(stList_get(flowers, i), false);
+    }
+    stList_destruct(flowers);
+
+    f = fopen(tempPath, "r");
+    FlowerStream *flowerStream = flowerWriter_getFlowerStream2(cactusDisk, f, 2, INT64_MAX);
+    CuAssertTrue(testCase, flowerStream_getNext(flowerStream) != NULL);
+    flowerStream_destruct(flowerStream);
+    fclose(f);
+    removeTempFile(tempPath);
+    testCommon_deleteTemporaryCactusDisk(cactusDisk);
+}
+
 static void testFlowerWriter(CuTest *testCase) {
     char *tempFile = "./flowerWriterTest.txt";
     FILE *fileHandle = fopen(tempFile, "w");
@@ -101,6 +181,8 @@ static void testFlowerWriter(CuTest *testCase) {
 CuSuite* cactusFlowerWriterTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testFlowerStream);
+    SUITE_ADD_TEST(suite, testFlowerStream_prefetch);
+    SUITE_ADD_TEST(suite, testFlowerStream_prefetchDestructEarly);
     SUITE_ADD_TEST(suite, testFlowerWriter);
     return suite;
 }
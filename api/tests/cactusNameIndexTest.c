@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+
+static void testNameIndex_random(CuTest* testCase) {
+    /*
+     * Inserts and removes random names, including negative and clustered ones, checking the index
+     * against a hash.
+     */
+    for (int64_t test = 0; test < 100; test++) {
+        NameIndex *nameIndex = nameIndex_construct();
+        stHash *names = stHash_construct3((uint64_t (*)(const void *)) stIntTuple_hashKey,
+                (int (*)(const void *, const void *)) stIntTuple_equalsFn, (void (*)(void *)) stIntTuple_destruct, NULL);
+        int64_t range = st_randomInt(1, 1000);
+        for (int64_t i = 0; i < 1000; i++) {
+            stIntTuple *name = stIntTuple_construct1(st_randomInt(-range, range) * (test % 2 ? 1 : 1024));
+            if (nameIndex_search(nameIndex, stIntTuple_get(name, 0)) != NULL) {
+                nameIndex_remove(nameIndex, stIntTuple_get(name, 0));
+                stIntTuple_destruct(stHash_remove(names, name));
+                stIntTuple_destruct(name);
+            } else {
+                nameIndex_insert(nameIndex, stIntTuple_get(name, 0), name);
+                stHash_insert(names, name, name);
+            }
+            CuAssertIntEquals(testCase, stHash_size(names), nameIndex_size(nameIndex));
+        }
+        nameIndex_remove(nameIndex, 2 * range * 1024 + 1); //Not in the index, so nothing is removed.
+        CuAssertIntEquals(testCase, stHash_size(names), nameIndex_size(nameIndex));
+        for (int64_t i = -range; i < range; i++) {
+            stIntTuple *name = stIntTuple_construct1(i * (test % 2 ? 1 : 1024));
+            CuAssertPtrEquals(testCase, stHash_search(names, name), nameIndex_search(nameIndex, stIntTuple_get(name, 0)));
+            stIntTuple_destruct(name);
+        }
+        stHash_destruct(names);
+        nameIndex_destruct(nameIndex);
+    }
+}
+
+static void testNameIndex_flower(CuTest* testCase) {
+    /*
+     * Checks the elements of a flower are found by name after others are removed.
+     */
+    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+    Event *event = eventTree_getRootEvent(eventTree_construct2(cactusDisk));
+    Flower *flower = flower_construct(cactusDisk);
+    stList *blocks = stList_construct();
+    for (int64_t i = 0; i < 1000; i++) {
+        Block *block = block_construct(1, flower);
+        segment_construct(block, event);
+        stList_append(blocks, block);
+    }
+    for (int64_t i = 0; i < 1000; i += 3) {
+        Block *block = stList_get(blocks, i);
+        Name name = block_getName(block);
+        block_destruct(block);
+        CuAssertTrue(testCase, flower_getBlock(flower, name) == NULL);
+    }
+    for (int64_t i = 1; i < 1000; i++) {
+        if (i % 3 == 0) {
+            continue;
+        }
+        Block *block = stList_get(blocks, i);
+        CuAssertTrue(testCase, flower_getBlock(flower, block_getName(block)) == block);
+        CuAssertTrue(testCase, flower_getBlock(flower, block_getName(block_getReverse(block))) == block);
+        Segment *segment = segment_getPositiveOrientation(block_getFirst(block));
+        CuAssertTrue(testCase, flower_getSegment(flower, segment_getName(segment)) == segment);
+        Cap *cap = cap_getPositiveOrientation(segment_get5Cap(segment));
+        CuAssertTrue(testCase, flower_getCap(flower, cap_getName(cap)) == cap);
+        End *end = end_getPositiveOrientation(block_get3End(block));
+        CuAssertTrue(testCase, flower_getEnd(flower, end_getName(end)) == end);
+    }
+    stList_destruct(blocks);
+    testCommon_deleteTemporaryCactusDisk(cactusDisk);
+}
+
+CuSuite* cactusNameIndexTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testNameIndex_random);
+    SUITE_ADD_TEST(suite, testNameIndex_flower);
+    return suite;
+}
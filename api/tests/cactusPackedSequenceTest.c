@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+
+static CactusDisk *cactusDisk = NULL;
+static stKVDatabaseConf *conf = NULL;
+
+static void cactusPackedSequenceTestTeardown() {
+    if (cactusDisk != NULL) {
+        testCommon_deleteTemporaryCactusDisk(cactusDisk);
+        stKVDatabaseConf_destruct(conf);
+        cactusDisk = NULL;
+    }
+}
+
+static void cactusPackedSequenceTestSetup() {
+    cactusPackedSequenceTestTeardown();
+    conf = testCommon_getTemporaryKVDatabaseConf();
+    cactusDisk = testCommon_getTemporaryCactusDisk();
+}
+
+static char *getRandomSequence(int64_t length) {
+    /*
+     * Makes a sequence with runs of soft masked bases, Ns and the odd IUPAC code.
+     */
+    const char *chars = "ACGTACGTACGTNRYacgtacgtn";
+    char *string = st_malloc(sizeof(char) * (length + 1));
+    for (int64_t i = 0; i < length; i++) {
+        string[i] = i > 0 && st_random() > 0.2 ? string[i - 1] : chars[st_randomInt(0, strlen(chars))];
+    }
+    string[length] = '\0';
+    return string;
+}
+
+static void testPackedSequence_roundTrip(CuTest* testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        int64_t length = st_randomInt(0, 1000);
+        char *string = getRandomSequence(length);
+        PackedSequence *packedSequence = packedSequence_construct(string, length);
+        CuAssertIntEquals(testCase, length, packedSequence_getLength(packedSequence));
+        char *string2 = packedSequence_getString(packedSequence);
+        CuAssertStrEquals(testCase, string, string2);
+        free(string2);
+        //Check the records stored in the cactus disk
+        int64_t recordSize;
+        void *record = packedSequence_writeBinaryRepresentation(packedSequence, &recordSize);
+        PackedSequence *packedSequence2 = packedSequence_loadFromBinaryRepresentation(record, recordSize);
+        string2 = packedSequence_getString(packedSequence2);
+        CuAssertStrEquals(testCase, string, string2);
+        free(string2);
+        free(record);
+        packedSequence_destruct(packedSequence2);
+        packedSequence_destruct(packedSequence);
+        free(string);
+    }
+}
+
+static void testPackedSequence_getSubSequenceAndReverseComplement(CuTest* testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        int64_t length = st_randomInt(1, 1000);
+        char *string = getRandomSequence(length);
+        PackedSequence *packedSequence = packedSequence_construct(string, length);
+        int64_t start = st_randomInt(0, length);
+        int64_t subLength = st_randomInt(0, length - start + 1);
+        PackedSequence *subSequence = packedSequence_getSubSequence(packedSequence, start, subLength);
+        char *expectedString = stString_getSubString(string, start, subLength);
+        char *string2 = packedSequence_getString(subSequence);
+        CuAssertStrEquals(testCase, expectedString, string2);
+        free(string2);
+        PackedSequence *reverseSequence = packedSequence_reverseComplement(subSequence);
+        char *expectedReverseString = stString_reverseComplementString(expectedString);
+        string2 = packedSequence_getString(reverseSequence);
+        CuAssertStrEquals(testCase, expectedReverseString, string2);
+        free(string2);
+        free(expectedReverseString);
+        free(expectedString);
+        packedSequence_destruct(reverseSequence);
+        packedSequence_destruct(subSequence);
+        packedSequence_destruct(packedSequence);
+        free(string);
+    }
+}
+
+static void testPackedSequence_concatenate(CuTest* testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        stList *packedSequences = stList_construct3(0, (void (*)(void *)) packedSequence_destruct);
+        stList *strings = stList_construct3(0, free);
+        int64_t sequenceNumber = st_randomInt(0, 10);
+        for (int64_t i = 0; i < sequenceNumber; i++) {
+            int64_t length = st_randomInt(0, 100);
+            char *string = getRandomSequence(length);
+            stList_append(strings, string);
+            stList_append(packedSequences, packedSequence_construct(string, length));
+        }
+        PackedSequence *packedSequence = packedSequence_concatenate(packedSequences);
+        char *expectedString = stString_join2("", strings);
+        char *string2 = packedSequence_getString(packedSequence);
+        CuAssertStrEquals(testCase, expectedString, string2);
+        free(string2);
+        free(expectedString);
+        packedSequence_destruct(packedSequence);
+        stList_destruct(strings);
+        stList_destruct(packedSequences);
+    }
+}
+
+static void testPackedSequenceCache(CuTest* testCase) {
+    PackedSequenceCache *cache = packedSequenceCache_construct(INT64_MAX);
+    char *string = getRandomSequence(1000);
+    int64_t offset;
+    CuAssertTrue(testCase, packedSequenceCache_getRecord(cache, 1, 0, 10, &offset, 1) == NULL);
+    packedSequenceCache_setRecord(cache, 1, 100, packedSequence_construct(string + 100, 100));
+    packedSequenceCache_setRecord(cache, 1, 150, packedSequence_construct(string + 150, 10));
+    packedSequenceCache_setRecord(cache, 2, 0, packedSequence_construct(string, 1000));
+    CuAssertTrue(testCase, packedSequenceCache_getRecord(cache, 1, 50, 100, &offset, 1) == NULL);
+    CuAssertTrue(testCase, packedSequenceCache_getRecord(cache, 1, 150, 100, &offset, 1) == NULL);
+    PackedSequence *packedSequence = packedSequenceCache_getRecord(cache, 1, 155, 45, &offset, 1);
+    CuAssertTrue(testCase, packedSequence != NULL);
+    CuAssertIntEquals(testCase, 55, offset);
+    CuAssertIntEquals(testCase, 100, packedSequence_getLength(packedSequence));
+    //Add a record containing the others
+    packedSequenceCache_setRecord(cache, 1, 0, packedSequence_construct(string, 500));
+    packedSequence = packedSequenceCache_getRecord(cache, 1, 155, 300, &offset, 1);
+    CuAssertTrue(testCase, packedSequence != NULL);
+    CuAssertIntEquals(testCase, 155, offset);
+    packedSequenceCache_clear(cache);
+    CuAssertTrue(testCase, packedSequenceCache_getRecord(cache, 1, 155, 45, &offset, 1) == NULL);
+    packedSequenceCache_destruct(cache);
+    free(string);
+}
+
+static void testPackedSequenceCache_leastRecentlyUsed(CuTest* testCase) {
+    /*
+     * Fills a cache with room for three sequences, checking the least recently used is evicted.
+     */
+    char *string = getRandomSequence(1000);
+    PackedSequence *packedSequence = packedSequence_construct(string, 1000);
+    int64_t size = packedSequence_getMemorySize(packedSequence);
+    packedSequence_destruct(packedSequence);
+    PackedSequenceCache *cache = packedSequenceCache_construct(3 * size);
+    int64_t offset;
+    for (int64_t i = 1; i <= 3; i++) {
+        packedSequenceCache_setRecord(cache, i, 0, packedSequence_construct(string, 1000));
+    }
+    CuAssertTrue(testCase, packedSequenceCache_getRecord(cache, 1, 0, 1000, &offset, 1) != NULL);
+    packedSequenceCache_setRecord(cache, 4, 0, packedSequence_construct(string, 1000));
+    CuAssertTrue(testCase, packedSequenceCache_getRecord(cache, 2, 0, 1000, &offset, 1) == NULL);
+    CuAssertTrue(testCase, packedSequenceCache_getRecord(cache, 1, 0, 1000, &offset, 1) != NULL);
+    CuAssertTrue(testCase, packedSequenceCache_getRecord(cache, 3, 0, 1000, &offset, 1) != NULL);
+    CuAssertTrue(testCase, packedSequenceCache_getRecord(cache, 4, 0, 1000, &offset, 1) != NULL);
+    CacheStats *stats = packedSequenceCache_getStats(cache);
+    CuAssertIntEquals(testCase, 4, stats->hits);
+    CuAssertIntEquals(testCase, 1, stats->misses);
+    CuAssertIntEquals(testCase, 1, stats->evictions);
+    CuAssertIntEquals(testCase, 4 * size, stats->bytesFetched);
+    //Shrinking the cache evicts the least recently used
+    packedSequenceCache_setMaxSize(cache, size);
+    CuAssertIntEquals(testCase, 3, stats->evictions);
+    CuAssertTrue(testCase, packedSequenceCache_getRecord(cache, 4, 0, 1000, &offset, 0) != NULL);
+    CuAssertTrue(testCase, packedSequenceCache_getRecord(cache, 3, 0, 1000, &offset, 0) == NULL);
+    CuAssertIntEquals(testCase, 4, stats->hits);
+    //A sequence bigger than the cache is still added
+    packedSequenceCache_setRecord(cache, 5, 0, packedSequence_construct(string, 1000));
+    packedSequenceCache_setMaxSize(cache, 1);
+    packedSequenceCache_setRecord(cache, 6, 0, packedSequence_construct(string, 1000));
+    CuAssertTrue(testCase, packedSequenceCache_getRecord(cache, 6, 0, 1000, &offset, 1) != NULL);
+    packedSequenceCache_destruct(cache);
+    free(string);
+}
+
+static void testPackedSequence_cactusDiskStrings(CuTest* testCase) {
+    cactusPackedSequenceTestSetup();
+    int64_t length = 2000;
+    char *string = getRandomSequence(length);
+    MetaSequence *metaSequence = metaSequence_construct(1, length, string, "FOO", 10, cactusDisk);
+    Name name = metaSequence_getName(metaSequence);
+    cactusDisk_write(cactusDisk);
+    cactusDisk_destruct(cactusDisk);
+    cactusDisk = cactusDisk_construct(conf, false, true);
+    metaSequence = cactusDisk_getMetaSequence(cactusDisk, name);
+    for (int64_t test = 0; test < 100; test++) {
+        int64_t start = st_randomInt(0, length);
+        int64_t subLength = st_randomInt(0, length - start + 1);
+        bool strand = st_random() > 0.5;
+        char *expectedString = stString_getSubString(string, start, subLength);
+        if (!strand) {
+            char *expectedString2 = stString_reverseComplementString(expectedString);
+            free(expectedString);
+            expectedString = expectedString2;
+        }
+        char *string2 = metaSequence_getString(metaSequence, start + 1, subLength, strand);
+        CuAssertStrEquals(testCase, expectedString, string2);
+        free(string2);
+        free(expectedString);
+    }
+    free(string);
+    cactusPackedSequenceTestTeardown();
+}
+
+CuSuite* cactusPackedSequenceTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testPackedSequence_roundTrip);
+    SUITE_ADD_TEST(suite, testPackedSequence_getSubSequenceAndReverseComplement);
+    SUITE_ADD_TEST(suite, testPackedSequence_concatenate);
+    SUITE_ADD_TEST(suite, testPackedSequenceCache);
+    SUITE_ADD_TEST(suite, testPackedSequenceCache_leastRecentlyUsed);
+    SUITE_ADD_TEST(suite, testPackedSequence_cactusDiskStrings);
+    return suite;
+}
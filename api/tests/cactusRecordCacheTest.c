@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+
+static void testRecordCache_setAndGet(CuTest* testCase) {
+    RecordCache *cache = recordCache_construct(INT64_MAX);
+    int64_t recordSize;
+    CuAssertTrue(testCase, recordCache_getRecord(cache, 1, &recordSize) == NULL);
+    CuAssertTrue(testCase, !recordCache_containsRecord(cache, 1));
+    recordCache_setRecord(cache, 1, "hello", 6);
+    recordCache_setRecord(cache, 2, "world!", 7);
+    CuAssertTrue(testCase, recordCache_containsRecord(cache, 1));
+    char *record = recordCache_getRecord(cache, 1, &recordSize);
+    CuAssertIntEquals(testCase, 6, recordSize);
+    CuAssertStrEquals(testCase, "hello", record);
+    free(record);
+    //Replace a record
+    recordCache_setRecord(cache, 1, "goodbye", 8);
+    record = recordCache_getRecord(cache, 1, &recordSize);
+    CuAssertIntEquals(testCase, 8, recordSize);
+    CuAssertStrEquals(testCase, "goodbye", record);
+    free(record);
+    CacheStats *stats = recordCache_getStats(cache);
+    CuAssertIntEquals(testCase, 2, stats->hits);
+    CuAssertIntEquals(testCase, 1, stats->misses);
+    CuAssertIntEquals(testCase, 0, stats->evictions);
+    CuAssertIntEquals(testCase, 21, stats->bytesFetched);
+    recordCache_clear(cache);
+    CuAssertTrue(testCase, !recordCache_containsRecord(cache, 2));
+    CuAssertIntEquals(testCase, 0, recordCache_getSize(cache));
+    recordCache_destruct(cache);
+}
+
+static void testRecordCache_leastRecentlyUsed(CuTest* testCase) {
+    /*
+     * Uses random records in a small cache, checking it holds just the most recently used records.
+     */
+    for (int64_t test = 0; test < 10; test++) {
+        int64_t maxSize = st_randomInt(2000, 10000);
+        RecordCache *cache = recordCache_construct(maxSize);
+        stList *recentlyUsed = stList_construct3(0, (void (*)(void *)) stIntTuple_destruct); //Most recently used last
+        for (int64_t i = 0; i < 1000; i++) {
+            Name name = st_randomInt(0, 50);
+            int64_t recordSize;
+            void *record = recordCache_getRecord(cache, name, &recordSize);
+            if (record == NULL) {
+                recordSize = st_randomInt(0, 1000);
+                record = st_calloc(recordSize + 1, 1);
+                recordCache_setRecord(cache, name, record, recordSize);
+            }
+            free(record);
+            for (int64_t j = 0; j < stList_length(recentlyUsed); j++) {
+                if (stIntTuple_get(stList_get(recentlyUsed, j), 0) == name) {
+                    stIntTuple_destruct(stList_remove(recentlyUsed, j));
+                    break;
+                }
+            }
+            stList_append(recentlyUsed, stIntTuple_construct1(name));
+            //The records in the cache must be the most recently used ones.
+            int64_t j = stList_length(recentlyUsed) - 1;
+            while (j >= 0 && recordCache_containsRecord(cache, stIntTuple_get(stList_get(recentlyUsed, j), 0))) {
+                j--;
+            }
+            CuAssertTrue(testCase, j < stList_length(recentlyUsed) - 1);
+            while (j >= 0) {
+                CuAssertTrue(testCase, !recordCache_containsRecord(cache, stIntTuple_get(stList_get(recentlyUsed, j--), 0)));
+            }
+            CuAssertTrue(testCase, recordCache_getSize(cache) <= maxSize);
+        }
+        stList_destruct(recentlyUsed);
+        recordCache_destruct(cache);
+    }
+}
+
+static void testRecordCache_setMaxSize(CuTest* testCase) {
+    RecordCache *cache = recordCache_construct(INT64_MAX);
+    char record[1000];
+    memset(record, 'A', 1000);
+    for (int64_t i = 0; i < 10; i++) {
+        recordCache_setRecord(cache, i, record, 100);
+    }
+    int64_t entrySize = recordCache_getSize(cache) / 10;
+    CuAssertTrue(testCase, entrySize >= 100);
+    int64_t recordSize;
+    free(recordCache_getRecord(cache, 0, &recordSize));
+    recordCache_setMaxSize(cache, 3 * entrySize);
+    CuAssertIntEquals(testCase, 3 * entrySize, recordCache_getSize(cache));
+    CuAssertIntEquals(testCase, 7, recordCache_getStats(cache)->evictions);
+    CuAssertTrue(testCase, recordCache_containsRecord(cache, 0));
+    CuAssertTrue(testCase, recordCache_containsRecord(cache, 8));
+    CuAssertTrue(testCase, recordCache_containsRecord(cache, 9));
+    CuAssertTrue(testCase, !recordCache_containsRecord(cache, 7));
+    //A record bigger than the cache is not added
+    recordCache_setRecord(cache, 10, record, 3 * entrySize);
+    CuAssertTrue(testCase, !recordCache_containsRecord(cache, 10));
+    recordCache_destruct(cache);
+}
+
+static void testCactusDisk_cacheSizes(CuTest* testCase) {
+    /*
+     * Checks the cache sizes are taken from the environment.
+     */
+    setenv("CACTUS_DISK_CACHE_SIZE", "5M", 1);
+    setenv("CACTUS_DISK_STRING_CACHE_SIZE", "123456", 1);
+    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+    CuAssertIntEquals(testCase, 5000000, recordCache_getMaxSize(cactusDisk->cache));
+    CuAssertIntEquals(testCase, 123456, packedSequenceCache_getMaxSize(cactusDisk->stringCache));
+    cactusDisk_setCacheSizes(cactusDisk, 1000, 2000);
+    CuAssertIntEquals(testCase, 1000, recordCache_getMaxSize(cactusDisk->cache));
+    CuAssertIntEquals(testCase, 2000, packedSequenceCache_getMaxSize(cactusDisk->stringCache));
+    testCommon_deleteTemporaryCactusDisk(cactusDisk);
+    unsetenv("CACTUS_DISK_CACHE_SIZE");
+    unsetenv("CACTUS_DISK_STRING_CACHE_SIZE");
+}
+
+CuSuite* cactusRecordCacheTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testRecordCache_setAndGet);
+    SUITE_ADD_TEST(suite, testRecordCache_leastRecentlyUsed);
+    SUITE_ADD_TEST(suite, testRecordCache_setMaxSize);
+    SUITE_ADD_TEST(suite, testCactusDisk_cacheSizes);
+    return suite;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+
+static char *getRandomRecord(int64_t *recordSize) {
+    /*
+     * Makes a repetitive record, like a flower record, with the odd random byte.
+     */
+    const char *chars = "CAPSEGMENTBLOCKEND";
+    *recordSize = st_randomInt(0, 5000);
+    char *record = st_malloc(*recordSize + 1);
+    for (int64_t i = 0; i < *recordSize; i++) {
+        record[i] = st_random() > 0.1 ? chars[i % strlen(chars)] : (char) st_randomInt(0, 256);
+    }
+    return record;
+}
+
+static void testRecordCodec_roundTrip(CuTest* testCase) {
+    stList *samples = stList_construct3(0, free);
+    int64_t sampleSizes[100];
+    for (int64_t i = 0; i < 100; i++) {
+        stList_append(samples, getRandomRecord(&sampleSizes[i]));
+    }
+    int64_t dictionarySize;
+    void *dictionary = recordCodec_trainDictionary(samples, sampleSizes, 10000, &dictionarySize);
+    CuAssertTrue(testCase, dictionary == NULL || recordCodec_isAvailable(RECORD_CODEC_ZSTD_DICTIONARY));
+    for (int64_t type = RECORD_CODEC_NONE; type <= RECORD_CODEC_ZSTD_DICTIONARY; type++) {
+        if (!recordCodec_isAvailable(type)) {
+            continue;
+        }
+        RecordCodec *codec = recordCodec_construct(type, RECORD_CODEC_DEFAULT_LEVEL);
+        if (dictionary != NULL) {
+            recordCodec_setDictionary(codec, dictionary, dictionarySize);
+        }
+        for (int64_t i = 0; i < stList_length(samples); i++) {
+            int64_t recordSize, dataSize;
+            void *record = recordCodec_compress(codec, stList_get(samples, i), sampleSizes[i], &recordSize);
+            CuAssertIntEquals(testCase, type, recordCodec_getRecordType(record, recordSize));
+            void *data = recordCodec_decompress(codec, record, recordSize, &dataSize);
+            CuAssertIntEquals(testCase, sampleSizes[i], dataSize);
+            CuAssertTrue(testCase, memcmp(data, stList_get(samples, i), dataSize) == 0);
+            free(data);
+            free(record);
+        }
+        recordCodec_destruct(codec);
+    }
+    free(dictionary);
+    stList_destruct(samples);
+}
+
+static void testRecordCodec_constructFromString(CuTest* testCase) {
+    RecordCodec *codec = recordCodec_constructFromString("zlib:6");
+    CuAssertIntEquals(testCase, RECORD_CODEC_ZLIB, recordCodec_getType(codec));
+    CuAssertIntEquals(testCase, 6, recordCodec_getLevel(codec));
+    recordCodec_destruct(codec);
+    codec = recordCodec_constructFromString("none");
+    CuAssertIntEquals(testCase, RECORD_CODEC_NONE, recordCodec_getType(codec));
+    CuAssertTrue(testCase, recordCodec_getLevel(codec) == RECORD_CODEC_DEFAULT_LEVEL);
+    recordCodec_destruct(codec);
+    codec = recordCodec_constructFromString("zlib:-1"); //A level, not the default.
+    CuAssertIntEquals(testCase, -1, recordCodec_getLevel(codec));
+    recordCodec_destruct(codec);
+    stTry {
+        recordCodec_constructFromString("zlip");
+        CuAssertTrue(testCase, 0);
+    } stCatch(except) {
+        st_logInfo("This is the message: %s\n", stExcept_getMsg(except));
+        stExcept_free(except);
+    } stTryEnd
+}
+
+static void testCactusDisk_getCompressionFromConfString(CuTest* testCase) {
+    char *compression = cactusDisk_getCompressionFromConfString(
+            "<st_kv_database_conf type=\"kyoto_tycoon\" compression=\"zstd:5\"><kyoto_tycoon host=\"localhost\" port=\"1978\" database_dir=\"foo\" /></st_kv_database_conf>");
+    CuAssertStrEquals(testCase, "zstd:5", compression);
+    free(compression);
+    CuAssertTrue(testCase, cactusDisk_getCompressionFromConfString(
+            "<st_kv_database_conf type=\"tokyo_cabinet\"><tokyo_cabinet database_dir=\"foo\" compression=\"none\" /></st_kv_database_conf>") == NULL);
+}
+
+static void testCactusDisk_mixedCodecs(CuTest* testCase) {
+    /*
+     * Writes flowers with different codecs into one cactus disk, and checks they can all be read back.
+     */
+    stKVDatabaseConf *conf = testCommon_getTemporaryKVDatabaseConf();
+    const char *codecs[] = { "none", "zlib:9", "zlib:1", "lz4", "zstd", "zstd_dictionary" };
+    int64_t types[] = { RECORD_CODEC_NONE, RECORD_CODEC_ZLIB, RECORD_CODEC_ZLIB, RECORD_CODEC_LZ4, RECORD_CODEC_ZSTD,
+            RECORD_CODEC_ZSTD_DICTIONARY };
+    stList *flowerNames = stList_construct3(0, (void (*)(void *)) stIntTuple_destruct);
+    for (int64_t i = 0; i < 6; i++) {
+        if (!recordCodec_isAvailable(types[i])) {
+            continue;
+        }
+        CactusDisk *cactusDisk = cactusDisk_construct2(conf, stList_length(flowerNames) == 0, true, codecs[i]);
+        for (int64_t j = 0; j < 20; j++) {
+            Flower *flower = flower_construct(cactusDisk);
+            end_construct(0, flower);
+            stList_append(flowerNames, stIntTuple_construct1(flower_getName(flower)));
+        }
+        cactusDisk_write(cactusDisk);
+        cactusDisk_destruct(cactusDisk);
+    }
+    CactusDisk *cactusDisk = cactusDisk_construct(conf, false, true);
+    for (int64_t i = 0; i < stList_length(flowerNames); i++) {
+        Flower *flower = cactusDisk_getFlower(cactusDisk, stIntTuple_get(stList_get(flowerNames, i), 0));
+        CuAssertTrue(testCase, flower != NULL);
+        CuAssertIntEquals(testCase, 1, flower_getEndNumber(flower));
+    }
+    testCommon_deleteTemporaryCactusDisk(cactusDisk);
+    stList_destruct(flowerNames);
+    stKVDatabaseConf_destruct(conf);
+}
+
+CuSuite* cactusRecordCodecTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testRecordCodec_roundTrip);
+    SUITE_ADD_TEST(suite, testRecordCodec_constructFromString);
+    SUITE_ADD_TEST(suite, testCactusDisk_getCompressionFromConfString);
+    SUITE_ADD_TEST(suite, testCactusDisk_mixedCodecs);
+    return suite;
+}
@@ -117,6 +117,189 @@ void testBinaryRepresentation_makeBinaryRepresentation(CuTest* testCase) {
     cactusSerialisationTestTeardown();
 }
 
+static void testBinaryRepresentation_stringsFn(void *object, void(*writeFn)(const void * ptr, size_t size, size_t count)) {
+    stList *strings = object;
+    binaryRepresentation_writeInteger(stList_length(strings), writeFn);
+    for (int64_t i = 0; i < stList_length(strings); i++) {
+        binaryRepresentation_writeString(stList_get(strings, i), writeFn);
+    }
+}
+
+static void checkStringsRepresentation(CuTest* testCase, stList *strings, const void *vA, int64_t recordSize) {
+    void *vA2 = (void *) vA;
+    CuAssertIntEquals(testCase, stList_length(strings), binaryRepresentation_getInteger(&vA2));
+    for (int64_t i = 0; i < stList_length(strings); i++) {
+        char *string = binaryRepresentation_getString(&vA2);
+        CuAssertStrEquals(testCase, stList_get(strings, i), string);
+        free(string);
+    }
+    CuAssertIntEquals(testCase, recordSize, (char *) vA2 - (char *) vA);
+}
+
+static stList *getRandomStrings(void) {
+    stList *strings = stList_construct3(0, free);
+    int64_t stringNumber = st_randomInt(0, 100);
+    for (int64_t i = 0; i < stringNumber; i++) {
+        int64_t length = st_randomInt(0, 1000);
+        char *string = st_malloc(length + 1);
+        for (int64_t j = 0; j < length; j++) {
+            string[j] = 'A' + st_randomInt(0, 26);
+        }
+        string[length] = '\0';
+        stList_append(strings, string);
+    }
+    return strings;
+}
+
+static void testBinaryRepresentationWriter(CuTest* testCase) {
+    /*
+     * Checks a writer grows its buffer as needed and can be reused.
+     */
+    BinaryRepresentationWriter *writer = binaryRepresentationWriter_construct();
+    for (int64_t test = 0; test < 100; test++) {
+        stList *strings = getRandomStrings();
+        int64_t recordSize;
+        const void *vA = binaryRepresentationWriter_makeBinaryRepresentation(writer, strings,
+                testBinaryRepresentation_stringsFn, &recordSize);
+        checkStringsRepresentation(testCase, strings, vA, recordSize);
+        void *vA2 = binaryRepresentation_makeBinaryRepresentation(strings, testBinaryRepresentation_stringsFn, &recordSize);
+        checkStringsRepresentation(testCase, strings, vA2, recordSize);
+        free(vA2);
+        stList_destruct(strings);
+    }
+    binaryRepresentationWriter_destruct(writer);
+}
+
+typedef struct _writerThreadInput {
+    stList *stringLists;
+    stList *expectedRepresentations;
+    stList *expectedRecordSizes;
+    bool identical;
+} WriterThreadInput;
+
+static void *testBinaryRepresentationWriter_threadsFn(void *arg) {
+    /*
+     * Serialises each of the lists of strings, checking the results match those made beforehand.
+     */
+    WriterThreadInput *input = arg;
+    BinaryRepresentationWriter *writer = binaryRepresentationWriter_construct();
+    input->identical = 1;
+    for (int64_t i = 0; i < stList_length(input->stringLists); i++) {
+        int64_t recordSize;
+        const void *vA = binaryRepresentationWriter_makeBinaryRepresentation(writer, stList_get(input->stringLists, i),
+                testBinaryRepresentation_stringsFn, &recordSize);
+        if (recordSize != stIntTuple_get(stList_get(input->expectedRecordSizes, i), 0)
+                || memcmp(vA, stList_get(input->expectedRepresentations, i), recordSize) != 0) {
+            input->identical = 0;
+        }
+    }
+    binaryRepresentationWriter_destruct(writer);
+    return NULL;
+}
+
+static void testBinaryRepresentationWriter_threads(CuTest* testCase) {
+    /*
+     * Checks writers can be used at the same time by different threads.
+     */
+    WriterThreadInput inputs[4];
+    pthread_t threads[4];
+    for (int64_t i = 0; i < 4; i++) {
+        inputs[i].stringLists = stList_construct3(0, (void (*)(void *)) stList_destruct);
+        inputs[i].expectedRepresentations = stList_construct3(0, free);
+        inputs[i].expectedRecordSizes = stList_construct3(0, (void (*)(void *)) stIntTuple_destruct);
+        for (int64_t j = 0; j < 50; j++) {
+            stList *strings = getRandomStrings();
+            int64_t recordSize;
+            stList_append(inputs[i].stringLists, strings);
+            stList_append(inputs[i].expectedRepresentations,
+                    binaryRepresentation_makeBinaryRepresentation(strings, testBinaryRepresentation_stringsFn, &recordSize));
+            stList_append(inputs[i].expectedRecordSizes, stIntTuple_construct1(recordSize));
+        }
+    }
+    for (int64_t i = 0; i < 4; i++) {
+        CuAssertTrue(testCase, pthread_create(&threads[i], NULL, testBinaryRepresentationWriter_threadsFn, &inputs[i]) == 0);
+    }
+    for (int64_t i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        CuAssertTrue(testCase, inputs[i].identical);
+        stList_destruct(inputs[i].stringLists);
+        stList_destruct(inputs[i].expectedRepresentations);
+        stList_destruct(inputs[i].expectedRecordSizes);
+    }
+}
+
+typedef struct _compactFormatTestInput {
+    int64_t length;
+    int64_t *integers;
+    Name *names;
+    int64_t *coordinates;
+    Name *sequenceNames;
+} CompactFormatTestInput;
+
+static void testBinaryRepresentation_compactFormatFn(void *object, void(*writeFn)(const void * ptr, size_t size, size_t count)) {
+    CompactFormatTestInput *input = object;
+    for (int64_t i = 0; i < input->length; i++) {
+        binaryRepresentation_writeInteger(input->integers[i], writeFn);
+        binaryRepresentation_writeName(input->names[i], writeFn);
+        binaryRepresentation_writeCoordinate(input->coordinates[i], input->sequenceNames[i], writeFn);
+        binaryRepresentation_writeString("hello", writeFn);
+    }
+}
+
+static void testBinaryRepresentation_compactFormat(CuTest* testCase) {
+    /*
+     * Checks integers, names and coordinates round trip through the compact format, and take less space than in
+     * the fixed format.
+     */
+    int64_t length = 1000;
+    Name baseName = 1000000000;
+    CompactFormatTestInput input;
+    input.length = length;
+    input.integers = st_malloc(sizeof(int64_t) * length);
+    input.names = st_malloc(sizeof(Name) * length);
+    input.coordinates = st_malloc(sizeof(int64_t) * length);
+    input.sequenceNames = st_malloc(sizeof(Name) * length);
+    for (int64_t i = 0; i < length; i++) {
+        input.integers[i] = i % 100 == 0 ? INT64_MIN : st_randomInt(-1000, 1000);
+        input.names[i] = i % 100 == 0 ? NULL_NAME : baseName + st_randomInt(-1000, 1000);
+        input.sequenceNames[i] = baseName + st_randomInt(0, 3);
+        input.coordinates[i] = i % 100 == 0 ? INT64_MAX : 100000000 + i * 10 + st_randomInt(0, 10);
+    }
+    int64_t fixedRecordSize;
+    void *fixedRecord = binaryRepresentation_makeBinaryRepresentation(&input, testBinaryRepresentation_compactFormatFn,
+            &fixedRecordSize);
+    BinaryRepresentationFormat *format = binaryRepresentationFormat_construct(BINARY_REPRESENTATION_FORMAT_COMPACT, baseName);
+    CuAssertTrue(testCase, binaryRepresentation_setFormat(format) == NULL);
+    CuAssertIntEquals(testCase, BINARY_REPRESENTATION_FORMAT_COMPACT, binaryRepresentation_getFormatVersion());
+    int64_t recordSize;
+    void *record = binaryRepresentation_makeBinaryRepresentation(&input, testBinaryRepresentation_compactFormatFn,
+            &recordSize);
+    binaryRepresentationFormat_destruct(format);
+    CuAssertTrue(testCase, recordSize < fixedRecordSize / 2);
+    //Read the record with a fresh format
+    format = binaryRepresentationFormat_construct(BINARY_REPRESENTATION_FORMAT_COMPACT, baseName);
+    binaryRepresentation_setFormat(format);
+    void *vA2 = record;
+    for (int64_t i = 0; i < length; i++) {
+        CuAssertIntEquals(testCase, input.integers[i], binaryRepresentation_getInteger(&vA2));
+        CuAssertIntEquals(testCase, input.names[i], binaryRepresentation_getName(&vA2));
+        CuAssertIntEquals(testCase, input.coordinates[i], binaryRepresentation_getCoordinate(&vA2, input.sequenceNames[i]));
+        char *string = binaryRepresentation_getString(&vA2);
+        CuAssertStrEquals(testCase, "hello", string);
+        free(string);
+    }
+    CuAssertIntEquals(testCase, recordSize, (char *) vA2 - (char *) record);
+    CuAssertTrue(testCase, binaryRepresentation_setFormat(NULL) == format);
+    CuAssertIntEquals(testCase, BINARY_REPRESENTATION_FORMAT_FIXED, binaryRepresentation_getFormatVersion());
+    binaryRepresentationFormat_destruct(format);
+    free(record);
+    free(fixedRecord);
+    free(input.integers);
+    free(input.names);
+    free(input.coordinates);
+    free(input.sequenceNames);
+}
+
 static void testBinaryRepresentation_resizeObjectAsPowerOf2(CuTest* testCase) {
     for(int64_t i=0; i<100000; i++) {
         int64_t recordSize = i;
@@ -138,6 +321,9 @@ CuSuite* cactusSerialisationTestSuite(void) {
     SUITE_ADD_TEST(suite, testBinaryRepresentation_float);
     SUITE_ADD_TEST(suite, testBinaryRepresentation_bool);
     SUITE_ADD_TEST(suite, testBinaryRepresentation_makeBinaryRepresentation);
+    SUITE_ADD_TEST(suite, testBinaryRepresentationWriter);
+    SUITE_ADD_TEST(suite, testBinaryRepresentationWriter_threads);
+    SUITE_ADD_TEST(suite, testBinaryRepresentation_compactFormat);
     SUITE_ADD_TEST(suite, testBinaryRepresentation_resizeObjectAsPowerOf2);
     return suite;
 }
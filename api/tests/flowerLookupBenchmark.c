@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+
+/*
+ * Times flower_getCap, flower_getEnd and flower_getSegment on a flower with many caps, against
+ * searching the sorted sets the flower keeps for iteration.
+ */
+
+static double getTime(int64_t startTime, int64_t lookups) {
+    return ((double) (cactusDiskStats_getTime() - startTime)) / lookups;
+}
+
+static void report(const char *name, int64_t startTime, int64_t lookups, int64_t found) {
+    fprintf(stdout, "%s: %" PRIi64 " lookups, %" PRIi64 " found, %.1f ns per lookup\n", name, lookups, found,
+            getTime(startTime, lookups));
+}
+
+int main(int argc, char *argv[]) {
+    int64_t capNumber = argc > 1 ? atol(argv[1]) : 1000000;
+    int64_t lookups = argc > 2 ? atol(argv[2]) : 10000000;
+
+    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+    Event *event = eventTree_getRootEvent(eventTree_construct2(cactusDisk));
+    Flower *flower = flower_construct(cactusDisk);
+    //Each block has two ends, and each of its segments two caps.
+    int64_t segmentsPerBlock = 10;
+    for (int64_t i = 0; i < capNumber / (2 * segmentsPerBlock); i++) {
+        Block *block = block_construct(1, flower);
+        for (int64_t j = 0; j < segmentsPerBlock; j++) {
+            segment_construct(block, event);
+        }
+    }
+    fprintf(stdout, "Built a flower with %" PRIi64 " caps, %" PRIi64 " ends and %" PRIi64 " segments\n",
+            flower_getCapNumber(flower), flower_getEndNumber(flower), flower_getSegmentNumber(flower));
+
+    //The names looked up, in random order.
+    Name *capNames = st_malloc(lookups * sizeof(Name));
+    Name *endNames = st_malloc(lookups * sizeof(Name));
+    Name *segmentNames = st_malloc(lookups * sizeof(Name));
+    Cap **caps = st_malloc(flower_getCapNumber(flower) * sizeof(Cap *));
+    End **ends = st_malloc(flower_getEndNumber(flower) * sizeof(End *));
+    Segment **segments = st_malloc(flower_getSegmentNumber(flower) * sizeof(Segment *));
+    Flower_CapIterator *capIt = flower_getCapIterator(flower);
+    for (int64_t i = 0; i < flower_getCapNumber(flower); i++) {
+        caps[i] = flower_getNextCap(capIt);
+    }
+    flower_destructCapIterator(capIt);
+    Flower_EndIterator *endIt = flower_getEndIterator(flower);
+    for (int64_t i = 0; i < flower_getEndNumber(flower); i++) {
+        ends[i] = flower_getNextEnd(endIt);
+    }
+    flower_destructEndIterator(endIt);
+    Flower_SegmentIterator *segmentIt = flower_getSegmentIterator(flower);
+    for (int64_t i = 0; i < flower_getSegmentNumber(flower); i++) {
+        segments[i] = flower_getNextSegment(segmentIt);
+    }
+    flower_destructSegmentIterator(segmentIt);
+    for (int64_t i = 0; i < lookups; i++) {
+        capNames[i] = cap_getName(caps[st_randomInt(0, flower_getCapNumber(flower))]);
+        endNames[i] = end_getName(ends[st_randomInt(0, flower_getEndNumber(flower))]);
+        segmentNames[i] = segment_getName(segments[st_randomInt(0, flower_getSegmentNumber(flower))]);
+    }
+
+    int64_t found = 0;
+    int64_t startTime = cactusDiskStats_getTime();
+    for (int64_t i = 0; i < lookups; i++) {
+        found += flower_getCap(flower, capNames[i]) != NULL;
+    }
+    report("flower_getCap", startTime, lookups, found);
+
+    found = 0;
+    startTime = cactusDiskStats_getTime();
+    for (int64_t i = 0; i < lookups; i++) {
+        Cap cap;
+        CapContents capContents;
+        cap.capContents = &capContents;
+        capContents.instance = capNames[i];
+        found += stSortedSet_search(flower->caps, &cap) != NULL;
+    }
+    report("sorted set search of caps", startTime, lookups, found);
+
+    found = 0;
+    startTime = cactusDiskStats_getTime();
+    for (int64_t i = 0; i < lookups; i++) {
+        found += flower_getEnd(flower, endNames[i]) != NULL;
+    }
+    report("flower_getEnd", startTime, lookups, found);
+
+    found = 0;
+    startTime = cactusDiskStats_getTime();
+    for (int64_t i = 0; i < lookups; i++) {
+        found += flower_getSegment(flower, segmentNames[i]) != NULL;
+    }
+    report("flower_getSegment", startTime, lookups, found);
+
+    found = 0;
+    startTime = cactusDiskStats_getTime();
+    for (int64_t i = 0; i < lookups; i++) {
+        Segment segment;
+        segment.name = segmentNames[i];
+        found += stSortedSet_search(flower->segments, &segment) != NULL;
+    }
+    report("sorted set search of segments", startTime, lookups, found);
+
+    free(capNames);
+    free(endNames);
+    free(segmentNames);
+    free(caps);
+    free(ends);
+    free(segments);
+    testCommon_deleteTemporaryCactusDisk(cactusDisk);
+    return 0;
+}
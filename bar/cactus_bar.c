@@ -9,6 +9,9 @@
 #include <getopt.h>
 #include <sys/mman.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "cactus.h"
 #include "sonLib.h"
@@ -57,6 +60,8 @@ void usage() {
 
     fprintf(stderr, "-E --endAlignmentsToPrecomputeOutputFile [fileName] : If this output file is provided then bar will read stdin first to parse the flower, then to parse the names of the end alignments to precompute. The results will be placed in this file.\n");
 
+    fprintf(stderr, "-T --endAlignmentsToPrecomputeOutputFormat [text|binary] : The format of the end alignments file written with --endAlignmentsToPrecomputeOutputFile. The binary format is smaller and faster to load. Either format can be read by --precomputedAlignments. Default text.\n");
+
     fprintf(stderr,
             "-F --useProgressiveMerging : Use progressive merging instead of poset merging for constructing multiple sequence alignments.\n");
 
@@ -70,32 +75,166 @@ void usage() {
 
     fprintf(stderr, "-M --minimumCoverageToRescue : Unaligned segments must have at least this proportion of their bases covered by an outgroup to be rescued.\n");
 
-    fprintf(stderr, "-h --help : Print this help screen\n");
-}
+    fprintf(stderr, "-P --numThreads : Number of threads aligning the ends of a flower at once, zero for one per processor. Default 1.\n");
 
-stPinch *getNextAlignedPairAlignment(stSortedSetIterator *it) {
-    AlignedPair *alignedPair = stSortedSet_getNext(it);
-    if (alignedPair == NULL) {
-        return NULL;
-    }
-    static stPinch pinch;
-    stPinch_fillOut(&pinch, alignedPair->subsequenceIdentifier, alignedPair->reverse->subsequenceIdentifier, alignedPair->position,
-            alignedPair->reverse->position, 1, alignedPair->strand == alignedPair->reverse->strand);
-    return &pinch;
+    fprintf(stderr, "-R --flowerThreads : Number of flowers aligned at once, each by its own thread, zero for one per processor. The processors are split between the flowers, which limits --numThreads. Default 1.\n");
+
+    fprintf(stderr, "-h --help : Print this help screen\n");
 }
 
 static int64_t minimumIngroupDegree = 0, minimumOutgroupDegree = 0, minimumDegree = 0, minimumNumberOfSpecies = 0;
-static Flower *flower;
+static __thread Flower *flower; //The flower of the thread, as several flowers may be aligned at once.
 
 bool blockFilterFn(stPinchBlock *pinchBlock) {
     return !stCaf_containsRequiredSpecies(pinchBlock, flower, minimumIngroupDegree, minimumOutgroupDegree, minimumDegree, minimumNumberOfSpecies);
 }
 
+/*
+ * The parameters for filling in the alignment of a flower, shared by the threads aligning flowers at once.
+ */
+typedef struct _barParameters {
+    StateMachine *sM;
+    stList *listOfEndAlignmentFiles;
+    int64_t spanningTrees;
+    int64_t maximumLength;
+    bool useProgressiveMerging;
+    float matchGamma;
+    PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters;
+    bool pruneOutStubAlignments;
+    int64_t numThreads;
+    bedRegion *bedRegions; //NULL if there is no ingroup coverage to rescue.
+    size_t numBeds;
+    int64_t minimumSizeToRescue;
+    double minimumCoverageToRescue;
+    int64_t chainLengthForBigFlower;
+    int64_t longChain;
+} BarParameters;
+
+/*
+ * Aligns the flower and builds the cactus for it, destroying the flower. The cactus disk serialises the changes
+ * made to it, so the flowers may be aligned by several threads at once, each with its own pinch graph.
+ */
+static void alignFlower(Flower *flowerToAlign, BarParameters *p) {
+    flower = flowerToAlign;
+    st_logInfo("Processing a flower\n");
+
+    AlignedPairSet *alignedPairs = makeFlowerAlignment3(p->sM, flower, p->listOfEndAlignmentFiles, p->spanningTrees, p->maximumLength,
+            p->useProgressiveMerging, p->matchGamma, p->pairwiseAlignmentBandingParameters, p->pruneOutStubAlignments, p->numThreads);
+    st_logInfo("Created the alignment: %" PRIi64 " pairs\n", alignedPairSet_size(alignedPairs));
+    stPinchIterator *pinchIterator = alignedPairSet_getPinchIterator(alignedPairs);
+
+    /*
+     * Run the cactus caf functions to build cactus.
+     */
+    stPinchThreadSet *threadSet = stCaf_setup(flower);
+    stCaf_anneal(threadSet, pinchIterator, NULL);
+    if (minimumDegree < 2) {
+        stCaf_makeDegreeOneBlocks(threadSet);
+    }
+    if (minimumIngroupDegree > 0 || minimumOutgroupDegree > 0 || minimumDegree > 1) {
+        stCaf_melt(flower, threadSet, blockFilterFn, 0, 0, 0, INT64_MAX);
+    }
+
+    if (p->bedRegions != NULL) {
+        // Rescue any sequence that is covered by outgroups
+        // but currently unaligned into single-degree blocks.
+        stPinchThreadSetIt pinchIt = stPinchThreadSet_getIt(threadSet);
+        stPinchThread *thread;
+        while ((thread = stPinchThreadSetIt_getNext(&pinchIt)) != NULL) {
+            Cap *cap = flower_getCap(flower,
+                                     stPinchThread_getName(thread));
+            assert(cap != NULL);
+            Sequence *sequence = cap_getSequence(cap);
+            assert(sequence != NULL);
+            rescueCoveredRegions(thread, p->bedRegions, p->numBeds,
+                                 sequence_getName(sequence),
+                                 p->minimumSizeToRescue,
+                                 p->minimumCoverageToRescue);
+        }
+        stCaf_joinTrivialBoundaries(threadSet);
+    }
+
+    stCaf_finish(flower, threadSet, p->chainLengthForBigFlower, p->longChain, INT64_MAX, INT64_MAX); //Flower now destroyed.
+    stPinchThreadSet_destruct(threadSet);
+    st_logInfo("Ran the cactus core script.\n");
+
+    /*
+     * Cleanup
+     */
+    //Clean up the aligned pairs after cleaning up the iterator
+    stPinchIterator_destruct(pinchIterator);
+    alignedPairSet_destruct(alignedPairs);
+
+    st_logInfo("Finished filling in the alignments for the flower\n");
+}
+
+typedef struct _flowerJobs {
+    stList *flowers;
+    int64_t nextFlower;
+    pthread_mutex_t lock;
+    BarParameters *parameters;
+} FlowerJobs;
+
+static void *alignFlowers(FlowerJobs *jobs) {
+    while (1) {
+        pthread_mutex_lock(&jobs->lock);
+        Flower *flowerToAlign = jobs->nextFlower < stList_length(jobs->flowers) ? stList_get(jobs->flowers, jobs->nextFlower++) : NULL;
+        pthread_mutex_unlock(&jobs->lock);
+        if (flowerToAlign == NULL) {
+            return NULL;
+        }
+        alignFlower(flowerToAlign, jobs->parameters);
+    }
+}
+
+/*
+ * Aligns the flowers, up to flowerThreads at once, or one per processor if flowerThreads is zero. When several
+ * flowers are aligned at once the processors are split between them, so each aligns its ends on at most its share.
+ */
+static void alignFlowersInParallel(stList *flowers, BarParameters *parameters, int64_t flowerThreads) {
+    if (flowerThreads == 0) {
+        flowerThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (flowerThreads > stList_length(flowers)) {
+        flowerThreads = stList_length(flowers);
+    }
+    if (flowerThreads <= 1) {
+        for (int64_t i = 0; i < stList_length(flowers); i++) {
+            alignFlower(stList_get(flowers, i), parameters);
+        }
+        return;
+    }
+    int64_t threadsPerFlower = sysconf(_SC_NPROCESSORS_ONLN) / flowerThreads;
+    if (threadsPerFlower < 1) {
+        threadsPerFlower = 1;
+    }
+    BarParameters parametersPerFlower = *parameters;
+    if (parametersPerFlower.numThreads == 0 || parametersPerFlower.numThreads > threadsPerFlower) {
+        parametersPerFlower.numThreads = threadsPerFlower;
+    }
+    FlowerJobs jobs;
+    jobs.flowers = flowers;
+    jobs.nextFlower = 0;
+    jobs.parameters = &parametersPerFlower;
+    pthread_mutex_init(&jobs.lock, NULL);
+    pthread_t *workers = st_malloc(flowerThreads * sizeof(pthread_t));
+    for (int64_t i = 0; i < flowerThreads; i++) {
+        if (pthread_create(&workers[i], NULL, (void *(*)(void *)) alignFlowers, &jobs) != 0) {
+            st_errAbort("Could not start a thread to align the flowers\n");
+        }
+    }
+    for (int64_t i = 0; i < flowerThreads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_mutex_destroy(&jobs.lock);
+    free(workers);
+}
+
 int main(int argc, char *argv[]) {
 
     char * logLevelString = NULL;
     char * cactusDiskDatabaseString = NULL;
-    int64_t i, j;
+    int64_t i;
     int64_t spanningTrees = 10;
     int64_t maximumLength = 1500;
     bool useProgressiveMerging = 0;
@@ -104,6 +243,7 @@ int main(int argc, char *argv[]) {
     int64_t k;
     stList *listOfEndAlignmentFiles = NULL;
     char *endAlignmentsToPrecomputeOutputFile = NULL;
+    bool writeEndAlignmentsAsBinary = 0;
     bool calculateWhichEndsToComputeSeparately = 0;
     int64_t largeEndSize = 1000000;
     int64_t chainLengthForBigFlower = 1000000;
@@ -111,6 +251,8 @@ int main(int argc, char *argv[]) {
     char *ingroupCoverageFilePath = NULL;
     int64_t minimumSizeToRescue = 1;
     double minimumCoverageToRescue = 0.0;
+    int64_t numThreads = 1;
+    int64_t flowerThreads = 1;
 
     PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters = pairwiseAlignmentBandingParameters_construct();
 
@@ -140,11 +282,14 @@ int main(int argc, char *argv[]) {
                         {"minimumSizeToRescue", required_argument, 0, 'K'},
                         {"minimumCoverageToRescue", required_argument, 0, 'M'},
                         { "minimumNumberOfSpecies", required_argument, 0, 'N' },
+                        { "numThreads", required_argument, 0, 'P' },
+                        { "endAlignmentsToPrecomputeOutputFormat", required_argument, 0, 'T' },
+                        { "flowerThreads", required_argument, 0, 'R' },
                         { 0, 0, 0, 0 } };
 
         int option_index = 0;
 
-        int key = getopt_long(argc, argv, "a:b:hi:j:kl:o:p:q:r:t:u:wy:A:B:D:E:FGI:J:K:L:M:N:", long_options, &option_index);
+        int key = getopt_long(argc, argv, "a:b:hi:j:kl:o:p:q:r:t:u:wy:A:B:D:E:FGI:J:K:L:M:N:P:R:T:", long_options, &option_index);
 
         if (key == -1) {
             break;
@@ -265,6 +410,27 @@ int main(int argc, char *argv[]) {
                     st_errAbort("Error parsing minimumNumberOfSpecies parameter");
                 }
                 break;
+            case 'P':
+                i = sscanf(optarg, "%" PRIi64, &numThreads);
+                if (i != 1 || numThreads < 0) {
+                    st_errAbort("Error parsing numThreads parameter");
+                }
+                break;
+            case 'R':
+                i = sscanf(optarg, "%" PRIi64, &flowerThreads);
+                if (i != 1 || flowerThreads < 0) {
+                    st_errAbort("Error parsing flowerThreads parameter");
+                }
+                break;
+            case 'T':
+                if (strcmp(optarg, "binary") == 0) {
+                    writeEndAlignmentsAsBinary = 1;
+                } else if (strcmp(optarg, "text") == 0) {
+                    writeEndAlignmentsAsBinary = 0;
+                } else {
+                    st_errAbort("Error parsing endAlignmentsToPrecomputeOutputFormat parameter, expected text or binary");
+                }
+                break;
             default:
                 usage();
                 return 1;
@@ -309,21 +475,30 @@ int main(int argc, char *argv[]) {
          */
         stList *names = flowerWriter_parseNames(stdin);
         Flower *flower = cactusDisk_getFlower(cactusDisk, *((Name *)stList_get(names, 0)));
-        FILE *fileHandle = fopen(endAlignmentsToPrecomputeOutputFile, "w");
-        if (fileHandle == NULL) {
-            st_errnoAbort("Opening end alignment file %s failed", endAlignmentsToPrecomputeOutputFile);
-        }
+        stList *ends = stList_construct();
         for(int64_t i=1; i<stList_length(names); i++) {
             End *end = flower_getEnd(flower, *((Name *)stList_get(names, i)));
             if (end == NULL) {
                 st_errAbort("The end %" PRIi64 " was not found in the flower\n", *((Name *)stList_get(names, i)));
             }
-            stSortedSet *endAlignment = makeEndAlignment(sM, end, spanningTrees, maximumLength, useProgressiveMerging,
-                            matchGamma, pairwiseAlignmentBandingParameters);
-            writeEndAlignmentToDisk(end, endAlignment, fileHandle);
-            stSortedSet_destruct(endAlignment);
+            stList_append(ends, end);
         }
-        fclose(fileHandle);
+        stList *endAlignments = makeEndAlignments(sM, ends, spanningTrees, maximumLength, useProgressiveMerging,
+                matchGamma, pairwiseAlignmentBandingParameters, numThreads);
+        if (writeEndAlignmentsAsBinary) {
+            writeEndAlignmentsToBinaryFile(ends, endAlignments, endAlignmentsToPrecomputeOutputFile);
+        } else {
+            FILE *fileHandle = fopen(endAlignmentsToPrecomputeOutputFile, "w");
+            if (fileHandle == NULL) {
+                st_errnoAbort("Opening end alignment file %s failed", endAlignmentsToPrecomputeOutputFile);
+            }
+            for(int64_t i=0; i<stList_length(ends); i++) {
+                writeEndAlignmentToDisk(stList_get(ends, i), stList_get(endAlignments, i), fileHandle);
+            }
+            fclose(fileHandle);
+        }
+        stList_destruct(endAlignments);
+        stList_destruct(ends);
         return 0; //avoid cleanup costs
         stList_destruct(names);
         st_logInfo("Finished precomputing end alignments\n");
@@ -367,59 +542,11 @@ int main(int argc, char *argv[]) {
             st_errAbort("We have precomputed alignments but %" PRIi64 " flowers to align.\n", stList_length(flowers));
         }
         cactusDisk_preCacheStrings(cactusDisk, flowers);
-        for (j = 0; j < stList_length(flowers); j++) {
-            flower = stList_get(flowers, j);
-            st_logInfo("Processing a flower\n");
-
-            stSortedSet *alignedPairs = makeFlowerAlignment3(sM, flower, listOfEndAlignmentFiles, spanningTrees, maximumLength,
-                    useProgressiveMerging, matchGamma, pairwiseAlignmentBandingParameters, pruneOutStubAlignments);
-            st_logInfo("Created the alignment: %" PRIi64 " pairs\n", stSortedSet_size(alignedPairs));
-            stPinchIterator *pinchIterator = stPinchIterator_constructFromAlignedPairs(alignedPairs, getNextAlignedPairAlignment);
-
-            /*
-             * Run the cactus caf functions to build cactus.
-             */
-            stPinchThreadSet *threadSet = stCaf_setup(flower);
-            stCaf_anneal(threadSet, pinchIterator, NULL);
-            if (minimumDegree < 2) {
-                stCaf_makeDegreeOneBlocks(threadSet);
-            }
-            if (minimumIngroupDegree > 0 || minimumOutgroupDegree > 0 || minimumDegree > 1) {
-                stCaf_melt(flower, threadSet, blockFilterFn, 0, 0, 0, INT64_MAX);
-            }
-
-            if (ingroupCoverageFilePath != NULL) {
-                // Rescue any sequence that is covered by outgroups
-                // but currently unaligned into single-degree blocks.
-                stPinchThreadSetIt pinchIt = stPinchThreadSet_getIt(threadSet);
-                stPinchThread *thread;
-                while ((thread = stPinchThreadSetIt_getNext(&pinchIt)) != NULL) {
-                    Cap *cap = flower_getCap(flower,
-                                             stPinchThread_getName(thread));
-                    assert(cap != NULL);
-                    Sequence *sequence = cap_getSequence(cap);
-                    assert(sequence != NULL);
-                    rescueCoveredRegions(thread, bedRegions, numBeds,
-                                         sequence_getName(sequence),
-                                         minimumSizeToRescue,
-                                         minimumCoverageToRescue);
-                }
-                stCaf_joinTrivialBoundaries(threadSet);
-            }
-
-            stCaf_finish(flower, threadSet, chainLengthForBigFlower, longChain, INT64_MAX, INT64_MAX); //Flower now destroyed.
-            stPinchThreadSet_destruct(threadSet);
-            st_logInfo("Ran the cactus core script.\n");
-
-            /*
-             * Cleanup
-             */
-            //Clean up the sorted set after cleaning up the iterator
-            stPinchIterator_destruct(pinchIterator);
-            stSortedSet_destruct(alignedPairs);
-
-            st_logInfo("Finished filling in the alignments for the flower\n");
-        }
+        BarParameters parameters = { sM, listOfEndAlignmentFiles, spanningTrees, maximumLength, useProgressiveMerging,
+                matchGamma, pairwiseAlignmentBandingParameters, pruneOutStubAlignments, numThreads,
+                ingroupCoverageFilePath != NULL ? bedRegions : NULL, numBeds, minimumSizeToRescue,
+                minimumCoverageToRescue, chainLengthForBigFlower, longChain };
+        alignFlowersInParallel(flowers, &parameters, flowerThreads);
         stList_destruct(flowers);
         //st_errAbort("Done\n");
         /*
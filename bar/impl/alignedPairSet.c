@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "sonLib.h"
+#include "cactus.h"
+#include "alignedPairSet.h"
+
+AlignedPairSet *alignedPairSet_construct(void) {
+    AlignedPairSet *alignedPairs = st_calloc(1, sizeof(AlignedPairSet));
+    alignedPairs->sorted = 1;
+    return alignedPairs;
+}
+
+void alignedPairSet_destruct(AlignedPairSet *alignedPairs) {
+    free(alignedPairs->subsequenceIdentifiers);
+    free(alignedPairs->positions);
+    free(alignedPairs->scores);
+    free(alignedPairs->reverses);
+    free(alignedPairs->strands);
+    free(alignedPairs->deleted);
+    free(alignedPairs);
+}
+
+static void setLength(AlignedPairSet *alignedPairs, int64_t maxLength) {
+    alignedPairs->maxLength = maxLength;
+    alignedPairs->subsequenceIdentifiers = st_realloc(alignedPairs->subsequenceIdentifiers, maxLength * sizeof(int64_t));
+    alignedPairs->positions = st_realloc(alignedPairs->positions, maxLength * sizeof(int64_t));
+    alignedPairs->scores = st_realloc(alignedPairs->scores, maxLength * sizeof(int64_t));
+    alignedPairs->reverses = st_realloc(alignedPairs->reverses, maxLength * sizeof(int64_t));
+    alignedPairs->strands = st_realloc(alignedPairs->strands, maxLength * sizeof(uint8_t));
+    alignedPairs->deleted = st_realloc(alignedPairs->deleted, maxLength * sizeof(uint8_t));
+}
+
+AlignedPairSet *alignedPairSet_construct2(int64_t pairNumber) {
+    AlignedPairSet *alignedPairs = alignedPairSet_construct();
+    if (pairNumber > 0) {
+        setLength(alignedPairs, 2 * pairNumber);
+    }
+    return alignedPairs;
+}
+
+static void addEntry(AlignedPairSet *alignedPairs, int64_t subsequenceIdentifier, int64_t position, bool strand,
+        int64_t score, int64_t reverse) {
+    int64_t i = alignedPairs->length++;
+    alignedPairs->subsequenceIdentifiers[i] = subsequenceIdentifier;
+    alignedPairs->positions[i] = position;
+    alignedPairs->strands[i] = strand;
+    alignedPairs->scores[i] = score;
+    alignedPairs->reverses[i] = reverse;
+    alignedPairs->deleted[i] = 0;
+}
+
+void alignedPairSet_add(AlignedPairSet *alignedPairs, int64_t subsequenceIdentifier1, int64_t position1, bool strand1,
+        int64_t subsequenceIdentifier2, int64_t position2, bool strand2, int64_t score1, int64_t score2) {
+    if (alignedPairs->length + 2 > alignedPairs->maxLength) {
+        setLength(alignedPairs, alignedPairs->maxLength * 2 + 2);
+    }
+    int64_t i = alignedPairs->length;
+    addEntry(alignedPairs, subsequenceIdentifier1, position1, strand1, score1, i + 1);
+    addEntry(alignedPairs, subsequenceIdentifier2, position2, strand2, score2, i);
+    alignedPairs->size += 2;
+    alignedPairs->sorted = 0;
+}
+
+void alignedPairSet_addAll(AlignedPairSet *alignedPairs, AlignedPairSet *alignedPairs2) {
+    if (alignedPairs->length + alignedPairs2->size > alignedPairs->maxLength) {
+        setLength(alignedPairs, alignedPairs->length + alignedPairs2->size);
+    }
+    for (int64_t i = alignedPairSet_getNext(alignedPairs2, -1); i < alignedPairs2->length;
+            i = alignedPairSet_getNext(alignedPairs2, i)) {
+        int64_t j = alignedPairs2->reverses[i];
+        if (i < j) {
+            alignedPairSet_add(alignedPairs, alignedPairs2->subsequenceIdentifiers[i], alignedPairs2->positions[i],
+                    alignedPairs2->strands[i], alignedPairs2->subsequenceIdentifiers[j], alignedPairs2->positions[j],
+                    alignedPairs2->strands[j], alignedPairs2->scores[i], alignedPairs2->scores[j]);
+        }
+    }
+}
+
+static int cmpEntry(AlignedPairSet *alignedPairs, int64_t i, int64_t subsequenceIdentifier, int64_t position,
+        bool strand) {
+    int j = cactusMisc_nameCompare(alignedPairs->subsequenceIdentifiers[i], subsequenceIdentifier);
+    if (j == 0) {
+        j = alignedPairs->positions[i] > position ? 1 : (alignedPairs->positions[i] < position ? -1 : 0);
+        if (j == 0) {
+            j = alignedPairs->strands[i] == strand ? 0 : (alignedPairs->strands[i] ? 1 : -1);
+        }
+    }
+    return j;
+}
+
+static int cmpEntries(AlignedPairSet *alignedPairs, int64_t i, int64_t j) {
+    int k = cmpEntry(alignedPairs, i, alignedPairs->subsequenceIdentifiers[j], alignedPairs->positions[j],
+            alignedPairs->strands[j]);
+    if (k == 0) {
+        int64_t i2 = alignedPairs->reverses[i], j2 = alignedPairs->reverses[j];
+        k = cmpEntry(alignedPairs, i2, alignedPairs->subsequenceIdentifiers[j2], alignedPairs->positions[j2],
+                alignedPairs->strands[j2]);
+    }
+    return k;
+}
+
+void alignedPairSet_addSorted(AlignedPairSet *alignedPairs, int64_t subsequenceIdentifier, int64_t position, bool strand,
+        int64_t score, int64_t reverse) {
+    assert(alignedPairs->sorted && alignedPairs->size == alignedPairs->length);
+    assert(alignedPairs->length == 0
+            || cmpEntry(alignedPairs, alignedPairs->length - 1, subsequenceIdentifier, position, strand) <= 0);
+    if (alignedPairs->length + 1 > alignedPairs->maxLength) {
+        setLength(alignedPairs, alignedPairs->maxLength * 2 + 2);
+    }
+    addEntry(alignedPairs, subsequenceIdentifier, position, strand, score, reverse);
+    alignedPairs->size++;
+}
+
+static __thread AlignedPairSet *alignedPairsForSort; //qsort has no argument for the comparison function.
+
+static int cmpEntriesForSort(const void *i, const void *j) {
+    return cmpEntries(alignedPairsForSort, *(const int64_t *) i, *(const int64_t *) j);
+}
+
+void alignedPairSet_sort(AlignedPairSet *alignedPairs) {
+    //Sort the indices of the entries, then move the entries into that order.
+    int64_t *order = st_malloc((alignedPairs->size + 1) * sizeof(int64_t));
+    int64_t *newIndices = st_malloc((alignedPairs->length + 1) * sizeof(int64_t));
+    int64_t size = 0;
+    for (int64_t i = 0; i < alignedPairs->length; i++) {
+        if (!alignedPairs->deleted[i]) {
+            order[size++] = i;
+        }
+    }
+    assert(size == alignedPairs->size);
+    alignedPairsForSort = alignedPairs;
+    qsort(order, size, sizeof(int64_t), cmpEntriesForSort);
+    for (int64_t i = 0; i < size; i++) {
+        newIndices[order[i]] = i;
+    }
+
+    AlignedPairSet *sortedPairs = alignedPairSet_construct();
+    setLength(sortedPairs, size + 1);
+    for (int64_t i = 0; i < size; i++) {
+        int64_t j = order[i];
+        assert(i == 0 || cmpEntries(alignedPairs, order[i - 1], j) < 0);
+        addEntry(sortedPairs, alignedPairs->subsequenceIdentifiers[j], alignedPairs->positions[j],
+                alignedPairs->strands[j], alignedPairs->scores[j], newIndices[alignedPairs->reverses[j]]);
+    }
+    free(order);
+    free(newIndices);
+
+    //Swap the sorted arrays in.
+    AlignedPairSet unsortedPairs = *alignedPairs;
+    *alignedPairs = *sortedPairs;
+    *sortedPairs = unsortedPairs;
+    alignedPairSet_destruct(sortedPairs);
+    alignedPairs->size = size;
+    alignedPairs->sorted = 1;
+}
+
+int64_t alignedPairSet_size(AlignedPairSet *alignedPairs) {
+    return alignedPairs->size;
+}
+
+int64_t alignedPairSet_getFirstFrom(AlignedPairSet *alignedPairs, int64_t subsequenceIdentifier, int64_t position,
+        bool strand) {
+    assert(alignedPairs->sorted);
+    int64_t min = 0, max = alignedPairs->length;
+    while (min < max) {
+        int64_t mid = min + (max - min) / 2;
+        if (cmpEntry(alignedPairs, mid, subsequenceIdentifier, position, strand) < 0) {
+            min = mid + 1;
+        } else {
+            max = mid;
+        }
+    }
+    return min;
+}
+
+int64_t alignedPairSet_getNext(AlignedPairSet *alignedPairs, int64_t entry) {
+    do {
+        entry++;
+    } while (entry < alignedPairs->length && alignedPairs->deleted[entry]);
+    return entry;
+}
+
+void alignedPairSet_delete(AlignedPairSet *alignedPairs, int64_t entry) {
+    assert(!alignedPairs->deleted[entry]);
+    assert(!alignedPairs->deleted[alignedPairs->reverses[entry]]);
+    alignedPairs->deleted[entry] = 1;
+    alignedPairs->deleted[alignedPairs->reverses[entry]] = 1;
+    alignedPairs->size -= 2;
+}
+
+bool alignedPairSet_equals(AlignedPairSet *alignedPairs, AlignedPairSet *alignedPairs2) {
+    assert(alignedPairs->sorted && alignedPairs2->sorted);
+    if (alignedPairs->size != alignedPairs2->size) {
+        return 0;
+    }
+    int64_t i = alignedPairSet_getNext(alignedPairs, -1), j = alignedPairSet_getNext(alignedPairs2, -1);
+    while (i < alignedPairs->length) {
+        assert(j < alignedPairs2->length);
+        int64_t i2 = alignedPairs->reverses[i], j2 = alignedPairs2->reverses[j];
+        if (cmpEntry(alignedPairs, i, alignedPairs2->subsequenceIdentifiers[j], alignedPairs2->positions[j],
+                alignedPairs2->strands[j]) != 0
+                || cmpEntry(alignedPairs, i2, alignedPairs2->subsequenceIdentifiers[j2], alignedPairs2->positions[j2],
+                        alignedPairs2->strands[j2]) != 0 || alignedPairs->scores[i] != alignedPairs2->scores[j]
+                || alignedPairs->scores[i2] != alignedPairs2->scores[j2]) {
+            return 0;
+        }
+        i = alignedPairSet_getNext(alignedPairs, i);
+        j = alignedPairSet_getNext(alignedPairs2, j);
+    }
+    return 1;
+}
+
+/*
+ * Pinch iterator over the set.
+ */
+
+typedef struct _alignedPairSetIt {
+    AlignedPairSet *alignedPairs;
+    int64_t entry;
+    stPinch pinch;
+} AlignedPairSetIt;
+
+static stPinch *alignedPairSetIt_getNext(AlignedPairSetIt *it) {
+    it->entry = alignedPairSet_getNext(it->alignedPairs, it->entry);
+    if (it->entry >= it->alignedPairs->length) {
+        it->entry = it->alignedPairs->length - 1; //So calling again returns NULL again.
+        return NULL;
+    }
+    AlignedPairSet *alignedPairs = it->alignedPairs;
+    int64_t i = it->entry, j = alignedPairs->reverses[i];
+    stPinch_fillOut(&it->pinch, alignedPairs->subsequenceIdentifiers[i], alignedPairs->subsequenceIdentifiers[j],
+            alignedPairs->positions[i], alignedPairs->positions[j], 1, alignedPairs->strands[i] == alignedPairs->strands[j]);
+    return &it->pinch;
+}
+
+static AlignedPairSetIt *alignedPairSetIt_reset(AlignedPairSetIt *it) {
+    it->entry = -1;
+    return it;
+}
+
+stPinchIterator *alignedPairSet_getPinchIterator(AlignedPairSet *alignedPairs) {
+    AlignedPairSetIt *it = st_malloc(sizeof(AlignedPairSetIt));
+    it->alignedPairs = alignedPairs;
+    it->entry = -1;
+    return stPinchIterator_construct(it, (stPinch *(*)(void *)) alignedPairSetIt_getNext,
+            (void *(*)(void *)) alignedPairSetIt_reset, free);
+}
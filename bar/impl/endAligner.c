@@ -4,7 +4,14 @@
  * Released under the MIT license, see LICENSE.txt
  */
 
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "endAligner.h"
+#include "alignedPairSet.h"
+#include "flowerAligner.h"
 #include "multipleAligner.h"
 #include "adjacencySequences.h"
 #include "pairwiseAligner.h"
@@ -52,16 +59,23 @@ int alignedPair_cmpFn(const AlignedPair *alignedPair1, const AlignedPair *aligne
     return i;
 }
 
-stSortedSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees, int64_t maxSequenceLength,
-        bool useProgressiveMerging, float gapGamma,
-        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters) {
-    //Make an alignment of the sequences in the ends
+/*
+ * The adjacency sequences of an end, which are all that is needed to align it. Getting them reads the cactus disk,
+ * so must be done one end at a time, but aligning them can then be done in parallel.
+ */
+typedef struct _endSequences {
+    stList *sequences;
+    stList *seqFrags;
+    int64_t *commonInstanceNumbers; //For each sequence, the number of sequences sharing its other end.
+} EndSequences;
 
+static void getEndSequences(End *end, int64_t maxSequenceLength, EndSequences *endSequences) {
     //Get the adjacency sequences to be aligned.
     Cap *cap;
     End_InstanceIterator *it = end_getInstanceIterator(end);
     stList *sequences = stList_construct3(0, (void (*)(void *))adjacencySequence_destruct);
     stList *seqFrags = stList_construct3(0, (void (*)(void *))seqFrag_destruct);
+    stList *otherEnds = stList_construct();
     stHash *endInstanceNumbers = stHash_construct2(NULL, free);
     while((cap = end_getNext(it)) != NULL) {
         if(cap_getSide(cap)) {
@@ -72,6 +86,7 @@ stSortedSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees,
         assert(cap_getAdjacency(cap) != NULL);
         End *otherEnd = end_getPositiveOrientation(cap_getEnd(cap_getAdjacency(cap)));
         stList_append(seqFrags, seqFrag_construct(adjacencySequence->string, 0, end_getName(otherEnd)));
+        stList_append(otherEnds, otherEnd);
         //Increase count of seqfrags with a given end.
         int64_t *c = stHash_search(endInstanceNumbers, otherEnd);
         if(c == NULL) {
@@ -83,6 +98,31 @@ stSortedSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees,
     }
     end_destructInstanceIterator(it);
 
+    endSequences->sequences = sequences;
+    endSequences->seqFrags = seqFrags;
+    endSequences->commonInstanceNumbers = st_malloc((stList_length(otherEnds) + 1) * sizeof(int64_t));
+    for(int64_t i=0; i<stList_length(otherEnds); i++) {
+        endSequences->commonInstanceNumbers[i] = *(int64_t *)stHash_search(endInstanceNumbers, stList_get(otherEnds, i));
+    }
+    stList_destruct(otherEnds);
+    stHash_destruct(endInstanceNumbers);
+}
+
+static void destructEndSequences(EndSequences *endSequences) {
+    stList_destruct(endSequences->seqFrags);
+    stList_destruct(endSequences->sequences);
+    free(endSequences->commonInstanceNumbers);
+}
+
+/*
+ * Aligns the sequences of an end. Does not touch the cactus disk, so is safe to run in parallel.
+ */
+static AlignedPairSet *alignEndSequences(StateMachine *sM, EndSequences *endSequences, int64_t spanningTrees,
+        bool useProgressiveMerging, float gapGamma,
+        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters) {
+    stList *sequences = endSequences->sequences;
+    stList *seqFrags = endSequences->seqFrags;
+
     //Get the alignment.
     MultipleAlignment *mA = makeAlignment(sM, seqFrags, spanningTrees, 100000000, useProgressiveMerging, gapGamma, pairwiseAlignmentBandingParameters);
 
@@ -107,11 +147,7 @@ stSortedSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees,
     double *scoreAdjustmentsNonCommonEnds = st_malloc(stList_length(seqFrags) * sizeof(double));
     double *scoreAdjustmentsCommonEnds = st_malloc(stList_length(seqFrags) * sizeof(double));
     for(int64_t i=0; i<stList_length(seqFrags); i++) {
-        SeqFrag *seqFrag = stList_get(seqFrags, i);
-        End *otherEnd = flower_getEnd(end_getFlower(end), seqFrag->rightEndId);
-        assert(otherEnd != NULL);
-        assert(stHash_search(endInstanceNumbers, otherEnd) != NULL);
-        int64_t commonInstanceNumber = *(int64_t *)stHash_search(endInstanceNumbers, otherEnd);
+        int64_t commonInstanceNumber = endSequences->commonInstanceNumbers[i];
         int64_t nonCommonInstanceNumber = stList_length(seqFrags) - commonInstanceNumber;
 
         assert(commonInstanceNumber > 0 && nonCommonInstanceNumber >= 0);
@@ -141,9 +177,7 @@ stSortedSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees,
     }
 
 	//Convert the alignment pairs to an alignment of the caps..
-    stSortedSet *sortedAlignment =
-                stSortedSet_construct3((int (*)(const void *, const void *))alignedPair_cmpFn,
-                (void (*)(void *))alignedPair_destruct);
+    AlignedPairSet *sortedAlignment = alignedPairSet_construct();
     while(stList_length(mA->alignedPairs) > 0) {
         stIntTuple *alignedPair = stList_pop(mA->alignedPairs);
         assert(stIntTuple_length(alignedPair) == 5);
@@ -165,46 +199,148 @@ stSortedSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees,
         double *scoreAdjustments = seqFrag1->rightEndId == seqFrag2->rightEndId ? scoreAdjustmentsCommonEnds : scoreAdjustmentsNonCommonEnds;
         assert(scoreAdjustments[seqIndex1] != INT64_MIN);
         assert(scoreAdjustments[seqIndex2] != INT64_MIN);
-        AlignedPair *alignedPair2 = alignedPair_construct(
+        alignedPairSet_add(sortedAlignment,
                 i->subsequenceIdentifier, i->start + (i->strand ? offset1 : -offset1), i->strand,
                 j->subsequenceIdentifier, j->start + (j->strand ? offset2 : -offset2), j->strand,
                 score*scoreAdjustments[seqIndex1], score*scoreAdjustments[seqIndex2]); //Do the reweighting here.
-        assert(stSortedSet_search(sortedAlignment, alignedPair2) == NULL);
-        assert(stSortedSet_search(sortedAlignment, alignedPair2->reverse) == NULL);
-        stSortedSet_insert(sortedAlignment, alignedPair2);
-        stSortedSet_insert(sortedAlignment, alignedPair2->reverse);
         stIntTuple_destruct(alignedPair);
     }
+    alignedPairSet_sort(sortedAlignment);
 
     //Cleanup
-    stList_destruct(seqFrags);
-    stList_destruct(sequences);
     free(pairwiseAlignmentsPerSequenceNonCommonEnds);
     free(pairwiseAlignmentsPerSequenceCommonEnds);
     free(scoreAdjustmentsNonCommonEnds);
     free(scoreAdjustmentsCommonEnds);
     multipleAlignment_destruct(mA);
-    stHash_destruct(endInstanceNumbers);
 
     return sortedAlignment;
 }
 
-void writeEndAlignmentToDisk(End *end, stSortedSet *endAlignment, FILE *fileHandle) {
-    fprintf(fileHandle, "%s %" PRIi64 "\n", cactusMisc_nameToStringStatic(end_getName(end)), stSortedSet_size(endAlignment));
-    stSortedSetIterator *it = stSortedSet_getIterator(endAlignment);
-    AlignedPair *aP;
-    while((aP = stSortedSet_getNext(it)) != NULL) {
-        fprintf(fileHandle, "%" PRIi64 " %" PRIi64 " %i %" PRIi64 " ", aP->subsequenceIdentifier, aP->position, aP->strand, aP->score);
-        aP = aP->reverse;
-        fprintf(fileHandle, "%" PRIi64 " %" PRIi64 " %i %" PRIi64 "\n", aP->subsequenceIdentifier, aP->position, aP->strand, aP->score);
+AlignedPairSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees, int64_t maxSequenceLength,
+        bool useProgressiveMerging, float gapGamma,
+        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters) {
+    //Make an alignment of the sequences in the ends
+    EndSequences endSequences;
+    getEndSequences(end, maxSequenceLength, &endSequences);
+    AlignedPairSet *sortedAlignment = alignEndSequences(sM, &endSequences, spanningTrees, useProgressiveMerging, gapGamma,
+            pairwiseAlignmentBandingParameters);
+    destructEndSequences(&endSequences);
+    return sortedAlignment;
+}
+
+/*
+ * An end to align on one of the threads of makeEndAlignments.
+ */
+typedef struct _endAlignmentJob {
+    EndSequences endSequences;
+    int64_t totalAdjacencyLength;
+    AlignedPairSet *alignment;
+} EndAlignmentJob;
+
+typedef struct _endAlignmentJobs {
+    StateMachine *sM;
+    int64_t spanningTrees;
+    bool useProgressiveMerging;
+    float gapGamma;
+    PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters;
+    EndAlignmentJob **jobs; //Biggest first.
+    int64_t jobNumber;
+    int64_t nextJob;
+    pthread_mutex_t lock;
+} EndAlignmentJobs;
+
+static int endAlignmentJob_cmpFn(const void *job1, const void *job2) {
+    int64_t length1 = (*(EndAlignmentJob * const *) job1)->totalAdjacencyLength;
+    int64_t length2 = (*(EndAlignmentJob * const *) job2)->totalAdjacencyLength;
+    if(length1 != length2) {
+        return length1 > length2 ? -1 : 1;
+    }
+    //Ties go in the order of the ends, so the schedule does not depend on qsort.
+    return *(EndAlignmentJob * const *) job1 < *(EndAlignmentJob * const *) job2 ? -1 : 1;
+}
+
+static void *alignEnds(void *arg) {
+    EndAlignmentJobs *jobs = arg;
+    while(1) {
+        pthread_mutex_lock(&jobs->lock);
+        int64_t i = jobs->nextJob++;
+        pthread_mutex_unlock(&jobs->lock);
+        if(i >= jobs->jobNumber) {
+            return NULL;
+        }
+        EndAlignmentJob *job = jobs->jobs[i];
+        job->alignment = alignEndSequences(jobs->sM, &job->endSequences, jobs->spanningTrees,
+                jobs->useProgressiveMerging, jobs->gapGamma, jobs->pairwiseAlignmentBandingParameters);
+        //Free the sequences as soon as they are aligned, rather than holding them all to the end.
+        destructEndSequences(&job->endSequences);
+    }
+}
+
+stList *makeEndAlignments(StateMachine *sM, stList *ends, int64_t spanningTrees, int64_t maxSequenceLength,
+        bool useProgressiveMerging, float gapGamma,
+        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, int64_t numThreads) {
+    stList *endAlignments = stList_construct3(0, (void (*)(void *))alignedPairSet_destruct);
+    if(numThreads == 0) {
+        numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if(numThreads <= 1 || stList_length(ends) <= 1) {
+        for(int64_t i=0; i<stList_length(ends); i++) {
+            stList_append(endAlignments, makeEndAlignment(sM, stList_get(ends, i), spanningTrees, maxSequenceLength,
+                    useProgressiveMerging, gapGamma, pairwiseAlignmentBandingParameters));
+        }
+        return endAlignments;
+    }
+
+    //Fetch the sequences of all the ends before starting the threads, as the string cache of the cactus disk is
+    //not thread safe.
+    EndAlignmentJob *jobArray = st_calloc(stList_length(ends) + 1, sizeof(EndAlignmentJob));
+    EndAlignmentJobs jobs = { sM, spanningTrees, useProgressiveMerging, gapGamma, pairwiseAlignmentBandingParameters,
+            st_malloc((stList_length(ends) + 1) * sizeof(EndAlignmentJob *)), stList_length(ends), 0 };
+    for(int64_t i=0; i<stList_length(ends); i++) {
+        End *end = stList_get(ends, i);
+        getEndSequences(end, maxSequenceLength, &jobArray[i].endSequences);
+        jobArray[i].totalAdjacencyLength = getTotalAdjacencyLength(end);
+        jobs.jobs[i] = &jobArray[i];
+    }
+
+    //Start the biggest ends first, so that one big end is not left running alone at the end.
+    qsort(jobs.jobs, jobs.jobNumber, sizeof(EndAlignmentJob *), endAlignmentJob_cmpFn);
+    pthread_mutex_init(&jobs.lock, NULL);
+    int64_t workerNumber = numThreads < jobs.jobNumber ? numThreads : jobs.jobNumber;
+    pthread_t *workers = st_malloc(workerNumber * sizeof(pthread_t));
+    for(int64_t i=0; i<workerNumber; i++) {
+        if(pthread_create(&workers[i], NULL, alignEnds, &jobs) != 0) {
+            st_errAbort("Could not start a thread to align the ends\n");
+        }
+    }
+    for(int64_t i=0; i<workerNumber; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_mutex_destroy(&jobs.lock);
+    free(workers);
+
+    //The alignments are returned in the order of the ends, whatever order they finished in.
+    for(int64_t i=0; i<stList_length(ends); i++) {
+        stList_append(endAlignments, jobArray[i].alignment);
+    }
+    free(jobs.jobs);
+    free(jobArray);
+    return endAlignments;
+}
+
+void writeEndAlignmentToDisk(End *end, AlignedPairSet *endAlignment, FILE *fileHandle) {
+    fprintf(fileHandle, "%s %" PRIi64 "\n", cactusMisc_nameToStringStatic(end_getName(end)), alignedPairSet_size(endAlignment));
+    for(int64_t i=alignedPairSet_getNext(endAlignment, -1); i<endAlignment->length; i=alignedPairSet_getNext(endAlignment, i)) {
+        int64_t j = endAlignment->reverses[i];
+        fprintf(fileHandle, "%" PRIi64 " %" PRIi64 " %i %" PRIi64 " ", endAlignment->subsequenceIdentifiers[i],
+                endAlignment->positions[i], endAlignment->strands[i], endAlignment->scores[i]);
+        fprintf(fileHandle, "%" PRIi64 " %" PRIi64 " %i %" PRIi64 "\n", endAlignment->subsequenceIdentifiers[j],
+                endAlignment->positions[j], endAlignment->strands[j], endAlignment->scores[j]);
     }
-    stSortedSet_destructIterator(it);
 }
 
-stSortedSet *loadEndAlignmentFromDisk(Flower *flower, FILE *fileHandle, End **end) {
-    stSortedSet *endAlignment =
-                stSortedSet_construct3((int (*)(const void *, const void *))alignedPair_cmpFn,
-                (void (*)(void *))alignedPair_destruct);
+AlignedPairSet *loadEndAlignmentFromDisk(Flower *flower, FILE *fileHandle, End **end) {
     char *line = stFile_getLineFromFile(fileHandle);
     if(line == NULL) {
         *end = NULL;
@@ -221,6 +357,7 @@ stSortedSet *loadEndAlignmentFromDisk(Flower *flower, FILE *fileHandle, End **en
     if(*end == NULL) {
         st_errAbort("We encountered an end name that is not in the database: '%s'\n", line);
     }
+    AlignedPairSet *endAlignment = alignedPairSet_construct();
     for(int64_t i=0; i<lineNumber; i++) {
         line = stFile_getLineFromFile(fileHandle);
         if(line == NULL) {
@@ -233,9 +370,204 @@ stSortedSet *loadEndAlignmentFromDisk(Flower *flower, FILE *fileHandle, End **en
         if(i != 8) {
             st_errAbort("We encountered a mis-specified name in loading an end alignment from the disk: '%s'\n", line);
         }
-        stSortedSet_insert(endAlignment, alignedPair_construct(sI1, p1, st1, sI2, p2, st2, score1, score2));
+        //Each pair is written once from each direction, so only add it from the first.
+        AlignedPair alignedPair1 = { sI1, p1, st1, score1, NULL }, alignedPair2 = { sI2, p2, st2, score2, NULL };
+        if(alignedPair_cmpFnP(&alignedPair1, &alignedPair2) < 0) {
+            alignedPairSet_add(endAlignment, sI1, p1, st1, sI2, p2, st2, score1, score2);
+        }
         free(line);
     }
+    alignedPairSet_sort(endAlignment);
     return endAlignment;
 }
 
+typedef struct _endAlignmentFileHeader {
+    char magic[8];
+    int64_t version;
+} EndAlignmentFileHeader;
+
+/*
+ * The bytes of a block of a binary end alignment file, as it is written.
+ */
+typedef struct _endAlignmentFileBuffer {
+    uint8_t *bytes;
+    int64_t length;
+    int64_t maxLength;
+} EndAlignmentFileBuffer;
+
+static void writeVarint(EndAlignmentFileBuffer *buffer, int64_t i) {
+    if(buffer->length + 10 > buffer->maxLength) {
+        buffer->maxLength = buffer->maxLength * 2 + 10;
+        buffer->bytes = st_realloc(buffer->bytes, buffer->maxLength);
+    }
+    //Zig-zag encoded, seven bits to a byte, least significant first.
+    uint64_t j = (((uint64_t)i) << 1) ^ (uint64_t)(i >> 63);
+    while(j >= 0x80) {
+        buffer->bytes[buffer->length++] = (uint8_t)(j | 0x80);
+        j >>= 7;
+    }
+    buffer->bytes[buffer->length++] = (uint8_t)j;
+}
+
+static int64_t getVarint(const uint8_t **bytes, const uint8_t *end, const char *binaryFile) {
+    uint64_t j = 0;
+    for(int64_t shift = 0; shift < 70; shift += 7) {
+        if(*bytes >= end) {
+            break;
+        }
+        uint8_t byte = *(*bytes)++;
+        j |= ((uint64_t)(byte & 0x7F)) << shift;
+        if(!(byte & 0x80)) {
+            return (int64_t)((j >> 1) ^ (~(j & 1) + 1));
+        }
+    }
+    st_errAbort("The file %s is not a complete binary end alignment file\n", binaryFile);
+    return 0;
+}
+
+/*
+ * Writes the entries of the sorted alignment, deleted ones excluded, each coded against the one before.
+ */
+static void writeEndAlignmentBlock(EndAlignmentFileBuffer *buffer, AlignedPairSet *endAlignment) {
+    //The indices of the entries once the deleted ones are left out, for the reverses.
+    int64_t *indices = st_malloc((endAlignment->length + 1) * sizeof(int64_t));
+    int64_t size = 0;
+    for(int64_t i=alignedPairSet_getNext(endAlignment, -1); i<endAlignment->length; i=alignedPairSet_getNext(endAlignment, i)) {
+        indices[i] = size++;
+    }
+    int64_t subsequenceIdentifier = 0, position = 0;
+    for(int64_t i=alignedPairSet_getNext(endAlignment, -1); i<endAlignment->length; i=alignedPairSet_getNext(endAlignment, i)) {
+        if(endAlignment->subsequenceIdentifiers[i] != subsequenceIdentifier) {
+            position = 0;
+        }
+        //Unsigned arithmetic, so the differences wrap rather than overflow.
+        writeVarint(buffer, (int64_t)((uint64_t)endAlignment->subsequenceIdentifiers[i] - (uint64_t)subsequenceIdentifier));
+        writeVarint(buffer, (int64_t)((uint64_t)endAlignment->positions[i] - (uint64_t)position));
+        writeVarint(buffer, endAlignment->scores[i]);
+        //The strand is a bit below the difference of the reverse, which is bounded by the number of entries.
+        writeVarint(buffer, (indices[endAlignment->reverses[i]] - indices[i]) * 2 + endAlignment->strands[i]);
+        subsequenceIdentifier = endAlignment->subsequenceIdentifiers[i];
+        position = endAlignment->positions[i];
+    }
+    free(indices);
+}
+
+void writeEndAlignmentsToBinaryFile(stList *ends, stList *endAlignments, const char *binaryFile) {
+    assert(stList_length(ends) == stList_length(endAlignments));
+    FILE *fileHandle = fopen(binaryFile, "wb");
+    if(fileHandle == NULL) {
+        st_errnoAbort("Opening end alignment file %s failed", binaryFile);
+    }
+    EndAlignmentFileHeader header;
+    memset(&header, 0, sizeof(EndAlignmentFileHeader));
+    memcpy(header.magic, END_ALIGNMENT_FILE_MAGIC, sizeof(header.magic));
+    header.version = END_ALIGNMENT_FILE_VERSION;
+    bool failed = fwrite(&header, sizeof(EndAlignmentFileHeader), 1, fileHandle) != 1;
+    EndAlignmentFileBuffer block = { NULL, 0, 0 }, blockHeader = { NULL, 0, 0 };
+    for(int64_t i=0; i<stList_length(ends); i++) {
+        AlignedPairSet *endAlignment = stList_get(endAlignments, i);
+        if(!endAlignment->sorted) {
+            alignedPairSet_sort(endAlignment);
+        }
+        block.length = 0;
+        writeEndAlignmentBlock(&block, endAlignment);
+        blockHeader.length = 0;
+        writeVarint(&blockHeader, end_getName(stList_get(ends, i)));
+        writeVarint(&blockHeader, alignedPairSet_size(endAlignment));
+        writeVarint(&blockHeader, block.length);
+        failed = failed || fwrite(blockHeader.bytes, 1, blockHeader.length, fileHandle) != (size_t)blockHeader.length
+                || (block.length > 0 && fwrite(block.bytes, 1, block.length, fileHandle) != (size_t)block.length);
+    }
+    free(block.bytes);
+    free(blockHeader.bytes);
+    if(fclose(fileHandle) != 0 || failed) {
+        st_errAbort("Could not write the binary end alignment file: %s\n", binaryFile);
+    }
+}
+
+bool isBinaryEndAlignmentFile(const char *endAlignmentFile) {
+    FILE *fileHandle = fopen(endAlignmentFile, "rb");
+    if(fileHandle == NULL) {
+        return 0;
+    }
+    EndAlignmentFileHeader header;
+    bool isBinary = fread(&header, sizeof(EndAlignmentFileHeader), 1, fileHandle) == 1
+            && memcmp(header.magic, END_ALIGNMENT_FILE_MAGIC, sizeof(header.magic)) == 0;
+    fclose(fileHandle);
+    return isBinary;
+}
+
+/*
+ * Decodes a block straight into a sorted set, as the entries were written in order.
+ */
+static AlignedPairSet *loadEndAlignmentBlock(const uint8_t *bytes, const uint8_t *end, int64_t entryNumber,
+        const char *binaryFile) {
+    AlignedPairSet *endAlignment = alignedPairSet_construct2(entryNumber / 2);
+    int64_t subsequenceIdentifier = 0, position = 0;
+    for(int64_t i=0; i<entryNumber; i++) {
+        int64_t subsequenceIdentifier2 = (int64_t)((uint64_t)subsequenceIdentifier + (uint64_t)getVarint(&bytes, end, binaryFile));
+        if(subsequenceIdentifier2 != subsequenceIdentifier) {
+            position = 0;
+        }
+        subsequenceIdentifier = subsequenceIdentifier2;
+        position = (int64_t)((uint64_t)position + (uint64_t)getVarint(&bytes, end, binaryFile));
+        int64_t score = getVarint(&bytes, end, binaryFile);
+        int64_t reverseAndStrand = getVarint(&bytes, end, binaryFile);
+        int64_t reverse = i + (reverseAndStrand >> 1);
+        if(reverse < 0 || reverse >= entryNumber || reverse == i) {
+            st_errAbort("The file %s holds an invalid binary end alignment\n", binaryFile);
+        }
+        alignedPairSet_addSorted(endAlignment, subsequenceIdentifier, position, reverseAndStrand & 1, score, reverse);
+    }
+    for(int64_t i=0; i<entryNumber; i++) {
+        if(endAlignment->reverses[endAlignment->reverses[i]] != i) {
+            st_errAbort("The file %s holds an invalid binary end alignment\n", binaryFile);
+        }
+    }
+    if(bytes != end) {
+        st_errAbort("The file %s holds an invalid binary end alignment\n", binaryFile);
+    }
+    return endAlignment;
+}
+
+void loadEndAlignmentsFromBinaryFile(Flower *flower, const char *binaryFile, stList *ends, stList *endAlignments) {
+    int fileHandle = open(binaryFile, O_RDONLY);
+    if(fileHandle < 0) {
+        st_errAbort("Could not open the binary end alignment file: %s\n", binaryFile);
+    }
+    struct stat fileStat;
+    if(fstat(fileHandle, &fileStat) != 0 || fileStat.st_size < (off_t) sizeof(EndAlignmentFileHeader)) {
+        st_errAbort("The file %s is too small to be a binary end alignment file\n", binaryFile);
+    }
+    const uint8_t *data = mmap(NULL, fileStat.st_size, PROT_READ, MAP_SHARED, fileHandle, 0);
+    close(fileHandle); //The mapping stays valid.
+    if(data == MAP_FAILED) {
+        st_errAbort("Could not map the binary end alignment file: %s\n", binaryFile);
+    }
+    const EndAlignmentFileHeader *header = (const EndAlignmentFileHeader *)data;
+    if(memcmp(header->magic, END_ALIGNMENT_FILE_MAGIC, sizeof(header->magic)) != 0
+            || header->version != END_ALIGNMENT_FILE_VERSION) {
+        st_errAbort("The file %s is not a binary end alignment file of version %i\n", binaryFile, END_ALIGNMENT_FILE_VERSION);
+    }
+    //The blocks are read once, from first to last.
+    posix_madvise((void *)data, fileStat.st_size, POSIX_MADV_SEQUENTIAL);
+    const uint8_t *bytes = data + sizeof(EndAlignmentFileHeader), *fileEnd = data + fileStat.st_size;
+    while(bytes < fileEnd) {
+        Name endName = getVarint(&bytes, fileEnd, binaryFile);
+        int64_t entryNumber = getVarint(&bytes, fileEnd, binaryFile);
+        int64_t blockLength = getVarint(&bytes, fileEnd, binaryFile);
+        //Each entry takes at least four bytes, and each pair two entries.
+        if(blockLength < 0 || blockLength > fileEnd - bytes || entryNumber < 0 || entryNumber % 2 != 0
+                || entryNumber > blockLength / 4) {
+            st_errAbort("The file %s is not a complete binary end alignment file\n", binaryFile);
+        }
+        End *end = flower_getEnd(flower, endName);
+        if(end == NULL) {
+            st_errAbort("We encountered an end name that is not in the database: %" PRIi64 "\n", endName);
+        }
+        stList_append(ends, end);
+        stList_append(endAlignments, loadEndAlignmentBlock(bytes, bytes + blockLength, entryNumber, binaryFile));
+        bytes += blockLength;
+    }
+    munmap((void *)data, fileStat.st_size);
+}
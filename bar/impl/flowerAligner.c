@@ -5,93 +5,85 @@
  */
 
 #include "endAligner.h"
+#include "flowerAligner.h"
 #include "cactus.h"
 #include "sonLib.h"
 #include "adjacencySequences.h"
 #include "pairwiseAligner.h"
 
-stList *getInducedAlignment(stSortedSet *endAlignment, AdjacencySequence *adjacencySequence) {
+InducedAlignment *getInducedAlignment(AlignedPairSet *endAlignment, AdjacencySequence *adjacencySequence) {
     /*
-     * Gets an ordered list of pairs from the end alignment for the given adjacency sequence.
+     * Gets the ordered entries of the end alignment for the given adjacency sequence.
      */
-    stList *inducedAlignment = stList_construct();
-    if (adjacencySequence->strand) {
-        AlignedPair *alignedPair = alignedPair_construct(adjacencySequence->subsequenceIdentifier,
-                adjacencySequence->start - 1, adjacencySequence->strand, 0, 0, 0, 0, 0);
-        AlignedPair *alignedPair2 = stSortedSet_searchGreaterThan(endAlignment, alignedPair);
-        if (alignedPair2 != NULL) {
-            stSortedSetIterator *it = stSortedSet_getIteratorFrom(endAlignment, alignedPair2);
-            while ((alignedPair2 = stSortedSet_getNext(it)) != NULL) {
-                if (alignedPair2->subsequenceIdentifier == adjacencySequence->subsequenceIdentifier) {
-                    if (alignedPair2->position >= adjacencySequence->start + adjacencySequence->length) {
-                        break;
-                    }
-                    assert(alignedPair2->position >= adjacencySequence->start);
-                    if (alignedPair2->strand == adjacencySequence->strand) {
-                        stList_append(inducedAlignment, alignedPair2);
-                    }
-                } else {
-                    break;
-                }
-            }
-            stSortedSet_destructIterator(it);
-        }
-        alignedPair_destruct(alignedPair->reverse);
-        alignedPair_destruct(alignedPair);
-    } else {
-        AlignedPair *alignedPair = alignedPair_construct(adjacencySequence->subsequenceIdentifier,
-                adjacencySequence->start + 1, adjacencySequence->strand, 0, 0, 0, 0, 0);
-        AlignedPair *alignedPair2 = stSortedSet_searchLessThan(endAlignment, alignedPair);
-        if (alignedPair2 != NULL) {
-            stSortedSetIterator *it = stSortedSet_getIteratorFrom(endAlignment, alignedPair2);
-            stSortedSet_getNext(it);
-            stSortedSet_getNext(it); //shift it up..
-            while ((alignedPair2 = stSortedSet_getPrevious(it)) != NULL) {
-                if (alignedPair2->subsequenceIdentifier == adjacencySequence->subsequenceIdentifier) {
-                    if (alignedPair2->position <= adjacencySequence->start - adjacencySequence->length) {
-                        break;
-                    }
-                    assert(alignedPair2->position <= adjacencySequence->start);
-                    if (alignedPair2->strand == adjacencySequence->strand) {
-                        stList_append(inducedAlignment, alignedPair2);
-                    }
-                } else {
-                    break;
-                }
-            }
-            stSortedSet_destructIterator(it);
+    InducedAlignment *inducedAlignment = st_malloc(sizeof(InducedAlignment));
+    inducedAlignment->endAlignment = endAlignment;
+    inducedAlignment->length = 0;
+    //The entries on the sequence are contiguous in the sorted end alignment.
+    int64_t start = adjacencySequence->strand ? adjacencySequence->start
+            : adjacencySequence->start - adjacencySequence->length + 1;
+    int64_t i = alignedPairSet_getFirstFrom(endAlignment, adjacencySequence->subsequenceIdentifier, start, 0);
+    int64_t j = i;
+    while (j < endAlignment->length && endAlignment->subsequenceIdentifiers[j] == adjacencySequence->subsequenceIdentifier
+            && endAlignment->positions[j] < start + adjacencySequence->length) {
+        j++;
+    }
+    inducedAlignment->entries = st_malloc((j - i + 1) * sizeof(int64_t));
+    for (; i < j; i++) {
+        if (!endAlignment->deleted[i] && endAlignment->strands[i] == adjacencySequence->strand) {
+            inducedAlignment->entries[inducedAlignment->length++] = i;
         }
-        alignedPair_destruct(alignedPair->reverse);
-        alignedPair_destruct(alignedPair);
+    }
+    if (!adjacencySequence->strand) {
+        inducedAlignment_reverse(inducedAlignment);
     }
     /*
      * Check the induced alignment
      */
-    for (int64_t i = 0; i < stList_length(inducedAlignment); i++) {
-        AlignedPair *alignedPair = stList_get(inducedAlignment, i);
-        (void) alignedPair;
-        assert(alignedPair->subsequenceIdentifier == adjacencySequence->subsequenceIdentifier);
-        assert(alignedPair->strand == adjacencySequence->strand);
+    for (int64_t i = 0; i < inducedAlignment->length; i++) {
+        int64_t entry = inducedAlignment->entries[i];
+        (void) entry;
+        assert(endAlignment->subsequenceIdentifiers[entry] == adjacencySequence->subsequenceIdentifier);
+        assert(endAlignment->strands[entry] == adjacencySequence->strand);
         if (adjacencySequence->strand) {
-            assert(alignedPair->position >= adjacencySequence->start);
-            assert(alignedPair->position < adjacencySequence->start + adjacencySequence->length);
+            assert(endAlignment->positions[entry] >= adjacencySequence->start);
+            assert(endAlignment->positions[entry] < adjacencySequence->start + adjacencySequence->length);
         } else {
-            assert(alignedPair->position <= adjacencySequence->start);
-            assert(alignedPair->position > adjacencySequence->start - adjacencySequence->length);
+            assert(endAlignment->positions[entry] <= adjacencySequence->start);
+            assert(endAlignment->positions[entry] > adjacencySequence->start - adjacencySequence->length);
         }
     }
     return inducedAlignment;
 }
 
+void inducedAlignment_reverse(InducedAlignment *inducedAlignment) {
+    for (int64_t i = 0, j = inducedAlignment->length - 1; i < j; i++, j--) {
+        int64_t entry = inducedAlignment->entries[i];
+        inducedAlignment->entries[i] = inducedAlignment->entries[j];
+        inducedAlignment->entries[j] = entry;
+    }
+}
+
+void inducedAlignment_destruct(InducedAlignment *inducedAlignment) {
+    free(inducedAlignment->entries);
+    free(inducedAlignment);
+}
+
+static int64_t getPairScore(InducedAlignment *inducedAlignment, int64_t i) {
+    return inducedAlignment->endAlignment->scores[inducedAlignment->entries[i]];
+}
+
+static int64_t getPairPosition(InducedAlignment *inducedAlignment, int64_t i) {
+    return inducedAlignment->endAlignment->positions[inducedAlignment->entries[i]];
+}
+
 /*
  * Runs along and cumulate the score of the pairs, traversing forward through the induced alignment.
  */
-static int64_t *cumulateScoreForward(stList *inducedAlignment1) {
-    int64_t *iA = st_malloc(sizeof(int64_t) * stList_length(inducedAlignment1));
+static int64_t *cumulateScoreForward(InducedAlignment *inducedAlignment1) {
+    int64_t *iA = st_malloc(sizeof(int64_t) * inducedAlignment1->length);
     int64_t totalScore = 0;
-    for (int64_t i = 0; i < stList_length(inducedAlignment1); i++) {
-        AlignedPair *alignedPair = stList_get(inducedAlignment1, i);
-        totalScore += alignedPair->score;
+    for (int64_t i = 0; i < inducedAlignment1->length; i++) {
+        totalScore += getPairScore(inducedAlignment1, i);
         iA[i] = totalScore;
     }
     return iA;
@@ -100,12 +92,11 @@ static int64_t *cumulateScoreForward(stList *inducedAlignment1) {
 /*
  * Runs along and cumulate the score of the pairs, traversing backward through the induced alignment.
  */
-static int64_t *cumulateScoreBackward(stList *inducedAlignment1) {
-    int64_t *iA = st_malloc(sizeof(int64_t) * stList_length(inducedAlignment1));
+static int64_t *cumulateScoreBackward(InducedAlignment *inducedAlignment1) {
+    int64_t *iA = st_malloc(sizeof(int64_t) * inducedAlignment1->length);
     int64_t totalScore = 0;
-    for (int64_t i = stList_length(inducedAlignment1) - 1; i >= 0; i--) {
-        AlignedPair *alignedPair = stList_get(inducedAlignment1, i);
-        totalScore += alignedPair->score;
+    for (int64_t i = inducedAlignment1->length - 1; i >= 0; i--) {
+        totalScore += getPairScore(inducedAlignment1, i);
         iA[i] = totalScore;
     }
     return iA;
@@ -114,15 +105,16 @@ static int64_t *cumulateScoreBackward(stList *inducedAlignment1) {
 /*
  * Chooses a point along the adjacency sequence at which to filter the two alignments,
  */
-static int64_t getCutOff(stList *inducedAlignment1, stList *inducedAlignment2, int64_t *cutOff1, int64_t *cutOff2) {
+static int64_t getCutOff(InducedAlignment *inducedAlignment1, InducedAlignment *inducedAlignment2, int64_t *cutOff1,
+        int64_t *cutOff2) {
     int64_t *cScore1 = cumulateScoreForward(inducedAlignment1);
     int64_t *cScore2 = cumulateScoreBackward(inducedAlignment2);
 
     //Check the score arrays for sanity..
-    for (int64_t i = 1; i < stList_length(inducedAlignment1); i++) {
+    for (int64_t i = 1; i < inducedAlignment1->length; i++) {
         assert(cScore1[i - 1] < cScore1[i]);
     }
-    for (int64_t i = 1; i < stList_length(inducedAlignment2); i++) {
+    for (int64_t i = 1; i < inducedAlignment2->length; i++) {
         assert(cScore2[i - 1] > cScore2[i]);
     }
 
@@ -130,23 +122,23 @@ static int64_t getCutOff(stList *inducedAlignment1, stList *inducedAlignment2, i
     *cutOff1 = 0;
     *cutOff2 = 0;
     int64_t maxScore = -1;
-    if (stList_length(inducedAlignment2) > 0) {
+    if (inducedAlignment2->length > 0) {
         maxScore = cScore2[0];
     }
     int64_t j = 0;
     int64_t pPos1 = INT64_MIN, pPos2 = INT64_MIN;
-    for (int64_t i = 0; i < stList_length(inducedAlignment1); i++) {
-        AlignedPair *alignedPair1 = stList_get(inducedAlignment1, i);
-        assert(alignedPair1->strand);
-        assert(pPos1 <= alignedPair1->position);
-        pPos1 = alignedPair1->position;
-        if (j < stList_length(inducedAlignment2)) {
+    for (int64_t i = 0; i < inducedAlignment1->length; i++) {
+        int64_t position1 = getPairPosition(inducedAlignment1, i);
+        assert(inducedAlignment1->endAlignment->strands[inducedAlignment1->entries[i]]);
+        assert(pPos1 <= position1);
+        pPos1 = position1;
+        if (j < inducedAlignment2->length) {
             do {
-                AlignedPair *alignedPair2 = stList_get(inducedAlignment2, j);
-                assert(!alignedPair2->strand);
-                assert(pPos2 <= alignedPair2->position);
-                pPos2 = alignedPair2->position;
-                if (alignedPair1->position < alignedPair2->position) {
+                int64_t position2 = getPairPosition(inducedAlignment2, j);
+                assert(!inducedAlignment2->endAlignment->strands[inducedAlignment2->entries[j]]);
+                assert(pPos2 <= position2);
+                pPos2 = position2;
+                if (position1 < position2) {
                     if (cScore1[i] + cScore2[j] >= maxScore) {
                         maxScore = cScore1[i] + cScore2[j];
                         *cutOff1 = i + 1;
@@ -156,13 +148,13 @@ static int64_t getCutOff(stList *inducedAlignment1, stList *inducedAlignment2, i
                 } else {
                     j++;
                 }
-            } while (j < stList_length(inducedAlignment2));
+            } while (j < inducedAlignment2->length);
         } else {
             if (cScore1[i] >= maxScore) {
-                *cutOff1 = stList_length(inducedAlignment1);
+                *cutOff1 = inducedAlignment1->length;
                 *cutOff2 = j;
-                assert(cScore1[stList_length(inducedAlignment1) - 1] >= maxScore);
-                maxScore = cScore1[stList_length(inducedAlignment1) - 1];
+                assert(cScore1[inducedAlignment1->length - 1] >= maxScore);
+                maxScore = cScore1[inducedAlignment1->length - 1];
                 break;
             }
         }
@@ -174,60 +166,147 @@ static int64_t getCutOff(stList *inducedAlignment1, stList *inducedAlignment2, i
     return maxScore;
 }
 
-void updateDeletedPairs(int64_t subsequenceIdentifier, stHash *deletedAlignedPairCounts) {
+/*
+ * The caps still to be cut, in a max-heap on the number of aligned pairs deleted so far from their adjacency
+ * sequences. Ties go to the cap latest in the order the caps were given in.
+ */
+typedef struct _cutPoint {
+    Name subsequenceIdentifier;
+    Cap *cap;
+    int64_t order;
+    int64_t deletedPairs;
+    int64_t heapIndex; //-1 once the cap has been popped.
+} CutPoint;
+
+typedef struct _capHeap {
+    CutPoint *cutPoints; //Sorted by subsequence identifier, to look up the counts.
+    int64_t cutPointNumber;
+    CutPoint **heap;
+    int64_t heapSize;
+} CapHeap;
+
+static int cutPoint_cmpFn(const void *cutPoint1, const void *cutPoint2) {
+    return cactusMisc_nameCompare(((CutPoint *) cutPoint1)->subsequenceIdentifier,
+            ((CutPoint *) cutPoint2)->subsequenceIdentifier);
+}
+
+static bool cutPoint_comesFirst(CutPoint *cutPoint1, CutPoint *cutPoint2) {
+    return cutPoint1->deletedPairs > cutPoint2->deletedPairs
+            || (cutPoint1->deletedPairs == cutPoint2->deletedPairs && cutPoint1->order > cutPoint2->order);
+}
+
+static void capHeap_set(CapHeap *capHeap, int64_t i, CutPoint *cutPoint) {
+    capHeap->heap[i] = cutPoint;
+    cutPoint->heapIndex = i;
+}
+
+static void capHeap_siftUp(CapHeap *capHeap, int64_t i) {
+    CutPoint *cutPoint = capHeap->heap[i];
+    while (i > 0 && cutPoint_comesFirst(cutPoint, capHeap->heap[(i - 1) / 2])) {
+        capHeap_set(capHeap, i, capHeap->heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    capHeap_set(capHeap, i, cutPoint);
+}
+
+static void capHeap_siftDown(CapHeap *capHeap, int64_t i) {
+    CutPoint *cutPoint = capHeap->heap[i];
+    while (2 * i + 1 < capHeap->heapSize) {
+        int64_t j = 2 * i + 1;
+        if (j + 1 < capHeap->heapSize && cutPoint_comesFirst(capHeap->heap[j + 1], capHeap->heap[j])) {
+            j++;
+        }
+        if (!cutPoint_comesFirst(capHeap->heap[j], cutPoint)) {
+            break;
+        }
+        capHeap_set(capHeap, i, capHeap->heap[j]);
+        i = j;
+    }
+    capHeap_set(capHeap, i, cutPoint);
+}
+
+CapHeap *capHeap_construct(stList *caps) {
+    CapHeap *capHeap = st_malloc(sizeof(CapHeap));
+    capHeap->cutPointNumber = stList_length(caps);
+    capHeap->cutPoints = st_malloc((capHeap->cutPointNumber + 1) * sizeof(CutPoint));
+    capHeap->heap = st_malloc((capHeap->cutPointNumber + 1) * sizeof(CutPoint *));
+    capHeap->heapSize = capHeap->cutPointNumber;
+    for (int64_t i = 0; i < capHeap->cutPointNumber; i++) {
+        Cap *cap = stList_get(caps, i);
+        assert(!cap_getSide(cap));
+        CutPoint cutPoint = { cap_getName(cap_getStrand(cap) ? cap : cap_getAdjacency(cap)), cap, i, 0, -1 };
+        capHeap->cutPoints[i] = cutPoint;
+    }
+    qsort(capHeap->cutPoints, capHeap->cutPointNumber, sizeof(CutPoint), cutPoint_cmpFn);
+    //With no pairs yet deleted the caps come out latest first, and an array in that order is already a heap.
+    for (int64_t i = 0; i < capHeap->cutPointNumber; i++) {
+        assert(i == 0 || capHeap->cutPoints[i - 1].subsequenceIdentifier != capHeap->cutPoints[i].subsequenceIdentifier);
+        capHeap_set(capHeap, capHeap->cutPointNumber - 1 - capHeap->cutPoints[i].order, &capHeap->cutPoints[i]);
+    }
+    return capHeap;
+}
+
+void capHeap_destruct(CapHeap *capHeap) {
+    free(capHeap->cutPoints);
+    free(capHeap->heap);
+    free(capHeap);
+}
+
+Cap *capHeap_pop(CapHeap *capHeap) {
+    if (capHeap->heapSize == 0) {
+        return NULL;
+    }
+    CutPoint *cutPoint = capHeap->heap[0];
+    if (--capHeap->heapSize > 0) {
+        capHeap_set(capHeap, 0, capHeap->heap[capHeap->heapSize]);
+        capHeap_siftDown(capHeap, 0);
+    }
+    cutPoint->heapIndex = -1;
+    return cutPoint->cap;
+}
+
+void updateDeletedPairs(int64_t subsequenceIdentifier, CapHeap *capHeap) {
 	/*
 	 * Adds one to count for the given sequenceIdentifier;
 	 */
-    stIntTuple *i = stIntTuple_construct1(subsequenceIdentifier);
-    int64_t *j = stHash_search(deletedAlignedPairCounts, i);
-    if(j == NULL) {
-        j = st_calloc(1, sizeof(int64_t));
-        stHash_insert(deletedAlignedPairCounts, i, j);
-    }
-    else {
-        stIntTuple_destruct(i);
+    CutPoint key;
+    key.subsequenceIdentifier = subsequenceIdentifier;
+    CutPoint *cutPoint = bsearch(&key, capHeap->cutPoints, capHeap->cutPointNumber, sizeof(CutPoint), cutPoint_cmpFn);
+    if (cutPoint != NULL) {
+        cutPoint->deletedPairs++;
+        if (cutPoint->heapIndex != -1) {
+            capHeap_siftUp(capHeap, cutPoint->heapIndex);
+        }
     }
-    (*j)++;
 }
 
-static void pruneAlignmentsP(stList *inducedAlignment, stSortedSet *endAlignment, int64_t start, int64_t end,
-        stSortedSet *pairsToDelete, stHash *deletedAlignedPairCounts) {
+static void pruneAlignmentsP(InducedAlignment *inducedAlignment, int64_t start, int64_t end, CapHeap *capHeap) {
+    AlignedPairSet *endAlignment = inducedAlignment->endAlignment;
     for (int64_t i = start; i < end; i++) {
-        AlignedPair *alignedPair = stList_get(inducedAlignment, i);
-        if (stSortedSet_search(endAlignment, alignedPair) != NULL) { //can be missing if we are pruning the reverse strand alignment at the same time
-            assert(stSortedSet_search(endAlignment, alignedPair->reverse) != NULL);
-            updateDeletedPairs(alignedPair->subsequenceIdentifier, deletedAlignedPairCounts);
-            updateDeletedPairs(alignedPair->reverse->subsequenceIdentifier, deletedAlignedPairCounts);
-            stSortedSet_remove(endAlignment, alignedPair);
-            stSortedSet_remove(endAlignment, alignedPair->reverse);
-            if (stSortedSet_search(pairsToDelete, alignedPair) == NULL) { // &&
-                assert(stSortedSet_search(pairsToDelete, alignedPair->reverse) == NULL);
-                stSortedSet_insert(pairsToDelete, alignedPair);
-                stSortedSet_insert(pairsToDelete, alignedPair->reverse);
-            } else {
-                assert(stSortedSet_search(pairsToDelete, alignedPair->reverse) != NULL);
-            }
+        int64_t entry = inducedAlignment->entries[i];
+        if (!endAlignment->deleted[entry]) { //can be deleted already if we are pruning the reverse strand alignment at the same time
+            updateDeletedPairs(endAlignment->subsequenceIdentifiers[entry], capHeap);
+            updateDeletedPairs(endAlignment->subsequenceIdentifiers[endAlignment->reverses[entry]], capHeap);
+            alignedPairSet_delete(endAlignment, entry);
         }
     }
 }
 
-static void pruneAlignments(Cap *cap, stList *inducedAlignment1, stList *inducedAlignment2, stSortedSet *endAlignment1,
-        stSortedSet *endAlignment2, void *deletedAlignedPairCounts) {
+static void pruneAlignments(Cap *cap, InducedAlignment *inducedAlignment1, InducedAlignment *inducedAlignment2,
+        void *capHeap) {
     /*
      * Chooses a point along the adjacency sequence at which to filter the two alignments,
      * then filters the aligned pairs by this point.
      */
     int64_t cutOff1 = 0, cutOff2 = 0;
     getCutOff(inducedAlignment1, inducedAlignment2, &cutOff1, &cutOff2);
-    stSortedSet *pairsToDelete = stSortedSet_construct2((void(*)(void *)) alignedPair_destruct);
     //Now do the actual filtering of the alignments.
-    pruneAlignmentsP(inducedAlignment1, endAlignment1, cutOff1, stList_length(inducedAlignment1), pairsToDelete, deletedAlignedPairCounts);
-    pruneAlignmentsP(inducedAlignment2, endAlignment2, 0, cutOff2, pairsToDelete, deletedAlignedPairCounts);
-    stSortedSet_destruct(pairsToDelete);
+    pruneAlignmentsP(inducedAlignment1, cutOff1, inducedAlignment1->length, capHeap);
+    pruneAlignmentsP(inducedAlignment2, 0, cutOff2, capHeap);
 }
 
-void getScore(Cap *cap, stList *inducedAlignment1, stList *inducedAlignment2, stSortedSet *endAlignment1,
-        stSortedSet *endAlignment2, void *capScoresFnHash) {
+void getScore(Cap *cap, InducedAlignment *inducedAlignment1, InducedAlignment *inducedAlignment2,
+        void *capScoresFnHash) {
 
     int64_t i, j;
     int64_t *maxScore = st_malloc(sizeof(int64_t));
@@ -245,59 +324,58 @@ static int sortCapsFn(const void *cap1, const void *cap2, const void *capScoresF
     return (i > 0) ? 1 : ((i < 0) ? -1 : 0); 
 }
 
-bool isAlignedToStubSequence(AlignedPair *alignedPair, Flower *flower) {
-	Cap *cap = flower_getCap(flower, alignedPair->reverse->subsequenceIdentifier);
+bool isAlignedToStubSequence(AlignedPairSet *endAlignment, int64_t entry, Flower *flower) {
+	Cap *cap = flower_getCap(flower, endAlignment->subsequenceIdentifiers[endAlignment->reverses[entry]]);
     assert(cap != NULL);
     End *end1 = cap_getEnd(cap), *end2 = cap_getEnd(cap_getAdjacency(cap));
     assert(end1 != NULL && end2 != NULL);
     return (end_isStubEnd(end1) && end_isFree(end1)) || (end_isStubEnd(end2) && end_isFree(end2));
 } 
 
-static int64_t findFirstNonStubAlignment(Flower *flower, stList *inducedAlignment, bool reverse) {
-    AlignedPair *pAlignedPair = NULL;
+static int64_t findFirstNonStubAlignment(Flower *flower, InducedAlignment *inducedAlignment, bool reverse) {
+    AlignedPairSet *endAlignment = inducedAlignment->endAlignment;
+    int64_t pEntry = -1;
     int64_t j = -1;
-    for (int64_t i = reverse ? stList_length(inducedAlignment) - 1 : 0; i < stList_length(inducedAlignment) && i >= 0; i
+    for (int64_t i = reverse ? inducedAlignment->length - 1 : 0; i < inducedAlignment->length && i >= 0; i
             += reverse ? -1 : 1) {
-        AlignedPair *alignedPair = stList_get(inducedAlignment, i);
-        assert(isAlignedToStubSequence(alignedPair->reverse, flower));
-        assert(pAlignedPair == NULL || pAlignedPair->subsequenceIdentifier == alignedPair->subsequenceIdentifier);
-        if (pAlignedPair == NULL || pAlignedPair->position != alignedPair->position) {
-            pAlignedPair = alignedPair;
+        int64_t entry = inducedAlignment->entries[i];
+        assert(isAlignedToStubSequence(endAlignment, endAlignment->reverses[entry], flower));
+        assert(pEntry == -1 || endAlignment->subsequenceIdentifiers[pEntry] == endAlignment->subsequenceIdentifiers[entry]);
+        if (pEntry == -1 || endAlignment->positions[pEntry] != endAlignment->positions[entry]) {
+            pEntry = entry;
             j = i;
         }
-        if(!isAlignedToStubSequence(alignedPair, flower)) {
+        if(!isAlignedToStubSequence(endAlignment, entry, flower)) {
             assert(j != -1);
             return j;
         }
     }
-    return (reverse ? -1 : stList_length(inducedAlignment));
+    return (reverse ? -1 : inducedAlignment->length);
 }
 
-static void pruneStubAlignments(Cap *cap, stList *inducedAlignment1, stList *inducedAlignment2,
-        stSortedSet *endAlignment1, stSortedSet *endAlignment2, void *deletedAlignedPairCounts) {
+static void pruneStubAlignments(Cap *cap, InducedAlignment *inducedAlignment1, InducedAlignment *inducedAlignment2,
+        void *capHeap) {
     assert(cap != NULL);
     End *end = cap_getEnd(cap);
     assert(cap_getAdjacency(cap) != NULL);
     End *adjacentEnd = cap_getEnd(cap_getAdjacency(cap));
     assert(end != NULL);
     assert(adjacentEnd != NULL);
-    int64_t cutOff1 = stList_length(inducedAlignment1) - 1;
+    int64_t cutOff1 = inducedAlignment1->length - 1;
     int64_t cutOff2 = 0;
     if (end_isStubEnd(adjacentEnd) && end_isFree(adjacentEnd)) {
         cutOff1 = findFirstNonStubAlignment(end_getFlower(end), inducedAlignment1, 1);
-        assert(stList_length(inducedAlignment2) == 0);
-        cutOff2 = stList_length(inducedAlignment2);
+        assert(inducedAlignment2->length == 0);
+        cutOff2 = inducedAlignment2->length;
     }
     if (end_isStubEnd(end) && end_isFree(end)) {
-        assert(stList_length(inducedAlignment1) == 0);
+        assert(inducedAlignment1->length == 0);
         cutOff1 = -1;
         cutOff2 = findFirstNonStubAlignment(end_getFlower(end), inducedAlignment2, 0);
     }
-    stSortedSet *pairsToDelete = stSortedSet_construct2((void(*)(void *)) alignedPair_destruct);
     //Now do the actual filtering of the alignments.
-    pruneAlignmentsP(inducedAlignment1, endAlignment1, cutOff1 + 1, stList_length(inducedAlignment1), pairsToDelete, deletedAlignedPairCounts);
-    pruneAlignmentsP(inducedAlignment2, endAlignment2, 0, cutOff2, pairsToDelete, deletedAlignedPairCounts);
-    stSortedSet_destruct(pairsToDelete);
+    pruneAlignmentsP(inducedAlignment1, cutOff1 + 1, inducedAlignment1->length, capHeap);
+    pruneAlignmentsP(inducedAlignment2, 0, cutOff2, capHeap);
 }
 
 /*
@@ -305,8 +383,8 @@ static void pruneStubAlignments(Cap *cap, stList *inducedAlignment1, stList *ind
  */
 
 static int makeFlowerAlignmentP(Cap *cap, stHash *endAlignments,
-        void(*fn)(Cap *, stList *, stList *, stSortedSet *, stSortedSet *, void *), void *extraArg) {
-    stSortedSet *endAlignment1 = stHash_search(endAlignments, end_getPositiveOrientation(cap_getEnd(cap)));
+        void(*fn)(Cap *, InducedAlignment *, InducedAlignment *, void *), void *extraArg) {
+    AlignedPairSet *endAlignment1 = stHash_search(endAlignments, end_getPositiveOrientation(cap_getEnd(cap)));
     assert(endAlignment1 != NULL);
 
     Cap *adjacentCap = cap_getAdjacency(cap);
@@ -314,7 +392,7 @@ static int makeFlowerAlignmentP(Cap *cap, stHash *endAlignments,
     assert(cap_getSide(adjacentCap));
     assert(cap_getStrand(adjacentCap));
     adjacentCap = cap_getReverse(adjacentCap);
-    stSortedSet *endAlignment2 = stHash_search(endAlignments, end_getPositiveOrientation(cap_getEnd(adjacentCap)));
+    AlignedPairSet *endAlignment2 = stHash_search(endAlignments, end_getPositiveOrientation(cap_getEnd(adjacentCap)));
     assert(endAlignment2 != NULL);
 
     AdjacencySequence *adjacencySequence1 = adjacencySequence_construct(cap, INT64_MAX);
@@ -324,21 +402,21 @@ static int makeFlowerAlignmentP(Cap *cap, stHash *endAlignments,
     assert(adjacencySequence1->strand == !adjacencySequence2->strand);
     assert(adjacencySequence2->start == adjacencySequence1->start + adjacencySequence1->length - 1);
 
-    stList *inducedAlignment1 = getInducedAlignment(endAlignment1, adjacencySequence1);
-    stList *inducedAlignment2 = getInducedAlignment(endAlignment2, adjacencySequence2);
-    stList_reverse(inducedAlignment2);
+    InducedAlignment *inducedAlignment1 = getInducedAlignment(endAlignment1, adjacencySequence1);
+    InducedAlignment *inducedAlignment2 = getInducedAlignment(endAlignment2, adjacencySequence2);
+    inducedAlignment_reverse(inducedAlignment2);
 
-    fn(cap, inducedAlignment1, inducedAlignment2, endAlignment1, endAlignment2, extraArg);
+    fn(cap, inducedAlignment1, inducedAlignment2, extraArg);
 
     //Cleanup.
     adjacencySequence_destruct(adjacencySequence1);
     adjacencySequence_destruct(adjacencySequence2);
-    stList_destruct(inducedAlignment1);
-    stList_destruct(inducedAlignment2);
+    inducedAlignment_destruct(inducedAlignment1);
+    inducedAlignment_destruct(inducedAlignment2);
     return 1;
 }
 
-static stSortedSet *makeFlowerAlignment2(Flower *flower, stHash *endAlignments, bool pruneOutStubAlignments) {
+static AlignedPairSet *makeFlowerAlignment2(Flower *flower, stHash *endAlignments, bool pruneOutStubAlignments) {
     /*
      * Makes the alignments of the ends, in "endAlignments", consistent with one another using the bar algorithm.
      */
@@ -368,71 +446,41 @@ static stSortedSet *makeFlowerAlignment2(Flower *flower, stHash *endAlignments,
     stList_sort2(caps, sortCapsFn, capScoresFnHash); //sorts the caps in ascending order according to their cut off score.
 
     //Now do the actual pruning
-    stHash *deletedAlignedPairCounts = stHash_construct3((uint64_t (*)(const void *))stIntTuple_hashKey,
-            (int (*)(const void *, const void *))stIntTuple_equalsFn, (void (*)(void *))stIntTuple_destruct, free);
+    CapHeap *capHeap = capHeap_construct(caps);
+    stList_destruct(caps);
+    stHash_destruct(capScoresFnHash);
     stList *freeStubCaps = stList_construct(); //Caps that we'll use when pruning the stub only ends of alignments.
-    while (stList_length(caps) > 0) {
-        //Pick cap with greatest number of deleted aligned pairs.
-        //This bias the bar algorithm to pick cutpoints that consistent
-        //with previously selected cutpoints.
-        Cap *cap = NULL;
-        int64_t deletedPairsForChosenCap = 0;
-        int64_t capIndex = INT64_MAX;
-        for(int64_t i=0; i<stList_length(caps); i++) {
-            Cap *cap2 = stList_get(caps, i);
-            assert(!cap_getSide(cap2));
-            stIntTuple *sequenceIdentifier = stIntTuple_construct1(cap_getName(cap_getStrand(cap2) ? cap2 : cap_getAdjacency(cap2)));
-            int64_t *deletedPairsCount = stHash_search(deletedAlignedPairCounts, sequenceIdentifier);
-            stIntTuple_destruct(sequenceIdentifier);
-            if(cap == NULL || deletedPairsForChosenCap == 0 || (deletedPairsCount != NULL && *deletedPairsCount >= deletedPairsForChosenCap)) {
-                cap = cap2;
-                capIndex = i;
-                if(deletedPairsCount != NULL) {
-                    deletedPairsForChosenCap = *deletedPairsCount;
-                }
-            }
-        }
-        //Having chosen the cap, remove it
-        assert(cap != NULL);
-        stList_remove(caps, capIndex);
+    Cap *cap;
+    //Pick cap with greatest number of deleted aligned pairs.
+    //This bias the bar algorithm to pick cutpoints that consistent
+    //with previously selected cutpoints.
+    while ((cap = capHeap_pop(capHeap)) != NULL) {
         //Do the filtering.
-        makeFlowerAlignmentP(cap, endAlignments, pruneAlignments, deletedAlignedPairCounts);
+        makeFlowerAlignmentP(cap, endAlignments, pruneAlignments, capHeap);
         assert(cap_getAdjacency(cap) != NULL);
         if ((end_isFree(cap_getEnd(cap)) && end_isStubEnd(cap_getEnd(cap))) || (end_isFree(
                 cap_getEnd(cap_getAdjacency(cap))) && end_isStubEnd(cap_getEnd(cap_getAdjacency(cap))))) {
             stList_append(freeStubCaps, cap);
         } 
     }
-    stList_destruct(caps);
-    stHash_destruct(capScoresFnHash);
 
     if (pruneOutStubAlignments) { //This is used to remove matches only containing stub sequences at end of an end alignment.
     	while (stList_length(freeStubCaps) > 0) {
-        	makeFlowerAlignmentP(stList_pop(freeStubCaps), endAlignments, pruneStubAlignments, deletedAlignedPairCounts);
+        	makeFlowerAlignmentP(stList_pop(freeStubCaps), endAlignments, pruneStubAlignments, capHeap);
         }
     }
     stList_destruct(freeStubCaps);
 
     //Now convert to set of final aligned pairs to return.
-    stSortedSet *sortedAlignment = stSortedSet_construct3((int(*)(const void *, const void *)) alignedPair_cmpFn,
-            (void(*)(void *)) alignedPair_destruct);
+    AlignedPairSet *sortedAlignment = alignedPairSet_construct();
     stList *endAlignmentsList = stHash_getValues(endAlignments);
-    while (stList_length(endAlignmentsList) > 0) {
-        stSortedSet *endAlignment = stList_pop(endAlignmentsList);
-        while (stSortedSet_size(endAlignment) > 0) {
-            AlignedPair *alignedPair = stSortedSet_getFirst(endAlignment);
-            stSortedSet_remove(endAlignment, alignedPair);
-            assert(stSortedSet_search(endAlignment, alignedPair->reverse) != NULL);
-            stSortedSet_remove(endAlignment, alignedPair->reverse);
-            assert(stSortedSet_search(sortedAlignment, alignedPair) == NULL);
-            assert(stSortedSet_search(sortedAlignment, alignedPair->reverse) == NULL);
-            stSortedSet_insert(sortedAlignment, alignedPair);
-            stSortedSet_insert(sortedAlignment, alignedPair->reverse);
-        }
+    for (int64_t i = 0; i < stList_length(endAlignmentsList); i++) {
+        alignedPairSet_addAll(sortedAlignment, stList_get(endAlignmentsList, i));
     }
     stList_destruct(endAlignmentsList);
     stHash_destruct(endAlignments);
-    stHash_destruct(deletedAlignedPairCounts);
+    capHeap_destruct(capHeap);
+    alignedPairSet_sort(sortedAlignment);
 
     return sortedAlignment;
 }
@@ -523,7 +571,7 @@ static stSortedSet *getEndsToAlign(Flower *flower, int64_t maxSequenceLength) {
 
 static void computeMissingEndAlignments(StateMachine *sM, Flower *flower, stHash *endAlignments, int64_t spanningTrees,
         int64_t maxSequenceLength, bool useProgressiveMerging, float gapGamma,
-        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters) {
+        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, int64_t numThreads) {
     /*
      * Creates end alignments for the ends that
      * do not have an alignment in the "endAlignments" hash, only creating
@@ -531,32 +579,38 @@ static void computeMissingEndAlignments(StateMachine *sM, Flower *flower, stHash
      */
     //Make the end alignments, representing each as an adjacency alignment.
     stSortedSet *endsToAlign = getEndsToAlign(flower, maxSequenceLength);
+    stList *ends = stList_construct();
     End *end;
     Flower_EndIterator *endIterator = flower_getEndIterator(flower);
     while ((end = flower_getNextEnd(endIterator)) != NULL) {
         if (stHash_search(endAlignments, end) == NULL) {
             if (stSortedSet_search(endsToAlign, end) != NULL) {
-                stHash_insert(
-                        endAlignments,
-                        end,
-                        makeEndAlignment(sM, end, spanningTrees, maxSequenceLength,
-                                useProgressiveMerging, gapGamma,
-                                pairwiseAlignmentBandingParameters));
+                stList_append(ends, end);
             } else {
-                stHash_insert(endAlignments, end, stSortedSet_construct());
+                stHash_insert(endAlignments, end, alignedPairSet_construct());
             }
         }
     }
     flower_destructEndIterator(endIterator);
     stSortedSet_destruct(endsToAlign);
+
+    stList *alignments = makeEndAlignments(sM, ends, spanningTrees, maxSequenceLength, useProgressiveMerging, gapGamma,
+            pairwiseAlignmentBandingParameters, numThreads);
+    for (int64_t i = 0; i < stList_length(ends); i++) {
+        stHash_insert(endAlignments, stList_get(ends, i), stList_get(alignments, i));
+    }
+    stList_setDestructor(alignments, NULL);
+    stList_destruct(alignments);
+    stList_destruct(ends);
 }
 
-stSortedSet *makeFlowerAlignment(StateMachine *sM, Flower *flower, int64_t spanningTrees, int64_t maxSequenceLength,
+AlignedPairSet *makeFlowerAlignment(StateMachine *sM, Flower *flower, int64_t spanningTrees, int64_t maxSequenceLength,
         bool useProgressiveMerging, float gapGamma,
-        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, bool pruneOutStubAlignments) {
-    stHash *endAlignments = stHash_construct2(NULL, (void(*)(void *)) stSortedSet_destruct);
+        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, bool pruneOutStubAlignments,
+        int64_t numThreads) {
+    stHash *endAlignments = stHash_construct2(NULL, (void(*)(void *)) alignedPairSet_destruct);
     computeMissingEndAlignments(sM, flower, endAlignments, spanningTrees, maxSequenceLength,
-            useProgressiveMerging, gapGamma, pairwiseAlignmentBandingParameters);
+            useProgressiveMerging, gapGamma, pairwiseAlignmentBandingParameters, numThreads);
     return makeFlowerAlignment2(flower, endAlignments, pruneOutStubAlignments);
 }
 
@@ -565,9 +619,21 @@ static void loadEndAlignments(Flower *flower, stHash *endAlignments, stList *lis
      * Load alignments from given list of files and add them to the "endAlignments" hash.
      */
     for (int64_t i = 0; i < stList_length(listOfEndAlignments); i++) {
+        if (isBinaryEndAlignmentFile(stList_get(listOfEndAlignments, i))) {
+            stList *ends = stList_construct();
+            stList *alignments = stList_construct();
+            loadEndAlignmentsFromBinaryFile(flower, stList_get(listOfEndAlignments, i), ends, alignments);
+            for (int64_t j = 0; j < stList_length(ends); j++) {
+                assert(stHash_search(endAlignments, stList_get(ends, j)) == NULL);
+                stHash_insert(endAlignments, stList_get(ends, j), stList_get(alignments, j));
+            }
+            stList_destruct(ends);
+            stList_destruct(alignments);
+            continue;
+        }
         End *end;
         FILE *fileHandle = fopen(stList_get(listOfEndAlignments, i), "r");
-        stSortedSet *alignment;
+        AlignedPairSet *alignment;
         while((alignment = loadEndAlignmentFromDisk(flower, fileHandle, &end)) != NULL) {
             assert(stHash_search(endAlignments, end) == NULL);
             stHash_insert(endAlignments, end, alignment);
@@ -576,15 +642,16 @@ static void loadEndAlignments(Flower *flower, stHash *endAlignments, stList *lis
     }
 }
 
-stSortedSet *makeFlowerAlignment3(StateMachine *sM, Flower *flower, stList *listOfEndAlignmentFiles, int64_t spanningTrees,
+AlignedPairSet *makeFlowerAlignment3(StateMachine *sM, Flower *flower, stList *listOfEndAlignmentFiles, int64_t spanningTrees,
         int64_t maxSequenceLength, bool useProgressiveMerging, float gapGamma,
-        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, bool pruneOutStubAlignments) {
-    stHash *endAlignments = stHash_construct2(NULL, (void(*)(void *)) stSortedSet_destruct);
+        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, bool pruneOutStubAlignments,
+        int64_t numThreads) {
+    stHash *endAlignments = stHash_construct2(NULL, (void(*)(void *)) alignedPairSet_destruct);
     if(listOfEndAlignmentFiles != NULL) {
         loadEndAlignments(flower, endAlignments, listOfEndAlignmentFiles);
     }
     computeMissingEndAlignments(sM, flower, endAlignments, spanningTrees, maxSequenceLength,
-            useProgressiveMerging, gapGamma, pairwiseAlignmentBandingParameters);
+            useProgressiveMerging, gapGamma, pairwiseAlignmentBandingParameters, numThreads);
     return makeFlowerAlignment2(flower, endAlignments, pruneOutStubAlignments);
 }
 
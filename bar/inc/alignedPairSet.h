@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+/*
+ * alignedPairSet.h
+ *
+ * A set of aligned pairs held as parallel arrays, rather than as a tree of AlignedPair objects.
+ */
+
+#ifndef ALIGNED_PAIR_SET_H_
+#define ALIGNED_PAIR_SET_H_
+
+#include "sonLib.h"
+#include "stPinchIterator.h"
+
+/*
+ * Each pair is held in both directions, as two entries that are each other's reverse. Pairs are added,
+ * then the set is sorted once, into the order of alignedPair_cmpFn, after which entries are found by binary
+ * search. Deleting a pair marks its two entries as deleted, leaving them in the arrays until the next sort.
+ */
+typedef struct _alignedPairSet {
+    int64_t length; //The number of entries, including deleted ones.
+    int64_t size; //The number of entries not deleted.
+    int64_t maxLength;
+    int64_t *subsequenceIdentifiers;
+    int64_t *positions;
+    int64_t *scores;
+    int64_t *reverses; //The index of the entry for the other direction of the pair.
+    uint8_t *strands;
+    uint8_t *deleted;
+    bool sorted;
+} AlignedPairSet;
+
+/*
+ * Constructs an empty set.
+ */
+AlignedPairSet *alignedPairSet_construct(void);
+
+/*
+ * Constructs an empty set with room for the given number of pairs.
+ */
+AlignedPairSet *alignedPairSet_construct2(int64_t pairNumber);
+
+/*
+ * Destructs the set.
+ */
+void alignedPairSet_destruct(AlignedPairSet *alignedPairs);
+
+/*
+ * Adds a pair, as alignedPair_construct. The set is unsorted until alignedPairSet_sort is called.
+ */
+void alignedPairSet_add(AlignedPairSet *alignedPairs, int64_t subsequenceIdentifier1, int64_t position1, bool strand1,
+        int64_t subsequenceIdentifier2, int64_t position2, bool strand2, int64_t score1, int64_t score2);
+
+/*
+ * Appends an entry to a sorted set without deleted entries, keeping it sorted. The entries must be appended in
+ * the order of alignedPair_cmpFn. The reverse is the index of the entry for the other direction of the pair,
+ * which may be appended later, so the set must not be used until every entry has been appended.
+ */
+void alignedPairSet_addSorted(AlignedPairSet *alignedPairs, int64_t subsequenceIdentifier, int64_t position, bool strand,
+        int64_t score, int64_t reverse);
+
+/*
+ * Adds the pairs of alignedPairs2 that are not deleted to alignedPairs.
+ */
+void alignedPairSet_addAll(AlignedPairSet *alignedPairs, AlignedPairSet *alignedPairs2);
+
+/*
+ * Sorts the entries into the order of alignedPair_cmpFn, dropping the deleted ones.
+ */
+void alignedPairSet_sort(AlignedPairSet *alignedPairs);
+
+/*
+ * The number of entries not deleted, which is twice the number of pairs.
+ */
+int64_t alignedPairSet_size(AlignedPairSet *alignedPairs);
+
+/*
+ * Returns the index of the first entry, deleted or not, of the sorted set that is at or after the given
+ * position, or the length of the set if there is none.
+ */
+int64_t alignedPairSet_getFirstFrom(AlignedPairSet *alignedPairs, int64_t subsequenceIdentifier, int64_t position,
+        bool strand);
+
+/*
+ * Returns the index of the next entry after the given one that is not deleted, or the length of the set if
+ * there is none. Pass -1 to get the first.
+ */
+int64_t alignedPairSet_getNext(AlignedPairSet *alignedPairs, int64_t entry);
+
+/*
+ * Deletes the pair of the entry, marking it and its reverse as deleted.
+ */
+void alignedPairSet_delete(AlignedPairSet *alignedPairs, int64_t entry);
+
+/*
+ * Returns non-zero if the two sorted sets hold the same pairs, with the same scores.
+ */
+bool alignedPairSet_equals(AlignedPairSet *alignedPairs, AlignedPairSet *alignedPairs2);
+
+/*
+ * Gets an iterator over the entries of the set that are not deleted, as pinches of length one. Each pair is
+ * returned twice, once from each direction. The set must not be changed while the iterator is in use.
+ */
+stPinchIterator *alignedPairSet_getPinchIterator(AlignedPairSet *alignedPairs);
+
+#endif /* ALIGNED_PAIR_SET_H_ */
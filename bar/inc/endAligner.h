@@ -17,6 +17,7 @@
 #include "sonLib.h"
 #include "cactus.h"
 #include "pairwiseAligner.h"
+#include "alignedPairSet.h"
 
 typedef struct _AlignedPair {
     int64_t subsequenceIdentifier;
@@ -47,19 +48,62 @@ int alignedPair_cmpFn(const AlignedPair *alignedPair1, const AlignedPair *aligne
  * the pairs returned are ordered according
  * to the alignerPair comparison function.
  */
-stSortedSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees, int64_t maxSequenceLength,
+AlignedPairSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees, int64_t maxSequenceLength,
         bool useProgressiveMerging, float gapGamma,
         PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters);
 
+/*
+ * Makes the alignment of each of a list of ends, as makeEndAlignment, aligning up to numThreads ends at once, the
+ * largest first, or one per processor if numThreads is zero. Returns a list of the alignments, in the order of the ends.
+ */
+stList *makeEndAlignments(StateMachine *sM, stList *ends, int64_t spanningTrees, int64_t maxSequenceLength,
+        bool useProgressiveMerging, float gapGamma,
+        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, int64_t numThreads);
+
 /*
  * Writes an end alignment to the given file.
  */
-void writeEndAlignmentToDisk(End *end, stSortedSet *endAlignment, FILE *fileHandle);
+void writeEndAlignmentToDisk(End *end, AlignedPairSet *endAlignment, FILE *fileHandle);
 
 /*
  * Loads an end alignment from the given file.
  */
-stSortedSet *loadEndAlignmentFromDisk(Flower *flower, FILE *fileHandle, End **end);
+AlignedPairSet *loadEndAlignmentFromDisk(Flower *flower, FILE *fileHandle, End **end);
+
+/*
+ * A binary end alignment file holds a set of end alignments compactly, so that it can be mapped into memory and
+ * loaded without parsing or sorting. It is laid out as:
+ *
+ * header: "CACTENDA", version (int64, in the byte order of the machine that wrote the file)
+ * for each end alignment: end name, number of entries and length of the block in bytes, then for each entry of the
+ *      sorted alignment, in order, its subsequence identifier, its position, its score, and its reverse and strand.
+ *
+ * Everything after the header is zig-zag varints. The subsequence identifier is the difference from that of the
+ * entry before. The position is the difference from that of the entry before on the same subsequence. The reverse is
+ * the difference between the index of the reverse entry and that of the entry, shifted up a bit above the strand.
+ * As the entries are written in sorted order the differences are mostly small, and the loader builds the sorted set
+ * directly. The text format is kept for debugging.
+ */
+#define END_ALIGNMENT_FILE_MAGIC "CACTENDA"
+#define END_ALIGNMENT_FILE_VERSION 2
+
+/*
+ * Writes the alignments of the given ends, in the same order, to a binary end alignment file, sorting any that are
+ * not sorted. Aborts if the file can not be written.
+ */
+void writeEndAlignmentsToBinaryFile(stList *ends, stList *endAlignments, const char *binaryFile);
+
+/*
+ * Returns non-zero if the file exists and starts with the magic of a binary end alignment file.
+ */
+bool isBinaryEndAlignmentFile(const char *endAlignmentFile);
+
+/*
+ * Loads the alignments of a binary end alignment file, which is mapped into memory read only, appending the ends
+ * to the list of ends and their alignments to the list of end alignments. Aborts if the file is not a complete
+ * binary end alignment file, or names an end not in the flower.
+ */
+void loadEndAlignmentsFromBinaryFile(Flower *flower, const char *binaryFile, stList *ends, stList *endAlignments);
 
 
 #endif /* ENDALIGNER_H_ */
@@ -15,24 +15,49 @@
 #define FLOWER_ALIGNER_H_
 
 #include "pairwiseAligner.h"
+#include "alignedPairSet.h"
+#include "adjacencySequences.h"
 
 /*
  * Constructs an alignment for the flower by constructing an alignment for each end
  * then filtering the alignments against each other so each position is a member of only one
  * end alignment. Spanning trees controls the number of pairwise alignments used
  * to construct the alignment, maxSequenceLength is the maximum length of a sequence to consider in the end alignment.
- * Model parameters is the parameters of the pairwise alignment model.
+ * Model parameters is the parameters of the pairwise alignment model. Up to numThreads ends are aligned at once.
  */
-stSortedSet *makeFlowerAlignment(StateMachine *sM, Flower *flower, int64_t spanningTrees,
+AlignedPairSet *makeFlowerAlignment(StateMachine *sM, Flower *flower, int64_t spanningTrees,
         int64_t maxSequenceLength, bool useProgressiveMerging, float gapGamma,
-        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, bool pruneOutStubAlignments);
+        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, bool pruneOutStubAlignments,
+        int64_t numThreads);
 
 /*
  * As above, but including alignments from disk.
  */
-stSortedSet *makeFlowerAlignment3(StateMachine *sM, Flower *flower, stList *listOfEndAlignmentFiles, int64_t spanningTrees,
+AlignedPairSet *makeFlowerAlignment3(StateMachine *sM, Flower *flower, stList *listOfEndAlignmentFiles, int64_t spanningTrees,
         int64_t maxSequenceLength, bool useProgressiveMerging, float gapGamma,
-        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, bool pruneOutStubAlignments);
+        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, bool pruneOutStubAlignments,
+        int64_t numThreads);
+
+/*
+ * The entries of an end alignment that lie on an adjacency sequence, in order along it.
+ */
+typedef struct _inducedAlignment {
+    AlignedPairSet *endAlignment;
+    int64_t *entries;
+    int64_t length;
+} InducedAlignment;
+
+/*
+ * Gets the entries of the sorted end alignment on the adjacency sequence that are not deleted.
+ */
+InducedAlignment *getInducedAlignment(AlignedPairSet *endAlignment, AdjacencySequence *adjacencySequence);
+
+/*
+ * Reverses the order of the entries.
+ */
+void inducedAlignment_reverse(InducedAlignment *inducedAlignment);
+
+void inducedAlignment_destruct(InducedAlignment *inducedAlignment);
 
 /*
  * Ascertain which ends should be aligned separately.
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "CuTest.h"
+#include "sonLib.h"
+#include "cactus.h"
+#include "endAligner.h"
+#include "alignedPairSet.h"
+
+/*
+ * Makes a set of random pairs, along with a sorted set holding the same pairs as AlignedPair objects, which
+ * gives the order the set should be sorted into.
+ */
+static AlignedPairSet *getRandomAlignedPairs(stSortedSet *alignedPairsInOrder) {
+    AlignedPairSet *alignedPairs = alignedPairSet_construct();
+    int64_t pairNumber = st_randomInt(0, 500);
+    for (int64_t i = 0; i < pairNumber; i++) {
+        AlignedPair *alignedPair = alignedPair_construct(st_randomInt(0, 5), st_randomInt(0, 50), st_random() > 0.5,
+                st_randomInt(0, 5), st_randomInt(0, 50), st_random() > 0.5, st_randomInt(1, 1000),
+                st_randomInt(1, 1000));
+        if (alignedPair_cmpFn(alignedPair, alignedPair->reverse) != 0 //Not aligned to itself.
+                && stSortedSet_search(alignedPairsInOrder, alignedPair) == NULL) {
+            alignedPairSet_add(alignedPairs, alignedPair->subsequenceIdentifier, alignedPair->position,
+                    alignedPair->strand, alignedPair->reverse->subsequenceIdentifier, alignedPair->reverse->position,
+                    alignedPair->reverse->strand, alignedPair->score, alignedPair->reverse->score);
+            stSortedSet_insert(alignedPairsInOrder, alignedPair);
+            stSortedSet_insert(alignedPairsInOrder, alignedPair->reverse);
+        } else {
+            alignedPair_destruct(alignedPair->reverse);
+            alignedPair_destruct(alignedPair);
+        }
+    }
+    return alignedPairs;
+}
+
+static void checkEntry(CuTest *testCase, AlignedPairSet *alignedPairs, int64_t entry, AlignedPair *alignedPair) {
+    CuAssertIntEquals(testCase, alignedPair->subsequenceIdentifier, alignedPairs->subsequenceIdentifiers[entry]);
+    CuAssertIntEquals(testCase, alignedPair->position, alignedPairs->positions[entry]);
+    CuAssertIntEquals(testCase, alignedPair->strand, alignedPairs->strands[entry]);
+    CuAssertIntEquals(testCase, alignedPair->score, alignedPairs->scores[entry]);
+}
+
+static void testAlignedPairSet_sort(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        stSortedSet *alignedPairsInOrder = stSortedSet_construct3((int (*)(const void *, const void *)) alignedPair_cmpFn,
+                (void (*)(void *)) alignedPair_destruct);
+        AlignedPairSet *alignedPairs = getRandomAlignedPairs(alignedPairsInOrder);
+        alignedPairSet_sort(alignedPairs);
+        CuAssertIntEquals(testCase, stSortedSet_size(alignedPairsInOrder), alignedPairSet_size(alignedPairs));
+        CuAssertIntEquals(testCase, stSortedSet_size(alignedPairsInOrder), alignedPairs->length);
+
+        //Check the entries are in the order of alignedPair_cmpFn, and each is the reverse of its reverse.
+        stSortedSetIterator *it = stSortedSet_getIterator(alignedPairsInOrder);
+        AlignedPair *alignedPair;
+        int64_t i = 0;
+        while ((alignedPair = stSortedSet_getNext(it)) != NULL) {
+            checkEntry(testCase, alignedPairs, i, alignedPair);
+            int64_t j = alignedPairs->reverses[i];
+            CuAssertIntEquals(testCase, i, alignedPairs->reverses[j]);
+            checkEntry(testCase, alignedPairs, j, alignedPair->reverse);
+            i++;
+        }
+        stSortedSet_destructIterator(it);
+
+        alignedPairSet_destruct(alignedPairs);
+        stSortedSet_destruct(alignedPairsInOrder);
+    }
+}
+
+static void testAlignedPairSet_getFirstFrom(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        stSortedSet *alignedPairsInOrder = stSortedSet_construct3((int (*)(const void *, const void *)) alignedPair_cmpFn,
+                (void (*)(void *)) alignedPair_destruct);
+        AlignedPairSet *alignedPairs = getRandomAlignedPairs(alignedPairsInOrder);
+        alignedPairSet_sort(alignedPairs);
+        for (int64_t i = 0; i < 100; i++) {
+            int64_t subsequenceIdentifier = st_randomInt(0, 5), position = st_randomInt(0, 50);
+            bool strand = st_random() > 0.5;
+            //The first entry at or after the position, found by scanning.
+            int64_t j = 0;
+            while (j < alignedPairs->length
+                    && (cactusMisc_nameCompare(alignedPairs->subsequenceIdentifiers[j], subsequenceIdentifier) < 0
+                            || (alignedPairs->subsequenceIdentifiers[j] == subsequenceIdentifier
+                                    && (alignedPairs->positions[j] < position
+                                            || (alignedPairs->positions[j] == position
+                                                    && alignedPairs->strands[j] < strand))))) {
+                j++;
+            }
+            CuAssertIntEquals(testCase, j,
+                    alignedPairSet_getFirstFrom(alignedPairs, subsequenceIdentifier, position, strand));
+        }
+        alignedPairSet_destruct(alignedPairs);
+        stSortedSet_destruct(alignedPairsInOrder);
+    }
+}
+
+static void testAlignedPairSet_delete(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        stSortedSet *alignedPairsInOrder = stSortedSet_construct3((int (*)(const void *, const void *)) alignedPair_cmpFn,
+                (void (*)(void *)) alignedPair_destruct);
+        AlignedPairSet *alignedPairs = getRandomAlignedPairs(alignedPairsInOrder);
+        alignedPairSet_sort(alignedPairs);
+        AlignedPairSet *alignedPairs2 = alignedPairSet_construct();
+        alignedPairSet_addAll(alignedPairs2, alignedPairs);
+        alignedPairSet_sort(alignedPairs2);
+        CuAssertTrue(testCase, alignedPairSet_equals(alignedPairs, alignedPairs2));
+
+        //Delete random pairs from the set, and the same pairs from the sorted set.
+        for (int64_t i = 0; i < alignedPairs->length; i++) {
+            if (!alignedPairs->deleted[i] && st_random() > 0.7) {
+                int64_t j = alignedPairs->reverses[i];
+                AlignedPair *alignedPair = alignedPair_construct(alignedPairs->subsequenceIdentifiers[i],
+                        alignedPairs->positions[i], alignedPairs->strands[i], alignedPairs->subsequenceIdentifiers[j],
+                        alignedPairs->positions[j], alignedPairs->strands[j], 0, 0);
+                AlignedPair *alignedPair2 = stSortedSet_search(alignedPairsInOrder, alignedPair);
+                CuAssertTrue(testCase, alignedPair2 != NULL);
+                stSortedSet_remove(alignedPairsInOrder, alignedPair2->reverse);
+                stSortedSet_remove(alignedPairsInOrder, alignedPair2);
+                alignedPair_destruct(alignedPair2->reverse);
+                alignedPair_destruct(alignedPair2);
+                alignedPair_destruct(alignedPair->reverse);
+                alignedPair_destruct(alignedPair);
+                alignedPairSet_delete(alignedPairs, i);
+            }
+        }
+        CuAssertIntEquals(testCase, stSortedSet_size(alignedPairsInOrder), alignedPairSet_size(alignedPairs));
+
+        //The iterator skips the deleted entries.
+        stSortedSetIterator *it = stSortedSet_getIterator(alignedPairsInOrder);
+        AlignedPair *alignedPair;
+        int64_t i = alignedPairSet_getNext(alignedPairs, -1);
+        while ((alignedPair = stSortedSet_getNext(it)) != NULL) {
+            CuAssertTrue(testCase, i < alignedPairs->length);
+            checkEntry(testCase, alignedPairs, i, alignedPair);
+            i = alignedPairSet_getNext(alignedPairs, i);
+        }
+        CuAssertIntEquals(testCase, alignedPairs->length, i);
+        stSortedSet_destructIterator(it);
+
+        //The pinch iterator gives one pinch per entry that is left, and can be reset.
+        stPinchIterator *pinchIterator = alignedPairSet_getPinchIterator(alignedPairs);
+        for (int64_t j = 0; j < 2; j++) {
+            int64_t pinchNumber = 0;
+            stPinch *pinch;
+            while ((pinch = stPinchIterator_getNext(pinchIterator)) != NULL) {
+                CuAssertIntEquals(testCase, 1, pinch->length);
+                pinchNumber++;
+            }
+            CuAssertIntEquals(testCase, alignedPairSet_size(alignedPairs), pinchNumber);
+            stPinchIterator_reset(pinchIterator);
+        }
+        stPinchIterator_destruct(pinchIterator);
+
+        //Sorting drops the deleted entries.
+        alignedPairSet_sort(alignedPairs);
+        CuAssertIntEquals(testCase, alignedPairSet_size(alignedPairs), alignedPairs->length);
+        it = stSortedSet_getIterator(alignedPairsInOrder);
+        i = 0;
+        while ((alignedPair = stSortedSet_getNext(it)) != NULL) {
+            checkEntry(testCase, alignedPairs, i, alignedPair);
+            CuAssertIntEquals(testCase, i, alignedPairs->reverses[alignedPairs->reverses[i]]);
+            i++;
+        }
+        stSortedSet_destructIterator(it);
+
+        alignedPairSet_destruct(alignedPairs);
+        alignedPairSet_destruct(alignedPairs2);
+        stSortedSet_destruct(alignedPairsInOrder);
+    }
+}
+
+CuSuite* alignedPairSetTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testAlignedPairSet_sort);
+    SUITE_ADD_TEST(suite, testAlignedPairSet_getFirstFrom);
+    SUITE_ADD_TEST(suite, testAlignedPairSet_delete);
+    return suite;
+}
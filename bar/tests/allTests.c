@@ -11,6 +11,7 @@
 #include "sonLib.h"
 
 CuSuite* adjacencySequenceTestSuite(void);
+CuSuite* alignedPairSetTestSuite(void);
 CuSuite* endAlignerTestSuite(void);
 CuSuite* flowerAlignerTestSuite(void);
 CuSuite* rescueTestSuite(void);
@@ -19,6 +20,7 @@ int stBaseAlignerRunAllTests(void) {
 	CuString *output = CuStringNew();
 	CuSuite* suite = CuSuiteNew();
 	CuSuiteAddSuite(suite, adjacencySequenceTestSuite());
+	CuSuiteAddSuite(suite, alignedPairSetTestSuite());
 	CuSuiteAddSuite(suite, endAlignerTestSuite());
 	CuSuiteAddSuite(suite, flowerAlignerTestSuite());
     CuSuiteAddSuite(suite, rescueTestSuite());
@@ -48,18 +48,20 @@ void test_alignedPair_cmpFn(CuTest *testCase) {
     stList_destruct(list);
 }
 
-int64_t isInAdjacencySequence(AlignedPair *alignedPair, AdjacencySequence *adjacencySequence) {
-    if (alignedPair->subsequenceIdentifier == adjacencySequence->subsequenceIdentifier) {
-        if (alignedPair->strand == adjacencySequence->strand) {
-            if (alignedPair->strand) {
-                if (alignedPair->position >= adjacencySequence->start
-                        && alignedPair->position < adjacencySequence->start
+int64_t isInAdjacencySequence(AlignedPairSet *alignedPairs, int64_t entry, AdjacencySequence *adjacencySequence) {
+    int64_t position = alignedPairs->positions[entry];
+    bool strand = alignedPairs->strands[entry];
+    if (alignedPairs->subsequenceIdentifiers[entry] == adjacencySequence->subsequenceIdentifier) {
+        if (strand == adjacencySequence->strand) {
+            if (strand) {
+                if (position >= adjacencySequence->start
+                        && position < adjacencySequence->start
                                 + adjacencySequence->length) {
                     return 1;
                 }
             } else {
-                if (alignedPair->position <= adjacencySequence->start
-                        && alignedPair->position > adjacencySequence->start
+                if (position <= adjacencySequence->start
+                        && position > adjacencySequence->start
                                 - adjacencySequence->length) {
                     return 1;
                 }
@@ -73,7 +75,7 @@ int64_t isInAdjacencySequence(AlignedPair *alignedPair, AdjacencySequence *adjac
 /*
  * Checks that the position referred to is in an adjacency coming from the end.
  */
-int64_t isInAdjacency(AlignedPair *alignedPair, End *end, int64_t maxLength) {
+int64_t isInAdjacency(AlignedPairSet *alignedPairs, int64_t entry, End *end, int64_t maxLength) {
     Cap *cap;
     End_InstanceIterator *it = end_getInstanceIterator(end);
     while ((cap = end_getNext(it)) != NULL) {
@@ -82,7 +84,7 @@ int64_t isInAdjacency(AlignedPair *alignedPair, End *end, int64_t maxLength) {
         }
         AdjacencySequence *adjacencySequence = adjacencySequence_construct(cap,
                 maxLength);
-        int64_t i = isInAdjacencySequence(alignedPair, adjacencySequence);
+        int64_t i = isInAdjacencySequence(alignedPairs, entry, adjacencySequence);
         adjacencySequence_destruct(adjacencySequence);
         if(i) {
             end_destructInstanceIterator(it);
@@ -99,21 +101,19 @@ static void testMakeEndAlignments(CuTest *testCase) {
     int64_t maxLength = 4;
     for (int64_t endIndex = 0; endIndex < 3; endIndex++) {
         End *end = ends[endIndex];
-        stSortedSet *endAlignment = makeEndAlignment(stateMachine, end, 5, maxLength, end_getInstanceNumber(end) > 50, 0.5, pairwiseParameters);
+        AlignedPairSet *endAlignment = makeEndAlignment(stateMachine, end, 5, maxLength, end_getInstanceNumber(end) > 50, 0.5, pairwiseParameters);
 
-        stSortedSetIterator *iterator = stSortedSet_getIterator(endAlignment);
-        AlignedPair *alignedPair;
         //Check pairs are part of valid sequences from end
-
-        while ((alignedPair = stSortedSet_getNext(iterator)) != NULL) {
-            CuAssertTrue(testCase, alignedPair->score > 0); //Check score is valid.
-            CuAssertTrue(testCase, alignedPair->score <= PAIR_ALIGNMENT_PROB_1);
-            CuAssertTrue(testCase, stSortedSet_search(endAlignment, alignedPair->reverse) != NULL); //Check other end is in.
+        for (int64_t i = alignedPairSet_getNext(endAlignment, -1); i < endAlignment->length; i = alignedPairSet_getNext(endAlignment, i)) {
+            CuAssertTrue(testCase, endAlignment->scores[i] > 0); //Check score is valid.
+            CuAssertTrue(testCase, endAlignment->scores[i] <= PAIR_ALIGNMENT_PROB_1);
+            int64_t j = endAlignment->reverses[i];
+            CuAssertTrue(testCase, !endAlignment->deleted[j]); //Check other end is in.
+            CuAssertIntEquals(testCase, i, endAlignment->reverses[j]);
             //Check coordinates are in sequence..
-            CuAssertTrue(testCase, isInAdjacency(alignedPair, end, maxLength));
+            CuAssertTrue(testCase, isInAdjacency(endAlignment, i, end, maxLength));
         }
-        stSortedSet_destructIterator(iterator);
-        stSortedSet_destruct(endAlignment);
+        alignedPairSet_destruct(endAlignment);
     }
     teardown();
 }
@@ -124,7 +124,7 @@ static void testReadAndWriteEndAlignments(CuTest *testCase) {
     int64_t maxLength = 4;
     for (int64_t endIndex = 0; endIndex < 3; endIndex++) {
         End *end = ends[endIndex];
-        stSortedSet *endAlignment = makeEndAlignment(stateMachine, end, 5, maxLength, end_getInstanceNumber(end) > 50, 0.5, pairwiseParameters);
+        AlignedPairSet *endAlignment = makeEndAlignment(stateMachine, end, 5, maxLength, end_getInstanceNumber(end) > 50, 0.5, pairwiseParameters);
         char *temporaryEndAlignmentFile = "temporaryEndAlignmentFile.end";
         FILE *fileHandle = fopen(temporaryEndAlignmentFile, "w");
         writeEndAlignmentToDisk(end, endAlignment, fileHandle);
@@ -132,27 +132,86 @@ static void testReadAndWriteEndAlignments(CuTest *testCase) {
         fclose(fileHandle);
         fileHandle = fopen(temporaryEndAlignmentFile, "r");
         End *end2;
-        stSortedSet *endAlignment2 = loadEndAlignmentFromDisk(flower, fileHandle, &end2);
+        AlignedPairSet *endAlignment2 = loadEndAlignmentFromDisk(flower, fileHandle, &end2);
         CuAssertPtrEquals(testCase, end, end2);
-        stSortedSet *endAlignment3 = loadEndAlignmentFromDisk(flower, fileHandle, &end2);
+        AlignedPairSet *endAlignment3 = loadEndAlignmentFromDisk(flower, fileHandle, &end2);
         CuAssertPtrEquals(testCase, end, end2);
         CuAssertTrue(testCase, loadEndAlignmentFromDisk(flower, fileHandle, &end2) == NULL);
         CuAssertTrue(testCase, end2 == NULL);
         fclose(fileHandle);
-        CuAssertTrue(testCase, stSortedSet_equals(endAlignment, endAlignment2));
-        CuAssertTrue(testCase, stSortedSet_equals(endAlignment, endAlignment3));
-        stSortedSet_destruct(endAlignment);
-        stSortedSet_destruct(endAlignment2);
-        stSortedSet_destruct(endAlignment3);
+        CuAssertTrue(testCase, alignedPairSet_equals(endAlignment, endAlignment2));
+        CuAssertTrue(testCase, alignedPairSet_equals(endAlignment, endAlignment3));
+        alignedPairSet_destruct(endAlignment);
+        alignedPairSet_destruct(endAlignment2);
+        alignedPairSet_destruct(endAlignment3);
         stFile_rmrf(temporaryEndAlignmentFile);
     }
     teardown();
 }
 
+static void testReadAndWriteBinaryEndAlignments(CuTest *testCase) {
+    setup();
+    End *ends[3] = { end1, end2, end3 };
+    int64_t maxLength = 4;
+    stList *endList = stList_construct();
+    stList *endAlignments = stList_construct3(0, (void (*)(void *))alignedPairSet_destruct);
+    for (int64_t endIndex = 0; endIndex < 3; endIndex++) {
+        stList_append(endList, ends[endIndex]);
+        AlignedPairSet *endAlignment = makeEndAlignment(stateMachine, ends[endIndex], 5, maxLength, end_getInstanceNumber(ends[endIndex]) > 50, 0.5, pairwiseParameters);
+        //Deleted pairs are left out of the file.
+        for (int64_t i = alignedPairSet_getNext(endAlignment, -1); i < endAlignment->length; i = alignedPairSet_getNext(endAlignment, i)) {
+            if (st_random() > 0.8) {
+                alignedPairSet_delete(endAlignment, i);
+            }
+        }
+        stList_append(endAlignments, endAlignment);
+    }
+    char *temporaryEndAlignmentFile = "temporaryEndAlignmentFile.bin";
+    writeEndAlignmentsToBinaryFile(endList, endAlignments, temporaryEndAlignmentFile);
+    CuAssertTrue(testCase, isBinaryEndAlignmentFile(temporaryEndAlignmentFile));
+    stList *endList2 = stList_construct();
+    stList *endAlignments2 = stList_construct3(0, (void (*)(void *))alignedPairSet_destruct);
+    loadEndAlignmentsFromBinaryFile(flower, temporaryEndAlignmentFile, endList2, endAlignments2);
+    CuAssertIntEquals(testCase, 3, stList_length(endList2));
+    CuAssertIntEquals(testCase, 3, stList_length(endAlignments2));
+    for (int64_t endIndex = 0; endIndex < 3; endIndex++) {
+        CuAssertPtrEquals(testCase, ends[endIndex], stList_get(endList2, endIndex));
+        AlignedPairSet *endAlignment2 = stList_get(endAlignments2, endIndex);
+        CuAssertTrue(testCase, alignedPairSet_equals(stList_get(endAlignments, endIndex), endAlignment2));
+        //Loaded already sorted, so sorting again changes nothing.
+        AlignedPairSet *endAlignment3 = alignedPairSet_construct();
+        alignedPairSet_addAll(endAlignment3, endAlignment2);
+        alignedPairSet_sort(endAlignment3);
+        CuAssertIntEquals(testCase, endAlignment3->length, endAlignment2->length);
+        for (int64_t i = 0; i < endAlignment2->length; i++) {
+            CuAssertIntEquals(testCase, endAlignment3->subsequenceIdentifiers[i], endAlignment2->subsequenceIdentifiers[i]);
+            CuAssertIntEquals(testCase, endAlignment3->positions[i], endAlignment2->positions[i]);
+            CuAssertIntEquals(testCase, endAlignment3->strands[i], endAlignment2->strands[i]);
+            CuAssertIntEquals(testCase, endAlignment3->reverses[i], endAlignment2->reverses[i]);
+        }
+        alignedPairSet_destruct(endAlignment3);
+    }
+    stFile_rmrf(temporaryEndAlignmentFile);
+
+    //The text format is not mistaken for the binary one.
+    FILE *fileHandle = fopen(temporaryEndAlignmentFile, "w");
+    writeEndAlignmentToDisk(end1, stList_get(endAlignments, 0), fileHandle);
+    fclose(fileHandle);
+    CuAssertTrue(testCase, !isBinaryEndAlignmentFile(temporaryEndAlignmentFile));
+    stFile_rmrf(temporaryEndAlignmentFile);
+
+    stList_destruct(endList);
+    stList_destruct(endAlignments);
+    stList_destruct(endList2);
+    stList_destruct(endAlignments2);
+    teardown();
+}
+
 CuSuite* endAlignerTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testMakeEndAlignments);
     SUITE_ADD_TEST(suite, testReadAndWriteEndAlignments);
+    SUITE_ADD_TEST(suite, testReadAndWriteBinaryEndAlignments);
     SUITE_ADD_TEST(suite, test_alignedPair_cmpFn);
     return suite;
 }
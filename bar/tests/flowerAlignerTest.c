@@ -10,8 +10,6 @@
 #include "adjacencySequences.h"
 #include "pairwiseAligner.h"
 
-stList *getInducedAlignment(stSortedSet *endAlignment, AdjacencySequence *adjacencySequence);
-
 static int getRandomPosition(AdjacencySequence *adjacencySequence) {
     if(adjacencySequence->strand) {
         return st_randomInt(adjacencySequence->start, adjacencySequence->start + adjacencySequence->length);
@@ -21,19 +19,15 @@ static int getRandomPosition(AdjacencySequence *adjacencySequence) {
     }
 }
 
-int64_t isInAdjacencySequence(AlignedPair *alignedPair, AdjacencySequence *adjacencySequence);
+int64_t isInAdjacencySequence(AlignedPairSet *alignedPairs, int64_t entry, AdjacencySequence *adjacencySequence);
 
-stList *getinducedAlignment2(stSortedSet *endAlignment, AdjacencySequence *adjacencySequence) {
-    stList *inducedAlignment = stList_construct();
-    stSortedSetIterator *it = stSortedSet_getIterator(endAlignment);
-    AlignedPair *alignedPair;
-    while((alignedPair = stSortedSet_getNext(it)) != NULL) {
-        if(isInAdjacencySequence(alignedPair, adjacencySequence)) {
-            stList_append(inducedAlignment, alignedPair);
+stList *getinducedAlignment2(AlignedPairSet *endAlignment, AdjacencySequence *adjacencySequence) {
+    stList *inducedAlignment = stList_construct3(0, (void (*)(void *))stIntTuple_destruct);
+    for(int64_t i=alignedPairSet_getNext(endAlignment, -1); i<endAlignment->length; i=alignedPairSet_getNext(endAlignment, i)) {
+        if(isInAdjacencySequence(endAlignment, i, adjacencySequence)) {
+            stList_append(inducedAlignment, stIntTuple_construct1(i));
         }
     }
-    stSortedSet_destructIterator(it);
-    stList_sort(inducedAlignment, (int (*)(const void *, const void *))alignedPair_cmpFn);
     if(!adjacencySequence->strand) {
         stList_reverse(inducedAlignment);
     }
@@ -44,7 +38,8 @@ void test_getInducedAlignment(CuTest *testCase) {
     for(int64_t test=0; test<100; test++) {
         setup();
 
-        stSortedSet *sortedAlignment = stSortedSet_construct3((int (*)(const void *, const void *))alignedPair_cmpFn,
+        AlignedPairSet *sortedAlignment = alignedPairSet_construct();
+        stSortedSet *pairsAdded = stSortedSet_construct3((int (*)(const void *, const void *))alignedPair_cmpFn,
                        (void (*)(void *))alignedPair_destruct);
 
 
@@ -65,44 +60,63 @@ void test_getInducedAlignment(CuTest *testCase) {
                         alignedPair_construct(aS1->subsequenceIdentifier, getRandomPosition(aS1), aS1->strand,
                                               aS2->subsequenceIdentifier, getRandomPosition(aS2), aS2->strand,
                                               st_randomInt(0, PAIR_ALIGNMENT_PROB_1), st_randomInt(0, PAIR_ALIGNMENT_PROB_1));
-                stSortedSet_insert(sortedAlignment, alignedPair);
-                stSortedSet_insert(sortedAlignment, alignedPair->reverse);
+                if(stSortedSet_search(pairsAdded, alignedPair) == NULL) { //The set holds each pair once.
+                    alignedPairSet_add(sortedAlignment, alignedPair->subsequenceIdentifier, alignedPair->position,
+                            alignedPair->strand, alignedPair->reverse->subsequenceIdentifier,
+                            alignedPair->reverse->position, alignedPair->reverse->strand, alignedPair->score,
+                            alignedPair->reverse->score);
+                    stSortedSet_insert(pairsAdded, alignedPair);
+                    stSortedSet_insert(pairsAdded, alignedPair->reverse);
+                }
+                else {
+                    alignedPair_destruct(alignedPair->reverse);
+                    alignedPair_destruct(alignedPair);
+                }
+            }
+        }
+        alignedPairSet_sort(sortedAlignment);
+        //Delete some of the pairs, which the induced alignments should skip.
+        for(int64_t i=0; i<sortedAlignment->length; i++) {
+            if(!sortedAlignment->deleted[i] && st_random() > 0.8) {
+                alignedPairSet_delete(sortedAlignment, i);
             }
         }
 
         for(int64_t i=0; i<stList_length(adjacencySequences); i++) {
             AdjacencySequence *adjacencySequence = stList_get(adjacencySequences, i);
-            stList *inducedAlignment = getInducedAlignment(sortedAlignment, adjacencySequence);
+            InducedAlignment *inducedAlignment = getInducedAlignment(sortedAlignment, adjacencySequence);
             stList *inducedAlignment2 = getinducedAlignment2(sortedAlignment, adjacencySequence);
 
-            /*st_logInfo("The lengths are %" PRIi64 " %" PRIi64 "\n", stList_length(inducedAlignment), stList_length(inducedAlignment2));
-            st_logInfo("Adj %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 "\n", adjacencySequence->sequenceName, adjacencySequence->start, adjacencySequence->length, adjacencySequence->strand);
-
-            for(int64_t j=0; j<stList_length(inducedAlignment); j++) {
-                AlignedPair *aP = stList_get(inducedAlignment, j);
-                st_logInfo("Hello %" PRIi64 " %" PRIi64 " %" PRIi64 "\n", aP->sequence, aP->position, aP->strand);
-            }
-
-            for(int64_t j=0; j<stList_length(inducedAlignment2); j++) {
-                AlignedPair *aP = stList_get(inducedAlignment2, j);
-                st_logInfo("Goodbye %" PRIi64 " %" PRIi64 " %" PRIi64 "\n", aP->sequence, aP->position, aP->strand);
-            }*/
-
-            CuAssertTrue(testCase, stList_length(inducedAlignment) == stList_length(inducedAlignment2));
-            for(int64_t j=0; j<stList_length(inducedAlignment); j++) {
-                CuAssertTrue(testCase, stList_get(inducedAlignment, j) == stList_get(inducedAlignment2, j));
+            CuAssertTrue(testCase, inducedAlignment->length == stList_length(inducedAlignment2));
+            for(int64_t j=0; j<inducedAlignment->length; j++) {
+                CuAssertTrue(testCase, inducedAlignment->entries[j] == stIntTuple_get(stList_get(inducedAlignment2, j), 0));
             }
 
-            stList_destruct(inducedAlignment);
+            inducedAlignment_destruct(inducedAlignment);
             stList_destruct(inducedAlignment2);
         }
 
         //cleanup
-        stSortedSet_destruct(sortedAlignment);
+        alignedPairSet_destruct(sortedAlignment);
+        stSortedSet_destruct(pairsAdded);
+        stList_destruct(adjacencySequences);
         teardown();
     }
 }
 
+/*
+ * Checks each entry of the set is valid, and is the reverse of its reverse.
+ */
+static void checkFlowerAlignment(CuTest *testCase, AlignedPairSet *flowerAlignment) {
+    for(int64_t i=alignedPairSet_getNext(flowerAlignment, -1); i<flowerAlignment->length; i=alignedPairSet_getNext(flowerAlignment, i)) {
+        CuAssertTrue(testCase, flowerAlignment->scores[i] > 0); //Check score is valid
+        CuAssertTrue(testCase, flowerAlignment->scores[i] <= PAIR_ALIGNMENT_PROB_1);
+        int64_t j = flowerAlignment->reverses[i];
+        CuAssertTrue(testCase, !flowerAlignment->deleted[j]); //Check other end is in.
+        CuAssertIntEquals(testCase, i, flowerAlignment->reverses[j]);
+    }
+}
+
 /*
  * Just runs the flower alignment through, doesn't really check its okay.
  */
@@ -110,18 +124,109 @@ void test_flowerAlignerRandom(CuTest *testCase) {
     setup();
     int64_t maxLength = 5;
     StateMachine *sM = stateMachine5_construct(fiveState);
-    stSortedSet *flowerAlignment = makeFlowerAlignment(sM, flower, 5, maxLength, 1, 0.5, pairwiseParameters, st_random() > 0.5);
+    AlignedPairSet *flowerAlignment = makeFlowerAlignment(sM, flower, 5, maxLength, 1, 0.5, pairwiseParameters, st_random() > 0.5, 1);
     stateMachine_destruct(sM);
     //Check the aligned pairs are all good..
-    stSortedSetIterator *iterator = stSortedSet_getIterator(flowerAlignment);
-    AlignedPair *alignedPair;
-    while((alignedPair = stSortedSet_getNext(iterator)) != NULL) {
-        CuAssertTrue(testCase, alignedPair->score > 0); //Check score is valid
-        CuAssertTrue(testCase, alignedPair->score <= PAIR_ALIGNMENT_PROB_1);
-        CuAssertTrue(testCase, stSortedSet_search(flowerAlignment, alignedPair->reverse) != NULL); //Check other end is in.
+    checkFlowerAlignment(testCase, flowerAlignment);
+    alignedPairSet_destruct(flowerAlignment);
+
+    teardown();
+}
+
+typedef struct _capHeap CapHeap;
+CapHeap *capHeap_construct(stList *caps);
+void capHeap_destruct(CapHeap *capHeap);
+Cap *capHeap_pop(CapHeap *capHeap);
+void updateDeletedPairs(int64_t subsequenceIdentifier, CapHeap *capHeap);
+
+/*
+ * Checks the caps come out of the heap in the order they came from the scan it replaced, which picked the cap with the
+ * most deleted pairs, going to the later cap on ties.
+ */
+void test_capHeap(CuTest *testCase) {
+    for(int64_t test=0; test<100; test++) {
+        setup();
+        stList *caps = stList_construct();
+        End *end;
+        Flower_EndIterator *endIterator = flower_getEndIterator(flower);
+        while((end = flower_getNextEnd(endIterator)) != NULL) {
+            Cap *cap;
+            End_InstanceIterator *capIterator = end_getInstanceIterator(end);
+            while((cap = end_getNext(capIterator)) != NULL) {
+                if(cap_getSide(cap)) {
+                    cap = cap_getReverse(cap);
+                }
+                if(cap_getStrand(cap)) {
+                    stList_append(caps, cap);
+                }
+            }
+            end_destructInstanceIterator(capIterator);
+        }
+        flower_destructEndIterator(endIterator);
+        for(int64_t i=stList_length(caps)-1; i>0; i--) {
+            int64_t j = st_randomInt(0, i+1);
+            Cap *cap = stList_get(caps, i);
+            stList_set(caps, i, stList_get(caps, j));
+            stList_set(caps, j, cap);
+        }
+
+        CapHeap *capHeap = capHeap_construct(caps);
+        stHash *deletedAlignedPairCounts = stHash_construct2(NULL, free);
+        while(1) {
+            //Delete some pairs, from caps that may already have been cut.
+            while(stList_length(caps) > 0 && st_random() > 0.3) {
+                Cap *cap = stList_get(caps, st_randomInt(0, stList_length(caps)));
+                int64_t *count = stHash_search(deletedAlignedPairCounts, cap);
+                if(count == NULL) {
+                    count = st_calloc(1, sizeof(int64_t));
+                    stHash_insert(deletedAlignedPairCounts, cap, count);
+                }
+                (*count)++;
+                updateDeletedPairs(cap_getName(cap), capHeap);
+            }
+            Cap *cap = capHeap_pop(capHeap);
+            if(stList_length(caps) == 0) {
+                CuAssertPtrEquals(testCase, NULL, cap);
+                break;
+            }
+            int64_t capIndex = 0, deletedPairsForChosenCap = 0;
+            for(int64_t i=0; i<stList_length(caps); i++) {
+                int64_t *count = stHash_search(deletedAlignedPairCounts, stList_get(caps, i));
+                if(count != NULL && *count >= deletedPairsForChosenCap) {
+                    capIndex = i;
+                    deletedPairsForChosenCap = *count;
+                }
+                else if(deletedPairsForChosenCap == 0) {
+                    capIndex = i;
+                }
+            }
+            CuAssertPtrEquals(testCase, stList_get(caps, capIndex), cap);
+            stList_remove(caps, capIndex);
+        }
+        capHeap_destruct(capHeap);
+        stHash_destruct(deletedAlignedPairCounts);
+        stList_destruct(caps);
+        teardown();
     }
-    stSortedSet_destructIterator(iterator);
-    stSortedSet_destruct(flowerAlignment);
+}
+
+/*
+ * Checks the ends aligned on several threads give the same flower alignment as those aligned one after another.
+ * The spanning trees are enough to include every pairwise alignment, so the alignments of the ends are not random.
+ */
+void test_flowerAlignerInParallel(CuTest *testCase) {
+    setup();
+    StateMachine *sM = stateMachine5_construct(fiveState);
+    bool pruneOutStubAlignments = st_random() > 0.5;
+    AlignedPairSet *flowerAlignment = makeFlowerAlignment(sM, flower, 1000, 5, 1, 0.5, pairwiseParameters,
+            pruneOutStubAlignments, 1);
+    AlignedPairSet *flowerAlignment2 = makeFlowerAlignment(sM, flower, 1000, 5, 1, 0.5, pairwiseParameters,
+            pruneOutStubAlignments, 4);
+    stateMachine_destruct(sM);
+    checkFlowerAlignment(testCase, flowerAlignment2);
+    CuAssertTrue(testCase, alignedPairSet_equals(flowerAlignment, flowerAlignment2));
+    alignedPairSet_destruct(flowerAlignment);
+    alignedPairSet_destruct(flowerAlignment2);
 
     teardown();
 }
@@ -130,5 +235,7 @@ CuSuite* flowerAlignerTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, test_getInducedAlignment);
     SUITE_ADD_TEST(suite, test_flowerAlignerRandom);
+    SUITE_ADD_TEST(suite, test_capHeap);
+    SUITE_ADD_TEST(suite, test_flowerAlignerInParallel);
     return suite;
 }
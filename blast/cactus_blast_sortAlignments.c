@@ -11,8 +11,20 @@ int main(int argc, char *argv[]) {
 	/*
 	 * Sort cigar file in descending order of score.
 	 */
-	assert(argc == 4);
+	/*
+	 * Optionally followed by the memory budget in bytes, the number of sorting threads (zero for one per
+	 * processor) and the directory for temporary files.
+	 */
+	assert(argc >= 4 && argc <= 7);
 	st_setLogLevelFromString(argv[1]);
+	if (argc > 4) {
+		int64_t memoryBudget, threadNumber = 0;
+		if (sscanf(argv[4], "%" PRIi64, &memoryBudget) != 1
+				|| (argc > 5 && sscanf(argv[5], "%" PRIi64, &threadNumber) != 1)) {
+			st_errAbort("Error parsing the memory budget or thread number of the sort");
+		}
+		stCaf_setCigarSortParameters(memoryBudget, threadNumber, argc > 6 ? argv[6] : NULL);
+	}
 	stCaf_sortCigarsFileByScoreInDescendingOrder(argv[2], argv[3]);
 	return 0;
 }
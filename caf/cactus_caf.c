@@ -21,7 +21,7 @@
 static void usage() {
     fprintf(stderr, "cactus_caf, version 0.2\n");
     fprintf(stderr, "-a --logLevel : Set the log level\n");
-    fprintf(stderr, "-b --alignments : The input alignments file\n");
+    fprintf(stderr, "-b --alignments : The input alignments file, either cigars or a binary pinch file from cactus_convertAlignmentsToPinchFile\n");
     fprintf(stderr, "-c --cactusDisk : The location of the flower disk directory\n");
     fprintf(stderr, "-d --lastzArguments : Lastz arguments\n");
     fprintf(stderr, "-h --help : Print this help screen\n");
@@ -93,6 +93,22 @@ static void usage() {
     fprintf(stderr, "-T --minimumBlockHomologySupport: Minimum fraction of possible homologies required not to be considered a transitively collapsed megablock.\n");
     fprintf(stderr, "-U --phylogenyNucleotideScalingFactor: Weighting for the nucleotide information in the distance matrix used to build each tree.\n");
     fprintf(stderr, "-V --minimumBlockDegreeToCheckSupport: Minimum degree required to be checked for being a megablock.\n");
+    fprintf(stderr, "--writeThreads : Number of threads used to serialise and compress the flowers written back to the cactus disk. Default 1.\n");
+    fprintf(stderr, "--sortMemory : Memory budget in bytes for sorting the alignments by score. Default 1GB.\n");
+    fprintf(stderr, "--sortThreads : Number of threads sorting the alignments, zero for one per processor. Default 0.\n");
+    fprintf(stderr, "--sortTempDir : Directory for the temporary files of the alignment sort. Default is the directory of the sorted alignments.\n");
+    fprintf(stderr, "--incrementalMelting : Melt the rounds of each annealing round from one cactus graph, rather than rebuilding it for every round.\n");
+    fprintf(stderr, "--annealingThreads : Number of threads annealing the alignments of the later annealing rounds, zero for one per processor. Not used with the hgvm alignment filter. Default 1.\n");
+    fprintf(stderr, "--checkpointFile : File to which the pinch graph is written after each annealing round.\n");
+    fprintf(stderr, "--resumeFromCheckpoint : If the checkpoint file exists, restore the pinch graph from it and carry on from the annealing round after it. Not supported with the hgvm alignment filter.\n");
+}
+
+/*
+ * The hgvm filter unions the components of the threads as it accepts pinches, so its result depends on the order
+ * of all the pinches, and it must anneal with one thread.
+ */
+static int64_t getAnnealingThreads(bool (*filterFn)(stPinchSegment *, stPinchSegment *), int64_t annealingThreads) {
+    return filterFn == stCaf_filterToEnsureCycleFreeIsolatedComponents ? 1 : annealingThreads;
 }
 
 static int64_t *getInts(const char *string, int64_t *arrayLength) {
@@ -275,6 +291,32 @@ static void printThreadSetStatistics(stPinchThreadSet *threadSet, Flower *flower
     free(blockSupports);
 }
 
+/*
+ * Gets an iterator over a file of cigar alignments or a binary pinch file. A cigar file is converted to a
+ * temporary binary pinch file, so that each annealing round scans the mapped pinches rather than parsing the
+ * text again.
+ */
+static stPinchIterator *getPinchIteratorForAlignmentsFile(char *alignmentsFile, bool sortAlignments, stList *tempFiles) {
+    if (stPinchIterator_isBinaryFile(alignmentsFile)) {
+        if (sortAlignments && !stPinchIterator_isBinaryFileSortedByScore(alignmentsFile)) {
+            st_errAbort("The binary pinch file %s must be sorted by score for the chosen filter, "
+                    "create it with cactus_convertAlignmentsToPinchFile --sort\n", alignmentsFile);
+        }
+        return stPinchIterator_constructFromBinaryFile(alignmentsFile);
+    }
+    if (sortAlignments) {
+        char *sortedFile = getTempFile();
+        stList_append(tempFiles, sortedFile);
+        stCaf_sortCigarsFileByScoreInDescendingOrder(alignmentsFile, sortedFile);
+        alignmentsFile = sortedFile;
+    }
+    char *binaryFile = getTempFile();
+    stList_append(tempFiles, binaryFile);
+    stPinchIterator_convertCigarFileToBinaryFile(alignmentsFile, binaryFile, sortAlignments);
+    st_logInfo("Converted the alignments in %s to the binary pinch file %s\n", alignmentsFile, binaryFile);
+    return stPinchIterator_constructFromBinaryFile(binaryFile);
+}
+
 int main(int argc, char *argv[]) {
     /*
      * Script for adding alignments to cactus tree.
@@ -342,6 +384,14 @@ int main(int argc, char *argv[]) {
     const char *referenceEventHeader = NULL;
     double phylogenyDoSplitsWithSupportHigherThanThisAllAtOnce = 1.0;
     int64_t numTreeBuildingThreads = 2;
+    int64_t writeThreads = 1;
+    int64_t sortMemory = 1073741824;
+    int64_t sortThreads = 0;
+    char *sortTempDir = NULL;
+    bool incrementalMelting = 0;
+    int64_t annealingThreads = 1;
+    char *checkpointFile = NULL;
+    bool resumeFromCheckpoint = 0;
     int64_t minimumBlockDegreeToCheckSupport = 10;
     double minimumBlockHomologySupport = 0.7;
     double nucleotideScalingFactor = 1.0;
@@ -404,6 +454,14 @@ int main(int argc, char *argv[]) {
 				{ "maxRecoverableChainsIterations", required_argument, 0, '1' },
 				{ "maxRecoverableChainLength", required_argument, 0, '2' },
 				{ "secondaryAlignments", required_argument, 0, '3' },
+				{ "writeThreads", required_argument, 0, '4' },
+				{ "sortMemory", required_argument, 0, '5' },
+				{ "sortThreads", required_argument, 0, '6' },
+				{ "sortTempDir", required_argument, 0, '7' },
+				{ "incrementalMelting", no_argument, 0, '8' },
+				{ "annealingThreads", required_argument, 0, '9' },
+				{ "checkpointFile", required_argument, 0, '0' },
+				{ "resumeFromCheckpoint", no_argument, 0, 'u' },
 				{ 0, 0, 0, 0 } };
 
         int option_index = 0;
@@ -697,6 +755,42 @@ int main(int argc, char *argv[]) {
             case '3':
                 secondaryAlignmentsFile = stString_copy(optarg);
                 break;
+            case '4':
+                k = sscanf(optarg, "%" PRIi64, &writeThreads);
+                if (k != 1 || writeThreads < 1) {
+                    st_errAbort("Error parsing the writeThreads argument");
+                }
+                break;
+            case '5':
+                k = sscanf(optarg, "%" PRIi64, &sortMemory);
+                if (k != 1 || sortMemory < 1) {
+                    st_errAbort("Error parsing the sortMemory argument");
+                }
+                break;
+            case '6':
+                k = sscanf(optarg, "%" PRIi64, &sortThreads);
+                if (k != 1 || sortThreads < 0) {
+                    st_errAbort("Error parsing the sortThreads argument");
+                }
+                break;
+            case '7':
+                sortTempDir = stString_copy(optarg);
+                break;
+            case '8':
+                incrementalMelting = 1;
+                break;
+            case '9':
+                k = sscanf(optarg, "%" PRIi64, &annealingThreads);
+                if (k != 1 || annealingThreads < 0) {
+                    st_errAbort("Error parsing the annealingThreads argument");
+                }
+                break;
+            case '0':
+                checkpointFile = stString_copy(optarg);
+                break;
+            case 'u':
+                resumeFromCheckpoint = 1;
+                break;
             default:
                 usage();
                 return 1;
@@ -726,12 +820,22 @@ int main(int argc, char *argv[]) {
     }
     assert(minimumOutgroupDegree >= 0);
     assert(minimumIngroupDegree >= 0);
+    if (checkpointFile != NULL && alignmentsFile == NULL) {
+        st_errAbort("A checkpoint file can only be used with an alignments file");
+    }
+    if (resumeFromCheckpoint && checkpointFile == NULL) {
+        st_errAbort("Resuming from a checkpoint needs a checkpoint file");
+    }
+    if (resumeFromCheckpoint && filterFn == stCaf_filterToEnsureCycleFreeIsolatedComponents) {
+        st_errAbort("Resuming from a checkpoint is not supported with the hgvm alignment filter");
+    }
 
     //////////////////////////////////////////////
     //Set up logging
     //////////////////////////////////////////////
 
     st_setLogLevelFromString(logLevelString);
+    stCaf_setCigarSortParameters(sortMemory, sortThreads, sortTempDir);
 
     //////////////////////////////////////////////
     //Log (some of) the inputs
@@ -745,15 +849,17 @@ int main(int argc, char *argv[]) {
 
     kvDatabaseConf = stKVDatabaseConf_constructFromString(cactusDiskDatabaseString);
     cactusDisk = cactusDisk_construct(kvDatabaseConf, false, true);
+    cactusDisk_setWriteThreads(cactusDisk, writeThreads);
     st_logInfo("Set up the flower disk\n");
 
     ///////////////////////////////////////////////////////////////////////////
     // Get the constraints
     ///////////////////////////////////////////////////////////////////////////
 
+    stList *tempFiles = stList_construct3(0, free);
     stPinchIterator *pinchIteratorForConstraints = NULL;
     if (constraintsFile != NULL) {
-        pinchIteratorForConstraints = stPinchIterator_constructFromFile(constraintsFile);
+        pinchIteratorForConstraints = getPinchIteratorForAlignmentsFile(constraintsFile, 0, tempFiles);
         st_logInfo("Created an iterator for the alignment constaints from file: %s\n", constraintsFile);
     }
 
@@ -793,16 +899,10 @@ int main(int argc, char *argv[]) {
                 assert(i == 0);
                 assert(stList_length(flowers) == 1);
 
-                if (sortAlignments) {
-                    tempFile1 = getTempFile();
-                    stCaf_sortCigarsFileByScoreInDescendingOrder(alignmentsFile, tempFile1);
-                    pinchIterator = stPinchIterator_constructFromFile(tempFile1);
-                } else {
-                    pinchIterator = stPinchIterator_constructFromFile(alignmentsFile);
-                }
+                pinchIterator = getPinchIteratorForAlignmentsFile(alignmentsFile, sortAlignments, tempFiles);
 
                 if(secondaryAlignmentsFile != NULL) {
-                	secondaryPinchIterator = stPinchIterator_constructFromFile(secondaryAlignmentsFile);
+                	secondaryPinchIterator = getPinchIteratorForAlignmentsFile(secondaryAlignmentsFile, 0, tempFiles);
                 }
 
             } else {
@@ -820,7 +920,23 @@ int main(int argc, char *argv[]) {
                 pinchIterator = stPinchIterator_constructFromList(alignmentsList);
             }
 
-            for (int64_t annealingRound = 0; annealingRound < annealingRoundsLength; annealingRound++) {
+            //Carry on after the rounds done before the job was stopped.
+            int64_t firstAnnealingRound = 0;
+            if (resumeFromCheckpoint && stFile_exists(checkpointFile)) {
+                firstAnnealingRound = stCaf_readPinchGraphCheckpoint(flower, threadSet, checkpointFile);
+                if (firstAnnealingRound < 0) { //Start again, so the blocks are those of a job that was not stopped.
+                    stPinchThreadSet_destruct(threadSet);
+                    threadSet = stCaf_constructEmptyPinchGraph(flower); //The flower is already set up.
+                    stSet_destruct(outgroupThreads);
+                    outgroupThreads = stCaf_getOutgroupThreads(flower, threadSet);
+                    firstAnnealingRound = 0;
+                } else {
+                    printf("Sequence graph statistics after restoring %" PRIi64 " annealing rounds:\n", firstAnnealingRound);
+                    printThreadSetStatistics(threadSet, flower, stdout);
+                }
+            }
+
+            for (int64_t annealingRound = firstAnnealingRound; annealingRound < annealingRoundsLength; annealingRound++) {
                 int64_t minimumChainLength = annealingRounds[annealingRound];
                 int64_t alignmentTrim = annealingRound < alignmentTrimLength ? alignmentTrims[annealingRound] : 0;
                 st_logDebug("Starting annealing round with a minimum chain length of %" PRIi64 " and an alignment trim of %" PRIi64 "\n", minimumChainLength, alignmentTrim);
@@ -839,7 +955,8 @@ int main(int argc, char *argv[]) {
                 if (annealingRound == 0) {
                     stCaf_anneal(threadSet, pinchIterator, filterFn);
                 } else {
-                    stCaf_annealBetweenAdjacencyComponents(threadSet, pinchIterator, filterFn);
+                    stCaf_annealBetweenAdjacencyComponentsInParallel(threadSet, pinchIterator, filterFn,
+                            getAnnealingThreads(filterFn, annealingThreads));
                 }
 
                 // Do the secondary annealing
@@ -847,7 +964,8 @@ int main(int argc, char *argv[]) {
 					if (annealingRound == 0) {
 						stCaf_anneal(threadSet, secondaryPinchIterator, secondaryFilterFn);
 					} else {
-						stCaf_annealBetweenAdjacencyComponents(threadSet, secondaryPinchIterator, secondaryFilterFn);
+						stCaf_annealBetweenAdjacencyComponentsInParallel(threadSet, secondaryPinchIterator, secondaryFilterFn,
+								getAnnealingThreads(secondaryFilterFn, annealingThreads));
 					}
                 }
 
@@ -883,17 +1001,42 @@ int main(int argc, char *argv[]) {
                 }
 
                 //Do the melting rounds
-                for (int64_t meltingRound = 0; meltingRound < meltingRoundsLength; meltingRound++) {
-                    int64_t minimumChainLengthForMeltingRound = meltingRounds[meltingRound];
-                    st_logDebug("Starting melting round with a minimum chain length of %" PRIi64 " \n", minimumChainLengthForMeltingRound);
-                    if (minimumChainLengthForMeltingRound >= minimumChainLength) {
-                        break;
+                if (incrementalMelting) {
+                    //The rounds, and the last round unless it breaks chains, share one cactus graph.
+                    bool breakChains = breakChainsAtReverseTandems || maximumMedianSequenceLengthBetweenLinkedEnds < INT64_MAX;
+                    int64_t *minimumChainLengths = st_malloc((meltingRoundsLength + 1) * sizeof(int64_t));
+                    int64_t minimumChainLengthsLength = 0;
+                    while (minimumChainLengthsLength < meltingRoundsLength && meltingRounds[minimumChainLengthsLength] < minimumChainLength) {
+                        minimumChainLengths[minimumChainLengthsLength] = meltingRounds[minimumChainLengthsLength];
+                        minimumChainLengthsLength++;
+                    }
+                    if (!breakChains) {
+                        minimumChainLengths[minimumChainLengthsLength++] = minimumChainLength;
                     }
-                    stCaf_melt(flower, threadSet, NULL, 0, minimumChainLengthForMeltingRound, 0, INT64_MAX);
-                } st_logDebug("Last melting round of cycle with a minimum chain length of %" PRIi64 " \n", minimumChainLength);
-                stCaf_melt(flower, threadSet, NULL, 0, minimumChainLength, breakChainsAtReverseTandems, maximumMedianSequenceLengthBetweenLinkedEnds);
+                    st_logDebug("Starting %" PRIi64 " incremental melting rounds\n", minimumChainLengthsLength);
+                    stCaf_meltIncrementally(flower, threadSet, minimumChainLengths, minimumChainLengthsLength);
+                    free(minimumChainLengths);
+                    if (breakChains) {
+                        st_logDebug("Last melting round of cycle with a minimum chain length of %" PRIi64 " \n", minimumChainLength);
+                        stCaf_melt(flower, threadSet, NULL, 0, minimumChainLength, breakChainsAtReverseTandems, maximumMedianSequenceLengthBetweenLinkedEnds);
+                    }
+                } else {
+                    for (int64_t meltingRound = 0; meltingRound < meltingRoundsLength; meltingRound++) {
+                        int64_t minimumChainLengthForMeltingRound = meltingRounds[meltingRound];
+                        st_logDebug("Starting melting round with a minimum chain length of %" PRIi64 " \n", minimumChainLengthForMeltingRound);
+                        if (minimumChainLengthForMeltingRound >= minimumChainLength) {
+                            break;
+                        }
+                        stCaf_melt(flower, threadSet, NULL, 0, minimumChainLengthForMeltingRound, 0, INT64_MAX);
+                    } st_logDebug("Last melting round of cycle with a minimum chain length of %" PRIi64 " \n", minimumChainLength);
+                    stCaf_melt(flower, threadSet, NULL, 0, minimumChainLength, breakChainsAtReverseTandems, maximumMedianSequenceLengthBetweenLinkedEnds);
+                }
                 //This does the filtering of blocks that do not have the required species/tree-coverage/degree.
                 stCaf_melt(flower, threadSet, blockFilterFn, blockTrim, 0, 0, INT64_MAX);
+
+                if (checkpointFile != NULL) {
+                    stCaf_writePinchGraphCheckpoint(flower, threadSet, annealingRound + 1, checkpointFile);
+                }
             }
 
             if (removeRecoverableChains) {
@@ -967,13 +1110,14 @@ int main(int argc, char *argv[]) {
             //Finish up
             stCaf_finish(flower, threadSet, chainLengthForBigFlower, longChain, minLengthForChromosome,
                     proportionOfUnalignedBasesForNewChromosome); //Flower is then destroyed at this point.
+            stCaf_setFlowerForAlignmentFiltering(NULL);
             st_logInfo("Ran the cactus core script\n");
 
             //Cleanup
             stPinchThreadSet_destruct(threadSet);
             stPinchIterator_destruct(pinchIterator);
             if(secondaryPinchIterator != NULL) {
-            	free(secondaryPinchIterator);
+            	stPinchIterator_destruct(secondaryPinchIterator);
             }
             stSet_destruct(outgroupThreads);
 
@@ -993,6 +1137,10 @@ int main(int argc, char *argv[]) {
     if (constraintsFile != NULL) {
         stPinchIterator_destruct(pinchIteratorForConstraints);
     }
+    for (int64_t i = 0; i < stList_length(tempFiles); i++) {
+        st_system("rm %s", stList_get(tempFiles, i));
+    }
+    stList_destruct(tempFiles);
 
     ///////////////////////////////////////////////////////////////////////////
     // Write the flower to disk.
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <getopt.h>
+#include "cactus.h"
+#include "sonLib.h"
+#include "commonC.h"
+#include "stPinchIterator.h"
+#include "stLastzAlignments.h"
+
+static void usage(void) {
+    fprintf(stderr, "cactus_convertAlignmentsToPinchFile [--sort] cigarFile pinchFile\n");
+    fprintf(stderr, "Converts a file of cigar alignments into a binary pinch file that cactus_caf can read "
+            "with --alignments or --secondaryAlignments without parsing it on every annealing round.\n");
+    fprintf(stderr, "-s --sort : Sort the alignments by descending score first, as cactus_caf does for "
+            "filters that need sorted alignments\n");
+    fprintf(stderr, "-a --logLevel : Set the log level\n");
+    fprintf(stderr, "-h --help : Print this help screen\n");
+}
+
+int main(int argc, char *argv[]) {
+    char *logLevelString = NULL;
+    bool sortAlignments = 0;
+    struct option longopts[] = { { "sort", no_argument, NULL, 's' }, { "logLevel", required_argument, NULL, 'a' },
+            { "help", no_argument, NULL, 'h' }, { 0, 0, 0, 0 } };
+    int flag;
+    while ((flag = getopt_long(argc, argv, "sa:h", longopts, NULL)) != -1) {
+        switch (flag) {
+        case 's':
+            sortAlignments = 1;
+            break;
+        case 'a':
+            logLevelString = stString_copy(optarg);
+            break;
+        case 'h':
+            usage();
+            return 0;
+        case '?':
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if (argc - optind != 2) {
+        usage();
+        return 1;
+    }
+    st_setLogLevelFromString(logLevelString);
+    char *alignmentsFile = argv[optind];
+    char *pinchFile = argv[optind + 1];
+
+    if (sortAlignments) {
+        char *sortedFile = getTempFile();
+        stCaf_sortCigarsFileByScoreInDescendingOrder(alignmentsFile, sortedFile);
+        stPinchIterator_convertCigarFileToBinaryFile(sortedFile, pinchFile, 1);
+        st_system("rm %s", sortedFile);
+        free(sortedFile);
+    } else {
+        stPinchIterator_convertCigarFileToBinaryFile(alignmentsFile, pinchFile, 0);
+    }
+    st_logInfo("Converted the alignments in %s to the binary pinch file %s\n", alignmentsFile, pinchFile);
+
+    free(logLevelString);
+    return 0;
+}
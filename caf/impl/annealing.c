@@ -1,3 +1,5 @@
+#include <pthread.h>
+#include <unistd.h>
 #include "sonLib.h"
 #include "cactus.h"
 #include "stPinchGraphs.h"
@@ -99,10 +101,23 @@ static int64_t min(int64_t i, int64_t j) {
     return i < j ? i : j;
 }
 
-static void alignSameComponents(stPinch *pinch, stPinchThreadSet *threadSet, stSortedSet *adjacencyComponentIntervals, bool (*filterFn)(stPinchSegment *, stPinchSegment *)) {
+static void applyPinch(stPinchThreadSet *threadSet, stPinch *pinch, bool (*filterFn)(stPinchSegment *, stPinchSegment *)) {
     stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet, pinch->name1);
     stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet, pinch->name2);
     assert(thread1 != NULL && thread2 != NULL);
+    if(filterFn != NULL) {
+        stPinchThread_filterPinch(thread1, thread2, pinch->start1, pinch->start2, pinch->length, pinch->strand, filterFn);
+    }
+    else {
+        stPinchThread_pinch(thread1, thread2, pinch->start1, pinch->start2, pinch->length, pinch->strand);
+    }
+}
+
+/*
+ * Cuts the pinch into the pieces that align bases in the same adjacency component, and calls pinchFn on each.
+ */
+static void clipToSameComponents(stPinch *pinch, stSortedSet *adjacencyComponentIntervals,
+        void (*pinchFn)(stPinch *, void *), void *extraArg) {
     stPinchInterval *pinchInterval1 = stPinchIntervals_getInterval(adjacencyComponentIntervals, pinch->name1,
             pinch->start1);
     int64_t offset = 0;
@@ -114,12 +129,9 @@ static void alignSameComponents(stPinch *pinch, stPinchThreadSet *threadSet, stS
             int64_t length = min(getIntersectionLength(pinch->start1 + offset, pinch->start2 + offset, pinchInterval1,
                     pinchInterval2), pinch->length - offset);
             if (stPinchInterval_getLabel(pinchInterval1) == stPinchInterval_getLabel(pinchInterval2)) {
-                if(filterFn != NULL) {
-                    stPinchThread_filterPinch(thread1, thread2, pinch->start1 + offset, pinch->start2 + offset, length, 1, filterFn);
-                }
-                else {
-                    stPinchThread_pinch(thread1, thread2, pinch->start1 + offset, pinch->start2 + offset, length, 1);
-                }
+                stPinch clippedPinch = { pinch->name1, pinch->name2, pinch->start1 + offset, pinch->start2 + offset,
+                        length, 1 };
+                pinchFn(&clippedPinch, extraArg);
             }
             offset += length;
             pinchInterval1 = updatePinchInterval(pinch->start1 + offset, pinchInterval1, adjacencyComponentIntervals);
@@ -133,12 +145,9 @@ static void alignSameComponents(stPinch *pinch, stPinchThreadSet *threadSet, stS
             int64_t length = min(getIntersectionLengthReverse(pinch->start1 + offset, end2 - offset, pinchInterval1,
                     pinchInterval2), pinch->length - offset);
             if (stPinchInterval_getLabel(pinchInterval1) == stPinchInterval_getLabel(pinchInterval2)) {
-                if(filterFn != NULL) {
-                    stPinchThread_filterPinch(thread1, thread2, pinch->start1 + offset, end2 - offset - length + 1, length, 0, filterFn);
-                }
-                else {
-                    stPinchThread_pinch(thread1, thread2, pinch->start1 + offset, end2 - offset - length + 1, length, 0);
-                }
+                stPinch clippedPinch = { pinch->name1, pinch->name2, pinch->start1 + offset,
+                        end2 - offset - length + 1, length, 0 };
+                pinchFn(&clippedPinch, extraArg);
             }
             offset += length;
             pinchInterval1 = updatePinchInterval(pinch->start1 + offset, pinchInterval1, adjacencyComponentIntervals);
@@ -147,6 +156,16 @@ static void alignSameComponents(stPinch *pinch, stPinchThreadSet *threadSet, stS
     }
 }
 
+typedef struct _annealingTarget {
+    stPinchThreadSet *threadSet;
+    bool (*filterFn)(stPinchSegment *, stPinchSegment *);
+} AnnealingTarget;
+
+static void applyClippedPinch(stPinch *pinch, void *extraArg) {
+    AnnealingTarget *target = extraArg;
+    applyPinch(target->threadSet, pinch, target->filterFn);
+}
+
 static stSortedSet *getAdjacencyComponentIntervals(stPinchThreadSet *threadSet, stList **adjacencyComponents) {
     stHash *pinchEndsToAdjacencyComponents;
     *adjacencyComponents = stPinchThreadSet_getAdjacencyComponents2(threadSet, &pinchEndsToAdjacencyComponents);
@@ -162,9 +181,10 @@ void stCaf_annealBetweenAdjacencyComponents2(stPinchThreadSet *threadSet, stPinc
     stList *adjacencyComponents;
     stSortedSet *adjacencyComponentIntervals = getAdjacencyComponentIntervals(threadSet, &adjacencyComponents);
     //Now do the actual alignments.
+    AnnealingTarget target = { threadSet, filterFn };
     stPinch *pinch;
     while ((pinch = pinchIterator(extraArg)) != NULL) {
-        alignSameComponents(pinch, threadSet, adjacencyComponentIntervals, filterFn);
+        clipToSameComponents(pinch, adjacencyComponentIntervals, applyClippedPinch, &target);
     }
     stSortedSet_destruct(adjacencyComponentIntervals);
     stList_destruct(adjacencyComponents);
@@ -175,3 +195,209 @@ void stCaf_annealBetweenAdjacencyComponents(stPinchThreadSet *threadSet, stPinch
     stCaf_annealBetweenAdjacencyComponents2(threadSet, (stPinch *(*)(void *)) stPinchIterator_getNext, pinchIterator, filterFn);
     stCaf_joinTrivialBoundaries(threadSet);
 }
+
+///////////////////////////////////////////////////////////////////////////
+// Parallel annealing between adjacency components.
+//
+// The pinches are clipped to the adjacency components in batches. Pinches in
+// different adjacency components align disjoint bases, but they may still
+// share the threads, which hold their segments in one sorted set, and the
+// blocks, whose two ends may be in different components. So the clipped
+// pinches of a batch are grouped by the threads they touch, counting the
+// threads of every block they overlap, and the groups, which share no
+// thread, are pinched concurrently. Within a group the pinches are applied
+// in the order of the pinch stream, so the graph is the same as when
+// annealing serially.
+///////////////////////////////////////////////////////////////////////////
+
+#define PINCH_BATCH_SIZE 262144
+
+typedef struct _pinchBatch {
+    stPinchThreadSet *threadSet;
+    bool (*filterFn)(stPinchSegment *, stPinchSegment *);
+    stPinch *pinches; //The clipped pinches, in the order of the pinch stream.
+    int64_t pinchNumber;
+    int64_t maxPinchNumber;
+    stPinch *groupedPinches; //The clipped pinches ordered by group, keeping the stream order within a group.
+    int64_t *groupStarts; //The pinches of group i are groupedPinches[groupStarts[i]] to groupedPinches[groupStarts[i+1]-1].
+    int64_t *groupOrder; //The groups, biggest first.
+    int64_t groupNumber;
+    int64_t nextGroup;
+    pthread_mutex_t lock;
+} PinchBatch;
+
+static void addClippedPinch(stPinch *pinch, void *extraArg) {
+    PinchBatch *batch = extraArg;
+    if (batch->pinchNumber == batch->maxPinchNumber) {
+        batch->maxPinchNumber = batch->maxPinchNumber * 2 + 1;
+        batch->pinches = st_realloc(batch->pinches, batch->maxPinchNumber * sizeof(stPinch));
+    }
+    batch->pinches[batch->pinchNumber++] = *pinch;
+}
+
+/*
+ * Puts the thread in the same component as the threads of the blocks overlapping the given interval of it, which
+ * pinching the interval may split or merge.
+ */
+static void unionThreadsOfBlocks(stUnionFind *threadComponents, stSet *blocksSeen, stPinchThread *thread,
+        int64_t start, int64_t length) {
+    stPinchSegment *segment = stPinchThread_getSegment(thread, start);
+    while (segment != NULL && stPinchSegment_getStart(segment) < start + length) {
+        stPinchBlock *block = stPinchSegment_getBlock(segment);
+        if (block != NULL && stSet_search(blocksSeen, block) == NULL) {
+            stSet_insert(blocksSeen, block);
+            stPinchBlockIt blockIt = stPinchBlock_getSegmentIterator(block);
+            stPinchSegment *segment2;
+            while ((segment2 = stPinchBlockIt_getNext(&blockIt)) != NULL) {
+                stUnionFind_union(threadComponents, thread, stPinchSegment_getThread(segment2));
+            }
+        }
+        segment = stPinchSegment_get3Prime(segment);
+    }
+}
+
+static __thread int64_t *groupSizesForSort; //qsort has no argument for the comparison function.
+
+static int compareGroupSizes(const void *group1, const void *group2) {
+    int64_t size1 = groupSizesForSort[*(const int64_t *) group1], size2 = groupSizesForSort[*(const int64_t *) group2];
+    return size1 > size2 ? -1 : (size1 < size2 ? 1 : (*(const int64_t *) group1 < *(const int64_t *) group2 ? -1 : 1));
+}
+
+static void groupPinches(PinchBatch *batch) {
+    //Put the threads touched by each pinch in one component.
+    stUnionFind *threadComponents = stUnionFind_construct();
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(batch->threadSet);
+    stPinchThread *thread;
+    while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        stUnionFind_add(threadComponents, thread);
+    }
+    stSet *blocksSeen = stSet_construct();
+    stPinchThread **threads = st_malloc((batch->pinchNumber + 1) * sizeof(stPinchThread *));
+    for (int64_t i = 0; i < batch->pinchNumber; i++) {
+        stPinch *pinch = &batch->pinches[i];
+        stPinchThread *thread1 = stPinchThreadSet_getThread(batch->threadSet, pinch->name1);
+        stPinchThread *thread2 = stPinchThreadSet_getThread(batch->threadSet, pinch->name2);
+        assert(thread1 != NULL && thread2 != NULL);
+        stUnionFind_union(threadComponents, thread1, thread2);
+        unionThreadsOfBlocks(threadComponents, blocksSeen, thread1, pinch->start1, pinch->length);
+        unionThreadsOfBlocks(threadComponents, blocksSeen, thread2, pinch->start2, pinch->length);
+        threads[i] = thread1;
+    }
+    stSet_destruct(blocksSeen);
+
+    //Number the groups, in the order they are first seen.
+    stHash *componentsToGroups = stHash_construct2(NULL, (void (*)(void *)) stIntTuple_destruct);
+    int64_t *groups = st_malloc((batch->pinchNumber + 1) * sizeof(int64_t));
+    int64_t *sizes = st_calloc(batch->pinchNumber + 1, sizeof(int64_t));
+    for (int64_t i = 0; i < batch->pinchNumber; i++) {
+        void *component = stUnionFind_find(threadComponents, threads[i]);
+        stIntTuple *group = stHash_search(componentsToGroups, component);
+        if (group == NULL) {
+            group = stIntTuple_construct1(stHash_size(componentsToGroups));
+            stHash_insert(componentsToGroups, component, group);
+        }
+        groups[i] = stIntTuple_get(group, 0);
+        sizes[groups[i]]++;
+    }
+    batch->groupNumber = stHash_size(componentsToGroups);
+    stHash_destruct(componentsToGroups);
+    stUnionFind_destruct(threadComponents);
+    free(threads);
+
+    //Bucket the pinches by group, stably.
+    batch->groupStarts = st_realloc(batch->groupStarts, (batch->groupNumber + 1) * sizeof(int64_t));
+    batch->groupOrder = st_realloc(batch->groupOrder, (batch->groupNumber + 1) * sizeof(int64_t));
+    batch->groupStarts[0] = 0;
+    for (int64_t i = 0; i < batch->groupNumber; i++) {
+        batch->groupStarts[i + 1] = batch->groupStarts[i] + sizes[i];
+        batch->groupOrder[i] = i;
+    }
+    batch->groupedPinches = st_realloc(batch->groupedPinches, (batch->pinchNumber + 1) * sizeof(stPinch));
+    int64_t *nextPositions = st_malloc((batch->groupNumber + 1) * sizeof(int64_t));
+    memcpy(nextPositions, batch->groupStarts, batch->groupNumber * sizeof(int64_t));
+    for (int64_t i = 0; i < batch->pinchNumber; i++) {
+        batch->groupedPinches[nextPositions[groups[i]]++] = batch->pinches[i];
+    }
+    free(nextPositions);
+    free(groups);
+
+    //Start the biggest groups first, so that one big group is not left running alone at the end.
+    groupSizesForSort = sizes;
+    qsort(batch->groupOrder, batch->groupNumber, sizeof(int64_t), compareGroupSizes);
+    free(sizes);
+}
+
+static void *annealGroups(void *arg) {
+    PinchBatch *batch = arg;
+    while (1) {
+        pthread_mutex_lock(&batch->lock);
+        int64_t i = batch->nextGroup++;
+        pthread_mutex_unlock(&batch->lock);
+        if (i >= batch->groupNumber) {
+            return NULL;
+        }
+        int64_t group = batch->groupOrder[i];
+        for (int64_t j = batch->groupStarts[group]; j < batch->groupStarts[group + 1]; j++) {
+            applyPinch(batch->threadSet, &batch->groupedPinches[j], batch->filterFn);
+        }
+    }
+}
+
+static void annealBatch(PinchBatch *batch, int64_t threadNumber) {
+    groupPinches(batch);
+    batch->nextGroup = 0;
+    int64_t workerNumber = threadNumber < batch->groupNumber ? threadNumber : batch->groupNumber;
+    pthread_t *workers = st_malloc((workerNumber + 1) * sizeof(pthread_t));
+    for (int64_t i = 0; i < workerNumber; i++) {
+        if (pthread_create(&workers[i], NULL, annealGroups, batch) != 0) {
+            st_errAbort("Could not start a thread to anneal the pinches\n");
+        }
+    }
+    for (int64_t i = 0; i < workerNumber; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    batch->pinchNumber = 0;
+}
+
+void stCaf_annealBetweenAdjacencyComponentsInParallel2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *),
+        void *extraArg, bool (*filterFn)(stPinchSegment *, stPinchSegment *), int64_t threadNumber) {
+    if (threadNumber == 0) {
+        threadNumber = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threadNumber <= 1) {
+        stCaf_annealBetweenAdjacencyComponents2(threadSet, pinchIterator, extraArg, filterFn);
+        return;
+    }
+    stList *adjacencyComponents;
+    stSortedSet *adjacencyComponentIntervals = getAdjacencyComponentIntervals(threadSet, &adjacencyComponents);
+    PinchBatch batch = { 0 };
+    batch.threadSet = threadSet;
+    batch.filterFn = filterFn;
+    pthread_mutex_init(&batch.lock, NULL);
+    stPinch *pinch;
+    while ((pinch = pinchIterator(extraArg)) != NULL) {
+        clipToSameComponents(pinch, adjacencyComponentIntervals, addClippedPinch, &batch);
+        if (batch.pinchNumber >= PINCH_BATCH_SIZE) {
+            annealBatch(&batch, threadNumber);
+        }
+    }
+    if (batch.pinchNumber > 0) {
+        annealBatch(&batch, threadNumber);
+    }
+    pthread_mutex_destroy(&batch.lock);
+    free(batch.pinches);
+    free(batch.groupedPinches);
+    free(batch.groupStarts);
+    free(batch.groupOrder);
+    stSortedSet_destruct(adjacencyComponentIntervals);
+    stList_destruct(adjacencyComponents);
+}
+
+void stCaf_annealBetweenAdjacencyComponentsInParallel(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator,
+        bool (*filterFn)(stPinchSegment *, stPinchSegment *), int64_t threadNumber) {
+    stPinchIterator_reset(pinchIterator);
+    stCaf_annealBetweenAdjacencyComponentsInParallel2(threadSet, (stPinch *(*)(void *)) stPinchIterator_getNext,
+            pinchIterator, filterFn, threadNumber);
+    stCaf_joinTrivialBoundaries(threadSet);
+}
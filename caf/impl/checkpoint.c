@@ -0,0 +1,263 @@
+/*
+ * checkpoint.c
+ *
+ * Dumps the pinch graph of a flower to a binary file between annealing rounds, and restores it, so that
+ * a caf job that is stopped part way through can carry on from its last completed round.
+ */
+
+// For fsync and fileno declarations (technically POSIX extensions).
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "sonLib.h"
+#include "cactus.h"
+#include "stPinchGraphs.h"
+#include "stCaf.h"
+
+typedef struct _checkpointHeader {
+    char magic[8];
+    int64_t version;
+    int64_t flowerName;
+    int64_t annealingRounds;
+    int64_t threadNumber;
+    int64_t blockNumber;
+} CheckpointHeader;
+
+typedef struct _checkpointBlock {
+    int64_t degree;
+    int64_t supportingHomologies;
+} CheckpointBlock;
+
+typedef struct _checkpointThread {
+    int64_t name;
+    int64_t start;
+    int64_t length;
+    int64_t segmentNumber;
+} CheckpointThread;
+
+typedef struct _checkpointSegment {
+    int64_t start;
+    int64_t length;
+    int64_t block; //The index of the block in the block table, or -1 if the segment is in no block.
+    int64_t orientation;
+} CheckpointSegment;
+
+/*
+ * Flushes the directory holding the file to the disk, so a rename of the file survives the machine stopping.
+ */
+static bool syncDirectory(const char *file) {
+    char *directory = stString_copy(file);
+    char *slash = strrchr(directory, '/');
+    if (slash == NULL) {
+        strcpy(directory, ".");
+    } else {
+        slash[slash == directory ? 1 : 0] = '\0';
+    }
+    int fileDescriptor = open(directory, O_RDONLY);
+    bool synced = fileDescriptor >= 0 && fsync(fileDescriptor) == 0;
+    if (fileDescriptor >= 0) {
+        close(fileDescriptor);
+    }
+    free(directory);
+    return synced;
+}
+
+void stCaf_writePinchGraphCheckpoint(Flower *flower, stPinchThreadSet *threadSet, int64_t annealingRounds,
+        const char *checkpointFile) {
+    //Written beside the checkpoint and then moved over it, so a job stopped while writing leaves the last one intact.
+    char *tempFile = stString_print("%s.tmp", checkpointFile);
+    FILE *fileHandle = fopen(tempFile, "wb");
+    if (fileHandle == NULL) {
+        st_errAbort("Could not create the checkpoint file: %s\n", tempFile);
+    }
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(CheckpointHeader));
+    memcpy(header.magic, ST_CAF_CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = ST_CAF_CHECKPOINT_VERSION;
+    header.flowerName = flower_getName(flower);
+    header.annealingRounds = annealingRounds;
+
+    //Number the blocks, and write the block table.
+    stHash *blocksToIndices = stHash_construct2(NULL, (void (*)(void *)) stIntTuple_destruct);
+    stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+    stPinchBlock *block;
+    while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+        stHash_insert(blocksToIndices, block, stIntTuple_construct1(header.blockNumber++));
+    }
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet);
+    while (stPinchThreadSetIt_getNext(&threadIt) != NULL) {
+        header.threadNumber++;
+    }
+    bool failed = fwrite(&header, sizeof(CheckpointHeader), 1, fileHandle) != 1;
+    blockIt = stPinchThreadSet_getBlockIt(threadSet);
+    while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+        CheckpointBlock checkpointBlock = { stPinchBlock_getDegree(block), stPinchBlock_getNumSupportingHomologies(block) };
+        failed = failed || fwrite(&checkpointBlock, sizeof(CheckpointBlock), 1, fileHandle) != 1;
+    }
+
+    //Then the segments of each thread, in order.
+    threadIt = stPinchThreadSet_getIt(threadSet);
+    stPinchThread *thread;
+    while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        CheckpointThread checkpointThread = { stPinchThread_getName(thread), stPinchThread_getStart(thread),
+                stPinchThread_getLength(thread), 0 };
+        for (stPinchSegment *segment = stPinchThread_getFirst(thread); segment != NULL;
+                segment = stPinchSegment_get3Prime(segment)) {
+            checkpointThread.segmentNumber++;
+        }
+        failed = failed || fwrite(&checkpointThread, sizeof(CheckpointThread), 1, fileHandle) != 1;
+        for (stPinchSegment *segment = stPinchThread_getFirst(thread); segment != NULL;
+                segment = stPinchSegment_get3Prime(segment)) {
+            block = stPinchSegment_getBlock(segment);
+            CheckpointSegment checkpointSegment = { stPinchSegment_getStart(segment), stPinchSegment_getLength(segment),
+                    block != NULL ? stIntTuple_get(stHash_search(blocksToIndices, block), 0) : -1,
+                    block != NULL ? stPinchSegment_getBlockOrientation(segment) : 1 };
+            failed = failed || fwrite(&checkpointSegment, sizeof(CheckpointSegment), 1, fileHandle) != 1;
+        }
+    }
+    stHash_destruct(blocksToIndices);
+    //The checkpoint is on the disk before it replaces the last, and the replacement is before the next round starts.
+    failed = failed || fflush(fileHandle) != 0 || fsync(fileno(fileHandle)) != 0;
+    if (fclose(fileHandle) != 0 || failed || rename(tempFile, checkpointFile) != 0 || !syncDirectory(checkpointFile)) {
+        st_errAbort("Could not write the checkpoint file: %s\n", checkpointFile);
+    }
+    free(tempFile);
+}
+
+static void readCheckpoint(void *data, size_t size, FILE *fileHandle, const char *checkpointFile) {
+    if (fread(data, size, 1, fileHandle) != 1) {
+        st_errAbort("The checkpoint file %s is truncated\n", checkpointFile);
+    }
+}
+
+/*
+ * Pinching only adds to the count of homologies supporting a block, and there is no way to set it, so the segments
+ * are pinched together again until the count is that of the checkpoint. Returns zero if the count can not be made
+ * exactly that of the checkpoint, as a pinch does not raise it or it is already higher.
+ */
+static bool restoreSupportingHomologies(stPinchBlock *block, stPinchThread *thread1, int64_t start1, bool orientation1,
+        stPinchThread *thread2, int64_t start2, bool orientation2, int64_t length, int64_t supportingHomologies) {
+    int64_t count;
+    while ((count = stPinchBlock_getNumSupportingHomologies(block)) < supportingHomologies && stPinchBlock_getDegree(block) > 1) {
+        stPinchThread_pinch(thread1, thread2, start1, start2, length, orientation1 == orientation2);
+        if ((int64_t) stPinchBlock_getNumSupportingHomologies(block) == count) {
+            return 0;
+        }
+    }
+    return count == supportingHomologies;
+}
+
+/*
+ * The first segment read of each block, which the others are pinched to.
+ */
+typedef struct _blockMember {
+    stPinchThread *thread;
+    int64_t start;
+    int64_t orientation;
+    int64_t degree; //The number of segments of the block restored so far.
+} BlockMember;
+
+int64_t stCaf_readPinchGraphCheckpoint(Flower *flower, stPinchThreadSet *threadSet, const char *checkpointFile) {
+    FILE *fileHandle = fopen(checkpointFile, "rb");
+    if (fileHandle == NULL) {
+        st_errAbort("Could not open the checkpoint file: %s\n", checkpointFile);
+    }
+    CheckpointHeader header;
+    readCheckpoint(&header, sizeof(CheckpointHeader), fileHandle, checkpointFile);
+    if (memcmp(header.magic, ST_CAF_CHECKPOINT_MAGIC, sizeof(header.magic)) != 0
+            || header.version != ST_CAF_CHECKPOINT_VERSION || header.blockNumber < 0 || header.threadNumber < 0) {
+        st_errAbort("The file %s is not a caf checkpoint\n", checkpointFile);
+    }
+    if (header.flowerName != flower_getName(flower)) {
+        st_errAbort("The checkpoint file %s is for flower %" PRIi64 ", not flower %" PRIi64 "\n", checkpointFile,
+                header.flowerName, flower_getName(flower));
+    }
+    CheckpointBlock *blocks = st_malloc((header.blockNumber + 1) * sizeof(CheckpointBlock));
+    for (int64_t i = 0; i < header.blockNumber; i++) {
+        readCheckpoint(&blocks[i], sizeof(CheckpointBlock), fileHandle, checkpointFile);
+    }
+    BlockMember *firstMembers = st_calloc(header.blockNumber + 1, sizeof(BlockMember));
+    int64_t blocksRestored = 0, blocksWithOtherSupport = 0;
+    CheckpointSegment *segments = NULL;
+    int64_t maxSegmentNumber = 0;
+    for (int64_t threadIndex = 0; threadIndex < header.threadNumber; threadIndex++) {
+        CheckpointThread checkpointThread;
+        readCheckpoint(&checkpointThread, sizeof(CheckpointThread), fileHandle, checkpointFile);
+        stPinchThread *thread = stPinchThreadSet_getThread(threadSet, checkpointThread.name);
+        if (thread == NULL || stPinchThread_getStart(thread) != checkpointThread.start
+                || stPinchThread_getLength(thread) != checkpointThread.length || checkpointThread.segmentNumber < 1) {
+            st_errAbort("The thread %" PRIi64 " of the checkpoint file %s does not match the flower\n",
+                    checkpointThread.name, checkpointFile);
+        }
+        if (checkpointThread.segmentNumber > maxSegmentNumber) {
+            maxSegmentNumber = checkpointThread.segmentNumber;
+            segments = st_realloc(segments, maxSegmentNumber * sizeof(CheckpointSegment));
+        }
+        //Cut the thread into the segments of the checkpoint, then put them into their blocks.
+        for (int64_t i = 0; i < checkpointThread.segmentNumber; i++) {
+            CheckpointSegment *segment = &segments[i];
+            readCheckpoint(segment, sizeof(CheckpointSegment), fileHandle, checkpointFile);
+            if (segment->block < -1 || segment->block >= header.blockNumber || segment->length < 1
+                    || segment->start != (i == 0 ? checkpointThread.start : segments[i - 1].start + segments[i - 1].length)) {
+                st_errAbort("The thread %" PRIi64 " of the checkpoint file %s is corrupt\n", checkpointThread.name,
+                        checkpointFile);
+            }
+            if (i > 0) {
+                stPinchThread_split(thread, segment->start - 1);
+            }
+        }
+        for (int64_t i = 0; i < checkpointThread.segmentNumber; i++) {
+            CheckpointSegment *segment = &segments[i];
+            if (segment->block == -1) {
+                continue;
+            }
+            BlockMember *firstMember = &firstMembers[segment->block];
+            if (firstMember->thread == NULL) {
+                firstMember->thread = thread;
+                firstMember->start = segment->start;
+                firstMember->orientation = segment->orientation;
+                stPinchSegment *pinchSegment = stPinchThread_getSegment(thread, segment->start);
+                if (stPinchSegment_getBlock(pinchSegment) == NULL) {
+                    stPinchBlock_construct3(pinchSegment, segment->orientation);
+                }
+            } else {
+                stPinchThread_pinch(firstMember->thread, thread, firstMember->start, segment->start, segment->length,
+                        firstMember->orientation == segment->orientation);
+            }
+            if (++firstMember->degree == blocks[segment->block].degree) {
+                //The block is complete.
+                stPinchBlock *block = stPinchSegment_getBlock(stPinchThread_getSegment(thread, segment->start));
+                if ((int64_t) stPinchBlock_getDegree(block) != blocks[segment->block].degree) {
+                    st_errAbort("A block of the checkpoint file %s could not be restored\n", checkpointFile);
+                }
+                if (!restoreSupportingHomologies(block, firstMember->thread, firstMember->start, firstMember->orientation,
+                        thread, segment->start, segment->orientation, segment->length,
+                        blocks[segment->block].supportingHomologies)) {
+                    blocksWithOtherSupport++;
+                }
+                blocksRestored++;
+            }
+        }
+    }
+    int c = fgetc(fileHandle);
+    fclose(fileHandle);
+    if (c != EOF || blocksRestored != header.blockNumber
+            || stPinchThreadSet_getTotalBlockNumber(threadSet) != header.blockNumber) {
+        st_errAbort("The checkpoint file %s does not match the pinch graph of the flower\n", checkpointFile);
+    }
+    free(segments);
+    free(firstMembers);
+    free(blocks);
+    if (blocksWithOtherSupport > 0) {
+        //The block homology support filter would then differ from a job that was not stopped.
+        st_logCritical("The supporting homologies of %" PRIi64 " blocks could not be restored exactly from the "
+                "checkpoint file %s, so it is not used\n", blocksWithOtherSupport, checkpointFile);
+        return -1;
+    }
+    st_logInfo("Restored the pinch graph after %" PRIi64 " annealing rounds from the checkpoint file %s\n",
+            header.annealingRounds, checkpointFile);
+    return header.annealingRounds;
+}
@@ -1,3 +1,4 @@
+#include <pthread.h>
 #include "cactus.h"
 #include "sonLib.h"
 #include "commonC.h"
@@ -8,8 +9,159 @@
 // parameter.
 static Flower *flower;
 
+/*
+ * The filters are called on every pinch, so the event and sequence of each thread of the flower are
+ * looked up once, when the flower is set, and numbered densely. The events (or sequences) of a block are
+ * then marked in a bitset by walking the block, and the bitset is cleared again by walking the block
+ * once more, so a check costs a constant time per segment and allocates nothing. Pinches may be filtered by
+ * several threads at once, so each thread has its own bitsets.
+ */
+typedef struct _threadInfo {
+    int64_t eventIndex;
+    int64_t sequenceIndex;
+} ThreadInfo;
+
+static Flower *threadInfoFlower = NULL; // The flower the thread info is for.
+static stHash *threadNamesToInfo = NULL; // Thread (cap) names to their ThreadInfo.
+static ThreadInfo *threadInfos = NULL;
+static Event **events = NULL; // Indexed by event index.
+static bool *outgroupEvents = NULL; // Indexed by event index.
+static int64_t eventNumber = 0;
+static int64_t sequenceNumber = 0;
+static int64_t threadInfoVersion = 0; // Incremented whenever the thread info is rebuilt.
+
+typedef struct _markBits {
+    int64_t threadInfoVersion; // The version of the thread info the bitsets are sized for.
+    uint64_t *eventBits; // Bitset of event indices, all zero between checks.
+    uint64_t *sequenceBits; // Bitset of sequence indices, all zero between checks.
+} MarkBits;
+
+static pthread_key_t markBitsKey;
+static pthread_once_t markBitsKeyOnce = PTHREAD_ONCE_INIT;
+
+static void destructMarkBits(void *markBits) {
+    free(((MarkBits *) markBits)->eventBits);
+    free(((MarkBits *) markBits)->sequenceBits);
+    free(markBits);
+}
+
+static void constructMarkBitsKey(void) {
+    if (pthread_key_create(&markBitsKey, destructMarkBits) != 0) {
+        st_errAbort("Could not create the key for the filtering bitsets");
+    }
+}
+
+static MarkBits *getMarkBits(void) {
+    pthread_once(&markBitsKeyOnce, constructMarkBitsKey);
+    MarkBits *markBits = pthread_getspecific(markBitsKey);
+    if (markBits == NULL) {
+        markBits = st_calloc(1, sizeof(MarkBits));
+        markBits->threadInfoVersion = -1;
+        pthread_setspecific(markBitsKey, markBits);
+    }
+    if (markBits->threadInfoVersion != threadInfoVersion) {
+        free(markBits->eventBits);
+        free(markBits->sequenceBits);
+        markBits->eventBits = st_calloc(eventNumber / 64 + 1, sizeof(uint64_t));
+        markBits->sequenceBits = st_calloc(sequenceNumber / 64 + 1, sizeof(uint64_t));
+        markBits->threadInfoVersion = threadInfoVersion;
+    }
+    return markBits;
+}
+
+static void destructThreadInfo(void) {
+    if (threadNamesToInfo != NULL) {
+        stHash_destruct(threadNamesToInfo);
+        free(threadInfos);
+        free(events);
+        free(outgroupEvents);
+        threadNamesToInfo = NULL;
+        threadInfoFlower = NULL;
+    }
+}
+
+static void constructThreadInfo(Flower *flower) {
+    destructThreadInfo();
+    threadInfoFlower = flower;
+    threadInfoVersion++;
+    EventTree *eventTree = flower_getEventTree(flower);
+    eventNumber = eventTree_getEventNumber(eventTree);
+    events = st_malloc(sizeof(Event *) * eventNumber);
+    outgroupEvents = st_malloc(sizeof(bool) * eventNumber);
+    stHash *eventsToIndices = stHash_construct2(NULL, (void (*)(void *)) stIntTuple_destruct);
+    EventTree_Iterator *eventIt = eventTree_getIterator(eventTree);
+    Event *event;
+    int64_t eventIndex = 0;
+    while ((event = eventTree_getNext(eventIt)) != NULL) {
+        events[eventIndex] = event;
+        outgroupEvents[eventIndex] = event_isOutgroup(event);
+        stHash_insert(eventsToIndices, event, stIntTuple_construct1(eventIndex++));
+    }
+    eventTree_destructIterator(eventIt);
+
+    stHash *sequencesToIndices = stHash_construct2(NULL, (void (*)(void *)) stIntTuple_destruct);
+    Flower_SequenceIterator *sequenceIt = flower_getSequenceIterator(flower);
+    Sequence *sequence;
+    int64_t sequenceIndex = 0;
+    while ((sequence = flower_getNextSequence(sequenceIt)) != NULL) {
+        stHash_insert(sequencesToIndices, sequence, stIntTuple_construct1(sequenceIndex++));
+    }
+    flower_destructSequenceIterator(sequenceIt);
+    sequenceNumber = sequenceIndex;
+
+    // Every cap, as the threads are named after caps.
+    threadNamesToInfo = stHash_construct();
+    threadInfos = st_malloc(sizeof(ThreadInfo) * (flower_getCapNumber(flower) + 1));
+    Flower_CapIterator *capIt = flower_getCapIterator(flower);
+    Cap *cap;
+    int64_t i = 0;
+    while ((cap = flower_getNextCap(capIt)) != NULL) {
+        ThreadInfo *threadInfo = &threadInfos[i++];
+        stIntTuple *index = stHash_search(eventsToIndices, cap_getEvent(cap));
+        assert(index != NULL);
+        threadInfo->eventIndex = stIntTuple_get(index, 0);
+        index = cap_getSequence(cap) != NULL ? stHash_search(sequencesToIndices, cap_getSequence(cap)) : NULL;
+        threadInfo->sequenceIndex = index != NULL ? stIntTuple_get(index, 0) : -1;
+        stHash_insert(threadNamesToInfo, (void *) cap_getName(cap), threadInfo);
+    }
+    flower_destructCapIterator(capIt);
+    stHash_destruct(eventsToIndices);
+    stHash_destruct(sequencesToIndices);
+}
+
 void stCaf_setFlowerForAlignmentFiltering(Flower *input) {
     flower = input;
+    if (flower != NULL) {
+        constructThreadInfo(flower);
+    } else {
+        destructThreadInfo();
+    }
+}
+
+static inline ThreadInfo *getThreadInfo(stPinchSegment *segment) {
+    ThreadInfo *threadInfo = threadNamesToInfo != NULL ?
+            stHash_search(threadNamesToInfo, (void *) stPinchSegment_getName(segment)) : NULL;
+    if (threadInfo == NULL) {
+        st_errAbort("The thread %" PRIi64 " is not a cap of the flower set for alignment filtering",
+                stPinchSegment_getName(segment));
+    }
+    return threadInfo;
+}
+
+static inline bool isOutgroup(stPinchSegment *segment) {
+    return outgroupEvents[getThreadInfo(segment)->eventIndex];
+}
+
+static inline bool testBit(uint64_t *bits, int64_t i) {
+    return (bits[i >> 6] >> (i & 63)) & 1;
+}
+
+static inline void setBit(uint64_t *bits, int64_t i, bool value) {
+    if (value) {
+        bits[i >> 6] |= ((uint64_t) 1) << (i & 63);
+    } else {
+        bits[i >> 6] &= ~(((uint64_t) 1) << (i & 63));
+    }
 }
 
 /*
@@ -17,6 +169,12 @@ void stCaf_setFlowerForAlignmentFiltering(Flower *input) {
  */
 
 Event *stCaf_getEvent(stPinchSegment *segment, Flower *flower) {
+    if (flower == threadInfoFlower) {
+        ThreadInfo *threadInfo = stHash_search(threadNamesToInfo, (void *) stPinchSegment_getName(segment));
+        if (threadInfo != NULL) {
+            return events[threadInfo->eventIndex];
+        }
+    }
     Event *event = cap_getEvent(flower_getCap(flower, stPinchSegment_getName(segment)));
     assert(event != NULL);
     return event;
@@ -26,11 +184,11 @@ Event *stCaf_getEvent(stPinchSegment *segment, Flower *flower) {
  * Filtering by presence of outgroup. This code is efficient and scales linearly with depth.
  */
 
-static bool containsOutgroupSegment(stPinchBlock *block, Flower *flower) {
+static bool containsOutgroupSegment(stPinchBlock *block) {
     stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
     stPinchSegment *segment;
     while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-        if (event_isOutgroup(stCaf_getEvent(segment, flower))) {
+        if (isOutgroup(segment)) {
             stPinchSegment_putSegmentFirstInBlock(segment);
             assert(stPinchBlock_getFirst(block) == segment);
             return 1;
@@ -39,33 +197,25 @@ static bool containsOutgroupSegment(stPinchBlock *block, Flower *flower) {
     return 0;
 }
 
-static bool isOutgroupSegment(stPinchSegment *segment, Flower *flower) {
-    if (event_isOutgroup(stCaf_getEvent(segment, flower))) {
-        return 1;
-    } else {
-        return 0;
-    }
-}
-
 bool stCaf_filterByOutgroup(stPinchSegment *segment1,
                             stPinchSegment *segment2) {
     stPinchBlock *block1, *block2;
     if ((block1 = stPinchSegment_getBlock(segment1)) != NULL) {
         if ((block2 = stPinchSegment_getBlock(segment2)) != NULL) {
             if (block1 == block2) {
-                return stPinchBlock_getLength(block1) == 1 ? 0 : containsOutgroupSegment(block1, flower);
+                return stPinchBlock_getLength(block1) == 1 ? 0 : containsOutgroupSegment(block1);
             }
             if (stPinchBlock_getDegree(block1) < stPinchBlock_getDegree(block2)) {
-                return containsOutgroupSegment(block1, flower) && containsOutgroupSegment(block2, flower);
+                return containsOutgroupSegment(block1) && containsOutgroupSegment(block2);
             }
-            return containsOutgroupSegment(block2, flower) && containsOutgroupSegment(block1, flower);
+            return containsOutgroupSegment(block2) && containsOutgroupSegment(block1);
         }
-        return isOutgroupSegment(segment2, flower) && containsOutgroupSegment(block1, flower);
+        return isOutgroup(segment2) && containsOutgroupSegment(block1);
     }
     if ((block2 = stPinchSegment_getBlock(segment2)) != NULL) {
-        return isOutgroupSegment(segment1, flower) && containsOutgroupSegment(block2, flower);
+        return isOutgroup(segment1) && containsOutgroupSegment(block2);
     }
-    return isOutgroupSegment(segment1, flower) && isOutgroupSegment(segment2, flower);
+    return isOutgroup(segment1) && isOutgroup(segment2);
 }
 
 bool stCaf_relaxedFilterByOutgroup(stPinchSegment *segment1,
@@ -74,12 +224,12 @@ bool stCaf_relaxedFilterByOutgroup(stPinchSegment *segment1,
     if ((block1 = stPinchSegment_getBlock(segment1)) != NULL) {
         if ((block2 = stPinchSegment_getBlock(segment2)) != NULL) {
             if (block1 == block2) {
-                return stPinchBlock_getLength(block1) == 1 ? 0 : containsOutgroupSegment(block1, flower);
+                return stPinchBlock_getLength(block1) == 1 ? 0 : containsOutgroupSegment(block1);
             }
             if (stPinchBlock_getDegree(block1) < stPinchBlock_getDegree(block2)) {
-                return containsOutgroupSegment(block1, flower) && containsOutgroupSegment(block2, flower);
+                return containsOutgroupSegment(block1) && containsOutgroupSegment(block2);
             }
-            return containsOutgroupSegment(block2, flower) && containsOutgroupSegment(block1, flower);
+            return containsOutgroupSegment(block2) && containsOutgroupSegment(block1);
         }
     }
     // If we get here, we are just adding a segment to a block, not
@@ -88,41 +238,92 @@ bool stCaf_relaxedFilterByOutgroup(stPinchSegment *segment1,
 }
 
 /*
- * Filtering by presence of repeat species in block. This code is inefficient and does not scale.
+ * Filtering by presence of repeat species (or sequences) in block.
  */
 
-static bool checkIntersection(stSortedSet *names1, stSortedSet *names2) {
-    stSortedSet *n12 = stSortedSet_getIntersection(names1, names2);
-    bool b = stSortedSet_size(n12) > 0;
-    stSortedSet_destruct(names1);
-    stSortedSet_destruct(names2);
-    stSortedSet_destruct(n12);
-    return b;
+#define EVENTS 0
+#define INGROUP_EVENTS 1
+#define SEQUENCES 2
+
+static inline int64_t getIndex(stPinchSegment *segment, int64_t type) {
+    ThreadInfo *threadInfo = getThreadInfo(segment);
+    if (type == SEQUENCES) {
+        assert(threadInfo->sequenceIndex != -1);
+        return threadInfo->sequenceIndex;
+    }
+    return type == INGROUP_EVENTS && outgroupEvents[threadInfo->eventIndex] ? -1 : threadInfo->eventIndex;
 }
 
-static stSortedSet *getEvents(stPinchSegment *segment, Flower *flower) {
-    stSortedSet *events = stSortedSet_construct();
-    if (stPinchSegment_getBlock(segment) != NULL) {
-        stPinchBlock *block = stPinchSegment_getBlock(segment);
-        stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
-        while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-            stSortedSet_insert(events, stCaf_getEvent(segment, flower));
+/*
+ * Sets or clears the bits of the events (or sequences) of the segment, or of its block if it has one.
+ */
+static void markSegments(MarkBits *markBits, stPinchSegment *segment, int64_t type, bool value) {
+    uint64_t *bits = type == SEQUENCES ? markBits->sequenceBits : markBits->eventBits;
+    stPinchBlock *block = stPinchSegment_getBlock(segment);
+    if (block == NULL) {
+        int64_t i = getIndex(segment, type);
+        if (i != -1) {
+            setBit(bits, i, value);
+        }
+        return;
+    }
+    stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
+    while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
+        int64_t i = getIndex(segment, type);
+        if (i != -1) {
+            setBit(bits, i, value);
+        }
+    }
+}
+
+static bool containsMarkedSegment(MarkBits *markBits, stPinchSegment *segment, int64_t type) {
+    uint64_t *bits = type == SEQUENCES ? markBits->sequenceBits : markBits->eventBits;
+    stPinchBlock *block = stPinchSegment_getBlock(segment);
+    if (block == NULL) {
+        int64_t i = getIndex(segment, type);
+        return i != -1 && testBit(bits, i);
+    }
+    stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
+    while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
+        int64_t i = getIndex(segment, type);
+        if (i != -1 && testBit(bits, i)) {
+            return true;
         }
-    } else {
-        stSortedSet_insert(events, stCaf_getEvent(segment, flower));
     }
-    return events;
+    return false;
+}
+
+static int64_t getDegree(stPinchSegment *segment) {
+    stPinchBlock *block = stPinchSegment_getBlock(segment);
+    return block == NULL ? 1 : stPinchBlock_getDegree(block);
 }
 
-static bool containsMoreThanOneEvent(stPinchSegment *segment, Flower *flower) {
+/*
+ * Returns non-zero if the blocks of the two segments (or the segments themselves if not in blocks)
+ * share an event (or sequence). The smaller block is marked, and the bigger scanned.
+ */
+static bool checkIntersection(stPinchSegment *segment1, stPinchSegment *segment2, int64_t type) {
+    if (getDegree(segment1) > getDegree(segment2)) {
+        stPinchSegment *segment = segment1;
+        segment1 = segment2;
+        segment2 = segment;
+    }
+    MarkBits *markBits = getMarkBits();
+    markSegments(markBits, segment1, type, 1);
+    bool b = containsMarkedSegment(markBits, segment2, type);
+    markSegments(markBits, segment1, type, 0);
+    return b;
+}
+
+static bool containsMoreThanOneEvent(stPinchSegment *segment) {
     if (stPinchSegment_getBlock(segment) == NULL) {
         return false;
     } else {
         stPinchBlock *block = stPinchSegment_getBlock(segment);
-        Event *event = stCaf_getEvent(segment, flower);
+        int64_t eventIndex = getThreadInfo(segment)->eventIndex;
         stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
         while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-            if (stCaf_getEvent(segment, flower) != event) {
+            if (getThreadInfo(segment)->eventIndex != eventIndex) {
                 return true;
             }
         }
@@ -136,12 +337,12 @@ bool stCaf_filterByMultipleSpecies(stPinchSegment *segment1,
     if ((block1 = stPinchSegment_getBlock(segment1)) != NULL) {
         if ((block2 = stPinchSegment_getBlock(segment2)) != NULL) {
             if (block1 == block2) {
-                return stPinchBlock_getLength(block1) == 1 ? 0 : containsMoreThanOneEvent(segment1, flower);
+                return stPinchBlock_getLength(block1) == 1 ? 0 : containsMoreThanOneEvent(segment1);
             }
             if (stPinchBlock_getDegree(block1) < stPinchBlock_getDegree(block2)) {
-            	return containsMoreThanOneEvent(segment1, flower) && containsMoreThanOneEvent(segment2, flower);
+            	return containsMoreThanOneEvent(segment1) && containsMoreThanOneEvent(segment2);
             }
-            return containsMoreThanOneEvent(segment2, flower) && containsMoreThanOneEvent(segment1, flower);
+            return containsMoreThanOneEvent(segment2) && containsMoreThanOneEvent(segment1);
         }
     }
     // If we get here, we are just adding a segment to a block, not
@@ -151,69 +352,31 @@ bool stCaf_filterByMultipleSpecies(stPinchSegment *segment1,
 
 bool stCaf_filterByRepeatSpecies(stPinchSegment *segment1,
                                  stPinchSegment *segment2) {
-    return checkIntersection(getEvents(segment1, flower), getEvents(segment2, flower));
+    return checkIntersection(segment1, segment2, EVENTS);
 }
 
 bool stCaf_relaxedFilterByRepeatSpecies(stPinchSegment *segment1,
                                         stPinchSegment *segment2) {
     return stPinchSegment_getBlock(segment1) != NULL
         && stPinchSegment_getBlock(segment2) != NULL
-        && checkIntersection(getEvents(segment1, flower), getEvents(segment2, flower));
-}
-
-static stSortedSet *getChrNames(stPinchSegment *segment, Flower *flower) {
-    stSortedSet *names = stSortedSet_construct();
-    if (stPinchSegment_getBlock(segment) != NULL) {
-        stPinchBlock *block = stPinchSegment_getBlock(segment);
-        stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
-        while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-            Cap *cap = flower_getCap(flower, stPinchSegment_getName(segment));
-            Sequence *sequence = cap_getSequence(cap);
-            stSortedSet_insert(names, (void *) sequence_getName(sequence));
-        }
-    } else {
-        Cap *cap = flower_getCap(flower, stPinchSegment_getName(segment));
-        Sequence *sequence = cap_getSequence(cap);
-        stSortedSet_insert(names, (void *) sequence_getName(sequence));
-    }
-    return names;
+        && checkIntersection(segment1, segment2, EVENTS);
 }
 
 bool stCaf_singleCopyChr(stPinchSegment *segment1,
                          stPinchSegment *segment2) {
-    return checkIntersection(getChrNames(segment1, flower), getChrNames(segment2, flower));
-}
-
-static stSortedSet *getIngroupEvents(stPinchSegment *segment, Flower *flower) {
-    stSortedSet *events = stSortedSet_construct();
-    if (stPinchSegment_getBlock(segment) != NULL) {
-        stPinchBlock *block = stPinchSegment_getBlock(segment);
-        stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
-        while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-            Event *event = stCaf_getEvent(segment, flower);
-            if (!event_isOutgroup(event)) {
-                stSortedSet_insert(events, event);
-            }
-        }
-    } else {
-        Event *event = stCaf_getEvent(segment, flower);
-        if (!event_isOutgroup(event)) {
-            stSortedSet_insert(events, event);
-        }
-    }
-    return events;
+    return checkIntersection(segment1, segment2, SEQUENCES);
 }
 
 bool stCaf_singleCopyIngroup(stPinchSegment *segment1,
                              stPinchSegment *segment2) {
-    return checkIntersection(getIngroupEvents(segment1, flower), getIngroupEvents(segment2, flower));
+    return checkIntersection(segment1, segment2, INGROUP_EVENTS);
 }
 
 bool stCaf_relaxedSingleCopyIngroup(stPinchSegment *segment1,
                                     stPinchSegment *segment2) {
     return stPinchSegment_getBlock(segment1) != NULL
         && stPinchSegment_getBlock(segment2) != NULL
-        && checkIntersection(getIngroupEvents(segment1, flower), getIngroupEvents(segment2, flower));
+        && checkIntersection(segment1, segment2, INGROUP_EVENTS);
 }
 
 /*
@@ -407,12 +570,32 @@ bool stCaf_containsRequiredSpecies(stPinchBlock *pinchBlock,
                                    int64_t minimumOutgroupDegree,
                                    int64_t minimumDegree,
                                    int64_t minimumNumberOfSpecies) {
-    stSet *seenEvents = stSet_construct();
     int64_t numberOfSpecies = 0;
     int64_t outgroupSequences = 0;
     int64_t ingroupSequences = 0;
     stPinchBlockIt segmentIt = stPinchBlock_getSegmentIterator(pinchBlock);
     stPinchSegment *segment;
+    if (flower == threadInfoFlower) { // Counts the species with the event bitset.
+        MarkBits *markBits = getMarkBits();
+        while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
+            int64_t eventIndex = getThreadInfo(segment)->eventIndex;
+            if (!testBit(markBits->eventBits, eventIndex)) {
+                setBit(markBits->eventBits, eventIndex, 1);
+                numberOfSpecies++;
+            }
+            if (outgroupEvents[eventIndex]) {
+                outgroupSequences++;
+            } else {
+                ingroupSequences++;
+            }
+        }
+        markSegments(markBits, stPinchBlock_getFirst(pinchBlock), EVENTS, 0);
+        return ingroupSequences >= minimumIngroupDegree &&
+            outgroupSequences >= minimumOutgroupDegree &&
+            outgroupSequences + ingroupSequences >= minimumDegree &&
+            numberOfSpecies >= minimumNumberOfSpecies;
+    }
+    stSet *seenEvents = stSet_construct();
     while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
         Event *event = stCaf_getEvent(segment, flower);
         if (!stSet_search(seenEvents, event)) {
@@ -10,103 +10,173 @@
 #include <math.h>
 #include <stdlib.h>
 
-static void *getValue(stHash *hash, int64_t node) {
-    stIntTuple *nodeTuple = stIntTuple_construct1(node);
-    void *object = stHash_search(hash, nodeTuple);
-    stIntTuple_destruct(nodeTuple);
-    return object;
-}
+/*
+ * The greedy breakup works on flat arrays. The nodes are numbered densely, and the components are kept in a
+ * union-find, joined by size, so adding an edge costs almost constant time and each node a few words.
+ */
 
-stList *stCaf_breakupComponentGreedily(stList *nodes, stList *edges, int64_t maxComponentSize) {
+typedef struct _greedyEdge {
+    int64_t weight;
+    int64_t node1; //The nodes as given, which break ties between edges of equal weight.
+    int64_t node2;
+    int64_t index1; //The dense numbers of the nodes.
+    int64_t index2;
+    int64_t edge; //The index of the edge in the input.
+} GreedyEdge;
+
+static int greedyEdge_cmp(const void *a, const void *b) {
     /*
-     * Make a component for each node in the graph
+     * Sorts the edges by descending weight, then by descending nodes, the order the sorted set based
+     * implementation took them in.
      */
-    stHash *nodeToComponents = stHash_construct3((uint64_t(*)(const void *)) stIntTuple_hashKey,
-            (int(*)(const void *, const void *)) stIntTuple_equalsFn, NULL, NULL);
-    stListIterator *listIt = stList_getIterator(nodes);
-    stIntTuple *node;
-    while ((node = stList_getNext(listIt)) != NULL) {
-        stSortedSet *component = stSortedSet_construct();
-        stSortedSet_insert(component, node);
-        assert(stHash_search(nodeToComponents, node) == NULL);
-        stHash_insert(nodeToComponents, node, component);
-    }
-    stList_destructIterator(listIt);
-
-    stList *sortedEdges = stList_copy(edges, NULL); //copy, to avoid messing input
-    stList_sort(sortedEdges, (int(*)(const void *, const void *)) stIntTuple_cmpFn); //Sort in ascending order, so best edge first
-    int64_t edgeScore = INT64_MAX;
-    //While edges exist, try and put them into the graph.
-    stList *edgesToDelete = stList_construct();
-    int64_t totalComponents = stList_length(nodes);
-    while (stList_length(sortedEdges) > 0) {
-        stIntTuple *edge = stList_pop(sortedEdges);
-        assert(edgeScore >= stIntTuple_get(edge, 0));
-        edgeScore = stIntTuple_get(edge, 0);
-        stSortedSet *component1 = getValue(nodeToComponents, stIntTuple_get(edge, 1));
-        stSortedSet *component2 = getValue(nodeToComponents, stIntTuple_get(edge, 2));
-        assert(component1 != NULL && component2 != NULL);
+    const GreedyEdge *edge1 = a, *edge2 = b;
+    if (edge1->weight != edge2->weight) {
+        return edge1->weight > edge2->weight ? -1 : 1;
+    }
+    if (edge1->node1 != edge2->node1) {
+        return edge1->node1 > edge2->node1 ? -1 : 1;
+    }
+    if (edge1->node2 != edge2->node2) {
+        return edge1->node2 > edge2->node2 ? -1 : 1;
+    }
+    return edge1->edge < edge2->edge ? -1 : (edge1->edge > edge2->edge ? 1 : 0);
+}
+
+static int64_t findComponent(int64_t *parents, int64_t node) {
+    while (parents[node] != node) {
+        parents[node] = parents[parents[node]]; //Path halving.
+        node = parents[node];
+    }
+    return node;
+}
+
+/*
+ * Adds the edges, best first, to a graph of nodeNumber unconnected nodes, rejecting those that would join
+ * two components into one bigger than maxComponentSize. Sorts the edges, and returns the rejected ones
+ * in the order they were considered, as indices into the sorted edges, in rejectedEdges.
+ */
+static int64_t breakupComponentGreedily(int64_t nodeNumber, GreedyEdge *edges, int64_t edgeNumber,
+        int64_t maxComponentSize, int64_t *rejectedEdges, int64_t *rejectedEdgeNumber) {
+    int64_t *parents = st_malloc((nodeNumber + 1) * sizeof(int64_t));
+    int64_t *sizes = st_malloc((nodeNumber + 1) * sizeof(int64_t));
+    for (int64_t i = 0; i < nodeNumber; i++) {
+        parents[i] = i;
+        sizes[i] = 1;
+    }
+    qsort(edges, edgeNumber, sizeof(GreedyEdge), greedyEdge_cmp);
+    int64_t totalComponents = nodeNumber;
+    *rejectedEdgeNumber = 0;
+    for (int64_t i = 0; i < edgeNumber; i++) {
+        int64_t component1 = findComponent(parents, edges[i].index1);
+        int64_t component2 = findComponent(parents, edges[i].index2);
         if (component1 == component2) { //We're golden, as the edge is already contained within one component.
             continue;
         }
-        if (stSortedSet_size(component1) + stSortedSet_size(component2) > maxComponentSize) { //This edge would make a too large component, so reject
-            stList_append(edgesToDelete, edge);
+        if (sizes[component1] + sizes[component2] > maxComponentSize) { //This edge would make a too large component, so reject
+            rejectedEdges[(*rejectedEdgeNumber)++] = i;
             continue;
         }
-        //Merge the components and replace references in the hash.
-        if (stSortedSet_size(component1) < stSortedSet_size(component2)) {
-            stSortedSet *component3 = component1;
+        //Hang the smaller component off the bigger.
+        if (sizes[component1] < sizes[component2]) {
+            int64_t component3 = component1;
             component1 = component2;
             component2 = component3;
         }
-        assert(stSortedSet_size(component1) >= stSortedSet_size(component2));
-        while (stSortedSet_size(component2) > 0) {
-            node = stSortedSet_getLast(component2);
-            stSortedSet_remove(component2, node);
-            assert(stSortedSet_search(component1, node) == NULL);
-            stSortedSet_insert(component1, node);
-            stHash_insert(nodeToComponents, node, component1);
-        }
-        stSortedSet_destruct(component2);
-        totalComponents -= 1;
+        parents[component2] = component1;
+        sizes[component1] += sizes[component2];
+        totalComponents--;
+    }
+    free(parents);
+    free(sizes);
+    return totalComponents;
+}
+
+stList *stCaf_breakupComponentGreedily(stList *nodes, stList *edges, int64_t maxComponentSize) {
+    /*
+     * Number the nodes densely.
+     */
+    int64_t nodeNumber = stList_length(nodes);
+    int64_t *indices = st_malloc((nodeNumber + 1) * sizeof(int64_t));
+    stHash *nodesToIndices = stHash_construct3((uint64_t(*)(const void *)) stIntTuple_hashKey,
+            (int(*)(const void *, const void *)) stIntTuple_equalsFn, NULL, NULL);
+    for (int64_t i = 0; i < nodeNumber; i++) {
+        stIntTuple *node = stList_get(nodes, i);
+        assert(stHash_search(nodesToIndices, node) == NULL);
+        indices[i] = i;
+        stHash_insert(nodesToIndices, node, &indices[i]);
+    }
+
+    int64_t edgeNumber = stList_length(edges);
+    GreedyEdge *greedyEdges = st_malloc((edgeNumber + 1) * sizeof(GreedyEdge));
+    for (int64_t i = 0; i < edgeNumber; i++) {
+        stIntTuple *edge = stList_get(edges, i);
+        GreedyEdge *greedyEdge = &greedyEdges[i];
+        greedyEdge->weight = stIntTuple_get(edge, 0);
+        greedyEdge->node1 = stIntTuple_get(edge, 1);
+        greedyEdge->node2 = stIntTuple_get(edge, 2);
+        stIntTuple *node = stIntTuple_construct1(greedyEdge->node1);
+        int64_t *index = stHash_search(nodesToIndices, node);
+        assert(index != NULL);
+        greedyEdge->index1 = *index;
+        stIntTuple_destruct(node);
+        node = stIntTuple_construct1(greedyEdge->node2);
+        index = stHash_search(nodesToIndices, node);
+        assert(index != NULL);
+        greedyEdge->index2 = *index;
+        stIntTuple_destruct(node);
+        greedyEdge->edge = i;
+    }
+    stHash_destruct(nodesToIndices);
+    free(indices);
+
+    int64_t *rejectedEdges = st_malloc((edgeNumber + 1) * sizeof(int64_t));
+    int64_t rejectedEdgeNumber;
+    int64_t totalComponents = breakupComponentGreedily(nodeNumber, greedyEdges, edgeNumber, maxComponentSize,
+            rejectedEdges, &rejectedEdgeNumber);
+    stList *edgesToDelete = stList_construct();
+    for (int64_t i = 0; i < rejectedEdgeNumber; i++) {
+        stList_append(edgesToDelete, stList_get(edges, greedyEdges[rejectedEdges[i]].edge));
     }
 
     st_logDebug(
             "We broke a graph with %" PRIi64 " nodes and %" PRIi64 " edges for a max component size of %" PRIi64 " into %" PRIi64 " distinct components with %" PRIi64 " edges, discarding %" PRIi64 " edges\n",
-            stList_length(nodes), stList_length(edges), maxComponentSize, totalComponents,
-            stList_length(edges) - stList_length(edgesToDelete), stList_length(edgesToDelete));
+            nodeNumber, edgeNumber, maxComponentSize, totalComponents, edgeNumber - rejectedEdgeNumber,
+            rejectedEdgeNumber);
 
     //Cleanup
-    stList_destruct(sortedEdges);
-    stList *components = stHash_getValues(nodeToComponents);
-    stSortedSet *componentsSet = stList_getSortedSet(components, NULL);
-    stList_destruct(components);
-    stSortedSet_setDestructor(componentsSet, (void(*)(void *)) stSortedSet_destruct);
-    stSortedSet_destruct(componentsSet);
-    stHash_destruct(nodeToComponents);
+    free(greedyEdges);
+    free(rejectedEdges);
 
     return edgesToDelete;
 }
 
-static void convertToNodesAndEdges(stList *adjacencyComponent, stList **nodes, stList **edges) {
-    //Make nodes
-    *nodes = stList_construct3(0, (void(*)(void *)) stIntTuple_destruct);
-    stHash *pinchEndsToNodesHash = stHash_construct3(stPinchEnd_hashFn, stPinchEnd_equalsFn, NULL, NULL);
-    for (int64_t i = 0; i < stList_length(adjacencyComponent); i++) {
-        stIntTuple *node = stIntTuple_construct1(i);
-        stList_append(*nodes, node);
-        assert(stHash_search(pinchEndsToNodesHash, stList_get(adjacencyComponent, i)) == NULL);
-        stHash_insert(pinchEndsToNodesHash, stList_get(adjacencyComponent, i), node);
-    }
-    //Make edges
-
-    //First build a hash of edges to their multiplicity
-    stHash *edgesToMultiplicityHash = stHash_construct3((uint64_t(*)(const void *)) stIntTuple_hashKey,
-            (int(*)(const void *, const void *)) stIntTuple_equalsFn, (void(*)(void *)) stIntTuple_destruct,
-            (void(*)(void *)) stIntTuple_destruct);
-    for (int64_t i = 0; i < stList_length(adjacencyComponent); i++) {
+static int nodePair_cmp(const void *a, const void *b) {
+    const int64_t *pair1 = a, *pair2 = b;
+    if (pair1[0] != pair2[0]) {
+        return pair1[0] < pair2[0] ? -1 : 1;
+    }
+    return pair1[1] < pair2[1] ? -1 : (pair1[1] > pair2[1] ? 1 : 0);
+}
+
+/*
+ * Makes an edge for each pair of ends of the adjacency component joined by adjacencies, weighted by the number of
+ * adjacencies joining them. The ends are numbered by their position in the component.
+ */
+static GreedyEdge *getEdges(stList *adjacencyComponent, int64_t *edgeNumber) {
+    int64_t nodeNumber = stList_length(adjacencyComponent);
+    int64_t *indices = st_malloc((nodeNumber + 1) * sizeof(int64_t));
+    stHash *pinchEndsToNodes = stHash_construct3(stPinchEnd_hashFn, stPinchEnd_equalsFn, NULL, NULL);
+    for (int64_t i = 0; i < nodeNumber; i++) {
+        assert(stHash_search(pinchEndsToNodes, stList_get(adjacencyComponent, i)) == NULL);
+        indices[i] = i;
+        stHash_insert(pinchEndsToNodes, stList_get(adjacencyComponent, i), &indices[i]);
+    }
+
+    //Each adjacency gives a pair of nodes, which are sorted so that the copies of a pair are counted in one pass.
+    int64_t pairNumber = 0, maxPairNumber = nodeNumber + 1;
+    int64_t *pairs = st_malloc(2 * maxPairNumber * sizeof(int64_t));
+    for (int64_t i = 0; i < nodeNumber; i++) {
         stPinchEnd *pinchEnd1 = stList_get(adjacencyComponent, i);
-        int64_t node1 = stIntTuple_get(stHash_search(pinchEndsToNodesHash, pinchEnd1), 0);
         stPinchBlockIt segmentIt = stPinchBlock_getSegmentIterator(stPinchEnd_getBlock(pinchEnd1));
         stPinchSegment *segment;
         while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
@@ -116,18 +186,16 @@ static void convertToNodesAndEdges(stList *adjacencyComponent, stList **nodes, s
                 if (stPinchSegment_getBlock(segment2) != NULL) {
                     stPinchEnd pinchEnd2 = stPinchEnd_constructStatic(stPinchSegment_getBlock(segment2),
                             stPinchEnd_endOrientation(traverse5Prime, segment2));
-                    assert(stHash_search(pinchEndsToNodesHash, &pinchEnd2) != NULL);
-                    int64_t node2 = stIntTuple_get(stHash_search(pinchEndsToNodesHash, &pinchEnd2), 0);
-                    if (node1 != node2) { //Ignore self edges
-                        stIntTuple *edge = node1 < node2 ? stIntTuple_construct2(node1, node2) : stIntTuple_construct2(node2, node1);
-                        int64_t multiplicity = 1;
-                        if (stHash_search(edgesToMultiplicityHash, edge) != NULL) {
-                            stIntTuple *count = stHash_removeAndFreeKey(edgesToMultiplicityHash, edge);
-                            multiplicity += stIntTuple_get(count, 0);
-                            stIntTuple_destruct(count);
-                            assert(multiplicity > 1);
+                    int64_t *node2 = stHash_search(pinchEndsToNodes, &pinchEnd2);
+                    assert(node2 != NULL);
+                    if (i != *node2) { //Ignore self edges
+                        if (pairNumber == maxPairNumber) {
+                            maxPairNumber *= 2;
+                            pairs = st_realloc(pairs, 2 * maxPairNumber * sizeof(int64_t));
                         }
-                        stHash_insert(edgesToMultiplicityHash, edge, stIntTuple_construct1(multiplicity));
+                        pairs[2 * pairNumber] = i < *node2 ? i : *node2;
+                        pairs[2 * pairNumber + 1] = i < *node2 ? *node2 : i;
+                        pairNumber++;
                     }
                     break;
                 }
@@ -135,18 +203,27 @@ static void convertToNodesAndEdges(stList *adjacencyComponent, stList **nodes, s
             }
         }
     }
+    stHash_destruct(pinchEndsToNodes);
+    free(indices);
+    qsort(pairs, pairNumber, 2 * sizeof(int64_t), nodePair_cmp);
+
     //Now build edges, scoring them according to their multiplicity
-    *edges = stList_construct3(0, (void(*)(void *)) stIntTuple_destruct);
-    stHashIterator *hashIt = stHash_getIterator(edgesToMultiplicityHash);
-    stIntTuple *edge;
-    while ((edge = stHash_getNext(hashIt)) != NULL) {
-        stIntTuple *count = stHash_search(edgesToMultiplicityHash, edge);
-        stList_append(*edges, stIntTuple_construct3(stIntTuple_get(count, 0), stIntTuple_get(edge, 0), stIntTuple_get(edge, 1)));
+    GreedyEdge *edges = st_malloc((pairNumber + 1) * sizeof(GreedyEdge));
+    *edgeNumber = 0;
+    for (int64_t i = 0; i < pairNumber;) {
+        int64_t j = i + 1;
+        while (j < pairNumber && pairs[2 * j] == pairs[2 * i] && pairs[2 * j + 1] == pairs[2 * i + 1]) {
+            j++;
+        }
+        GreedyEdge *edge = &edges[*edgeNumber];
+        edge->weight = j - i;
+        edge->node1 = edge->index1 = pairs[2 * i];
+        edge->node2 = edge->index2 = pairs[2 * i + 1];
+        edge->edge = (*edgeNumber)++;
+        i = j;
     }
-
-    //Cleanup
-    stHash_destruct(pinchEndsToNodesHash);
-    stHash_destruct(edgesToMultiplicityHash);
+    free(pairs);
+    return edges;
 }
 
 static void breakEdges(stPinchThreadSet *threadSet, stPinchEnd *pinchEnd1, stPinchEnd *pinchEnd2) {
@@ -196,17 +273,24 @@ void stCaf_breakupComponentsGreedily(stPinchThreadSet *threadSet, float maximumA
         stList *adjacencyComponent = stList_get(adjacencyComponents, i);
         if (maximumAdjacencyComponentSize < stList_length(adjacencyComponent)) {
             //Get graph description
-            stList *nodes, *edges;
-            convertToNodesAndEdges(adjacencyComponent, &nodes, &edges);
+            int64_t nodeNumber = stList_length(adjacencyComponent), edgeNumber;
+            GreedyEdge *edges = getEdges(adjacencyComponent, &edgeNumber);
             //Get the edges to remove
-            stList *edgesToDelete = stCaf_breakupComponentGreedily(nodes, edges, maximumAdjacencyComponentSize);
+            int64_t *edgesToDelete = st_malloc((edgeNumber + 1) * sizeof(int64_t));
+            int64_t edgesToDeleteNumber;
+            int64_t totalComponents = breakupComponentGreedily(nodeNumber, edges, edgeNumber,
+                    maximumAdjacencyComponentSize, edgesToDelete, &edgesToDeleteNumber);
+            st_logDebug(
+                    "We broke a graph with %" PRIi64 " nodes and %" PRIi64 " edges for a max component size of %" PRIi64 " into %" PRIi64 " distinct components with %" PRIi64 " edges, discarding %" PRIi64 " edges\n",
+                    nodeNumber, edgeNumber, maximumAdjacencyComponentSize, totalComponents,
+                    edgeNumber - edgesToDeleteNumber, edgesToDeleteNumber);
             //Break edges;
             int64_t unbrokenEdges = 0;
-            for (int64_t j = 0; j < stList_length(edgesToDelete); j++) {
-                stIntTuple *edge = stList_get(edgesToDelete, j);
-                assert(stIntTuple_get(edge, 1) < stIntTuple_get(edge, 2));
-                stPinchEnd *pinchEnd1 = stList_get(adjacencyComponent, stIntTuple_get(edge, 1));
-                stPinchEnd *pinchEnd2 = stList_get(adjacencyComponent, stIntTuple_get(edge, 2));
+            for (int64_t j = 0; j < edgesToDeleteNumber; j++) {
+                GreedyEdge *edge = &edges[edgesToDelete[j]];
+                assert(edge->node1 < edge->node2);
+                stPinchEnd *pinchEnd1 = stList_get(adjacencyComponent, edge->node1);
+                stPinchEnd *pinchEnd2 = stList_get(adjacencyComponent, edge->node2);
                 if (stPinchBlock_getDegree(stPinchEnd_getBlock(pinchEnd1)) > 1 && stPinchBlock_getDegree(stPinchEnd_getBlock(pinchEnd2))
                         > 1) {
                     breakEdges(threadSet, pinchEnd1, pinchEnd2);
@@ -214,14 +298,13 @@ void stCaf_breakupComponentsGreedily(stPinchThreadSet *threadSet, float maximumA
                     unbrokenEdges++;
                 }
             }
-            if (stList_length(edgesToDelete) > 0) {
+            if (edgesToDeleteNumber > 0) {
                 st_logInfo("Pinch graph component with %" PRIi64 " nodes and %" PRIi64 " edges is being split up by breaking %" PRIi64 " edges to reduce size to less than %" PRIi64 " max, but found %" PRIi64 " pointless edges \n",
-                           stList_length(nodes), stList_length(edges), stList_length(edgesToDelete), maximumAdjacencyComponentSize, unbrokenEdges);
+                           nodeNumber, edgeNumber, edgesToDeleteNumber, maximumAdjacencyComponentSize, unbrokenEdges);
             }
             //Cleanup
-            stList_destruct(edges);
-            stList_destruct(nodes);
-            stList_destruct(edgesToDelete);
+            free(edges);
+            free(edgesToDelete);
         }
     }
     stList_destruct(adjacencyComponents);
@@ -79,24 +79,3 @@ void stCaf_sortCigarsByScoreInDescendingOrder(stList *cigars) {
         }
 #endif
 }
-
-void stCaf_sortCigarsFileByScoreInDescendingOrder(char *cigarsFile, char *sortedFile) {
-    int64_t i = st_system("sort -k10,10nr -k2,2 %s > %s", cigarsFile, sortedFile);
-    if(i != 0) {
-        st_errAbort("Encountered unix sort error when sorting cigar alignments in file: %s\n", cigarsFile);
-    }
-    i = st_system("chmod 777 %s", sortedFile);
-    if(i != 0) {
-        st_errAbort("Encountered error when changing file permissions: %s\n", cigarsFile);
-    }
-#ifndef NDEBUG
-    double score = INT64_MAX;
-    FILE *fileHandle = fopen(sortedFile, "r");
-    struct PairwiseAlignment *pA;
-    while ((pA = cigarRead(fileHandle)) != NULL) {
-        assert(pA->score <= score);
-        score = pA->score;
-    }
-    fclose(fileHandle);
-#endif
-}
@@ -142,6 +142,148 @@ void stCaf_melt(Flower *flower, stPinchThreadSet *threadSet, bool blockFilterfn(
     stCaf_joinTrivialBoundaries(threadSet);
 }
 
+///////////////////////////////////////////////////////////////////////////
+// Incremental melting
+//
+// Melting the blocks of a chain contracts the chain's cycle in the cactus graph, merging the adjacency components
+// along it into one node. Every cut of two edges in another chain is still a cut, so the other chains, and their
+// lengths, are exactly those a rebuilt cactus graph would have. The one exception is at the top level, where a
+// thread component that loses its link to the dead end component is attached to it anew when the graph is
+// rebuilt, which can join chains. So the rounds can melt chains from one graph, in order of length, rebuilding it
+// only when that happens.
+///////////////////////////////////////////////////////////////////////////
+
+typedef struct _chainLength {
+    stCactusEdgeEnd *chainEnd;
+    int64_t length;
+} ChainLength;
+
+static int chainLength_cmp(const void *a, const void *b) {
+    int64_t i = ((const ChainLength *) a)->length, j = ((const ChainLength *) b)->length;
+    return i < j ? -1 : (i > j ? 1 : 0);
+}
+
+static ChainLength *getChainLengths(stCactusGraph *cactusGraph, int64_t *chainNumber) {
+    int64_t maxChainNumber = 64;
+    ChainLength *chainLengths = st_malloc(maxChainNumber * sizeof(ChainLength));
+    *chainNumber = 0;
+    stCactusGraphNodeIt *nodeIt = stCactusGraphNodeIterator_construct(cactusGraph);
+    stCactusNode *cactusNode;
+    while ((cactusNode = stCactusGraphNodeIterator_getNext(nodeIt)) != NULL) {
+        stCactusNodeEdgeEndIt cactusEdgeEndIt = stCactusNode_getEdgeEndIt(cactusNode);
+        stCactusEdgeEnd *cactusEdgeEnd;
+        while ((cactusEdgeEnd = stCactusNodeEdgeEndIt_getNext(&cactusEdgeEndIt)) != NULL) {
+            if (stCactusEdgeEnd_isChainEnd(cactusEdgeEnd) && stCactusEdgeEnd_getLinkOrientation(cactusEdgeEnd)) {
+                if (*chainNumber == maxChainNumber) {
+                    maxChainNumber *= 2;
+                    chainLengths = st_realloc(chainLengths, maxChainNumber * sizeof(ChainLength));
+                }
+                chainLengths[*chainNumber].chainEnd = cactusEdgeEnd;
+                chainLengths[(*chainNumber)++].length = getChainLength(cactusEdgeEnd);
+            }
+        }
+    }
+    stCactusGraphNodeIterator_destruct(nodeIt);
+    qsort(chainLengths, *chainNumber, sizeof(ChainLength), chainLength_cmp);
+    return chainLengths;
+}
+
+/*
+ * Gets the threads with an end in the dead end component, as attached when the cactus graph was built.
+ */
+static stSet *getAttachedThreads(stPinchThreadSet *threadSet, stList *deadEndComponent) {
+    stSet *deadEnds = stSet_construct3(stPinchEnd_hashFn, stPinchEnd_equalsFn, NULL);
+    for (int64_t i = 0; i < stList_length(deadEndComponent); i++) {
+        stSet_insert(deadEnds, stList_get(deadEndComponent, i));
+    }
+    stSet *attachedThreads = stSet_construct();
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet);
+    stPinchThread *thread;
+    while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        stPinchSegment *first = stPinchThread_getFirst(thread), *last = stPinchThread_getLast(thread);
+        stPinchEnd end5Prime = stPinchEnd_constructStatic(stPinchSegment_getBlock(first), stPinchSegment_getBlockOrientation(first));
+        stPinchEnd end3Prime = stPinchEnd_constructStatic(stPinchSegment_getBlock(last), !stPinchSegment_getBlockOrientation(last));
+        if (stSet_search(deadEnds, &end5Prime) != NULL || stSet_search(deadEnds, &end3Prime) != NULL) {
+            stSet_insert(attachedThreads, thread);
+        }
+    }
+    stSet_destruct(deadEnds);
+    return attachedThreads;
+}
+
+/*
+ * Returns non-zero if every thread component still contains a thread attached to the dead end component.
+ */
+static bool threadComponentsAreAttached(stPinchThreadSet *threadSet, stSet *attachedThreads) {
+    stSortedSet *threadComponents = stPinchThreadSet_getThreadComponents(threadSet);
+    stSortedSetIterator *componentIt = stSortedSet_getIterator(threadComponents);
+    bool attached = 1;
+    stList *threadComponent;
+    while (attached && (threadComponent = stSortedSet_getNext(componentIt)) != NULL) {
+        attached = 0;
+        for (int64_t i = 0; i < stList_length(threadComponent) && !attached; i++) {
+            attached = stSet_search(attachedThreads, stList_get(threadComponent, i)) != NULL;
+        }
+    }
+    stSortedSet_destructIterator(componentIt);
+    stSortedSet_destruct(threadComponents);
+    return attached;
+}
+
+void stCaf_meltIncrementally(Flower *flower, stPinchThreadSet *threadSet, int64_t *minimumChainLengths,
+        int64_t minimumChainLengthsLength) {
+    stCactusGraph *cactusGraph = NULL;
+    ChainLength *chainLengths = NULL;
+    stSet *attachedThreads = NULL;
+    int64_t chainNumber = 0, nextChain = 0, graphsBuilt = 0;
+    for (int64_t round = 0; round < minimumChainLengthsLength; round++) {
+        int64_t minimumChainLength = minimumChainLengths[round];
+        assert(round == 0 || minimumChainLength >= minimumChainLengths[round - 1]);
+        if (minimumChainLength <= 1) {
+            continue;
+        }
+        if (cactusGraph == NULL) {
+            stCactusNode *startCactusNode;
+            stList *deadEndComponent;
+            cactusGraph = stCaf_getCactusGraphForThreadSet(flower, threadSet, &startCactusNode, &deadEndComponent, 0, INT64_MAX,
+                    0.0, 0, INT64_MAX);
+            chainLengths = getChainLengths(cactusGraph, &chainNumber);
+            attachedThreads = getAttachedThreads(threadSet, deadEndComponent);
+            nextChain = 0;
+            graphsBuilt++;
+        }
+        //The chains melted by earlier rounds are all shorter, so this round melts the next ones in order of length.
+        stList *blocksToDelete = stList_construct3(0, (void(*)(void *)) stPinchBlock_destruct);
+        while (nextChain < chainNumber && chainLengths[nextChain].length < minimumChainLength) {
+            addChainBlocksToBlocksToDelete(chainLengths[nextChain++].chainEnd, blocksToDelete);
+        }
+
+        printf("A melting round is destroying %" PRIi64 " blocks with an average degree "
+               "of %lf from chains with length less than %" PRIi64 ". Total aligned bases"
+               " lost: %" PRIu64 "\n",
+               stList_length(blocksToDelete), stCaf_averageBlockDegree(blocksToDelete),
+               minimumChainLength, stCaf_totalAlignedBases(blocksToDelete));
+
+        bool melted = stList_length(blocksToDelete) > 0;
+        stList_destruct(blocksToDelete); //This will destroy the blocks
+        if (melted && flower_getName(flower) == 0 && !threadComponentsAreAttached(threadSet, attachedThreads)) {
+            //A rebuilt graph would attach the detached thread components, so rebuild it for the next round.
+            stCactusGraph_destruct(cactusGraph);
+            free(chainLengths);
+            stSet_destruct(attachedThreads);
+            cactusGraph = NULL;
+        }
+    }
+    if (cactusGraph != NULL) {
+        stCactusGraph_destruct(cactusGraph);
+        free(chainLengths);
+        stSet_destruct(attachedThreads);
+    }
+    st_logDebug("Melted %" PRIi64 " rounds building %" PRIi64 " cactus graphs\n", minimumChainLengthsLength, graphsBuilt);
+    //The trivial boundaries are joined once, as joining them does not change the lengths of the chains.
+    stCaf_joinTrivialBoundaries(threadSet);
+}
+
 static bool isTelomere(stPinchEnd *end, stSet *deadEndComponent) {
     stPinchSegment *segment = stPinchBlock_getFirst(end->block);
     bool atEndOfThread = stPinchThread_getFirst(stPinchSegment_getThread(segment)) == segment || stPinchThread_getLast(stPinchSegment_getThread(segment)) == segment;
@@ -6,6 +6,10 @@
  */
 
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "sonLib.h"
 #include "stPinchGraphs.h"
 #include "stPinchIterator.h"
@@ -139,6 +143,142 @@ stPinchIterator *stPinchIterator_constructFromFile(const char *alignmentFile) {
     return pinchIterator;
 }
 
+typedef struct _pinchFileHeader {
+    char magic[8];
+    int64_t version;
+    int64_t flags;
+    int64_t recordNumber;
+} PinchFileHeader;
+
+typedef struct _pinchFileRecord {
+    int64_t name1;
+    int64_t name2;
+    int64_t start1;
+    int64_t start2;
+    int64_t length;
+    int64_t strand;
+    double score;
+} PinchFileRecord;
+
+static bool readPinchFileHeader(const char *binaryFile, PinchFileHeader *header) {
+    FILE *fileHandle = fopen(binaryFile, "rb");
+    if (fileHandle == NULL) {
+        return 0;
+    }
+    bool isBinary = fread(header, sizeof(PinchFileHeader), 1, fileHandle) == 1
+            && memcmp(header->magic, ST_PINCH_FILE_MAGIC, sizeof(header->magic)) == 0;
+    fclose(fileHandle);
+    return isBinary;
+}
+
+bool stPinchIterator_isBinaryFile(const char *alignmentFile) {
+    PinchFileHeader header;
+    return readPinchFileHeader(alignmentFile, &header);
+}
+
+bool stPinchIterator_isBinaryFileSortedByScore(const char *binaryFile) {
+    PinchFileHeader header;
+    return readPinchFileHeader(binaryFile, &header) && (header.flags & ST_PINCH_FILE_SORTED_BY_SCORE);
+}
+
+void stPinchIterator_convertCigarFileToBinaryFile(const char *alignmentFile, const char *binaryFile, bool sortedByScore) {
+    FILE *inputHandle = fopen(alignmentFile, "r");
+    if (inputHandle == NULL) {
+        st_errAbort("Could not open the alignments file: %s\n", alignmentFile);
+    }
+    FILE *outputHandle = fopen(binaryFile, "wb");
+    if (outputHandle == NULL) {
+        st_errAbort("Could not create the binary pinch file: %s\n", binaryFile);
+    }
+    PinchFileHeader header;
+    memset(&header, 0, sizeof(PinchFileHeader));
+    memcpy(header.magic, ST_PINCH_FILE_MAGIC, sizeof(header.magic));
+    header.version = ST_PINCH_FILE_VERSION;
+    header.flags = sortedByScore ? ST_PINCH_FILE_SORTED_BY_SCORE : 0;
+    bool failed = fwrite(&header, sizeof(PinchFileHeader), 1, outputHandle) != 1;
+    //The pinches are taken from the alignments exactly as the text iterator does, keeping the score of their alignment.
+    PairwiseAlignmentToPinch *pA = pairwiseAlignmentToPinch_construct(inputHandle,
+            (struct PairwiseAlignment *(*)(void *)) cigarRead, 1);
+    stPinch *pinch;
+    while ((pinch = pairwiseAlignmentToPinch_getNext(pA)) != NULL) {
+        PinchFileRecord record = { pinch->name1, pinch->name2, pinch->start1, pinch->start2, pinch->length,
+                pinch->strand, pA->pairwiseAlignment->score };
+        failed = failed || fwrite(&record, sizeof(PinchFileRecord), 1, outputHandle) != 1;
+        header.recordNumber++;
+    }
+    pairwiseAlignmentToPinch_destructForFile(pA);
+    //Now the number of records is known, write it into the header.
+    failed = failed || fseek(outputHandle, 0, SEEK_SET) != 0
+            || fwrite(&header, sizeof(PinchFileHeader), 1, outputHandle) != 1;
+    if (fclose(outputHandle) != 0 || failed) {
+        st_errAbort("Could not write the binary pinch file: %s\n", binaryFile);
+    }
+}
+
+typedef struct _pinchFile {
+    const PinchFileHeader *data; //The mapping of the whole file.
+    int64_t dataSize;
+    const PinchFileRecord *records;
+    int64_t recordNumber;
+    int64_t recordIndex;
+    stPinch pinch;
+} PinchFile;
+
+static stPinch *pinchFile_getNext(PinchFile *pinchFile) {
+    if (pinchFile->recordIndex >= pinchFile->recordNumber) {
+        return NULL;
+    }
+    const PinchFileRecord *record = &pinchFile->records[pinchFile->recordIndex++];
+    stPinch_fillOut(&pinchFile->pinch, record->name1, record->name2, record->start1, record->start2, record->length,
+            record->strand);
+    return &pinchFile->pinch;
+}
+
+static PinchFile *pinchFile_reset(PinchFile *pinchFile) {
+    pinchFile->recordIndex = 0;
+    return pinchFile;
+}
+
+static void pinchFile_destruct(PinchFile *pinchFile) {
+    munmap((void *) pinchFile->data, pinchFile->dataSize);
+    free(pinchFile);
+}
+
+stPinchIterator *stPinchIterator_constructFromBinaryFile(const char *binaryFile) {
+    int fileHandle = open(binaryFile, O_RDONLY);
+    if (fileHandle < 0) {
+        st_errAbort("Could not open the binary pinch file: %s\n", binaryFile);
+    }
+    struct stat fileStat;
+    if (fstat(fileHandle, &fileStat) != 0 || fileStat.st_size < (off_t) sizeof(PinchFileHeader)) {
+        st_errAbort("The file %s is too small to be a binary pinch file\n", binaryFile);
+    }
+    const PinchFileHeader *data = mmap(NULL, fileStat.st_size, PROT_READ, MAP_SHARED, fileHandle, 0);
+    close(fileHandle); //The mapping stays valid.
+    if (data == MAP_FAILED) {
+        st_errAbort("Could not map the binary pinch file: %s\n", binaryFile);
+    }
+    if (memcmp(data->magic, ST_PINCH_FILE_MAGIC, sizeof(data->magic)) != 0 || data->version != ST_PINCH_FILE_VERSION
+            || data->recordNumber < 0 || (int64_t) sizeof(PinchFileHeader)
+                    + data->recordNumber * (int64_t) sizeof(PinchFileRecord) != (int64_t) fileStat.st_size) {
+        st_errAbort("The file %s is not a complete binary pinch file\n", binaryFile);
+    }
+    //Every pass reads the records from first to last.
+    posix_madvise((void *) data, fileStat.st_size, POSIX_MADV_SEQUENTIAL);
+    PinchFile *pinchFile = st_calloc(1, sizeof(PinchFile));
+    pinchFile->data = data;
+    pinchFile->dataSize = fileStat.st_size;
+    pinchFile->records = (const PinchFileRecord *) (data + 1);
+    pinchFile->recordNumber = data->recordNumber;
+
+    stPinchIterator *pinchIterator = st_calloc(1, sizeof(stPinchIterator));
+    pinchIterator->alignmentArg = pinchFile;
+    pinchIterator->getNextAlignment = (stPinch *(*)(void *)) pinchFile_getNext;
+    pinchIterator->destructAlignmentArg = (void(*)(void *)) pinchFile_destruct;
+    pinchIterator->startAlignmentStack = (void *(*)(void *)) pinchFile_reset;
+    return pinchIterator;
+}
+
 static PairwiseAlignmentToPinch *pairwiseAlignmentToPinch_resetForList(PairwiseAlignmentToPinch *pA) {
     while (stList_getPrevious(pA->alignmentArg) != NULL)
         ;
@@ -178,6 +318,16 @@ stPinchIterator *stPinchIterator_constructFromAlignedPairs(stSortedSet *alignedP
     return pinchIterator;
 }
 
+stPinchIterator *stPinchIterator_construct(void *alignmentArg, stPinch *(*getNextAlignment)(void *),
+        void *(*startAlignmentStack)(void *), void (*destructAlignmentArg)(void *)) {
+    stPinchIterator *pinchIterator = st_calloc(1, sizeof(stPinchIterator));
+    pinchIterator->alignmentArg = alignmentArg;
+    pinchIterator->getNextAlignment = getNextAlignment;
+    pinchIterator->destructAlignmentArg = destructAlignmentArg;
+    pinchIterator->startAlignmentStack = startAlignmentStack;
+    return pinchIterator;
+}
+
 void stPinchIterator_setTrim(stPinchIterator *pinchIterator, int64_t alignmentTrim) {
     pinchIterator->alignmentTrim = alignmentTrim;
 }
@@ -0,0 +1,379 @@
+/*
+ * sortCigars.c
+ *
+ * External merge sort of cigar files. The input is cut into runs that fit a memory budget, the runs are sorted
+ * and written out by a pool of threads, and then merged a bounded number at a time.
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "sonLib.h"
+#include "stLastzAlignments.h"
+
+#define DEFAULT_MEMORY_BUDGET 1073741824
+#define MAX_MERGE_FAN_IN 64
+
+static int64_t memoryBudget = DEFAULT_MEMORY_BUDGET;
+static int64_t threadNumber = 0; //Zero means one per online processor.
+static char *tempDir = NULL; //NULL means the directory of the sorted file.
+
+void stCaf_setCigarSortParameters(int64_t memoryBudget2, int64_t threadNumber2, const char *tempDir2) {
+    if (memoryBudget2 <= 0 || threadNumber2 < 0) {
+        st_errAbort("The memory budget of the cigar sort must be positive and its thread number non-negative\n");
+    }
+    memoryBudget = memoryBudget2;
+    threadNumber = threadNumber2;
+    free(tempDir);
+    tempDir = tempDir2 != NULL ? stString_copy(tempDir2) : NULL;
+}
+
+/*
+ * The order of a sort: by the numeric field (the score or the start of the first sequence), ascending or
+ * descending, then by the name of the first sequence, then by the whole line, so the order does not
+ * depend on how the input was cut into runs.
+ */
+typedef struct _cigarOrder {
+    int64_t numberField; //Counting from 1, as for sort -k.
+    bool numberDescending;
+    bool nameFirst; //Compare the names before the numbers.
+} CigarOrder;
+
+static const CigarOrder byScore = { 10, 1, 0 };
+static const CigarOrder byFirstSequenceStart = { 3, 0, 1 };
+
+typedef struct _sortLine {
+    const char *line; //Includes the newline.
+    int64_t length;
+    const char *name; //The name of the first sequence, field 2.
+    int64_t nameLength;
+    double number;
+} SortLine;
+
+static void parseKeys(SortLine *sortLine, const CigarOrder *order) {
+    const char *i = sortLine->line, *end = sortLine->line + sortLine->length;
+    sortLine->name = end;
+    sortLine->nameLength = 0;
+    sortLine->number = 0.0;
+    for (int64_t field = 1; i < end && field <= order->numberField; field++) {
+        while (i < end && (*i == ' ' || *i == '\t')) {
+            i++;
+        }
+        const char *fieldStart = i;
+        while (i < end && *i != ' ' && *i != '\t' && *i != '\n') {
+            i++;
+        }
+        if (field == 2) {
+            sortLine->name = fieldStart;
+            sortLine->nameLength = i - fieldStart;
+        }
+        if (field == order->numberField) {
+            sortLine->number = strtod(fieldStart, NULL);
+        }
+    }
+}
+
+static int compareNames(const SortLine *line1, const SortLine *line2) {
+    int i = memcmp(line1->name, line2->name,
+            line1->nameLength < line2->nameLength ? line1->nameLength : line2->nameLength);
+    return i != 0 ? i : (line1->nameLength < line2->nameLength ? -1 : (line1->nameLength > line2->nameLength));
+}
+
+static int compareNumbers(const SortLine *line1, const SortLine *line2, const CigarOrder *order) {
+    if (line1->number == line2->number) {
+        return 0;
+    }
+    return (line1->number < line2->number) != order->numberDescending ? -1 : 1;
+}
+
+static int compareLines(const SortLine *line1, const SortLine *line2, const CigarOrder *order) {
+    int i = order->nameFirst ? compareNames(line1, line2) : compareNumbers(line1, line2, order);
+    if (i == 0) {
+        i = order->nameFirst ? compareNumbers(line1, line2, order) : compareNames(line1, line2);
+    }
+    if (i == 0) {
+        i = memcmp(line1->line, line2->line, line1->length < line2->length ? line1->length : line2->length);
+        if (i == 0) {
+            i = line1->length < line2->length ? -1 : (line1->length > line2->length);
+        }
+    }
+    return i;
+}
+
+static char *getRunFile(const char *runDir) {
+    char *runFile = stString_print("%s/cactusCigarSortXXXXXX", runDir);
+    int fileHandle = mkstemp(runFile);
+    if (fileHandle < 0) {
+        st_errAbort("Could not create a temporary file for sorting cigars in %s\n", runDir);
+    }
+    close(fileHandle);
+    return runFile;
+}
+
+static void writeLine(FILE *fileHandle, const SortLine *sortLine, const char *fileName) {
+    if (fwrite(sortLine->line, 1, sortLine->length, fileHandle) != (size_t) sortLine->length
+            || (sortLine->line[sortLine->length - 1] != '\n' && fputc('\n', fileHandle) == EOF)) {
+        st_errAbort("Could not write the sorted cigars to %s\n", fileName);
+    }
+}
+
+/*
+ * A run is a block of lines of the input that is sorted in memory and written to its own file.
+ */
+typedef struct _sortRun {
+    char *data;
+    int64_t dataLength;
+    SortLine *lines;
+    int64_t lineNumber;
+    const CigarOrder *order;
+    char *fileName;
+    pthread_t thread;
+} SortRun;
+
+static __thread const CigarOrder *qsortOrder; //qsort has no argument for the comparison function.
+
+static int compareLinesForQsort(const void *line1, const void *line2) {
+    return compareLines(line1, line2, qsortOrder);
+}
+
+static void *sortRun(void *arg) {
+    SortRun *run = arg;
+    for (int64_t i = 0; i < run->lineNumber; i++) {
+        parseKeys(&run->lines[i], run->order);
+    }
+    qsortOrder = run->order;
+    qsort(run->lines, run->lineNumber, sizeof(SortLine), compareLinesForQsort);
+    FILE *fileHandle = fopen(run->fileName, "w");
+    if (fileHandle == NULL) {
+        st_errAbort("Could not open %s to write sorted cigars\n", run->fileName);
+    }
+    for (int64_t i = 0; i < run->lineNumber; i++) {
+        writeLine(fileHandle, &run->lines[i], run->fileName);
+    }
+    if (fclose(fileHandle) != 0) {
+        st_errAbort("Could not write the sorted cigars to %s\n", run->fileName);
+    }
+    //Only the name of the file is needed from here on.
+    free(run->data);
+    free(run->lines);
+    run->data = NULL;
+    run->lines = NULL;
+    return NULL;
+}
+
+/*
+ * Reads lines into the run until its share of the memory budget, counting the line table, is used. Returns
+ * non-zero if the end of the input was reached.
+ */
+static bool readRun(SortRun *run, FILE *fileHandle, int64_t runBudget, char **line, size_t *lineCapacity) {
+    int64_t dataCapacity = 1024, lineCapacity2 = 64;
+    run->data = st_malloc(dataCapacity);
+    run->lines = st_malloc(lineCapacity2 * sizeof(SortLine));
+    run->dataLength = 0;
+    run->lineNumber = 0;
+    ssize_t length;
+    while (run->dataLength + run->lineNumber * (int64_t) sizeof(SortLine) < runBudget
+            && (length = getline(line, lineCapacity, fileHandle)) != -1) {
+        if (length == 0 || (length == 1 && (*line)[0] == '\n')) {
+            continue; //Blank lines hold no alignment.
+        }
+        if (run->dataLength + length > dataCapacity) {
+            while (run->dataLength + length > dataCapacity) {
+                dataCapacity *= 2;
+            }
+            run->data = st_realloc(run->data, dataCapacity);
+        }
+        if (run->lineNumber == lineCapacity2) {
+            lineCapacity2 *= 2;
+            run->lines = st_realloc(run->lines, lineCapacity2 * sizeof(SortLine));
+        }
+        memcpy(run->data + run->dataLength, *line, length);
+        //The lines point at offsets until the data stops moving.
+        run->lines[run->lineNumber].line = (const char *) (intptr_t) run->dataLength;
+        run->lines[run->lineNumber++].length = length;
+        run->dataLength += length;
+    }
+    for (int64_t i = 0; i < run->lineNumber; i++) {
+        run->lines[i].line = run->data + (intptr_t) run->lines[i].line;
+    }
+    return feof(fileHandle);
+}
+
+/*
+ * A file being merged, holding its current line.
+ */
+typedef struct _mergeInput {
+    FILE *fileHandle;
+    char *line;
+    size_t lineCapacity;
+    SortLine sortLine;
+} MergeInput;
+
+static bool mergeInput_next(MergeInput *input, const CigarOrder *order) {
+    ssize_t length = getline(&input->line, &input->lineCapacity, input->fileHandle);
+    if (length == -1) {
+        return 0;
+    }
+    input->sortLine.line = input->line;
+    input->sortLine.length = length;
+    parseKeys(&input->sortLine, order);
+    return 1;
+}
+
+static void siftDown(MergeInput **heap, int64_t heapSize, int64_t i, const CigarOrder *order) {
+    while (1) {
+        int64_t smallest = i, left = 2 * i + 1, right = 2 * i + 2;
+        if (left < heapSize && compareLines(&heap[left]->sortLine, &heap[smallest]->sortLine, order) < 0) {
+            smallest = left;
+        }
+        if (right < heapSize && compareLines(&heap[right]->sortLine, &heap[smallest]->sortLine, order) < 0) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        MergeInput *input = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = input;
+        i = smallest;
+    }
+}
+
+/*
+ * Merges the sorted files into the output file, then removes them.
+ */
+static void mergeRuns(char **runFiles, int64_t runNumber, const char *outputFile, const CigarOrder *order) {
+    MergeInput *inputs = st_calloc(runNumber, sizeof(MergeInput));
+    MergeInput **heap = st_malloc(runNumber * sizeof(MergeInput *));
+    int64_t heapSize = 0;
+    for (int64_t i = 0; i < runNumber; i++) {
+        inputs[i].fileHandle = fopen(runFiles[i], "r");
+        if (inputs[i].fileHandle == NULL) {
+            st_errAbort("Could not open the sorted cigars in %s\n", runFiles[i]);
+        }
+        if (mergeInput_next(&inputs[i], order)) {
+            heap[heapSize++] = &inputs[i];
+        }
+    }
+    for (int64_t i = heapSize / 2 - 1; i >= 0; i--) {
+        siftDown(heap, heapSize, i, order);
+    }
+    FILE *fileHandle = fopen(outputFile, "w");
+    if (fileHandle == NULL) {
+        st_errAbort("Could not open %s to write sorted cigars\n", outputFile);
+    }
+    while (heapSize > 0) {
+        writeLine(fileHandle, &heap[0]->sortLine, outputFile);
+        if (!mergeInput_next(heap[0], order)) {
+            heap[0] = heap[--heapSize];
+        }
+        siftDown(heap, heapSize, 0, order);
+    }
+    if (fclose(fileHandle) != 0) {
+        st_errAbort("Could not write the sorted cigars to %s\n", outputFile);
+    }
+    for (int64_t i = 0; i < runNumber; i++) {
+        fclose(inputs[i].fileHandle);
+        free(inputs[i].line);
+        if (remove(runFiles[i]) != 0) {
+            st_logCritical("Could not remove the temporary file %s\n", runFiles[i]);
+        }
+    }
+    free(inputs);
+    free(heap);
+}
+
+static void sortCigarsFile(const char *cigarsFile, const char *sortedFile, const CigarOrder *order) {
+    int64_t threads = threadNumber > 0 ? threadNumber : sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) {
+        threads = 1;
+    }
+    //Each thread sorts its own run, so each run gets an even share of the budget.
+    int64_t runBudget = memoryBudget / threads > 1024 ? memoryBudget / threads : 1024;
+    char *sortedFileCopy = stString_copy(sortedFile);
+    char *runDir = tempDir != NULL ? stString_copy(tempDir) : stString_copy(dirname(sortedFileCopy));
+    free(sortedFileCopy);
+
+    FILE *fileHandle = fopen(cigarsFile, "r");
+    if (fileHandle == NULL) {
+        st_errAbort("Could not open the cigars file %s to sort it\n", cigarsFile);
+    }
+    stList *runs = stList_construct();
+    char *line = NULL;
+    size_t lineCapacity = 0;
+    int64_t startedRuns = 0, finishedRuns = 0;
+    bool done = 0;
+    while (!done) {
+        SortRun *run = st_calloc(1, sizeof(SortRun));
+        run->order = order;
+        done = readRun(run, fileHandle, runBudget, &line, &lineCapacity);
+        if (startedRuns == 0 && done) {
+            //The input fits in one run, so it is sorted straight into the output.
+            run->fileName = stString_copy(sortedFile);
+            sortRun(run);
+            free(run->fileName);
+            free(run);
+            break;
+        }
+        run->fileName = getRunFile(runDir);
+        stList_append(runs, run);
+        if (startedRuns - finishedRuns == threads) {
+            //Bound the memory in use by waiting for the oldest run.
+            pthread_join(((SortRun *) stList_get(runs, finishedRuns++))->thread, NULL);
+        }
+        if (pthread_create(&run->thread, NULL, sortRun, run) != 0) {
+            st_errAbort("Could not start a thread to sort cigars\n");
+        }
+        startedRuns++;
+    }
+    free(line);
+    fclose(fileHandle);
+    while (finishedRuns < startedRuns) {
+        pthread_join(((SortRun *) stList_get(runs, finishedRuns++))->thread, NULL);
+    }
+
+    //Merge at most MAX_MERGE_FAN_IN files at a time, to bound the open files.
+    int64_t runNumber = stList_length(runs);
+    char **runFiles = st_malloc((runNumber + 1) * sizeof(char *));
+    for (int64_t i = 0; i < runNumber; i++) {
+        SortRun *run = stList_get(runs, i);
+        runFiles[i] = run->fileName;
+        free(run);
+    }
+    stList_destruct(runs);
+    int64_t firstRun = 0;
+    while (runNumber - firstRun > MAX_MERGE_FAN_IN) {
+        char *mergedFile = getRunFile(runDir);
+        mergeRuns(runFiles + firstRun, MAX_MERGE_FAN_IN, mergedFile, order);
+        for (int64_t i = firstRun; i < firstRun + MAX_MERGE_FAN_IN; i++) {
+            free(runFiles[i]);
+        }
+        firstRun += MAX_MERGE_FAN_IN;
+        runFiles = st_realloc(runFiles, (runNumber + 1) * sizeof(char *));
+        runFiles[runNumber++] = mergedFile;
+    }
+    if (runNumber > firstRun) {
+        mergeRuns(runFiles + firstRun, runNumber - firstRun, sortedFile, order);
+    }
+    for (int64_t i = firstRun; i < runNumber; i++) {
+        free(runFiles[i]);
+    }
+    free(runFiles);
+    free(runDir);
+    if (chmod(sortedFile, 0777) != 0) {
+        st_errAbort("Encountered error when changing file permissions: %s\n", sortedFile);
+    }
+}
+
+void stCaf_sortCigarsFileByScoreInDescendingOrder(char *cigarsFile, char *sortedFile) {
+    sortCigarsFile(cigarsFile, sortedFile, &byScore);
+}
+
+void stCaf_sortCigarsFileByFirstSequenceStartCoordinateInAscendingOrder(char *cigarsFile, char *sortedFile) {
+    sortCigarsFile(cigarsFile, sortedFile, &byFirstSequenceStart);
+}
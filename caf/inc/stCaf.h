@@ -43,11 +43,53 @@ void stCaf_anneal(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator, b
  */
 void stCaf_annealBetweenAdjacencyComponents(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator, bool (*filterFn)(stPinchSegment *, stPinchSegment *));
 
+/*
+ * As stCaf_annealBetweenAdjacencyComponents, but pinches the alignments with the given number of threads (zero for one
+ * per processor), giving the same graph. Pinches that touch no common pinch thread are pinched concurrently, so the
+ * filter function must be safe to call from several threads.
+ */
+void stCaf_annealBetweenAdjacencyComponentsInParallel(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator,
+        bool (*filterFn)(stPinchSegment *, stPinchSegment *), int64_t threadNumber);
+
 /*
  * Joins all trivial boundaries, but not joining stub boundaries.
  */
 void stCaf_joinTrivialBoundaries(stPinchThreadSet *threadSet);
 
+///////////////////////////////////////////////////////////////////////////
+// Checkpointing -- saving the pinch graph between annealing rounds
+///////////////////////////////////////////////////////////////////////////
+
+/*
+ * A checkpoint file holds the pinch graph of a flower after a number of annealing rounds. It is laid out as:
+ *
+ * header: "CACTCKPT", version, flower name, annealing rounds done, number of threads, number of blocks (int64s)
+ * blocks: degree, supporting homologies (int64s)
+ * threads: name, start, length, number of segments (int64s), followed by the thread's segments in order:
+ *          start, length, index of block or -1, orientation in block (int64s)
+ *
+ * The integers are in the byte order of the machine that wrote the file.
+ */
+#define ST_CAF_CHECKPOINT_MAGIC "CACTCKPT"
+#define ST_CAF_CHECKPOINT_VERSION 1
+
+/*
+ * Writes the pinch graph of the flower to the checkpoint file, after the given number of annealing rounds. The
+ * file is replaced only once the new checkpoint is completely written and synced to the disk. Aborts if it can
+ * not be written.
+ */
+void stCaf_writePinchGraphCheckpoint(Flower *flower, stPinchThreadSet *threadSet, int64_t annealingRounds,
+        const char *checkpointFile);
+
+/*
+ * Restores the pinch graph in the checkpoint file into the thread set, which must be the empty pinch graph of the
+ * flower, as made by stCaf_setup. Returns the number of annealing rounds done when the checkpoint was written.
+ * Returns -1 if the numbers of homologies supporting the blocks can not be restored exactly, in which case the
+ * thread set is left part restored and the caller should start again from an empty pinch graph. Aborts if the
+ * checkpoint is not of the flower.
+ */
+int64_t stCaf_readPinchGraphCheckpoint(Flower *flower, stPinchThreadSet *threadSet, const char *checkpointFile);
+
 ///////////////////////////////////////////////////////////////////////////
 // Melting fuctions -- removing alignments from the pinch graph
 ///////////////////////////////////////////////////////////////////////////
@@ -58,6 +100,16 @@ void stCaf_joinTrivialBoundaries(stPinchThreadSet *threadSet);
 void stCaf_melt(Flower *flower, stPinchThreadSet *threadSet, bool blockFilterfn(stPinchBlock *), int64_t blockEndTrim,
         int64_t minimumChainLength, bool breakChainsAtReverseTandems, int64_t maximumMedianSpacingBetweenLinkedEnds);
 
+/*
+ * Melts the chains shorter than each of the minimum chain lengths in turn, which must be in ascending order. This
+ * is the same as calling stCaf_melt with each length and no block filter, trim or chain breaking, but builds the
+ * cactus graph once rather than once per round. The chains a round melts are contracted in the graph, which
+ * leaves the other chains as a rebuilt graph would have them, so the graph is only rebuilt if the melting
+ * detaches a thread component of the top level flower from the dead end component.
+ */
+void stCaf_meltIncrementally(Flower *flower, stPinchThreadSet *threadSet, int64_t *minimumChainLengths,
+        int64_t minimumChainLengthsLength);
+
 /*
  * Removes any recoverable chains (those expected to be picked up by
  * bar phase) from the graph. Only chains that are recoverable *and*
@@ -120,7 +172,10 @@ void stCaf_finish(Flower *flower, stPinchThreadSet *threadSet, int64_t chainLeng
 /*
  * Must be used before any of stCaf_filterByOutgroup,
  * stCaf_relaxedFilterByOutgroup, or stCaf_filterByRepeatSpecies are
- * used.
+ * used. Numbers the events and sequences of the caps of the flower, so
+ * the filters look them up in constant time. Passing NULL frees the
+ * tables, which must be done once the flower is finished, as a later
+ * flower at the same address would otherwise be given its tables.
  */
 void stCaf_setFlowerForAlignmentFiltering(Flower *input);
 
@@ -142,7 +197,7 @@ bool stCaf_relaxedFilterByOutgroup(stPinchSegment *segment1,
 
 /*
  * Filters incoming alignments by presence of repeat species in
- * block. This code is inefficient and does not scale.
+ * block. Takes time linear in the degrees of the two blocks.
  */
 bool stCaf_filterByRepeatSpecies(stPinchSegment *segment1,
                                  stPinchSegment *segment2);
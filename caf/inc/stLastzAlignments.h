@@ -17,6 +17,24 @@ stList *stCaf_selfAlignFlower(Flower *flower, int64_t minimumSequenceLength, con
 
 void stCaf_sortCigarsByScoreInDescendingOrder(stList *cigars);
 
+/*
+ * Sorts a file of cigars by descending score, breaking ties by the name of the first sequence and then by the
+ * whole line, and writes them to sortedFile. This is an external merge sort: the cigars are cut into runs that
+ * fit the memory budget, which are sorted in parallel and written to temporary files, then merged.
+ */
 void stCaf_sortCigarsFileByScoreInDescendingOrder(char *cigarsFile, char *sortedFile);
 
+/*
+ * As stCaf_sortCigarsFileByScoreInDescendingOrder, but sorts by the name of the first sequence, then by the
+ * start coordinate on it in ascending order.
+ */
+void stCaf_sortCigarsFileByFirstSequenceStartCoordinateInAscendingOrder(char *cigarsFile, char *sortedFile);
+
+/*
+ * Sets the memory budget in bytes of the cigar file sorts, the number of threads sorting runs (zero for one
+ * per processor) and the directory for their temporary files (NULL for the directory of the sorted file).
+ * The defaults are 1GB, one thread per processor and the directory of the sorted file.
+ */
+void stCaf_setCigarSortParameters(int64_t memoryBudget, int64_t threadNumber, const char *tempDir);
+
 #endif /* ST_LASTZALIGNMENT_H_ */
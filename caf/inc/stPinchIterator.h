@@ -37,6 +37,45 @@ void stPinchIterator_destruct(
 stPinchIterator *stPinchIterator_constructFromFile(
         const char *alignmentFile);
 
+/*
+ * A binary pinch file holds the gapless matches (pinches) of a set of pairwise alignments as fixed width
+ * records, so that it can be mapped into memory and scanned, rather than parsed, on every pass over the
+ * alignments. It is laid out as:
+ *
+ * header: "CACTPINC", version, flags, number of records (int64s)
+ * records: name1, name2, start1, start2, length, strand (int64s), score (double)
+ *
+ * The records are in the order of the alignments they come from, and within an alignment in the order of its
+ * matches. If the flags include ST_PINCH_FILE_SORTED_BY_SCORE the alignments were sorted by descending
+ * score. The integers are in the byte order of the machine that wrote the file.
+ */
+#define ST_PINCH_FILE_MAGIC "CACTPINC"
+#define ST_PINCH_FILE_VERSION 1
+#define ST_PINCH_FILE_SORTED_BY_SCORE 1
+
+/*
+ * Returns non-zero if the file exists and starts with the magic of a binary pinch file.
+ */
+bool stPinchIterator_isBinaryFile(const char *alignmentFile);
+
+/*
+ * Returns non-zero if the binary pinch file was written from alignments sorted by descending score.
+ */
+bool stPinchIterator_isBinaryFileSortedByScore(const char *binaryFile);
+
+/*
+ * Converts a file of cigar alignments into a binary pinch file. Pass sortedByScore if the alignments are
+ * already sorted by descending score, to record it in the file. Aborts if either file can not be opened or
+ * the binary file can not be written.
+ */
+void stPinchIterator_convertCigarFileToBinaryFile(const char *alignmentFile, const char *binaryFile, bool sortedByScore);
+
+/*
+ * Get a pairwise alignment iterator from a binary pinch file, which is mapped into memory read only, so that
+ * resetting the iterator is free. Aborts if the file is not a complete binary pinch file.
+ */
+stPinchIterator *stPinchIterator_constructFromBinaryFile(const char *binaryFile);
+
 /*
  * Get a pairwise alignment iterator from a list of alignments.
  * Does not cleanup the list or modify the list.
@@ -50,6 +89,14 @@ stPinchIterator *stPinchIterator_constructFromList(
 stPinchIterator *stPinchIterator_constructFromAlignedPairs(
         stSortedSet *alignedPairs, stPinch *(*getNextAlignedPairAlignment)(stSortedSetIterator *));
 
+/*
+ * Constructs an iterator over the alignments of some other structure. getNextAlignment returns the next pinch of
+ * alignmentArg, or NULL when there are no more, startAlignmentStack returns it to its first pinch, and
+ * destructAlignmentArg is called on it when the iterator is destructed.
+ */
+stPinchIterator *stPinchIterator_construct(void *alignmentArg, stPinch *(*getNextAlignment)(void *),
+        void *(*startAlignmentStack)(void *), void (*destructAlignmentArg)(void *));
+
 /*
  * Sets the amount to trim from the ends of each pinch in bases.
  */
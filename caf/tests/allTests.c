@@ -13,6 +13,9 @@ CuSuite* pinchIteratorTestSuite(void);
 CuSuite* recoverableChainsTestSuite(void);
 CuSuite* phylogenyTestSuite(void);
 CuSuite* filteringTestSuite(void);
+CuSuite* sortCigarsTestSuite(void);
+CuSuite* meltingTestSuite(void);
+CuSuite* checkpointTestSuite(void);
 
 int cactusCoreRunAllTests(void) {
     CuString *output = CuStringNew();
@@ -23,6 +26,9 @@ int cactusCoreRunAllTests(void) {
     CuSuiteAddSuite(suite, recoverableChainsTestSuite());
     CuSuiteAddSuite(suite, phylogenyTestSuite());
     CuSuiteAddSuite(suite, filteringTestSuite());
+    CuSuiteAddSuite(suite, sortCigarsTestSuite());
+    CuSuiteAddSuite(suite, meltingTestSuite());
+    CuSuiteAddSuite(suite, checkpointTestSuite());
 
     CuSuiteRun(suite);
     CuSuiteSummary(suite, output);
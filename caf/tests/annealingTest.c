@@ -14,6 +14,9 @@ void stCaf_anneal2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *
 void stCaf_annealBetweenAdjacencyComponents2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *),
         void *extraArg, bool (*filterFn)(stPinchSegment *, stPinchSegment *));
 
+void stCaf_annealBetweenAdjacencyComponentsInParallel2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *),
+        void *extraArg, bool (*filterFn)(stPinchSegment *, stPinchSegment *), int64_t threadNumber);
+
 static stPinch *randomPinch(void *extraArg) {
     if(st_random() < 0.01) {
         return NULL;
@@ -41,9 +44,109 @@ static void testAnnealingBetweenAdjacencyComponents(CuTest *testCase) {
     }
 }
 
+static stPinchThreadSet *copyThreadSet(stPinchThreadSet *threadSet) {
+    stPinchThreadSet *threadSet2 = stPinchThreadSet_construct();
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet);
+    stPinchThread *thread;
+    while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        stPinchThreadSet_addThread(threadSet2, stPinchThread_getName(thread), stPinchThread_getStart(thread),
+                stPinchThread_getLength(thread));
+    }
+    stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+    stPinchBlock *block;
+    while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+        stPinchBlockIt segmentIt = stPinchBlock_getSegmentIterator(block);
+        stPinchSegment *first = stPinchBlockIt_getNext(&segmentIt), *segment;
+        while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
+            stPinchThread_pinch(stPinchThreadSet_getThread(threadSet2, stPinchSegment_getName(first)),
+                    stPinchThreadSet_getThread(threadSet2, stPinchSegment_getName(segment)),
+                    stPinchSegment_getStart(first), stPinchSegment_getStart(segment), stPinchSegment_getLength(first),
+                    stPinchSegment_getBlockOrientation(first) == stPinchSegment_getBlockOrientation(segment));
+        }
+    }
+    return threadSet2;
+}
+
+/*
+ * Checks the two graphs have the same segments, and the same blocks, by mapping the blocks of the first graph to
+ * those of the second.
+ */
+static void checkThreadSetsAreEqual(CuTest *testCase, stPinchThreadSet *threadSet1, stPinchThreadSet *threadSet2) {
+    stHash *blocks1ToBlocks2 = stHash_construct();
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet1);
+    stPinchThread *thread1;
+    while ((thread1 = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet2, stPinchThread_getName(thread1));
+        CuAssertTrue(testCase, thread2 != NULL);
+        stPinchSegment *segment1 = stPinchThread_getFirst(thread1), *segment2 = stPinchThread_getFirst(thread2);
+        while (segment1 != NULL && segment2 != NULL) {
+            CuAssertIntEquals(testCase, stPinchSegment_getStart(segment1), stPinchSegment_getStart(segment2));
+            CuAssertIntEquals(testCase, stPinchSegment_getLength(segment1), stPinchSegment_getLength(segment2));
+            stPinchBlock *block1 = stPinchSegment_getBlock(segment1), *block2 = stPinchSegment_getBlock(segment2);
+            CuAssertTrue(testCase, (block1 == NULL) == (block2 == NULL));
+            if (block1 != NULL) {
+                CuAssertIntEquals(testCase, stPinchBlock_getDegree(block1), stPinchBlock_getDegree(block2));
+                stPinchBlock *block = stHash_search(blocks1ToBlocks2, block1);
+                if (block == NULL) {
+                    stHash_insert(blocks1ToBlocks2, block1, block2);
+                } else {
+                    CuAssertPtrEquals(testCase, block, block2);
+                }
+            }
+            segment1 = stPinchSegment_get3Prime(segment1);
+            segment2 = stPinchSegment_get3Prime(segment2);
+        }
+        CuAssertTrue(testCase, segment1 == NULL && segment2 == NULL);
+    }
+    CuAssertIntEquals(testCase, stPinchThreadSet_getTotalBlockNumber(threadSet1),
+            stPinchThreadSet_getTotalBlockNumber(threadSet2));
+    stHash_destruct(blocks1ToBlocks2);
+}
+
+/*
+ * A filter whose result depends on the order the pinches are applied in.
+ */
+static bool filterBigBlocks(stPinchSegment *segment1, stPinchSegment *segment2) {
+    stPinchBlock *block1 = stPinchSegment_getBlock(segment1), *block2 = stPinchSegment_getBlock(segment2);
+    return (block1 == NULL ? 1 : stPinchBlock_getDegree(block1)) + (block2 == NULL ? 1 : stPinchBlock_getDegree(block2)) > 5;
+}
+
+static stPinch *listPinch(void *extraArg) {
+    return stListIterator_getNext(extraArg);
+}
+
+static void testAnnealingBetweenAdjacencyComponentsInParallel(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting parallel annealing between adjacency components random test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomGraph();
+        stPinchThreadSet *threadSet2 = copyThreadSet(threadSet);
+        checkThreadSetsAreEqual(testCase, threadSet, threadSet2);
+        stList *pinches = stList_construct3(0, free);
+        while (st_random() > 0.01) {
+            stPinch *pinch = st_malloc(sizeof(stPinch));
+            *pinch = stPinchThreadSet_getRandomPinch(threadSet);
+            stList_append(pinches, pinch);
+        }
+        bool (*filterFn)(stPinchSegment *, stPinchSegment *) = test % 2 == 0 ? NULL : filterBigBlocks;
+
+        stListIterator *it = stList_getIterator(pinches);
+        stCaf_annealBetweenAdjacencyComponents2(threadSet, listPinch, it, filterFn);
+        stList_destructIterator(it);
+        it = stList_getIterator(pinches);
+        stCaf_annealBetweenAdjacencyComponentsInParallel2(threadSet2, listPinch, it, filterFn, st_randomInt(2, 9));
+        stList_destructIterator(it);
+        checkThreadSetsAreEqual(testCase, threadSet, threadSet2);
+
+        stList_destruct(pinches);
+        stPinchThreadSet_destruct(threadSet);
+        stPinchThreadSet_destruct(threadSet2);
+    }
+}
+
 CuSuite* annealingTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testAnnealing);
     SUITE_ADD_TEST(suite, testAnnealingBetweenAdjacencyComponents);
+    SUITE_ADD_TEST(suite, testAnnealingBetweenAdjacencyComponentsInParallel);
     return suite;
 }
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "CuTest.h"
+#include "sonLib.h"
+#include "stCaf.h"
+#include "stPinchGraphs.h"
+
+static char *checkpointFile = "tempFileForCheckpointTest.ckpt";
+
+/*
+ * Checks the two graphs have the same segments and the same blocks, with the same relative orientations, by
+ * mapping the blocks of the first graph to those of the second.
+ */
+static void checkThreadSetsAreEqual(CuTest *testCase, stPinchThreadSet *threadSet1, stPinchThreadSet *threadSet2) {
+    stHash *blocks1ToBlocks2 = stHash_construct();
+    stHash *blocks1ToOrientations = stHash_construct2(NULL, (void (*)(void *)) stIntTuple_destruct);
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet1);
+    stPinchThread *thread1;
+    while ((thread1 = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet2, stPinchThread_getName(thread1));
+        CuAssertTrue(testCase, thread2 != NULL);
+        stPinchSegment *segment1 = stPinchThread_getFirst(thread1), *segment2 = stPinchThread_getFirst(thread2);
+        while (segment1 != NULL && segment2 != NULL) {
+            CuAssertIntEquals(testCase, stPinchSegment_getStart(segment1), stPinchSegment_getStart(segment2));
+            CuAssertIntEquals(testCase, stPinchSegment_getLength(segment1), stPinchSegment_getLength(segment2));
+            stPinchBlock *block1 = stPinchSegment_getBlock(segment1), *block2 = stPinchSegment_getBlock(segment2);
+            CuAssertTrue(testCase, (block1 == NULL) == (block2 == NULL));
+            if (block1 != NULL) {
+                CuAssertIntEquals(testCase, stPinchBlock_getDegree(block1), stPinchBlock_getDegree(block2));
+                CuAssertIntEquals(testCase, stPinchBlock_getNumSupportingHomologies(block1),
+                        stPinchBlock_getNumSupportingHomologies(block2));
+                bool sameOrientation = stPinchSegment_getBlockOrientation(segment1)
+                        == stPinchSegment_getBlockOrientation(segment2);
+                stPinchBlock *block = stHash_search(blocks1ToBlocks2, block1);
+                if (block == NULL) {
+                    stHash_insert(blocks1ToBlocks2, block1, block2);
+                    stHash_insert(blocks1ToOrientations, block1, stIntTuple_construct1(sameOrientation));
+                } else {
+                    CuAssertPtrEquals(testCase, block, block2);
+                    CuAssertIntEquals(testCase, stIntTuple_get(stHash_search(blocks1ToOrientations, block1), 0),
+                            sameOrientation);
+                }
+            }
+            segment1 = stPinchSegment_get3Prime(segment1);
+            segment2 = stPinchSegment_get3Prime(segment2);
+        }
+        CuAssertTrue(testCase, segment1 == NULL && segment2 == NULL);
+    }
+    CuAssertIntEquals(testCase, stPinchThreadSet_getTotalBlockNumber(threadSet1),
+            stPinchThreadSet_getTotalBlockNumber(threadSet2));
+    stHash_destruct(blocks1ToBlocks2);
+    stHash_destruct(blocks1ToOrientations);
+}
+
+static void testCheckpointRoundTrip(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+        eventTree_construct2(cactusDisk);
+        Flower *flower = flower_construct2(0, cactusDisk);
+        group_construct2(flower);
+
+        int64_t threadNumber = st_randomInt(1, 10);
+        Name *threadNames = st_malloc(threadNumber * sizeof(Name));
+        for (int64_t i = 0; i < threadNumber; i++) {
+            char *header = stString_print("%" PRIi64 "", i);
+            threadNames[i] = testCommon_addThreadToFlower(flower, header, st_randomInt(10, 200));
+            free(header);
+        }
+        stPinchThreadSet *threadSet = stCaf_setup(flower);
+        int64_t pinchNumber = st_randomInt(0, 100);
+        for (int64_t i = 0; i < pinchNumber; i++) {
+            stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet, threadNames[st_randomInt(0, threadNumber)]);
+            stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet, threadNames[st_randomInt(0, threadNumber)]);
+            //Keep off the stubs at the ends of the threads.
+            int64_t length = st_randomInt(1, 8);
+            int64_t start1 = stPinchThread_getStart(thread1) + st_randomInt(1, stPinchThread_getLength(thread1) - length);
+            int64_t start2 = stPinchThread_getStart(thread2) + st_randomInt(1, stPinchThread_getLength(thread2) - length);
+            stPinchThread_pinch(thread1, thread2, start1, start2, length, st_random() > 0.5);
+        }
+        if (st_random() > 0.5) {
+            stCaf_joinTrivialBoundaries(threadSet);
+        }
+        int64_t annealingRounds = st_randomInt(0, 5);
+        stCaf_writePinchGraphCheckpoint(flower, threadSet, annealingRounds, checkpointFile);
+
+        stPinchThreadSet *threadSet2 = stCaf_constructEmptyPinchGraph(flower); //The flower is already set up.
+        int64_t restoredAnnealingRounds = stCaf_readPinchGraphCheckpoint(flower, threadSet2, checkpointFile);
+        //A checkpoint whose supporting homologies can not be restored exactly is not used.
+        if (restoredAnnealingRounds != -1) {
+            CuAssertIntEquals(testCase, annealingRounds, restoredAnnealingRounds);
+            checkThreadSetsAreEqual(testCase, threadSet, threadSet2);
+        }
+
+        stFile_rmrf(checkpointFile);
+        stPinchThreadSet_destruct(threadSet);
+        stPinchThreadSet_destruct(threadSet2);
+        free(threadNames);
+        testCommon_deleteTemporaryCactusDisk(cactusDisk);
+    }
+}
+
+CuSuite* checkpointTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testCheckpointRoundTrip);
+    return suite;
+}
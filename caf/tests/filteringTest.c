@@ -349,11 +349,102 @@ static void testHGVMFiltering(CuTest *testCase) {
     }
 }
 
+// The events (or ingroup events, or sequences) of the block of the segment, or of the segment if
+// it has no block, found without the tables built by stCaf_setFlowerForAlignmentFiltering.
+static stSet *getNaiveSet(stPinchSegment *segment, int64_t type) {
+    stSet *set = stSet_construct();
+    stList *segments = stList_construct();
+    stPinchBlock *block = stPinchSegment_getBlock(segment);
+    if (block != NULL) {
+        stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
+        while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
+            stList_append(segments, segment);
+        }
+    } else {
+        stList_append(segments, segment);
+    }
+    for (int64_t i = 0; i < stList_length(segments); i++) {
+        Cap *cap = flower_getCap(flower, stPinchSegment_getName(stList_get(segments, i)));
+        if (type == 2) {
+            stSet_insert(set, cap_getSequence(cap));
+        } else if (type == 0 || !event_isOutgroup(cap_getEvent(cap))) {
+            stSet_insert(set, cap_getEvent(cap));
+        }
+    }
+    stList_destruct(segments);
+    return set;
+}
+
+static bool naiveIntersection(stPinchSegment *segment1, stPinchSegment *segment2, int64_t type) {
+    stSet *set1 = getNaiveSet(segment1, type);
+    stSet *set2 = getNaiveSet(segment2, type);
+    stSet *set12 = stSet_getIntersection(set1, set2);
+    bool b = stSet_size(set12) > 0;
+    stSet_destruct(set1);
+    stSet_destruct(set2);
+    stSet_destruct(set12);
+    return b;
+}
+
+static stPinchSegment *getRandomSegment(stPinchThreadSet *threadSet) {
+    stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
+    stPinchThread *thread = stPinchThreadSet_getThread(threadSet, pinch.name1);
+    return stPinchThread_getSegment(thread, pinch.start1);
+}
+
+static void testFiltersMatchNaiveVersions(CuTest *testCase) {
+    /*
+     * Builds random blocks, then checks the filters, which use the dense event and sequence tables,
+     * agree with versions that look up each segment's cap.
+     */
+    for (int64_t testNum = 0; testNum < 20; testNum++) {
+        setup(true);
+        Event *threadEvents[] = { ingroup1, ingroup1, ingroup2, ingroup2, ingroup2, outgroup1, outgroup2 };
+        for (int64_t i = 0; i < 7; i++) {
+            addThreadToFlower(flower, threadEvents[i], 200);
+        }
+        stPinchThreadSet *threadSet = stCaf_setup(flower);
+        stCaf_setFlowerForAlignmentFiltering(flower);
+        for (int64_t i = 0; i < 100; i++) {
+            stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
+            stPinchThread_pinch(stPinchThreadSet_getThread(threadSet, pinch.name1),
+                                stPinchThreadSet_getThread(threadSet, pinch.name2),
+                                pinch.start1, pinch.start2, pinch.length, pinch.strand);
+        }
+        for (int64_t i = 0; i < 1000; i++) {
+            stPinchSegment *segment1 = getRandomSegment(threadSet);
+            stPinchSegment *segment2 = getRandomSegment(threadSet);
+            CuAssertIntEquals(testCase, naiveIntersection(segment1, segment2, 0),
+                              stCaf_filterByRepeatSpecies(segment1, segment2));
+            CuAssertIntEquals(testCase, naiveIntersection(segment1, segment2, 1),
+                              stCaf_singleCopyIngroup(segment1, segment2));
+            CuAssertIntEquals(testCase, naiveIntersection(segment1, segment2, 2),
+                              stCaf_singleCopyChr(segment1, segment2));
+            CuAssertTrue(testCase, stCaf_getEvent(segment1, flower)
+                         == cap_getEvent(flower_getCap(flower, stPinchSegment_getName(segment1))));
+            stPinchBlock *block = stPinchSegment_getBlock(segment1);
+            if (block != NULL) {
+                stSet *events = getNaiveSet(segment1, 0);
+                int64_t numberOfSpecies = stSet_size(events);
+                stSet_destruct(events);
+                CuAssertTrue(testCase, stCaf_containsRequiredSpecies(block, flower, 0, 0, 0, numberOfSpecies));
+                CuAssertTrue(testCase, !stCaf_containsRequiredSpecies(block, flower, 0, 0, 0, numberOfSpecies + 1));
+                CuAssertTrue(testCase, stCaf_containsRequiredSpecies(block, flower, 0, 0, stPinchBlock_getDegree(block), 0));
+                CuAssertTrue(testCase, !stCaf_containsRequiredSpecies(block, flower, 0, 0, stPinchBlock_getDegree(block) + 1, 0));
+            }
+        }
+        stCaf_setFlowerForAlignmentFiltering(NULL);
+        stPinchThreadSet_destruct(threadSet);
+        teardown();
+    }
+}
+
 CuSuite* filteringTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testChainHasUnequalNumberOfIngroupCopies);
     SUITE_ADD_TEST(suite, testChainHasUnequalNumberOfIngroupCopiesOrNoOutgroup);
     SUITE_ADD_TEST(suite, testChainHasUnequalNumberOfIngroupCopiesOrNoOutgroup_noOutgroups);
     SUITE_ADD_TEST(suite, testHGVMFiltering);
+    SUITE_ADD_TEST(suite, testFiltersMatchNaiveVersions);
     return suite;
 }
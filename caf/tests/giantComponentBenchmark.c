@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "sonLib.h"
+#include "stGiantComponent.h"
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/*
+ * Times stCaf_breakupComponentGreedily on a synthetic giant component, against the implementation it replaced,
+ * which kept a sorted set for each component. Each is run in its own process, so that the peak memory of each
+ * can be reported.
+ */
+
+static void *getValue(stHash *hash, int64_t node) {
+    stIntTuple *nodeTuple = stIntTuple_construct1(node);
+    void *object = stHash_search(hash, nodeTuple);
+    stIntTuple_destruct(nodeTuple);
+    return object;
+}
+
+static stList *breakupComponentGreedilyWithSortedSets(stList *nodes, stList *edges, int64_t maxComponentSize) {
+    stHash *nodeToComponents = stHash_construct3((uint64_t(*)(const void *)) stIntTuple_hashKey,
+            (int(*)(const void *, const void *)) stIntTuple_equalsFn, NULL, NULL);
+    stListIterator *listIt = stList_getIterator(nodes);
+    stIntTuple *node;
+    while ((node = stList_getNext(listIt)) != NULL) {
+        stSortedSet *component = stSortedSet_construct();
+        stSortedSet_insert(component, node);
+        stHash_insert(nodeToComponents, node, component);
+    }
+    stList_destructIterator(listIt);
+
+    stList *sortedEdges = stList_copy(edges, NULL);
+    stList_sort(sortedEdges, (int(*)(const void *, const void *)) stIntTuple_cmpFn);
+    stList *edgesToDelete = stList_construct();
+    while (stList_length(sortedEdges) > 0) {
+        stIntTuple *edge = stList_pop(sortedEdges);
+        stSortedSet *component1 = getValue(nodeToComponents, stIntTuple_get(edge, 1));
+        stSortedSet *component2 = getValue(nodeToComponents, stIntTuple_get(edge, 2));
+        if (component1 == component2) {
+            continue;
+        }
+        if (stSortedSet_size(component1) + stSortedSet_size(component2) > maxComponentSize) {
+            stList_append(edgesToDelete, edge);
+            continue;
+        }
+        if (stSortedSet_size(component1) < stSortedSet_size(component2)) {
+            stSortedSet *component3 = component1;
+            component1 = component2;
+            component2 = component3;
+        }
+        while (stSortedSet_size(component2) > 0) {
+            node = stSortedSet_getLast(component2);
+            stSortedSet_remove(component2, node);
+            stSortedSet_insert(component1, node);
+            stHash_insert(nodeToComponents, node, component1);
+        }
+        stSortedSet_destruct(component2);
+    }
+
+    stList_destruct(sortedEdges);
+    stList *components = stHash_getValues(nodeToComponents);
+    stSortedSet *componentsSet = stList_getSortedSet(components, NULL);
+    stList_destruct(components);
+    stSortedSet_setDestructor(componentsSet, (void(*)(void *)) stSortedSet_destruct);
+    stSortedSet_destruct(componentsSet);
+    stHash_destruct(nodeToComponents);
+    return edgesToDelete;
+}
+
+static int64_t getTime(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return ((int64_t) time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+static int64_t getPeakMemory(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss; //In kilobytes.
+}
+
+static void run(const char *name, stList *(*breakupComponentGreedily)(stList *, stList *, int64_t), stList *nodes,
+        stList *edges, int64_t maxComponentSize) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        st_errAbort("Could not fork to run the benchmark\n");
+    }
+    if (pid == 0) {
+        int64_t startMemory = getPeakMemory();
+        int64_t startTime = getTime();
+        stList *edgesToDelete = breakupComponentGreedily(nodes, edges, maxComponentSize);
+        double seconds = (getTime() - startTime) / 1.0e9;
+        fprintf(stdout, "%s: %.2f seconds, %" PRIi64 " KB peak memory over the graph, %" PRIi64 " edges deleted\n",
+                name, seconds, getPeakMemory() - startMemory, stList_length(edgesToDelete));
+        fflush(stdout);
+        _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+}
+
+int main(int argc, char *argv[]) {
+    int64_t nodeNumber = argc > 1 ? atol(argv[1]) : 1000000;
+    int64_t edgesPerNode = argc > 2 ? atol(argv[2]) : 4;
+    int64_t maxComponentSize = argc > 3 ? atol(argv[3]) : 1 + log(nodeNumber) * 10;
+
+    //Random edges with a few nodes per edge make one giant component.
+    stList *nodes = stList_construct3(0, (void(*)(void *)) stIntTuple_destruct);
+    for (int64_t i = 0; i < nodeNumber; i++) {
+        stList_append(nodes, stIntTuple_construct1(i));
+    }
+    stList *edges = stList_construct3(0, (void(*)(void *)) stIntTuple_destruct);
+    for (int64_t i = 0; i < nodeNumber * edgesPerNode; i++) {
+        int64_t node1 = st_randomInt(0, nodeNumber), node2 = st_randomInt(0, nodeNumber);
+        stList_append(edges, stIntTuple_construct3(st_randomInt(1, 100), node1 < node2 ? node1 : node2,
+                node1 < node2 ? node2 : node1));
+    }
+    fprintf(stdout, "Breaking up a graph of %" PRIi64 " nodes and %" PRIi64 " edges into components of at most %"
+            PRIi64 " nodes\n", nodeNumber, stList_length(edges), maxComponentSize);
+
+    run("sorted sets", breakupComponentGreedilyWithSortedSets, nodes, edges, maxComponentSize);
+    run("union-find", stCaf_breakupComponentGreedily, nodes, edges, maxComponentSize);
+
+    stList_destruct(edges);
+    stList_destruct(nodes);
+    return 0;
+}
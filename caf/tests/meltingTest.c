@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "CuTest.h"
+#include "sonLib.h"
+#include "stCaf.h"
+#include "stPinchGraphs.h"
+
+typedef struct _randomPinch {
+    int64_t thread1, thread2, start1, start2, length;
+    bool strand;
+} RandomPinch;
+
+static void pinchRandomly(stPinchThreadSet *threadSet, Name *threadNames, RandomPinch *pinches, int64_t pinchNumber) {
+    for (int64_t i = 0; i < pinchNumber; i++) {
+        RandomPinch *pinch = &pinches[i];
+        stPinchThread_pinch(stPinchThreadSet_getThread(threadSet, threadNames[pinch->thread1]),
+                stPinchThreadSet_getThread(threadSet, threadNames[pinch->thread2]), pinch->start1, pinch->start2,
+                pinch->length, pinch->strand);
+    }
+}
+
+static void checkThreadSetsAreEqual(CuTest *testCase, stPinchThreadSet *threadSet1, stPinchThreadSet *threadSet2) {
+    CuAssertIntEquals(testCase, stPinchThreadSet_getTotalBlockNumber(threadSet1), stPinchThreadSet_getTotalBlockNumber(threadSet2));
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet1);
+    stPinchThread *thread1;
+    while ((thread1 = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet2, stPinchThread_getName(thread1));
+        CuAssertTrue(testCase, thread2 != NULL);
+        stPinchSegment *segment1 = stPinchThread_getFirst(thread1), *segment2 = stPinchThread_getFirst(thread2);
+        while (segment1 != NULL && segment2 != NULL) {
+            CuAssertIntEquals(testCase, stPinchSegment_getStart(segment1), stPinchSegment_getStart(segment2));
+            CuAssertIntEquals(testCase, stPinchSegment_getLength(segment1), stPinchSegment_getLength(segment2));
+            stPinchBlock *block1 = stPinchSegment_getBlock(segment1), *block2 = stPinchSegment_getBlock(segment2);
+            CuAssertTrue(testCase, (block1 == NULL) == (block2 == NULL));
+            if (block1 != NULL) {
+                CuAssertIntEquals(testCase, stPinchBlock_getDegree(block1), stPinchBlock_getDegree(block2));
+            }
+            segment1 = stPinchSegment_get3Prime(segment1);
+            segment2 = stPinchSegment_get3Prime(segment2);
+        }
+        CuAssertTrue(testCase, segment1 == NULL && segment2 == NULL);
+    }
+}
+
+static void testMeltIncrementally(CuTest *testCase) {
+    /*
+     * Melts random pinch graphs round by round with stCaf_melt and with stCaf_meltIncrementally, and checks the
+     * same alignments are left.
+     */
+    for (int64_t test = 0; test < 100; test++) {
+        CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+        eventTree_construct2(cactusDisk);
+        //Only the top level flower attaches thread components, so test both. Below the top level the threads are
+        //attached to the ends of the flower.
+        bool topLevel = test % 2 == 0;
+        Flower *flower = topLevel ? flower_construct2(0, cactusDisk) : flower_construct(cactusDisk);
+        group_construct2(flower);
+
+        int64_t threadNumber = st_randomInt(2, 10);
+        Name *threadNames = st_malloc(threadNumber * sizeof(Name));
+        for (int64_t i = 0; i < threadNumber; i++) {
+            char *header = stString_print("%" PRIi64 "", i);
+            threadNames[i] = testCommon_addThreadToFlower(flower, header, 100);
+            free(header);
+            if (!topLevel) {
+                Cap *cap = flower_getCap(flower, threadNames[i]);
+                end_makeAttached(cap_getEnd(cap));
+                end_makeAttached(cap_getEnd(cap_getAdjacency(cap)));
+            }
+        }
+        int64_t pinchNumber = st_randomInt(0, 100);
+        RandomPinch *pinches = st_malloc((pinchNumber + 1) * sizeof(RandomPinch));
+        for (int64_t i = 0; i < pinchNumber; i++) {
+            RandomPinch pinch = { st_randomInt(0, threadNumber), st_randomInt(0, threadNumber), st_randomInt(10, 80),
+                    st_randomInt(10, 80), st_randomInt(1, 10), st_random() > 0.5 };
+            pinches[i] = pinch;
+        }
+        stPinchThreadSet *threadSet1 = stCaf_setup(flower);
+        stPinchThreadSet *threadSet2 = stCaf_constructEmptyPinchGraph(flower); //The flower is already set up.
+        pinchRandomly(threadSet1, threadNames, pinches, pinchNumber);
+        pinchRandomly(threadSet2, threadNames, pinches, pinchNumber);
+
+        int64_t minimumChainLengths[] = { 2, 4, 8, 16, 32 };
+        int64_t roundNumber = st_randomInt(1, 6);
+        for (int64_t i = 0; i < roundNumber; i++) {
+            stCaf_melt(flower, threadSet1, NULL, 0, minimumChainLengths[i], 0, INT64_MAX);
+        }
+        stCaf_meltIncrementally(flower, threadSet2, minimumChainLengths, roundNumber);
+        checkThreadSetsAreEqual(testCase, threadSet1, threadSet2);
+
+        stPinchThreadSet_destruct(threadSet1);
+        stPinchThreadSet_destruct(threadSet2);
+        free(pinches);
+        free(threadNames);
+        testCommon_deleteTemporaryCactusDisk(cactusDisk);
+    }
+}
+
+CuSuite* meltingTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testMeltIncrementally);
+    return suite;
+}
@@ -106,6 +106,35 @@ static void testPinchIteratorFromFile(CuTest *testCase) {
     }
 }
 
+static void testPinchIteratorFromBinaryFile(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        stList *pairwiseAlignments = getRandomPairwiseAlignments();
+        st_logInfo("Doing a random pinch iterator from binary file test %" PRIi64 " with %" PRIi64 " alignments\n", test, stList_length(pairwiseAlignments));
+        //Put alignments in a file and convert it
+        char *tempFile = "tempFileForPinchIteratorTest.cig";
+        char *binaryFile = "tempFileForPinchIteratorTest.pinches";
+        FILE *fileHandle = fopen(tempFile, "w");
+        for (int64_t i = 0; i < stList_length(pairwiseAlignments); i++) {
+            cigarWrite(fileHandle, stList_get(pairwiseAlignments, i), 0);
+        }
+        fclose(fileHandle);
+        bool sortedByScore = st_random() > 0.5;
+        stPinchIterator_convertCigarFileToBinaryFile(tempFile, binaryFile, sortedByScore);
+        CuAssertTrue(testCase, !stPinchIterator_isBinaryFile(tempFile));
+        CuAssertTrue(testCase, stPinchIterator_isBinaryFile(binaryFile));
+        CuAssertIntEquals(testCase, sortedByScore, stPinchIterator_isBinaryFileSortedByScore(binaryFile));
+        //Get an iterator
+        stPinchIterator *pinchIterator = stPinchIterator_constructFromBinaryFile(binaryFile);
+        //Now test it
+        testIterator(testCase, pinchIterator, pairwiseAlignments);
+        //Cleanup
+        stPinchIterator_destruct(pinchIterator);
+        stFile_rmrf(tempFile);
+        stFile_rmrf(binaryFile);
+        stList_destruct(pairwiseAlignments);
+    }
+}
+
 static void testPinchIteratorFromList(CuTest *testCase) {
     for (int64_t test = 0; test < 100; test++) {
         stList *pairwiseAlignments = getRandomPairwiseAlignments();
@@ -123,6 +152,7 @@ static void testPinchIteratorFromList(CuTest *testCase) {
 CuSuite* pinchIteratorTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testPinchIteratorFromFile);
+    SUITE_ADD_TEST(suite, testPinchIteratorFromBinaryFile);
     SUITE_ADD_TEST(suite, testPinchIteratorFromList);
     return suite;
 }
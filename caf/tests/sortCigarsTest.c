@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "CuTest.h"
+#include "sonLib.h"
+#include "stLastzAlignments.h"
+#include "pairwiseAlignment.h"
+
+static char *cigarsFile = "tempFileForSortCigarsTest.cig";
+static char *sortedFile = "tempFileForSortCigarsTest.sorted.cig";
+static char *sortedFile2 = "tempFileForSortCigarsTest.sorted2.cig";
+
+static void writeRandomCigars(int64_t cigarNumber) {
+    FILE *fileHandle = fopen(cigarsFile, "w");
+    for (int64_t i = 0; i < cigarNumber; i++) {
+        char *contig1 = stString_print("%" PRIi64 "", st_randomInt(0, 20));
+        char *contig2 = stString_print("%" PRIi64 "", st_randomInt(0, 20));
+        int64_t start1 = st_randomInt(0, 1000), start2 = st_randomInt(0, 1000), length = st_randomInt(1, 100);
+        struct List *operationList = constructEmptyList(0, NULL);
+        listAppend(operationList, constructAlignmentOperation(PAIRWISE_MATCH, length, 0));
+        //Few distinct scores, so that there are many ties.
+        struct PairwiseAlignment *pA = constructPairwiseAlignment(contig1, start1, start1 + length, 1, contig2,
+                start2, start2 + length, 1, st_randomInt(0, 10), operationList);
+        cigarWrite(fileHandle, pA, 0);
+        destructPairwiseAlignment(pA);
+        free(contig1);
+        free(contig2);
+    }
+    fclose(fileHandle);
+}
+
+static stList *readLines(const char *fileName) {
+    stList *lines = stList_construct3(0, free);
+    FILE *fileHandle = fopen(fileName, "r");
+    char *line;
+    while ((line = stFile_getLineFromFile(fileHandle)) != NULL) {
+        stList_append(lines, line);
+    }
+    fclose(fileHandle);
+    return lines;
+}
+
+static void checkSorted(CuTest *testCase, bool byScore) {
+    stList *lines = readLines(cigarsFile);
+    stList *sortedLines = readLines(sortedFile);
+    //The sorted file holds the same lines.
+    CuAssertIntEquals(testCase, stList_length(lines), stList_length(sortedLines));
+    stList *copy = stList_copy(sortedLines, NULL);
+    stList_sort(lines, (int (*)(const void *, const void *)) strcmp);
+    stList_sort(copy, (int (*)(const void *, const void *)) strcmp);
+    for (int64_t i = 0; i < stList_length(lines); i++) {
+        CuAssertStrEquals(testCase, stList_get(lines, i), stList_get(copy, i));
+    }
+    //And they are in order.
+    FILE *fileHandle = fopen(sortedFile, "r");
+    struct PairwiseAlignment *pA, *previous = NULL;
+    while ((pA = cigarRead(fileHandle)) != NULL) {
+        if (previous != NULL) {
+            if (byScore) {
+                CuAssertTrue(testCase, previous->score >= pA->score);
+                if (previous->score == pA->score) {
+                    CuAssertTrue(testCase, strcmp(previous->contig1, pA->contig1) <= 0);
+                }
+            } else {
+                int i = strcmp(previous->contig1, pA->contig1);
+                CuAssertTrue(testCase, i <= 0);
+                CuAssertTrue(testCase, i != 0 || previous->start1 <= pA->start1);
+            }
+            destructPairwiseAlignment(previous);
+        }
+        previous = pA;
+    }
+    if (previous != NULL) {
+        destructPairwiseAlignment(previous);
+    }
+    fclose(fileHandle);
+    stList_destruct(copy);
+    stList_destruct(lines);
+    stList_destruct(sortedLines);
+}
+
+static void testSortCigarsFile(CuTest *testCase, bool byScore) {
+    for (int64_t test = 0; test < 10; test++) {
+        int64_t cigarNumber = test == 0 ? 0 : st_randomInt(0, 2000);
+        st_logInfo("Doing a random cigar sort test %" PRIi64 " with %" PRIi64 " cigars\n", test, cigarNumber);
+        writeRandomCigars(cigarNumber);
+        //A budget this small cuts the cigars into many runs, needing more than one round of merging.
+        stCaf_setCigarSortParameters(st_randomInt(1, 5000), st_randomInt(0, 5), NULL);
+        if (byScore) {
+            stCaf_sortCigarsFileByScoreInDescendingOrder(cigarsFile, sortedFile);
+        } else {
+            stCaf_sortCigarsFileByFirstSequenceStartCoordinateInAscendingOrder(cigarsFile, sortedFile);
+        }
+        checkSorted(testCase, byScore);
+        //The order does not depend on how the cigars were cut into runs.
+        stCaf_setCigarSortParameters(1073741824, 0, NULL);
+        if (byScore) {
+            stCaf_sortCigarsFileByScoreInDescendingOrder(cigarsFile, sortedFile2);
+        } else {
+            stCaf_sortCigarsFileByFirstSequenceStartCoordinateInAscendingOrder(cigarsFile, sortedFile2);
+        }
+        stList *lines = readLines(sortedFile);
+        stList *lines2 = readLines(sortedFile2);
+        CuAssertIntEquals(testCase, stList_length(lines), stList_length(lines2));
+        for (int64_t i = 0; i < stList_length(lines); i++) {
+            CuAssertStrEquals(testCase, stList_get(lines, i), stList_get(lines2, i));
+        }
+        stList_destruct(lines);
+        stList_destruct(lines2);
+        stFile_rmrf(cigarsFile);
+        stFile_rmrf(sortedFile);
+        stFile_rmrf(sortedFile2);
+    }
+}
+
+static void testSortCigarsFileByScore(CuTest *testCase) {
+    testSortCigarsFile(testCase, 1);
+}
+
+static void testSortCigarsFileByFirstSequenceStart(CuTest *testCase) {
+    testSortCigarsFile(testCase, 0);
+}
+
+CuSuite* sortCigarsTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testSortCigarsFileByScore);
+    SUITE_ADD_TEST(suite, testSortCigarsFileByFirstSequenceStart);
+    return suite;
+}
@@ -127,7 +127,8 @@ int main(int argc, char *argv[]) {
     stKVDatabaseConf_destruct(kvDatabaseConf);
     st_logInfo("Set up the secondary database\n");
 
-    FlowerStream *flowerStream = flowerWriter_getFlowerStream(cactusDisk, stdin);
+    FlowerStream *flowerStream = flowerWriter_getFlowerStream2(cactusDisk, stdin,
+            FLOWER_STREAM_DEFAULT_PREFETCH_DEPTH, FLOWER_STREAM_DEFAULT_MAX_PREFETCH_SIZE);
     if (outputFile != NULL && flowerStream_size(flowerStream) != 1) {
         stThrowNew("RUNTIME_ERROR",
                    "Output file specified, but there is more than one flower\n");
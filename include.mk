@@ -15,5 +15,15 @@ inclDirs = api/inc bar/inc caf/inc hal/inc reference/inc submodules/sonLib/C/inc
 	submodules/matchingAndOrdering/inc submodules/cPecan/inc
 
 cflags += ${inclDirs:%=-I${rootPath}/%}
-basicLibs = ${sonLibPath}/sonLib.a ${sonLibPath}/cuTest.a ${dblibs}
+basicLibs = ${sonLibPath}/sonLib.a ${sonLibPath}/cuTest.a ${dblibs} -lpthread
 basicLibsDependencies = ${sonLibPath}/sonLib.a ${sonLibPath}/cuTest.a 
+
+#Optional codecs for compressing the records of the cactus disk, used if the libraries are installed.
+ifneq ($(wildcard /usr/include/lz4.h /usr/local/include/lz4.h),)
+	cflags += -DHAVE_LZ4
+	basicLibs += -llz4
+endif
+ifneq ($(wildcard /usr/include/zdict.h /usr/local/include/zdict.h),)
+	cflags += -DHAVE_ZSTD
+	basicLibs += -lzstd
+endif
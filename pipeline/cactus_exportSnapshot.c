@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactus.h"
+#include "sonLib.h"
+
+/*
+ * Writes the flowers nested in a flower, with their sequences, to a read only snapshot file, which
+ * the read mostly phases can then read instead of the database by setting CACTUS_DISK_SNAPSHOT.
+ */
+
+int main(int argc, char *argv[]) {
+    if (argc != 5) {
+        fprintf(stderr, "Usage: cactus_exportSnapshot logLevel cactusDiskDatabaseString rootFlowerName snapshotFile\n");
+        return 1;
+    }
+    st_setLogLevelFromString(argv[1]);
+    st_logDebug("Set up logging\n");
+
+    stKVDatabaseConf *kvDatabaseConf = stKVDatabaseConf_constructFromString(argv[2]);
+    CactusDisk *cactusDisk = cactusDisk_construct(kvDatabaseConf, false, false);
+    stKVDatabaseConf_destruct(kvDatabaseConf);
+    st_logDebug("Set up the flower disk\n");
+
+    cactusDisk_writeSnapshot(cactusDisk, cactusMisc_stringToName(argv[3]), argv[4]);
+    st_logInfo("Wrote the snapshot %s\n", argv[4]);
+
+    cactusDisk_destruct(cactusDisk);
+    return 0;
+}
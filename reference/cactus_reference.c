@@ -234,7 +234,8 @@ int main(int argc, char *argv[]) {
     useSimulatedAnnealing ? exponentiallyDecreasingTemperatureFn
     : constantTemperatureFn;
 
-    FlowerStream *flowerStream = flowerWriter_getFlowerStream(cactusDisk, stdin);
+    FlowerStream *flowerStream = flowerWriter_getFlowerStream2(cactusDisk, stdin,
+            FLOWER_STREAM_DEFAULT_PREFETCH_DEPTH, FLOWER_STREAM_DEFAULT_MAX_PREFETCH_SIZE);
     Flower *flower;
     while ((flower = flowerStream_getNext(flowerStream)) != NULL) {
         st_logInfo("Processing flower %" PRIi64 "\n", flower_getName(flower));
@@ -274,13 +274,16 @@ int main(int argc, char *argv[]) {
     //////////////////////////////////////////////
 
     stKVDatabaseConf *kvDatabaseConf = kvDatabaseConf = stKVDatabaseConf_constructFromString(cactusDiskDatabaseString);
+    //The codec the records are compressed with, recorded in the cactus disk for the later stages.
+    char *compression = cactusDisk_getCompressionFromConfString(cactusDiskDatabaseString);
     if (stKVDatabaseConf_getType(kvDatabaseConf) == stKVDatabaseTypeTokyoCabinet || stKVDatabaseConf_getType(kvDatabaseConf)
             == stKVDatabaseTypeKyotoTycoon) {
         assert(stKVDatabaseConf_getDir(kvDatabaseConf) != NULL);
-        cactusDisk = cactusDisk_construct(kvDatabaseConf, true, true);
+        cactusDisk = cactusDisk_construct2(kvDatabaseConf, true, true, compression);
     } else {
-        cactusDisk = cactusDisk_construct(kvDatabaseConf, true, true);
+        cactusDisk = cactusDisk_construct2(kvDatabaseConf, true, true, compression);
     }
+    free(compression);
     st_logInfo("Set up the flower disk\n");
 
     //////////////////////////////////////////////